@@ -0,0 +1,486 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+#include "experimental/arena.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "experimental/recursive_indirect.h"
+#include "indirect.h"
+#include "polymorphic.h"
+
+namespace {
+
+TEST(ArenaTest, AllocationsAreContiguous) {
+  xyz::arena a;
+  auto* p = static_cast<std::byte*>(a.allocate(16, 8));
+  auto* pp = static_cast<std::byte*>(a.allocate(16, 8));
+  EXPECT_EQ(pp, p + 16);
+  EXPECT_EQ(a.block_count(), 1);
+}
+
+TEST(ArenaTest, AllocationsAreAligned) {
+  xyz::arena a;
+  for (std::size_t alignment : {1, 2, 8, 16, 64, 256}) {
+    (void)a.allocate(1, 1);
+    void* p = a.allocate(8, alignment);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(p) % alignment, 0);
+  }
+}
+
+TEST(ArenaTest, AddsBlocksWhenFull) {
+  xyz::arena a(1024);
+  for (int i = 0; i < 64; ++i) (void)a.allocate(64, 8);
+  EXPECT_GT(a.block_count(), 1);
+}
+
+TEST(ArenaTest, LargeAllocations) {
+  xyz::arena a(1024);
+  auto* p = static_cast<std::byte*>(a.allocate(4096, 16));
+  std::fill(p, p + 4096, std::byte(42));
+  EXPECT_EQ(a.block_count(), 1);
+}
+
+TEST(ArenaTest, Release) {
+  xyz::arena a;
+  (void)a.allocate(16, 8);
+  a.release();
+  EXPECT_EQ(a.block_count(), 0);
+  (void)a.allocate(16, 8);
+  EXPECT_EQ(a.block_count(), 1);
+}
+
+TEST(ArenaAllocatorTest, Equality) {
+  xyz::arena a;
+  xyz::arena b;
+  xyz::arena_allocator<int> aa(a);
+  xyz::arena_allocator<double> aaa(aa);
+  xyz::arena_allocator<int> bb(b);
+  EXPECT_EQ(aa, aaa);
+  EXPECT_NE(aa, bb);
+  EXPECT_EQ(aaa.get_arena(), &a);
+}
+
+TEST(ArenaAllocatorTest, Indirect) {
+  xyz::arena a;
+  using I = xyz::indirect<int, xyz::arena_allocator<int>>;
+  I i(std::allocator_arg, xyz::arena_allocator<int>(a), 42);
+  I ii = i;
+  EXPECT_EQ(*ii, 42);
+  EXPECT_EQ(ii.get_allocator().get_arena(), &a);
+  EXPECT_EQ(a.block_count(), 1);
+}
+
+class Base {
+ public:
+  virtual ~Base() = default;
+  virtual int value() const = 0;
+};
+
+class Derived : public Base {
+  int value_;
+
+ public:
+  Derived(int v) : value_(v) {}
+  int value() const override { return value_; }
+};
+
+TEST(ArenaAllocatorTest, Polymorphic) {
+  xyz::arena a;
+  using P = xyz::polymorphic<Base, xyz::arena_allocator<Base>>;
+  P p(std::allocator_arg, xyz::arena_allocator<Base>(a),
+      std::in_place_type<Derived>, 42);
+  P pp = p;
+  EXPECT_EQ(pp->value(), 42);
+  EXPECT_EQ(pp.get_allocator().get_arena(), &a);
+  EXPECT_EQ(a.block_count(), 1);
+}
+
+TEST(ArenaAllocatorTest, ContainersPropagateTheArena) {
+  xyz::arena a;
+  using P = xyz::polymorphic<Base, xyz::arena_allocator<Base>>;
+  std::vector<P, xyz::arena_allocator<P>> v{xyz::arena_allocator<P>(a)};
+  v.emplace_back(std::in_place_type<Derived>, 42);
+  EXPECT_EQ(v[0]->value(), 42);
+  EXPECT_EQ(v[0].get_allocator().get_arena(), &a);
+}
+
+TEST(ArenaAllocatorTest, NestedContainersUseTheArena) {
+  xyz::arena a;
+  using V = std::vector<int, xyz::arena_allocator<int>>;
+  using I = xyz::indirect<V, xyz::arena_allocator<V>>;
+  I i(std::allocator_arg, xyz::arena_allocator<V>(a));
+  i->push_back(42);
+  EXPECT_EQ(i->get_allocator().get_arena(), &a);
+  I ii = i;
+  EXPECT_EQ((*ii)[0], 42);
+  EXPECT_EQ(ii->get_allocator().get_arena(), &a);
+}
+
+// An allocator-aware type with nested indirect members.
+class Node {
+ public:
+  using allocator_type = xyz::arena_allocator<Node>;
+
+  Node(std::allocator_arg_t, const allocator_type& alloc, int value)
+      : value_(std::allocator_arg, alloc, value),
+        values_(std::allocator_arg, alloc) {}
+
+  Node(const Node&) = default;
+
+  Node(std::allocator_arg_t, const allocator_type& alloc, const Node& other)
+      : value_(std::allocator_arg, alloc, *other.value_),
+        values_(std::allocator_arg, alloc, *other.values_) {}
+
+  using Values = std::vector<int, xyz::arena_allocator<int>>;
+
+  xyz::indirect<int, xyz::arena_allocator<int>> value_;
+  xyz::indirect<Values, xyz::arena_allocator<Values>> values_;
+};
+
+TEST(ArenaAllocatorTest, NestedUsesAllocatorConstruction) {
+  xyz::arena a;
+  xyz::arena b;
+  Node n(std::allocator_arg, xyz::arena_allocator<Node>(b), 42);
+  n.values_->push_back(101);
+
+  using I = xyz::indirect<Node, xyz::arena_allocator<Node>>;
+  I i(std::allocator_arg, xyz::arena_allocator<Node>(a), n);
+  EXPECT_EQ(*i->value_, 42);
+  EXPECT_EQ((*i->values_)[0], 101);
+  EXPECT_EQ(i->value_.get_allocator().get_arena(), &a);
+  EXPECT_EQ(i->values_.get_allocator().get_arena(), &a);
+  EXPECT_EQ(i->values_->get_allocator().get_arena(), &a);
+
+  I ii = i;
+  EXPECT_EQ(ii->value_.get_allocator().get_arena(), &a);
+  EXPECT_EQ(ii->values_->get_allocator().get_arena(), &a);
+}
+
+static_assert(xyz::allocator_releases_in_bulk_v<xyz::arena_allocator<int>>);
+static_assert(!xyz::allocator_releases_in_bulk_v<std::allocator<int>>);
+
+// An arena allocator that counts calls to destroy and deallocate.
+template <class T>
+class CountingArenaAllocator : public xyz::arena_allocator<T> {
+ public:
+  int* destroyed_;
+  int* deallocated_;
+
+  CountingArenaAllocator(xyz::arena& a, int* destroyed, int* deallocated)
+      : xyz::arena_allocator<T>(a),
+        destroyed_(destroyed),
+        deallocated_(deallocated) {}
+
+  template <class U>
+  CountingArenaAllocator(const CountingArenaAllocator<U>& other)
+      : xyz::arena_allocator<T>(other),
+        destroyed_(other.destroyed_),
+        deallocated_(other.deallocated_) {}
+
+  template <class U>
+  void destroy(U* p) {
+    ++*destroyed_;
+    p->~U();
+  }
+
+  void deallocate(T* p, std::size_t n) {
+    ++*deallocated_;
+    xyz::arena_allocator<T>::deallocate(p, n);
+  }
+};
+
+TEST(ArenaAllocatorTest, IndirectSkipsTrivialDestruction) {
+  xyz::arena a;
+  int destroyed = 0;
+  int deallocated = 0;
+  CountingArenaAllocator<int> alloc(a, &destroyed, &deallocated);
+  {
+    xyz::indirect<int, CountingArenaAllocator<int>> i(std::allocator_arg,
+                                                      alloc, 42);
+    auto ii = i;
+    i = ii;
+  }
+  EXPECT_EQ(destroyed, 0);
+  EXPECT_EQ(deallocated, 0);
+}
+
+TEST(ArenaAllocatorTest, IndirectDestroysNonTrivialTypes) {
+  xyz::arena a;
+  int destroyed = 0;
+  int deallocated = 0;
+  CountingArenaAllocator<std::string> alloc(a, &destroyed, &deallocated);
+  {
+    xyz::indirect<std::string, CountingArenaAllocator<std::string>> i(
+        std::allocator_arg, alloc, std::string(100, 'x'));
+  }
+  EXPECT_EQ(destroyed, 1);
+  EXPECT_EQ(deallocated, 0);
+}
+
+// A polymorphic base class with a trivial destructor.
+class TrivialBase {
+ public:
+  virtual int value() const = 0;
+};
+
+class TrivialDerived : public TrivialBase {
+  int value_;
+
+ public:
+  TrivialDerived(int v) : value_(v) {}
+  int value() const override { return value_; }
+};
+
+static_assert(std::is_trivially_destructible_v<TrivialDerived>);
+
+TEST(ArenaAllocatorTest, PolymorphicSkipsTrivialDestruction) {
+  xyz::arena a;
+  int destroyed = 0;
+  int deallocated = 0;
+  CountingArenaAllocator<TrivialBase> alloc(a, &destroyed, &deallocated);
+  {
+    xyz::polymorphic<TrivialBase, CountingArenaAllocator<TrivialBase>> p(
+        std::allocator_arg, alloc, std::in_place_type<TrivialDerived>, 42);
+    auto pp = p;
+    EXPECT_EQ(pp->value(), 42);
+  }
+  EXPECT_EQ(destroyed, 0);
+  EXPECT_EQ(deallocated, 0);
+}
+
+TEST(ArenaAllocatorTest, PolymorphicDestroysNonTrivialTypes) {
+  xyz::arena a;
+  int destroyed = 0;
+  int deallocated = 0;
+  CountingArenaAllocator<Base> alloc(a, &destroyed, &deallocated);
+  {
+    xyz::polymorphic<Base, CountingArenaAllocator<Base>> p(
+        std::allocator_arg, alloc, std::in_place_type<Derived>, 42);
+  }
+  EXPECT_EQ(destroyed, 1);
+  EXPECT_EQ(deallocated, 0);
+}
+
+TEST(ArenaTest, BytesAllocatedIncludesPadding) {
+  xyz::arena a;
+  (void)a.allocate(1, 1);
+  (void)a.allocate(8, 8);
+  EXPECT_EQ(a.bytes_allocated(), 16);
+  a.release();
+  EXPECT_EQ(a.bytes_allocated(), 0);
+}
+
+TEST(ArenaTest, ReserveKeepsAllocationsInOneBlock) {
+  xyz::arena a(1024);
+  (void)a.allocate(1000, 8);
+  a.reserve(4096);
+  EXPECT_EQ(a.block_count(), 2);
+  for (int i = 0; i < 63; ++i) (void)a.allocate(64, 8);
+  EXPECT_EQ(a.block_count(), 2);
+  // The space left in the current block is enough.
+  a.reserve(64);
+  EXPECT_EQ(a.block_count(), 2);
+  (void)a.allocate(64, 8);
+  EXPECT_EQ(a.block_count(), 2);
+}
+
+// A tree node whose children are allocated with the node's allocator.
+class TreeNode {
+ public:
+  using allocator_type = xyz::arena_allocator<TreeNode>;
+  using Child = xyz::indirect<TreeNode, allocator_type>;
+  using Children = std::vector<Child, xyz::arena_allocator<Child>>;
+
+  TreeNode(std::allocator_arg_t, const allocator_type& alloc, int value)
+      : value_(value), children_(alloc) {}
+
+  TreeNode(const TreeNode&) = default;
+
+  TreeNode(std::allocator_arg_t, const allocator_type& alloc,
+           const TreeNode& other)
+      : value_(other.value_), children_(other.children_, alloc) {}
+
+  int value_;
+  Children children_;
+};
+
+// Builds a complete tree of the given depth with children added in an order
+// unrelated to their position in the tree, and scraps interleaved.
+TreeNode::Child MakeScatteredTree(xyz::arena& a, int depth, int& next) {
+  xyz::arena_allocator<TreeNode> alloc(a);
+  TreeNode::Child node(std::allocator_arg, alloc,
+                       TreeNode(std::allocator_arg, alloc, next++));
+  if (depth > 0) {
+    node->children_.reserve(2);
+    auto right = MakeScatteredTree(a, depth - 1, next);
+    (void)a.allocate(40, 8);
+    auto left = MakeScatteredTree(a, depth - 1, next);
+    node->children_.push_back(std::move(left));
+    node->children_.push_back(std::move(right));
+  }
+  return node;
+}
+
+void CollectPreorder(const TreeNode& n, std::vector<const TreeNode*>& out) {
+  out.push_back(&n);
+  for (const auto& c : n.children_) CollectPreorder(*c, out);
+}
+
+TEST(ArenaCompactTest, CompactsIndirectTreeIntoOneBlock) {
+  xyz::arena scattered(1024);
+  int next = 0;
+  auto tree = MakeScatteredTree(scattered, 8, next);
+  EXPECT_GT(scattered.block_count(), 1);
+
+  xyz::arena a;
+  auto compacted = xyz::compact(tree, a);
+  EXPECT_EQ(a.block_count(), 1);
+  EXPECT_EQ(compacted.get_allocator().get_arena(), &a);
+
+  std::vector<const TreeNode*> original;
+  std::vector<const TreeNode*> copy;
+  CollectPreorder(*tree, original);
+  CollectPreorder(*compacted, copy);
+  ASSERT_EQ(copy.size(), original.size());
+  for (std::size_t i = 0; i < copy.size(); ++i) {
+    EXPECT_EQ(copy[i]->value_, original[i]->value_);
+    EXPECT_EQ(copy[i]->children_.get_allocator().get_arena(), &a);
+    // Nodes are laid out in depth-first order.
+    if (i > 0) {
+      EXPECT_LT(copy[i - 1], copy[i]);
+    }
+  }
+}
+
+TEST(ArenaCompactTest, CopiesOfACompactedTreeStayInItsArena) {
+  xyz::arena scattered;
+  int next = 0;
+  auto tree = MakeScatteredTree(scattered, 3, next);
+  xyz::arena a;
+  auto compacted = xyz::compact(tree, a);
+  auto copy = compacted;
+  EXPECT_EQ(copy.get_allocator().get_arena(), &a);
+  EXPECT_EQ(copy->children_[0]->value_, tree->children_[0]->value_);
+}
+
+// A tree node that copies and destroys its descendants iteratively.
+class IterativeTreeNode {
+ public:
+  using allocator_type = xyz::arena_allocator<IterativeTreeNode>;
+  using Child = xyz::indirect<IterativeTreeNode, allocator_type>;
+  using Children = std::vector<Child, xyz::arena_allocator<Child>>;
+
+  int value_;
+  Children children_;
+
+  static constexpr auto indirect_children = &IterativeTreeNode::children_;
+
+  IterativeTreeNode(std::allocator_arg_t, const allocator_type& alloc,
+                    int value)
+      : value_(value), children_(alloc) {}
+
+  IterativeTreeNode(const IterativeTreeNode& other)
+      : IterativeTreeNode(std::allocator_arg,
+                          other.children_.get_allocator(), other) {}
+
+  IterativeTreeNode(std::allocator_arg_t, const allocator_type& alloc,
+                    const IterativeTreeNode& other)
+      : IterativeTreeNode(std::allocator_arg, alloc, xyz::without_children,
+                          other) {
+    xyz::copy_children(other, *this);
+  }
+
+  IterativeTreeNode(xyz::without_children_t, const IterativeTreeNode& other)
+      : IterativeTreeNode(std::allocator_arg,
+                          other.children_.get_allocator(),
+                          xyz::without_children, other) {}
+
+  IterativeTreeNode(std::allocator_arg_t, const allocator_type& alloc,
+                    xyz::without_children_t, const IterativeTreeNode& other)
+      : value_(other.value_), children_(alloc) {}
+
+  ~IterativeTreeNode() { xyz::destroy_children(*this); }
+};
+
+IterativeTreeNode::Child MakeScatteredIterativeTree(xyz::arena& a, int depth,
+                                                    int& next) {
+  xyz::arena_allocator<IterativeTreeNode> alloc(a);
+  IterativeTreeNode::Child node(
+      std::allocator_arg, alloc,
+      IterativeTreeNode(std::allocator_arg, alloc, next++));
+  for (int i = 0; depth > 0 && i < 3; ++i) {
+    (void)a.allocate(40, 8);
+    node->children_.push_back(MakeScatteredIterativeTree(a, depth - 1, next));
+  }
+  return node;
+}
+
+TEST(ArenaCompactTest, CompactsIterativelyCopiedTreeWithSiblingsTogether) {
+  xyz::arena scattered(1024);
+  int next = 0;
+  auto tree = MakeScatteredIterativeTree(scattered, 5, next);
+  EXPECT_GT(scattered.block_count(), 1);
+
+  xyz::arena a;
+  auto compacted = xyz::compact(tree, a);
+  EXPECT_EQ(a.block_count(), 1);
+
+  std::vector<std::pair<const IterativeTreeNode*, const IterativeTreeNode*>>
+      work{{&*tree, &*compacted}};
+  int nodes = 0;
+  while (!work.empty()) {
+    auto [original, copy] = work.back();
+    work.pop_back();
+    ++nodes;
+    EXPECT_EQ(copy->value_, original->value_);
+    EXPECT_EQ(copy->children_.get_allocator().get_arena(), &a);
+    ASSERT_EQ(copy->children_.size(), original->children_.size());
+    for (std::size_t i = 0; i < copy->children_.size(); ++i) {
+      // The children of a node are laid out next to each other.
+      if (i > 0) {
+        EXPECT_EQ(&*copy->children_[i - 1] + 1, &*copy->children_[i]);
+      }
+      work.emplace_back(&*original->children_[i], &*copy->children_[i]);
+    }
+  }
+  EXPECT_EQ(nodes, next);
+}
+
+TEST(ArenaCompactTest, CompactsPolymorphic) {
+  using P = xyz::polymorphic<Base, xyz::arena_allocator<Base>>;
+  xyz::arena scattered;
+  P p(std::allocator_arg, xyz::arena_allocator<Base>(scattered),
+      std::in_place_type<Derived>, 42);
+  xyz::arena a;
+  P compacted = xyz::compact(p, a);
+  EXPECT_EQ(compacted->value(), 42);
+  EXPECT_EQ(compacted.get_allocator().get_arena(), &a);
+  EXPECT_EQ(a.block_count(), 1);
+}
+
+}  // namespace
@@ -0,0 +1,128 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+#include "benchmarks/allocation_counters.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// Constant-initialized so that allocations made before main are counted.
+constinit xyz::allocation_stats global_stats;
+
+// Each allocation is preceded by a header that records its size so that
+// unsized operator delete can record the bytes it frees. The header is
+// `align` bytes long so that the allocation keeps its alignment.
+void* allocate(std::size_t size, std::size_t align) {
+  if (size == 0) size = 1;
+  for (;;) {
+    void* p = align <= alignof(std::max_align_t)
+                  ? std::malloc(align + size)
+                  : std::aligned_alloc(align, (align + size + align - 1) /
+                                                  align * align);
+    if (p != nullptr) {
+      *static_cast<std::size_t*>(p) = size;
+      global_stats.record_allocation(size);
+      return static_cast<std::byte*>(p) + align;
+    }
+    std::new_handler handler = std::get_new_handler();
+    if (handler == nullptr) throw std::bad_alloc();
+    handler();
+  }
+}
+
+void deallocate(void* p, std::size_t align) noexcept {
+  if (p == nullptr) return;
+  void* block = static_cast<std::byte*>(p) - align;
+  global_stats.record_deallocation(*static_cast<std::size_t*>(block));
+  std::free(block);
+}
+
+constexpr std::size_t default_align = alignof(std::max_align_t);
+
+}  // namespace
+
+xyz::allocation_stats& xyz::benchmarks::allocation_counters::stats() noexcept {
+  return global_stats;
+}
+
+void* operator new(std::size_t size) { return allocate(size, default_align); }
+
+void* operator new[](std::size_t size) {
+  return allocate(size, default_align);
+}
+
+void* operator new(std::size_t size, std::align_val_t align) {
+  return allocate(size, std::max(static_cast<std::size_t>(align),
+                                 default_align));
+}
+
+void* operator new[](std::size_t size, std::align_val_t align) {
+  return allocate(size, std::max(static_cast<std::size_t>(align),
+                                 default_align));
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  try {
+    return allocate(size, default_align);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  try {
+    return allocate(size, default_align);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+void operator delete(void* p) noexcept { deallocate(p, default_align); }
+
+void operator delete[](void* p) noexcept { deallocate(p, default_align); }
+
+void operator delete(void* p, std::size_t) noexcept {
+  deallocate(p, default_align);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+  deallocate(p, default_align);
+}
+
+void operator delete(void* p, std::align_val_t align) noexcept {
+  deallocate(p, std::max(static_cast<std::size_t>(align), default_align));
+}
+
+void operator delete[](void* p, std::align_val_t align) noexcept {
+  deallocate(p, std::max(static_cast<std::size_t>(align), default_align));
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t align) noexcept {
+  deallocate(p, std::max(static_cast<std::size_t>(align), default_align));
+}
+
+void operator delete[](void* p, std::size_t,
+                       std::align_val_t align) noexcept {
+  deallocate(p, std::max(static_cast<std::size_t>(align), default_align));
+}
@@ -0,0 +1,70 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+// Per-iteration allocation counters for the benchmarks.
+//
+// Linking allocation_counters.cc into a benchmark replaces the global
+// operator new and operator delete with versions that record every
+// allocation in allocation_counters::stats(). Raw pointers, unique_ptr,
+// containers and indirect and polymorphic with the default allocator all
+// allocate through operator new, so their counts are directly comparable.
+//
+// An allocation_counters takes a snapshot when it is constructed. Calling
+// report() after the benchmark loop publishes the allocations,
+// deallocations and bytes allocated since then, per iteration, as counters
+// of the benchmark::State. Construct it immediately before the loop so that
+// setup and teardown are not counted.
+
+#ifndef XYZ_BENCHMARKS_ALLOCATION_COUNTERS_H_
+#define XYZ_BENCHMARKS_ALLOCATION_COUNTERS_H_
+
+#include <benchmark/benchmark.h>
+
+#include "experimental/instrumented_allocator.h"
+
+namespace xyz::benchmarks {
+
+class allocation_counters {
+  allocation_snapshot start_;
+
+ public:
+  // The allocations made through the replacement global operator new.
+  static allocation_stats& stats() noexcept;
+
+  allocation_counters() noexcept : start_(stats().snapshot()) {}
+
+  void report(benchmark::State& state) const {
+    const allocation_snapshot end = stats().snapshot();
+    auto per_iteration = [](std::uint64_t n) {
+      return benchmark::Counter(static_cast<double>(n),
+                                benchmark::Counter::kAvgIterations);
+    };
+    state.counters["allocs"] = per_iteration(end.allocations -
+                                             start_.allocations);
+    state.counters["deallocs"] =
+        per_iteration(end.deallocations - start_.deallocations);
+    state.counters["bytes"] =
+        per_iteration(end.bytes_allocated - start_.bytes_allocated);
+  }
+};
+
+}  // namespace xyz::benchmarks
+
+#endif  // XYZ_BENCHMARKS_ALLOCATION_COUNTERS_H_
@@ -0,0 +1,268 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "experimental/arena.h"
+#include "indirect.h"
+#include "polymorphic.h"
+
+namespace {
+
+constexpr size_t LARGE_VECTOR_SIZE = 1 << 16;
+
+class Base {
+ public:
+  virtual ~Base() = default;
+  virtual size_t value() const = 0;
+};
+
+class Derived : public Base {
+  size_t value_;
+
+ public:
+  Derived(size_t v) : value_(v) {}
+  size_t value() const override { return value_; }
+};
+
+// A polymorphic base class with a trivial destructor.
+class TrivialBase {
+ public:
+  virtual size_t value() const = 0;
+};
+
+class TrivialDerived : public TrivialBase {
+  size_t value_;
+
+ public:
+  TrivialDerived(size_t v) : value_(v) {}
+  size_t value() const override { return value_; }
+};
+
+template <class Vector, class... Ts>
+static void Fill(Vector& v, Ts&&... ts) {
+  v.reserve(LARGE_VECTOR_SIZE);
+  for (size_t i = 0; i < LARGE_VECTOR_SIZE; ++i) {
+    v.emplace_back(ts..., i);
+  }
+}
+
+// The cost of tearing down a request-local object graph.
+
+static void Arena_BM_IndirectTeardown_StdAllocator(benchmark::State& state) {
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::optional<std::vector<xyz::indirect<size_t>>> v(std::in_place);
+    Fill(*v, std::in_place);
+    state.ResumeTiming();
+    v.reset();
+  }
+}
+
+static void Arena_BM_IndirectTeardown_Arena(benchmark::State& state) {
+  using I = xyz::indirect<size_t, xyz::arena_allocator<size_t>>;
+  using V = std::vector<I, xyz::arena_allocator<I>>;
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::optional<xyz::arena> a(std::in_place);
+    std::optional<V> v(std::in_place, xyz::arena_allocator<I>(*a));
+    Fill(*v, std::in_place);
+    state.ResumeTiming();
+    v.reset();
+    a.reset();
+  }
+}
+
+static void Arena_BM_PolymorphicTeardown_StdAllocator(
+    benchmark::State& state) {
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::optional<std::vector<xyz::polymorphic<Base>>> v(std::in_place);
+    Fill(*v, std::in_place_type<Derived>);
+    state.ResumeTiming();
+    v.reset();
+  }
+}
+
+static void Arena_BM_PolymorphicTeardown_Arena(benchmark::State& state) {
+  using P = xyz::polymorphic<Base, xyz::arena_allocator<Base>>;
+  using V = std::vector<P, xyz::arena_allocator<P>>;
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::optional<xyz::arena> a(std::in_place);
+    std::optional<V> v(std::in_place, xyz::arena_allocator<P>(*a));
+    Fill(*v, std::in_place_type<Derived>);
+    state.ResumeTiming();
+    v.reset();
+    a.reset();
+  }
+}
+
+// arena_allocator releases in bulk, so trivially destructible control blocks
+// are neither destroyed nor deallocated.
+static void Arena_BM_TrivialPolymorphicTeardown_Arena(benchmark::State& state) {
+  using P = xyz::polymorphic<TrivialBase, xyz::arena_allocator<TrivialBase>>;
+  using V = std::vector<P, xyz::arena_allocator<P>>;
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::optional<xyz::arena> a(std::in_place);
+    std::optional<V> v(std::in_place, xyz::arena_allocator<P>(*a));
+    Fill(*v, std::in_place_type<TrivialDerived>);
+    state.ResumeTiming();
+    v.reset();
+    a.reset();
+  }
+}
+
+// The cost of a whole request: building and tearing down the object graph.
+
+static void Arena_BM_PolymorphicRequest_StdAllocator(benchmark::State& state) {
+  for (auto _ : state) {
+    std::vector<xyz::polymorphic<Base>> v;
+    Fill(v, std::in_place_type<Derived>);
+    benchmark::DoNotOptimize(v);
+  }
+}
+
+static void Arena_BM_PolymorphicRequest_Arena(benchmark::State& state) {
+  using P = xyz::polymorphic<Base, xyz::arena_allocator<Base>>;
+  using V = std::vector<P, xyz::arena_allocator<P>>;
+  for (auto _ : state) {
+    xyz::arena a;
+    V v{xyz::arena_allocator<P>(a)};
+    Fill(v, std::in_place_type<Derived>);
+    benchmark::DoNotOptimize(v);
+  }
+}
+
+// The cost of traversing a tree built in parse order and then compacted.
+
+constexpr size_t TREE_LEAF_COUNT = 1 << 18;
+
+// Alloc is std::allocator for a tree allocated node by node from the heap and
+// arena_allocator for one allocated from an arena.
+template <template <class> class Alloc>
+class TreeNode {
+ public:
+  using allocator_type = Alloc<TreeNode>;
+  using Child = xyz::indirect<TreeNode, allocator_type>;
+  using Children = std::vector<Child, Alloc<Child>>;
+
+  TreeNode(std::allocator_arg_t, const allocator_type& alloc, size_t value)
+      : value_(value), children_(alloc) {}
+
+  TreeNode(const TreeNode&) = default;
+
+  TreeNode(std::allocator_arg_t, const allocator_type& alloc,
+           const TreeNode& other)
+      : value_(other.value_), children_(other.children_, alloc) {}
+
+  size_t value_;
+  Children children_;
+};
+
+// Builds a binary tree bottom up, pairing nodes at random as a parser might
+// and calling `scrap(n)` between nodes to allocate n bytes of other data that
+// outlive the tree, so that neighbouring nodes in the tree are far apart in
+// memory.
+template <class Node, class Scrap>
+static typename Node::Child MakeScatteredTree(
+    const typename Node::allocator_type& alloc, Scrap scrap) {
+  using Child = typename Node::Child;
+  std::mt19937 gen{42};
+  std::uniform_int_distribution<size_t> scrap_size(8, 64);
+  auto make_node = [&](size_t value) {
+    scrap(scrap_size(gen));
+    return Child(std::allocator_arg, alloc,
+                 Node(std::allocator_arg, alloc, value));
+  };
+
+  std::vector<Child> level;
+  for (size_t i = 0; i < TREE_LEAF_COUNT; ++i) {
+    level.push_back(make_node(i));
+  }
+  while (level.size() > 1) {
+    std::shuffle(level.begin(), level.end(), gen);
+    std::vector<Child> next;
+    for (size_t i = 0; i + 1 < level.size(); i += 2) {
+      auto parent = make_node(i);
+      parent->children_.reserve(2);
+      parent->children_.push_back(std::move(level[i]));
+      parent->children_.push_back(std::move(level[i + 1]));
+      next.push_back(std::move(parent));
+    }
+    if (level.size() % 2 == 1) next.push_back(std::move(level.back()));
+    level = std::move(next);
+  }
+  return std::move(level.front());
+}
+
+template <class Node>
+static size_t SumTree(const Node& n) {
+  size_t sum = n.value_;
+  for (const auto& c : n.children_) sum += SumTree(*c);
+  return sum;
+}
+
+// The baseline is allocated node by node from the general-purpose heap.
+static void Arena_BM_TreeTraversal_Scattered(benchmark::State& state) {
+  using Node = TreeNode<std::allocator>;
+  std::vector<std::unique_ptr<std::byte[]>> scraps;
+  scraps.reserve(2 * TREE_LEAF_COUNT);
+  auto tree = MakeScatteredTree<Node>(Node::allocator_type(), [&](size_t n) {
+    scraps.emplace_back(new std::byte[n]);
+  });
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(SumTree(*tree));
+  }
+}
+
+static void Arena_BM_TreeTraversal_Compacted(benchmark::State& state) {
+  using Node = TreeNode<xyz::arena_allocator>;
+  xyz::arena scattered;
+  auto tree = MakeScatteredTree<Node>(
+      Node::allocator_type(scattered),
+      [&](size_t n) { (void)scattered.allocate(n, 8); });
+  xyz::arena a;
+  auto compacted = xyz::compact(tree, a);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(SumTree(*compacted));
+  }
+}
+
+}  // namespace
+
+BENCHMARK(Arena_BM_IndirectTeardown_StdAllocator);
+BENCHMARK(Arena_BM_IndirectTeardown_Arena);
+BENCHMARK(Arena_BM_PolymorphicTeardown_StdAllocator);
+BENCHMARK(Arena_BM_PolymorphicTeardown_Arena);
+BENCHMARK(Arena_BM_TrivialPolymorphicTeardown_Arena);
+BENCHMARK(Arena_BM_PolymorphicRequest_StdAllocator);
+BENCHMARK(Arena_BM_PolymorphicRequest_Arena);
+BENCHMARK(Arena_BM_TreeTraversal_Scattered);
+BENCHMARK(Arena_BM_TreeTraversal_Compacted);
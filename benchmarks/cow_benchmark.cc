@@ -0,0 +1,152 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <cstddef>
+#include <numeric>
+#include <vector>
+
+#include "experimental/cow_indirect.h"
+#include "experimental/cow_polymorphic.h"
+#include "indirect.h"
+#include "polymorphic.h"
+
+namespace {
+
+constexpr size_t LARGE_VECTOR_SIZE = 1 << 16;
+
+// A configuration-like object that is expensive to copy.
+class Config {
+ public:
+  virtual ~Config() = default;
+  virtual size_t value() const = 0;
+};
+
+class LargeConfig : public Config {
+  std::array<size_t, 64> values_;
+
+ public:
+  LargeConfig(size_t v) { values_.fill(v); }
+
+  size_t value() const override {
+    return std::accumulate(values_.begin(), values_.end(), size_t(0));
+  }
+};
+
+template <class Handle>
+static void Copy(benchmark::State& state, const Handle& h) {
+  for (auto _ : state) {
+    auto hh = h;
+    benchmark::DoNotOptimize(hh);
+  }
+}
+
+template <class Handle>
+static void VectorCopy(benchmark::State& state, const Handle& h) {
+  std::vector<Handle> v(LARGE_VECTOR_SIZE, h);
+  for (auto _ : state) {
+    auto vv = v;
+    benchmark::DoNotOptimize(vv);
+  }
+}
+
+template <class Handle>
+static void CopyAndMutate(benchmark::State& state, const Handle& h) {
+  for (auto _ : state) {
+    auto hh = h;
+    benchmark::DoNotOptimize(&*hh);
+  }
+}
+
+static void Cow_BM_Copy_Indirect(benchmark::State& state) {
+  Copy(state, xyz::indirect<LargeConfig>(std::in_place, 42));
+}
+
+static void Cow_BM_Copy_CowIndirect(benchmark::State& state) {
+  Copy(state, xyz::cow_indirect<LargeConfig>(std::in_place, 42));
+}
+
+static void Cow_BM_Copy_CowIndirectNonAtomic(benchmark::State& state) {
+  Copy(state,
+       xyz::cow_indirect<LargeConfig, std::allocator<LargeConfig>,
+                         xyz::non_atomic_reference_count>(std::in_place, 42));
+}
+
+static void Cow_BM_Copy_Polymorphic(benchmark::State& state) {
+  Copy(state, xyz::polymorphic<Config>(std::in_place_type<LargeConfig>, 42));
+}
+
+static void Cow_BM_Copy_CowPolymorphic(benchmark::State& state) {
+  Copy(state,
+       xyz::cow_polymorphic<Config>(std::in_place_type<LargeConfig>, 42));
+}
+
+static void Cow_BM_Copy_CowPolymorphicNonAtomic(benchmark::State& state) {
+  Copy(state, xyz::cow_polymorphic<Config, std::allocator<Config>,
+                                   xyz::non_atomic_reference_count>(
+                  std::in_place_type<LargeConfig>, 42));
+}
+
+static void Cow_BM_VectorCopy_Indirect(benchmark::State& state) {
+  VectorCopy(state, xyz::indirect<LargeConfig>(std::in_place, 42));
+}
+
+static void Cow_BM_VectorCopy_CowIndirect(benchmark::State& state) {
+  VectorCopy(state, xyz::cow_indirect<LargeConfig>(std::in_place, 42));
+}
+
+static void Cow_BM_VectorCopy_Polymorphic(benchmark::State& state) {
+  VectorCopy(state,
+             xyz::polymorphic<Config>(std::in_place_type<LargeConfig>, 42));
+}
+
+static void Cow_BM_VectorCopy_CowPolymorphic(benchmark::State& state) {
+  VectorCopy(state,
+             xyz::cow_polymorphic<Config>(std::in_place_type<LargeConfig>, 42));
+}
+
+// Copies followed by a non-const access pay for the deep copy as well as the
+// reference count.
+static void Cow_BM_CopyAndMutate_Indirect(benchmark::State& state) {
+  CopyAndMutate(state, xyz::indirect<LargeConfig>(std::in_place, 42));
+}
+
+static void Cow_BM_CopyAndMutate_CowIndirect(benchmark::State& state) {
+  CopyAndMutate(state, xyz::cow_indirect<LargeConfig>(std::in_place, 42));
+}
+
+}  // namespace
+
+BENCHMARK(Cow_BM_Copy_Indirect);
+BENCHMARK(Cow_BM_Copy_CowIndirect);
+BENCHMARK(Cow_BM_Copy_CowIndirectNonAtomic);
+BENCHMARK(Cow_BM_Copy_Polymorphic);
+BENCHMARK(Cow_BM_Copy_CowPolymorphic);
+BENCHMARK(Cow_BM_Copy_CowPolymorphicNonAtomic);
+
+BENCHMARK(Cow_BM_VectorCopy_Indirect);
+BENCHMARK(Cow_BM_VectorCopy_CowIndirect);
+BENCHMARK(Cow_BM_VectorCopy_Polymorphic);
+BENCHMARK(Cow_BM_VectorCopy_CowPolymorphic);
+
+BENCHMARK(Cow_BM_CopyAndMutate_Indirect);
+BENCHMARK(Cow_BM_CopyAndMutate_CowIndirect);
@@ -26,7 +26,15 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <optional>
 #include <vector>
 
+#include "benchmarks/allocation_counters.h"
+
+#ifdef XYZ_INDIRECT_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
+#include "experimental/indirect_sbo.h"
+#endif  // XYZ_INDIRECT_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
+
+#ifndef XYZ_INDIRECT_H
 #include "indirect.h"
+#endif  // XYZ_INDIRECT_H
 
 namespace {
 
@@ -50,11 +58,13 @@ class A {
 
 static void Indirect_BM_Copy_RawPtr(benchmark::State& state) {
   auto p = new A(42);
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     auto pp = p->clone();
     benchmark::DoNotOptimize(pp);
     delete pp;
   }
+  counters.report(state);
   delete p;
 }
 
@@ -64,6 +74,7 @@ static void Indirect_BM_VectorCopy_RawPointer(benchmark::State& state) {
     v[i] = new A(i);
   }
 
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     std::vector<A*> vv(LARGE_VECTOR_SIZE);
 
@@ -76,6 +87,7 @@ static void Indirect_BM_VectorCopy_RawPointer(benchmark::State& state) {
       delete p;
     }
   }
+  counters.report(state);
 
   for (auto& p : v) {
     delete p;
@@ -88,6 +100,7 @@ static void Indirect_BM_ArrayCopy_RawPointer(benchmark::State& state) {
     v[i] = new A(i);
   }
 
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     std::array<A*, LARGE_ARRAY_SIZE> vv;
     for (size_t i = 0; i < v.size(); ++i) {
@@ -98,6 +111,7 @@ static void Indirect_BM_ArrayCopy_RawPointer(benchmark::State& state) {
       delete vv[i];
     }
   }
+  counters.report(state);
 
   for (size_t i = 0; i < v.size(); ++i) {
     delete v[i];
@@ -110,12 +124,14 @@ static void Indirect_BM_VectorAccumulate_RawPointer(benchmark::State& state) {
     v[i] = new A(i);
   }
 
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     size_t sum = std::accumulate(
         v.begin(), v.end(), size_t(0),
         [](size_t acc, const auto& p) { return acc + p->value(); });
     benchmark::DoNotOptimize(sum);
   }
+  counters.report(state);
 
   for (auto& p : v) {
     delete p;
@@ -124,10 +140,12 @@ static void Indirect_BM_VectorAccumulate_RawPointer(benchmark::State& state) {
 
 static void Indirect_BM_Copy_UniquePtr(benchmark::State& state) {
   auto p = std::make_unique<A>(42);
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     auto pp = std::unique_ptr<A>(p->clone());
     benchmark::DoNotOptimize(pp);
   }
+  counters.report(state);
 }
 
 static void Indirect_BM_VectorCopy_UniquePointer(benchmark::State& state) {
@@ -136,6 +154,7 @@ static void Indirect_BM_VectorCopy_UniquePointer(benchmark::State& state) {
     v[i] = std::make_unique<A>(i);
   }
 
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     std::vector<std::unique_ptr<A>> vv(LARGE_VECTOR_SIZE);
     for (size_t i = 0; i < v.size(); ++i) {
@@ -143,6 +162,7 @@ static void Indirect_BM_VectorCopy_UniquePointer(benchmark::State& state) {
     }
     benchmark::DoNotOptimize(vv);
   }
+  counters.report(state);
 }
 
 static void Indirect_BM_ArrayCopy_UniquePointer(benchmark::State& state) {
@@ -151,6 +171,7 @@ static void Indirect_BM_ArrayCopy_UniquePointer(benchmark::State& state) {
     v[i] = std::make_unique<A>(i);
   }
 
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     std::array<std::unique_ptr<A>, LARGE_ARRAY_SIZE> vv;
     for (size_t i = 0; i < v.size(); ++i) {
@@ -158,6 +179,7 @@ static void Indirect_BM_ArrayCopy_UniquePointer(benchmark::State& state) {
     }
     benchmark::DoNotOptimize(vv);
   }
+  counters.report(state);
 }
 
 static void Indirect_BM_VectorAccumulate_UniquePointer(
@@ -167,20 +189,24 @@ static void Indirect_BM_VectorAccumulate_UniquePointer(
     v[i] = std::make_unique<A>(i);
   }
 
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     size_t sum = std::accumulate(
         v.begin(), v.end(), size_t(0),
         [](size_t acc, const auto& p) { return acc + p->value(); });
     benchmark::DoNotOptimize(sum);
   }
+  counters.report(state);
 }
 
 static void Indirect_BM_Copy_Indirect(benchmark::State& state) {
   auto p = xyz::indirect<A>(std::in_place, 42);
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     auto pp = p;
     benchmark::DoNotOptimize(pp);
   }
+  counters.report(state);
 }
 
 static void Indirect_BM_VectorCopy_Indirect(benchmark::State& state) {
@@ -190,10 +216,12 @@ static void Indirect_BM_VectorCopy_Indirect(benchmark::State& state) {
     v.push_back(xyz::indirect<A>(std::in_place, i));
   }
 
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     auto vv = v;
     benchmark::DoNotOptimize(vv);
   }
+  counters.report(state);
 }
 
 static void Indirect_BM_ArrayCopy_Indirect(benchmark::State& state) {
@@ -202,10 +230,12 @@ static void Indirect_BM_ArrayCopy_Indirect(benchmark::State& state) {
     v[i] = std::optional<xyz::indirect<A>>(xyz::indirect<A>(std::in_place, i));
   }
 
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     auto vv = v;
     benchmark::DoNotOptimize(vv);
   }
+  counters.report(state);
 }
 
 static void Indirect_BM_VectorAccumulate_Indirect(benchmark::State& state) {
@@ -215,12 +245,14 @@ static void Indirect_BM_VectorAccumulate_Indirect(benchmark::State& state) {
     v.push_back(xyz::indirect<A>(std::in_place, i));
   }
 
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     size_t sum = std::accumulate(
         v.begin(), v.end(), size_t(0),
         [](size_t acc, const auto& p) { return acc + p->value(); });
     benchmark::DoNotOptimize(sum);
   }
+  counters.report(state);
 }
 
 }  // namespace
@@ -0,0 +1,132 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "experimental/parallel_copy.h"
+#include "experimental/thread_caching_allocator.h"
+#include "indirect.h"
+#include "polymorphic.h"
+
+namespace {
+
+constexpr size_t LARGE_VECTOR_SIZE = 1 << 20;
+
+class Base {
+ public:
+  virtual ~Base() = default;
+  virtual size_t value() const = 0;
+};
+
+class Derived : public Base {
+ private:
+  size_t value_;
+
+ public:
+  Derived(size_t v) : value_(v) {}
+
+  size_t value() const override { return value_; }
+};
+
+class Derived2 : public Base {
+ private:
+  size_t value_;
+
+ public:
+  Derived2(size_t v) : value_(v) {}
+
+  size_t value() const override { return 2 * value_; }
+};
+
+// The benchmark argument is the number of threads. One thread is a serial
+// copy made through parallel_copy, for comparison with the serial copies in
+// indirect_benchmark and polymorphic_benchmark.
+
+template <class A>
+static void IndirectVectorCopy(benchmark::State& state) {
+  std::vector<xyz::indirect<size_t, A>> v;
+  v.reserve(LARGE_VECTOR_SIZE);
+  for (size_t i = 0; i < LARGE_VECTOR_SIZE; ++i) {
+    v.emplace_back(std::in_place, i);
+  }
+
+  for (auto _ : state) {
+    auto vv = xyz::parallel_copy(v, static_cast<size_t>(state.range(0)));
+    benchmark::DoNotOptimize(vv);
+  }
+}
+
+template <class A>
+static void PolymorphicVectorCopy(benchmark::State& state) {
+  std::vector<xyz::polymorphic<Base, A>> v;
+  v.reserve(LARGE_VECTOR_SIZE);
+  for (size_t i = 0; i < LARGE_VECTOR_SIZE; ++i) {
+    if (i % 2 == 0) {
+      v.emplace_back(std::in_place_type<Derived>, i);
+    } else {
+      v.emplace_back(std::in_place_type<Derived2>, i);
+    }
+  }
+
+  for (auto _ : state) {
+    auto vv = xyz::parallel_copy(v, static_cast<size_t>(state.range(0)));
+    benchmark::DoNotOptimize(vv);
+  }
+}
+
+static void ParallelCopy_BM_VectorCopy_Indirect(benchmark::State& state) {
+  IndirectVectorCopy<std::allocator<size_t>>(state);
+}
+
+static void ParallelCopy_BM_VectorCopy_IndirectThreadCaching(
+    benchmark::State& state) {
+  IndirectVectorCopy<xyz::thread_caching_allocator<size_t>>(state);
+}
+
+static void ParallelCopy_BM_VectorCopy_Polymorphic(benchmark::State& state) {
+  PolymorphicVectorCopy<std::allocator<Base>>(state);
+}
+
+static void ParallelCopy_BM_VectorCopy_PolymorphicThreadCaching(
+    benchmark::State& state) {
+  PolymorphicVectorCopy<xyz::thread_caching_allocator<Base>>(state);
+}
+
+}  // namespace
+
+BENCHMARK(ParallelCopy_BM_VectorCopy_Indirect)
+    ->RangeMultiplier(2)
+    ->Range(1, 16)
+    ->UseRealTime();
+BENCHMARK(ParallelCopy_BM_VectorCopy_IndirectThreadCaching)
+    ->RangeMultiplier(2)
+    ->Range(1, 16)
+    ->UseRealTime();
+BENCHMARK(ParallelCopy_BM_VectorCopy_Polymorphic)
+    ->RangeMultiplier(2)
+    ->Range(1, 16)
+    ->UseRealTime();
+BENCHMARK(ParallelCopy_BM_VectorCopy_PolymorphicThreadCaching)
+    ->RangeMultiplier(2)
+    ->Range(1, 16)
+    ->UseRealTime();
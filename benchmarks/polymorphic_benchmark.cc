@@ -20,16 +20,26 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <benchmark/benchmark.h>
 
+#include <algorithm>
 #include <array>
 #include <iostream>
+#include <iterator>
 #include <numeric>
 #include <optional>
+#include <random>
+#include <type_traits>
 #include <vector>
 
+#include "benchmarks/allocation_counters.h"
+
 #ifdef XYZ_POLYMORPHIC_CXX_14
 #include "compatibility/polymorphic_cxx14.h"
 #endif  // XYZ_POLYMORPHIC_CXX_14
 
+#ifdef XYZ_POLYMORPHIC_NO_VTABLE
+#include "polymorphic_no_vtable.h"
+#endif  // XYZ_POLYMORPHIC_NO_VTABLE
+
 #ifdef XYZ_POLYMORPHIC_USES_EXPERIMENTAL_INLINE_VTABLE
 #include "experimental/polymorphic_inline_vtable.h"
 #endif  // XYZ_POLYMORPHIC_USES_EXPERIMENTAL_INLINE_VTABLE
@@ -38,10 +48,22 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "experimental/polymorphic_sbo.h"
 #endif  // XYZ_POLYMORPHIC_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
 
+#ifdef XYZ_POLYMORPHIC_USES_EXPERIMENTAL_CACHED_POINTER
+#include "experimental/polymorphic_cached_pointer.h"
+#endif  // XYZ_POLYMORPHIC_USES_EXPERIMENTAL_CACHED_POINTER
+
+#ifdef XYZ_POLYMORPHIC_USES_EXPERIMENTAL_BATCHED_CLONE
+#include "experimental/polymorphic_batched_clone.h"
+#endif  // XYZ_POLYMORPHIC_USES_EXPERIMENTAL_BATCHED_CLONE
+
 #ifndef XYZ_POLYMORPHIC_H_
 #include "polymorphic.h"
 #endif  // XYZ_POLYMORPHIC_H_
 
+#ifdef XYZ_POLYMORPHIC_HAS_TYPE_ID
+#include "experimental/group_by_dynamic_type.h"
+#endif  // XYZ_POLYMORPHIC_HAS_TYPE_ID
+
 namespace {
 
 constexpr size_t LARGE_VECTOR_SIZE = 1 << 20;
@@ -118,11 +140,13 @@ class PolyDerived2 : public PolyBase {
 
 static void Polymorphic_BM_Copy_RawPtr(benchmark::State& state) {
   auto p = new Derived(42);
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     auto pp = p->clone();
     benchmark::DoNotOptimize(pp);
     delete pp;
   }
+  counters.report(state);
   delete p;
 }
 
@@ -136,6 +160,7 @@ static void Polymorphic_BM_VectorCopy_RawPointer(benchmark::State& state) {
     }
   }
 
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     std::vector<Base*> vv(LARGE_VECTOR_SIZE);
 
@@ -148,6 +173,7 @@ static void Polymorphic_BM_VectorCopy_RawPointer(benchmark::State& state) {
       delete p;
     }
   }
+  counters.report(state);
 
   for (auto& p : v) {
     delete p;
@@ -164,6 +190,7 @@ static void Polymorphic_BM_ArrayCopy_RawPointer(benchmark::State& state) {
     }
   }
 
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     std::array<Base*, LARGE_ARRAY_SIZE> vv;
     for (size_t i = 0; i < v.size(); ++i) {
@@ -174,6 +201,7 @@ static void Polymorphic_BM_ArrayCopy_RawPointer(benchmark::State& state) {
       delete vv[i];
     }
   }
+  counters.report(state);
 
   for (size_t i = 0; i < v.size(); ++i) {
     delete v[i];
@@ -191,12 +219,14 @@ static void Polymorphic_BM_VectorAccumulate_RawPointer(
     }
   }
 
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     size_t sum = std::accumulate(
         v.begin(), v.end(), size_t(0),
         [](size_t acc, const auto& p) { return acc + p->value(); });
     benchmark::DoNotOptimize(sum);
   }
+  counters.report(state);
 
   for (auto& p : v) {
     delete p;
@@ -205,10 +235,12 @@ static void Polymorphic_BM_VectorAccumulate_RawPointer(
 
 static void Polymorphic_BM_Copy_UniquePtr(benchmark::State& state) {
   auto p = std::make_unique<Derived>(42);
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     auto pp = std::unique_ptr<Base>(p->clone());
     benchmark::DoNotOptimize(pp);
   }
+  counters.report(state);
 }
 
 static void Polymorphic_BM_VectorCopy_UniquePointer(benchmark::State& state) {
@@ -221,6 +253,7 @@ static void Polymorphic_BM_VectorCopy_UniquePointer(benchmark::State& state) {
     }
   }
 
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     std::vector<std::unique_ptr<Base>> vv(LARGE_VECTOR_SIZE);
     for (size_t i = 0; i < v.size(); ++i) {
@@ -228,6 +261,7 @@ static void Polymorphic_BM_VectorCopy_UniquePointer(benchmark::State& state) {
     }
     benchmark::DoNotOptimize(vv);
   }
+  counters.report(state);
 }
 
 static void Polymorphic_BM_ArrayCopy_UniquePointer(benchmark::State& state) {
@@ -240,6 +274,7 @@ static void Polymorphic_BM_ArrayCopy_UniquePointer(benchmark::State& state) {
     }
   }
 
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     std::array<std::unique_ptr<Base>, LARGE_ARRAY_SIZE> vv;
     for (size_t i = 0; i < v.size(); ++i) {
@@ -247,6 +282,7 @@ static void Polymorphic_BM_ArrayCopy_UniquePointer(benchmark::State& state) {
     }
     benchmark::DoNotOptimize(vv);
   }
+  counters.report(state);
 }
 
 static void Polymorphic_BM_VectorAccumulate_UniquePointer(
@@ -260,20 +296,24 @@ static void Polymorphic_BM_VectorAccumulate_UniquePointer(
     }
   }
 
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     size_t sum = std::accumulate(
         v.begin(), v.end(), size_t(0),
         [](size_t acc, const auto& p) { return acc + p->value(); });
     benchmark::DoNotOptimize(sum);
   }
+  counters.report(state);
 }
 
 static void Polymorphic_BM_Copy_Polymorphic(benchmark::State& state) {
   auto p = xyz::polymorphic<PolyBase>(std::in_place_type<PolyDerived>, 42);
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     auto pp = p;
     benchmark::DoNotOptimize(pp);
   }
+  counters.report(state);
 }
 
 static void Polymorphic_BM_VectorCopy_Polymorphic(benchmark::State& state) {
@@ -289,12 +329,41 @@ static void Polymorphic_BM_VectorCopy_Polymorphic(benchmark::State& state) {
     }
   }
 
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     auto vv = v;
     benchmark::DoNotOptimize(vv);
   }
+  counters.report(state);
 }
 
+#ifdef XYZ_POLYMORPHIC_HAS_CLONE_RANGE
+static void Polymorphic_BM_VectorCopy_PolymorphicCloneRange(
+    benchmark::State& state) {
+  std::vector<xyz::polymorphic<PolyBase>> v;
+  v.reserve(LARGE_VECTOR_SIZE);
+  for (size_t i = 0; i < LARGE_VECTOR_SIZE; ++i) {
+    if (i % 2 == 0) {
+      v.push_back(
+          xyz::polymorphic<PolyBase>(std::in_place_type<PolyDerived>, i));
+    } else {
+      v.push_back(
+          xyz::polymorphic<PolyBase>(std::in_place_type<PolyDerived2>, i));
+    }
+  }
+
+  xyz::benchmarks::allocation_counters counters;
+  for (auto _ : state) {
+    std::vector<xyz::polymorphic<PolyBase>> vv;
+    vv.reserve(v.size());
+    xyz::clone_range(v.begin(), v.end(), std::back_inserter(vv),
+                     v.front().get_allocator());
+    benchmark::DoNotOptimize(vv);
+  }
+  counters.report(state);
+}
+#endif  // XYZ_POLYMORPHIC_HAS_CLONE_RANGE
+
 static void Polymorphic_BM_ArrayCopy_Polymorphic(benchmark::State& state) {
   std::array<std::optional<xyz::polymorphic<PolyBase>>, LARGE_ARRAY_SIZE> v;
   for (size_t i = 0; i < v.size(); ++i) {
@@ -307,10 +376,12 @@ static void Polymorphic_BM_ArrayCopy_Polymorphic(benchmark::State& state) {
     }
   }
 
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     auto vv = v;
     benchmark::DoNotOptimize(vv);
   }
+  counters.report(state);
 }
 
 static void Polymorphic_BM_VectorAccumulate_Polymorphic(
@@ -327,12 +398,156 @@ static void Polymorphic_BM_VectorAccumulate_Polymorphic(
     }
   }
 
+  xyz::benchmarks::allocation_counters counters;
   for (auto _ : state) {
     size_t sum = std::accumulate(
         v.begin(), v.end(), size_t(0),
         [](size_t acc, const auto& p) { return acc + p->value(); });
     benchmark::DoNotOptimize(sum);
   }
+  counters.report(state);
+}
+
+#ifdef XYZ_POLYMORPHIC_HAS_VISIT
+static void Polymorphic_BM_VectorAccumulate_PolymorphicVisit(
+    benchmark::State& state) {
+  std::vector<xyz::polymorphic<PolyBase>> v;
+  v.reserve(LARGE_VECTOR_SIZE);
+  for (size_t i = 0; i < LARGE_VECTOR_SIZE; ++i) {
+    if (i % 2 == 0) {
+      v.push_back(
+          xyz::polymorphic<PolyBase>(std::in_place_type<PolyDerived>, i));
+    } else {
+      v.push_back(
+          xyz::polymorphic<PolyBase>(std::in_place_type<PolyDerived2>, i));
+    }
+  }
+
+  xyz::benchmarks::allocation_counters counters;
+  for (auto _ : state) {
+    size_t sum = std::accumulate(
+        v.begin(), v.end(), size_t(0), [](size_t acc, const auto& p) {
+          return acc + xyz::visit<PolyDerived, PolyDerived2>(
+                           p, [](const auto& u) {
+                             // Qualified calls to the derived type's value
+                             // are not virtual.
+                             using U = std::remove_cvref_t<decltype(u)>;
+                             if constexpr (std::is_same_v<U, PolyBase>) {
+                               return u.value();
+                             } else {
+                               return u.U::value();
+                             }
+                           });
+        });
+    benchmark::DoNotOptimize(sum);
+  }
+  counters.report(state);
+}
+#endif  // XYZ_POLYMORPHIC_HAS_VISIT
+
+// The mixed accumulate benchmarks choose the type of each element at random
+// so that the target of each virtual call cannot be predicted from the last.
+
+static std::vector<xyz::polymorphic<PolyBase>> MakeMixedPolymorphicVector() {
+  std::vector<xyz::polymorphic<PolyBase>> v;
+  v.reserve(LARGE_VECTOR_SIZE);
+  std::mt19937 gen{42};
+  std::bernoulli_distribution coin;
+  for (size_t i = 0; i < LARGE_VECTOR_SIZE; ++i) {
+    if (coin(gen)) {
+      v.push_back(
+          xyz::polymorphic<PolyBase>(std::in_place_type<PolyDerived>, i));
+    } else {
+      v.push_back(
+          xyz::polymorphic<PolyBase>(std::in_place_type<PolyDerived2>, i));
+    }
+  }
+  return v;
+}
+
+static void Polymorphic_BM_VectorAccumulateMixed_Polymorphic(
+    benchmark::State& state) {
+  auto v = MakeMixedPolymorphicVector();
+
+  xyz::benchmarks::allocation_counters counters;
+  for (auto _ : state) {
+    size_t sum = std::accumulate(
+        v.begin(), v.end(), size_t(0),
+        [](size_t acc, const auto& p) { return acc + p->value(); });
+    benchmark::DoNotOptimize(sum);
+  }
+  counters.report(state);
+}
+
+#ifdef XYZ_POLYMORPHIC_HAS_TYPE_ID
+static void Polymorphic_BM_VectorAccumulateMixed_PolymorphicGrouped(
+    benchmark::State& state) {
+  auto v = MakeMixedPolymorphicVector();
+  xyz::group_by_dynamic_type(v.begin(), v.end());
+
+  xyz::benchmarks::allocation_counters counters;
+  for (auto _ : state) {
+    size_t sum = std::accumulate(
+        v.begin(), v.end(), size_t(0),
+        [](size_t acc, const auto& p) { return acc + p->value(); });
+    benchmark::DoNotOptimize(sum);
+  }
+  counters.report(state);
+}
+#endif  // XYZ_POLYMORPHIC_HAS_TYPE_ID
+
+// The shuffled accumulate benchmarks visit objects in a different order to
+// the one they were allocated in so that each access misses the cache.
+
+static void Polymorphic_BM_VectorAccumulateShuffled_RawPointer(
+    benchmark::State& state) {
+  std::vector<Base*> v(LARGE_VECTOR_SIZE);
+  for (size_t i = 0; i < LARGE_VECTOR_SIZE; ++i) {
+    if (i % 2 == 0) {
+      v[i] = new Derived(i);
+    } else {
+      v[i] = new Derived2(i);
+    }
+  }
+  std::shuffle(v.begin(), v.end(), std::mt19937{42});
+
+  xyz::benchmarks::allocation_counters counters;
+  for (auto _ : state) {
+    size_t sum = std::accumulate(
+        v.begin(), v.end(), size_t(0),
+        [](size_t acc, const auto& p) { return acc + p->value(); });
+    benchmark::DoNotOptimize(sum);
+  }
+  counters.report(state);
+
+  for (auto& p : v) {
+    delete p;
+  }
+}
+
+static void Polymorphic_BM_VectorAccumulateShuffled_Polymorphic(
+    benchmark::State& state) {
+  std::vector<xyz::polymorphic<PolyBase>> v;
+  v.reserve(LARGE_VECTOR_SIZE);
+  for (size_t i = 0; i < LARGE_VECTOR_SIZE; ++i) {
+    if (i % 2 == 0) {
+      v.push_back(
+          xyz::polymorphic<PolyBase>(std::in_place_type<PolyDerived>, i));
+    } else {
+      v.push_back(
+          xyz::polymorphic<PolyBase>(std::in_place_type<PolyDerived2>, i));
+    }
+  }
+  std::shuffle(v.begin(), v.end(), std::mt19937{42});
+
+  xyz::benchmarks::allocation_counters counters;
+  for (auto _ : state) {
+    size_t sum = std::accumulate(
+        v.begin(), v.end(), size_t(0),
+        [](size_t acc, const auto& p) { return acc + p->value(); });
+    benchmark::DoNotOptimize(sum);
+  }
+  counters.report(state);
 }
 
 }  // namespace
@@ -344,6 +559,9 @@ BENCHMARK(Polymorphic_BM_Copy_Polymorphic);
 BENCHMARK(Polymorphic_BM_VectorCopy_RawPointer);
 BENCHMARK(Polymorphic_BM_VectorCopy_UniquePointer);
 BENCHMARK(Polymorphic_BM_VectorCopy_Polymorphic);
+#ifdef XYZ_POLYMORPHIC_HAS_CLONE_RANGE
+BENCHMARK(Polymorphic_BM_VectorCopy_PolymorphicCloneRange);
+#endif  // XYZ_POLYMORPHIC_HAS_CLONE_RANGE
 
 BENCHMARK(Polymorphic_BM_ArrayCopy_RawPointer);
 BENCHMARK(Polymorphic_BM_ArrayCopy_UniquePointer);
@@ -352,3 +570,14 @@ BENCHMARK(Polymorphic_BM_ArrayCopy_Polymorphic);
 BENCHMARK(Polymorphic_BM_VectorAccumulate_RawPointer);
 BENCHMARK(Polymorphic_BM_VectorAccumulate_UniquePointer);
 BENCHMARK(Polymorphic_BM_VectorAccumulate_Polymorphic);
+#ifdef XYZ_POLYMORPHIC_HAS_VISIT
+BENCHMARK(Polymorphic_BM_VectorAccumulate_PolymorphicVisit);
+#endif  // XYZ_POLYMORPHIC_HAS_VISIT
+
+BENCHMARK(Polymorphic_BM_VectorAccumulateMixed_Polymorphic);
+#ifdef XYZ_POLYMORPHIC_HAS_TYPE_ID
+BENCHMARK(Polymorphic_BM_VectorAccumulateMixed_PolymorphicGrouped);
+#endif  // XYZ_POLYMORPHIC_HAS_TYPE_ID
+
+BENCHMARK(Polymorphic_BM_VectorAccumulateShuffled_RawPointer);
+BENCHMARK(Polymorphic_BM_VectorAccumulateShuffled_Polymorphic);
@@ -0,0 +1,144 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <numeric>
+#include <vector>
+
+#include "experimental/polymorphic_collection.h"
+#include "polymorphic.h"
+
+namespace {
+
+constexpr size_t LARGE_VECTOR_SIZE = 1 << 20;
+
+class PolyBase {
+ public:
+  virtual ~PolyBase() = default;
+  virtual size_t value() const = 0;
+};
+
+class PolyDerived final : public PolyBase {
+ private:
+  size_t value_;
+
+ public:
+  PolyDerived(size_t v) : value_(v) {}
+
+  size_t value() const override { return value_; }
+};
+
+class PolyDerived2 final : public PolyBase {
+ private:
+  size_t value_;
+
+ public:
+  PolyDerived2(size_t v) : value_(v) {}
+
+  size_t value() const override { return 2 * value_; }
+};
+
+std::vector<xyz::polymorphic<PolyBase>> MakeVectorOfPolymorphic() {
+  std::vector<xyz::polymorphic<PolyBase>> v;
+  v.reserve(LARGE_VECTOR_SIZE);
+  for (size_t i = 0; i < LARGE_VECTOR_SIZE; ++i) {
+    if (i % 2 == 0) {
+      v.emplace_back(std::in_place_type<PolyDerived>, i);
+    } else {
+      v.emplace_back(std::in_place_type<PolyDerived2>, i);
+    }
+  }
+  return v;
+}
+
+xyz::polymorphic_collection<PolyBase> MakePolymorphicCollection() {
+  xyz::polymorphic_collection<PolyBase> c;
+  c.reserve<PolyDerived>(LARGE_VECTOR_SIZE / 2);
+  c.reserve<PolyDerived2>(LARGE_VECTOR_SIZE / 2);
+  for (size_t i = 0; i < LARGE_VECTOR_SIZE; ++i) {
+    if (i % 2 == 0) {
+      c.emplace<PolyDerived>(i);
+    } else {
+      c.emplace<PolyDerived2>(i);
+    }
+  }
+  return c;
+}
+
+static void PolymorphicCollection_BM_Accumulate_VectorOfPolymorphic(
+    benchmark::State& state) {
+  auto v = MakeVectorOfPolymorphic();
+  for (auto _ : state) {
+    size_t sum = std::accumulate(
+        v.begin(), v.end(), size_t(0),
+        [](size_t acc, const auto& p) { return acc + p->value(); });
+    benchmark::DoNotOptimize(sum);
+  }
+}
+
+static void PolymorphicCollection_BM_Accumulate_ForEach(
+    benchmark::State& state) {
+  auto c = MakePolymorphicCollection();
+  for (auto _ : state) {
+    size_t sum = 0;
+    c.for_each([&](const PolyBase& p) { sum += p.value(); });
+    benchmark::DoNotOptimize(sum);
+  }
+}
+
+static void PolymorphicCollection_BM_Accumulate_ForEachAs(
+    benchmark::State& state) {
+  auto c = MakePolymorphicCollection();
+  for (auto _ : state) {
+    size_t sum = 0;
+    c.for_each_as<PolyDerived, PolyDerived2>(
+        [&](const auto& p) { sum += p.value(); });
+    benchmark::DoNotOptimize(sum);
+  }
+}
+
+static void PolymorphicCollection_BM_Copy_VectorOfPolymorphic(
+    benchmark::State& state) {
+  auto v = MakeVectorOfPolymorphic();
+  for (auto _ : state) {
+    auto vv = v;
+    benchmark::DoNotOptimize(vv);
+  }
+}
+
+static void PolymorphicCollection_BM_Copy_PolymorphicCollection(
+    benchmark::State& state) {
+  auto c = MakePolymorphicCollection();
+  for (auto _ : state) {
+    auto cc = c;
+    benchmark::DoNotOptimize(cc);
+  }
+}
+
+}  // namespace
+
+BENCHMARK(PolymorphicCollection_BM_Accumulate_VectorOfPolymorphic);
+BENCHMARK(PolymorphicCollection_BM_Accumulate_ForEach);
+BENCHMARK(PolymorphicCollection_BM_Accumulate_ForEachAs);
+
+BENCHMARK(PolymorphicCollection_BM_Copy_VectorOfPolymorphic);
+BENCHMARK(PolymorphicCollection_BM_Copy_PolymorphicCollection);
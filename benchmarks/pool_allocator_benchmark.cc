@@ -0,0 +1,215 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+#include "experimental/pool_allocator.h"
+#include "indirect.h"
+#include "polymorphic.h"
+
+namespace {
+
+constexpr size_t LARGE_VECTOR_SIZE = 1 << 16;
+
+class Base {
+ public:
+  virtual ~Base() = default;
+  virtual size_t value() const = 0;
+};
+
+class Derived : public Base {
+  size_t value_;
+
+ public:
+  Derived(size_t v) : value_(v) {}
+  size_t value() const override { return value_; }
+};
+
+// Each allocator source is wrapped so that benchmarks can be written once.
+// `reserve<T>(count)` pre-warms the source so that `count` objects of type T
+// can be allocated without further requests to the system.
+struct StdAllocatorSource {
+  template <class T>
+  std::allocator<T> get() {
+    return {};
+  }
+
+  template <class T>
+  void reserve(size_t) {}
+};
+
+struct PoolAllocatorSource {
+  xyz::size_class_pool pool_;
+
+  template <class T>
+  xyz::pool_allocator<T> get() {
+    return xyz::pool_allocator<T>(pool_);
+  }
+
+  template <class T>
+  void reserve(size_t count) {
+    get<T>().reserve(count);
+  }
+};
+
+struct PmrPoolSource {
+  std::pmr::unsynchronized_pool_resource resource_;
+
+  template <class T>
+  std::pmr::polymorphic_allocator<T> get() {
+    return &resource_;
+  }
+
+  // The pool resource keeps deallocated blocks for reuse.
+  template <class T>
+  void reserve(size_t count) {
+    std::vector<void*> blocks(count);
+    for (auto& p : blocks) p = resource_.allocate(sizeof(T), alignof(T));
+    for (auto* p : blocks) resource_.deallocate(p, sizeof(T), alignof(T));
+  }
+};
+
+template <class Source>
+static void IndirectCopy(benchmark::State& state) {
+  Source source;
+  auto alloc = source.template get<size_t>();
+  using I = xyz::indirect<size_t, decltype(alloc)>;
+  I i(std::allocator_arg, alloc, 42);
+  for (auto _ : state) {
+    I ii(i);
+    benchmark::DoNotOptimize(ii);
+  }
+}
+
+template <class Source>
+static void PolymorphicCopy(benchmark::State& state) {
+  Source source;
+  auto alloc = source.template get<Base>();
+  using P = xyz::polymorphic<Base, decltype(alloc)>;
+  P p(std::allocator_arg, alloc, std::in_place_type<Derived>, 42);
+  for (auto _ : state) {
+    P pp(p);
+    benchmark::DoNotOptimize(pp);
+  }
+}
+
+template <class Source>
+static void IndirectVectorCopy(benchmark::State& state) {
+  Source source;
+  // Pre-warm with blocks for the original and copied vectors.
+  source.template reserve<size_t>(2 * LARGE_VECTOR_SIZE);
+  auto alloc = source.template get<size_t>();
+  using I = xyz::indirect<size_t, decltype(alloc)>;
+  std::vector<I> v;
+  v.reserve(LARGE_VECTOR_SIZE);
+  for (size_t i = 0; i < LARGE_VECTOR_SIZE; ++i) {
+    v.emplace_back(std::allocator_arg, alloc, i);
+  }
+  for (auto _ : state) {
+    auto vv = v;
+    benchmark::DoNotOptimize(vv);
+  }
+}
+
+template <class Source>
+static void PolymorphicVectorCopy(benchmark::State& state) {
+  Source source;
+  auto alloc = source.template get<Base>();
+  using P = xyz::polymorphic<Base, decltype(alloc)>;
+  std::vector<P> v;
+  v.reserve(LARGE_VECTOR_SIZE);
+  for (size_t i = 0; i < LARGE_VECTOR_SIZE; ++i) {
+    v.emplace_back(std::allocator_arg, alloc, std::in_place_type<Derived>, i);
+  }
+  for (auto _ : state) {
+    auto vv = v;
+    benchmark::DoNotOptimize(vv);
+  }
+}
+
+static void Pool_BM_IndirectCopy_StdAllocator(benchmark::State& state) {
+  IndirectCopy<StdAllocatorSource>(state);
+}
+
+static void Pool_BM_IndirectCopy_PoolAllocator(benchmark::State& state) {
+  IndirectCopy<PoolAllocatorSource>(state);
+}
+
+static void Pool_BM_IndirectCopy_PmrPool(benchmark::State& state) {
+  IndirectCopy<PmrPoolSource>(state);
+}
+
+static void Pool_BM_PolymorphicCopy_StdAllocator(benchmark::State& state) {
+  PolymorphicCopy<StdAllocatorSource>(state);
+}
+
+static void Pool_BM_PolymorphicCopy_PoolAllocator(benchmark::State& state) {
+  PolymorphicCopy<PoolAllocatorSource>(state);
+}
+
+static void Pool_BM_PolymorphicCopy_PmrPool(benchmark::State& state) {
+  PolymorphicCopy<PmrPoolSource>(state);
+}
+
+static void Pool_BM_IndirectVectorCopy_StdAllocator(benchmark::State& state) {
+  IndirectVectorCopy<StdAllocatorSource>(state);
+}
+
+static void Pool_BM_IndirectVectorCopy_PoolAllocator(benchmark::State& state) {
+  IndirectVectorCopy<PoolAllocatorSource>(state);
+}
+
+static void Pool_BM_IndirectVectorCopy_PmrPool(benchmark::State& state) {
+  IndirectVectorCopy<PmrPoolSource>(state);
+}
+
+static void Pool_BM_PolymorphicVectorCopy_StdAllocator(
+    benchmark::State& state) {
+  PolymorphicVectorCopy<StdAllocatorSource>(state);
+}
+
+static void Pool_BM_PolymorphicVectorCopy_PoolAllocator(
+    benchmark::State& state) {
+  PolymorphicVectorCopy<PoolAllocatorSource>(state);
+}
+
+static void Pool_BM_PolymorphicVectorCopy_PmrPool(benchmark::State& state) {
+  PolymorphicVectorCopy<PmrPoolSource>(state);
+}
+
+}  // namespace
+
+BENCHMARK(Pool_BM_IndirectCopy_StdAllocator);
+BENCHMARK(Pool_BM_IndirectCopy_PoolAllocator);
+BENCHMARK(Pool_BM_IndirectCopy_PmrPool);
+BENCHMARK(Pool_BM_PolymorphicCopy_StdAllocator);
+BENCHMARK(Pool_BM_PolymorphicCopy_PoolAllocator);
+BENCHMARK(Pool_BM_PolymorphicCopy_PmrPool);
+BENCHMARK(Pool_BM_IndirectVectorCopy_StdAllocator);
+BENCHMARK(Pool_BM_IndirectVectorCopy_PoolAllocator);
+BENCHMARK(Pool_BM_IndirectVectorCopy_PmrPool);
+BENCHMARK(Pool_BM_PolymorphicVectorCopy_StdAllocator);
+BENCHMARK(Pool_BM_PolymorphicVectorCopy_PoolAllocator);
+BENCHMARK(Pool_BM_PolymorphicVectorCopy_PmrPool);
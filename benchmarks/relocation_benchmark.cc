@@ -0,0 +1,287 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <type_traits>
+#include <vector>
+
+#include "indirect.h"
+#include "polymorphic.h"
+
+namespace {
+
+constexpr size_t LARGE_VECTOR_SIZE = 1 << 20;
+
+class Base {
+ public:
+  virtual ~Base() = default;
+  virtual size_t value() const = 0;
+};
+
+class Derived : public Base {
+ private:
+  size_t value_;
+
+ public:
+  Derived(size_t v) : value_(v) {}
+
+  size_t value() const override { return value_; }
+};
+
+using Indirect = xyz::indirect<size_t>;
+using PmrIndirect =
+    xyz::indirect<size_t, std::pmr::polymorphic_allocator<size_t>>;
+using Polymorphic = xyz::polymorphic<Base>;
+
+// A polymorphic allocator for values that all share one memory resource.
+template <class T>
+struct SharedResourceAllocator : std::pmr::polymorphic_allocator<T> {
+  using is_assumed_equal = std::true_type;
+
+  using std::pmr::polymorphic_allocator<T>::polymorphic_allocator;
+
+  template <class U>
+  SharedResourceAllocator(const std::pmr::polymorphic_allocator<U>& other)
+      : std::pmr::polymorphic_allocator<T>(other.resource()) {}
+
+  template <class U>
+  struct rebind {
+    using other = SharedResourceAllocator<U>;
+  };
+};
+
+using SharedIndirect = xyz::indirect<size_t, SharedResourceAllocator<size_t>>;
+using PmrPolymorphic =
+    xyz::polymorphic<Base, std::pmr::polymorphic_allocator<Base>>;
+using SharedPolymorphic =
+    xyz::polymorphic<Base, SharedResourceAllocator<Base>>;
+
+// A minimal growable array that moves its elements with
+// xyz::uninitialized_relocate rather than with their move constructors.
+template <class T>
+class RelocatingVector {
+  std::allocator<T> alloc_;
+  T* data_ = nullptr;
+  size_t size_ = 0;
+  size_t capacity_ = 0;
+
+ public:
+  RelocatingVector() = default;
+  RelocatingVector(const RelocatingVector&) = delete;
+  RelocatingVector& operator=(const RelocatingVector&) = delete;
+
+  ~RelocatingVector() {
+    std::destroy(data_, data_ + size_);
+    if (data_ != nullptr) alloc_.deallocate(data_, capacity_);
+  }
+
+  template <class... Ts>
+  void emplace_back(Ts&&... ts) {
+    if (size_ == capacity_) {
+      size_t capacity = capacity_ == 0 ? 1 : 2 * capacity_;
+      T* data = alloc_.allocate(capacity);
+      xyz::uninitialized_relocate(data_, data_ + size_, data);
+      if (data_ != nullptr) alloc_.deallocate(data_, capacity_);
+      data_ = data;
+      capacity_ = capacity;
+    }
+    std::construct_at(data_ + size_, std::forward<Ts>(ts)...);
+    ++size_;
+  }
+
+  void erase_front() {
+    std::destroy_at(data_);
+    xyz::uninitialized_relocate(data_ + 1, data_ + size_, data_);
+    --size_;
+  }
+
+  size_t size() const { return size_; }
+};
+
+template <class V, class... Ts>
+void Grow(V& v, Ts&&... ts) {
+  for (size_t i = 0; i < LARGE_VECTOR_SIZE; ++i) {
+    v.emplace_back(ts..., i);
+  }
+}
+
+static void Relocation_BM_VectorGrowth_Indirect(benchmark::State& state) {
+  for (auto _ : state) {
+    std::vector<Indirect> v;
+    Grow(v, std::in_place);
+    benchmark::DoNotOptimize(v);
+  }
+}
+
+static void Relocation_BM_VectorGrowth_IndirectRelocate(
+    benchmark::State& state) {
+  for (auto _ : state) {
+    RelocatingVector<Indirect> v;
+    Grow(v, std::in_place);
+    benchmark::DoNotOptimize(v);
+  }
+}
+
+// The move constructor of an indirect with a pmr allocator is not noexcept,
+// so std::vector copies its elements when it grows.
+static void Relocation_BM_VectorGrowth_PmrIndirect(benchmark::State& state) {
+  std::pmr::polymorphic_allocator<size_t> alloc(
+      std::pmr::new_delete_resource());
+  for (auto _ : state) {
+    std::vector<PmrIndirect> v;
+    Grow(v, std::allocator_arg, alloc);
+    benchmark::DoNotOptimize(v);
+  }
+}
+
+static void Relocation_BM_VectorGrowth_PmrIndirectRelocate(
+    benchmark::State& state) {
+  std::pmr::polymorphic_allocator<size_t> alloc(
+      std::pmr::new_delete_resource());
+  for (auto _ : state) {
+    RelocatingVector<PmrIndirect> v;
+    Grow(v, std::allocator_arg, alloc);
+    benchmark::DoNotOptimize(v);
+  }
+}
+
+static void Relocation_BM_VectorGrowth_Polymorphic(benchmark::State& state) {
+  for (auto _ : state) {
+    std::vector<Polymorphic> v;
+    Grow(v, std::in_place_type<Derived>);
+    benchmark::DoNotOptimize(v);
+  }
+}
+
+static void Relocation_BM_VectorGrowth_PolymorphicRelocate(
+    benchmark::State& state) {
+  for (auto _ : state) {
+    RelocatingVector<Polymorphic> v;
+    Grow(v, std::in_place_type<Derived>);
+    benchmark::DoNotOptimize(v);
+  }
+}
+
+// A std::pmr::vector gives each element its memory resource. Unless the
+// allocators are assumed to be equal, the elements' move constructors are not
+// noexcept and the vector copies them when it reallocates.
+
+template <class P, class... Ts>
+void GrowPmrVector(benchmark::State& state, Ts... ts) {
+  for (auto _ : state) {
+    std::pmr::vector<P> v(std::pmr::new_delete_resource());
+    Grow(v, ts...);
+    benchmark::DoNotOptimize(v);
+  }
+}
+
+static void Relocation_BM_PmrVectorGrowth_PmrIndirect(
+    benchmark::State& state) {
+  GrowPmrVector<PmrIndirect>(state, std::in_place);
+}
+
+static void Relocation_BM_PmrVectorGrowth_SharedIndirect(
+    benchmark::State& state) {
+  GrowPmrVector<SharedIndirect>(state, std::in_place);
+}
+
+static void Relocation_BM_PmrVectorGrowth_PmrPolymorphic(
+    benchmark::State& state) {
+  GrowPmrVector<PmrPolymorphic>(state, std::in_place_type<Derived>);
+}
+
+static void Relocation_BM_PmrVectorGrowth_SharedPolymorphic(
+    benchmark::State& state) {
+  GrowPmrVector<SharedPolymorphic>(state, std::in_place_type<Derived>);
+}
+
+// Each iteration erases the first element and appends one so that the size
+// stays at LARGE_VECTOR_SIZE.
+
+static void Relocation_BM_EraseFront_Indirect(benchmark::State& state) {
+  std::vector<Indirect> v;
+  v.reserve(LARGE_VECTOR_SIZE + 1);
+  Grow(v, std::in_place);
+  for (auto _ : state) {
+    v.erase(v.begin());
+    v.emplace_back(std::in_place, size_t(0));
+    benchmark::DoNotOptimize(v);
+  }
+}
+
+static void Relocation_BM_EraseFront_IndirectRelocate(
+    benchmark::State& state) {
+  RelocatingVector<Indirect> v;
+  Grow(v, std::in_place);
+  for (auto _ : state) {
+    v.erase_front();
+    v.emplace_back(std::in_place, size_t(0));
+    benchmark::DoNotOptimize(v);
+  }
+}
+
+static void Relocation_BM_EraseFront_Polymorphic(benchmark::State& state) {
+  std::vector<Polymorphic> v;
+  v.reserve(LARGE_VECTOR_SIZE + 1);
+  Grow(v, std::in_place_type<Derived>);
+  for (auto _ : state) {
+    v.erase(v.begin());
+    v.emplace_back(std::in_place_type<Derived>, size_t(0));
+    benchmark::DoNotOptimize(v);
+  }
+}
+
+static void Relocation_BM_EraseFront_PolymorphicRelocate(
+    benchmark::State& state) {
+  RelocatingVector<Polymorphic> v;
+  Grow(v, std::in_place_type<Derived>);
+  for (auto _ : state) {
+    v.erase_front();
+    v.emplace_back(std::in_place_type<Derived>, size_t(0));
+    benchmark::DoNotOptimize(v);
+  }
+}
+
+}  // namespace
+
+BENCHMARK(Relocation_BM_VectorGrowth_Indirect);
+BENCHMARK(Relocation_BM_VectorGrowth_IndirectRelocate);
+
+BENCHMARK(Relocation_BM_VectorGrowth_PmrIndirect);
+BENCHMARK(Relocation_BM_VectorGrowth_PmrIndirectRelocate);
+
+BENCHMARK(Relocation_BM_VectorGrowth_Polymorphic);
+BENCHMARK(Relocation_BM_VectorGrowth_PolymorphicRelocate);
+
+BENCHMARK(Relocation_BM_PmrVectorGrowth_PmrIndirect);
+BENCHMARK(Relocation_BM_PmrVectorGrowth_SharedIndirect);
+
+BENCHMARK(Relocation_BM_PmrVectorGrowth_PmrPolymorphic);
+BENCHMARK(Relocation_BM_PmrVectorGrowth_SharedPolymorphic);
+
+BENCHMARK(Relocation_BM_EraseFront_Indirect);
+BENCHMARK(Relocation_BM_EraseFront_IndirectRelocate);
+
+BENCHMARK(Relocation_BM_EraseFront_Polymorphic);
+BENCHMARK(Relocation_BM_EraseFront_PolymorphicRelocate);
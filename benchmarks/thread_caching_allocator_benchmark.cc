@@ -0,0 +1,105 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "experimental/thread_caching_allocator.h"
+#include "indirect.h"
+#include "polymorphic.h"
+
+namespace {
+
+constexpr size_t VECTOR_SIZE = 1 << 12;
+
+class Base {
+ public:
+  virtual ~Base() = default;
+  virtual size_t value() const = 0;
+};
+
+class Derived : public Base {
+  size_t value_;
+
+ public:
+  Derived(size_t v) : value_(v) {}
+  size_t value() const override { return value_; }
+};
+
+template <class A>
+static void IndirectVectorCopy(benchmark::State& state) {
+  using I = xyz::indirect<size_t, A>;
+  std::vector<I> v;
+  v.reserve(VECTOR_SIZE);
+  for (size_t i = 0; i < VECTOR_SIZE; ++i) {
+    v.emplace_back(std::in_place, i);
+  }
+  for (auto _ : state) {
+    auto vv = v;
+    benchmark::DoNotOptimize(vv);
+  }
+}
+
+template <class A>
+static void PolymorphicVectorCopy(benchmark::State& state) {
+  using P = xyz::polymorphic<Base, A>;
+  std::vector<P> v;
+  v.reserve(VECTOR_SIZE);
+  for (size_t i = 0; i < VECTOR_SIZE; ++i) {
+    v.emplace_back(std::in_place_type<Derived>, i);
+  }
+  for (auto _ : state) {
+    auto vv = v;
+    benchmark::DoNotOptimize(vv);
+  }
+}
+
+static void ThreadCaching_BM_IndirectVectorCopy_StdAllocator(
+    benchmark::State& state) {
+  IndirectVectorCopy<std::allocator<size_t>>(state);
+}
+
+static void ThreadCaching_BM_IndirectVectorCopy_ThreadCachingAllocator(
+    benchmark::State& state) {
+  IndirectVectorCopy<xyz::thread_caching_allocator<size_t>>(state);
+}
+
+static void ThreadCaching_BM_PolymorphicVectorCopy_StdAllocator(
+    benchmark::State& state) {
+  PolymorphicVectorCopy<std::allocator<Base>>(state);
+}
+
+static void ThreadCaching_BM_PolymorphicVectorCopy_ThreadCachingAllocator(
+    benchmark::State& state) {
+  PolymorphicVectorCopy<xyz::thread_caching_allocator<Base>>(state);
+}
+
+}  // namespace
+
+BENCHMARK(ThreadCaching_BM_IndirectVectorCopy_StdAllocator)->ThreadRange(1, 8);
+BENCHMARK(ThreadCaching_BM_IndirectVectorCopy_ThreadCachingAllocator)
+    ->ThreadRange(1, 8);
+BENCHMARK(ThreadCaching_BM_PolymorphicVectorCopy_StdAllocator)
+    ->ThreadRange(1, 8);
+BENCHMARK(ThreadCaching_BM_PolymorphicVectorCopy_ThreadCachingAllocator)
+    ->ThreadRange(1, 8);
@@ -0,0 +1,211 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+#include "experimental/closed_polymorphic.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace {
+
+class Base {
+ public:
+  virtual ~Base() = default;
+  virtual int value() const = 0;
+  virtual void set_value(int) = 0;
+};
+
+class Derived : public Base {
+ private:
+  int value_;
+
+ public:
+  Derived(int v) : value_(v) {}
+
+  Derived() : Derived(0) {}
+
+  int value() const override { return value_; }
+
+  void set_value(int v) override { value_ = v; }
+};
+
+class StringDerived : public Base {
+ private:
+  std::string s_;
+
+ public:
+  StringDerived(int v) : s_(100, static_cast<char>('a' + v)) {}
+
+  int value() const override { return s_.empty() ? -1 : s_[0] - 'a'; }
+
+  void set_value(int v) override { s_.assign(100, static_cast<char>('a' + v)); }
+};
+
+// A derived type whose Base subobject is not at offset zero.
+class Padding {
+ public:
+  virtual ~Padding() = default;
+  std::int64_t padding_ = 0;
+};
+
+class OffsetDerived : public Padding, public Base {
+ private:
+  int value_;
+
+ public:
+  OffsetDerived(int v) : value_(v) {}
+
+  int value() const override { return value_; }
+
+  void set_value(int v) override { value_ = v; }
+};
+
+using Closed =
+    xyz::closed_polymorphic<Base, Derived, StringDerived, OffsetDerived>;
+
+static_assert(sizeof(Closed) <=
+              sizeof(StringDerived) + alignof(StringDerived));
+static_assert(std::is_same_v<Closed::index_type, std::uint8_t>);
+
+TEST(ClosedPolymorphicTest, DefaultConstructsFirstAlternative) {
+  Closed c;
+  EXPECT_EQ(c.index(), 0);
+  EXPECT_EQ(c->value(), 0);
+}
+
+TEST(ClosedPolymorphicTest, ValueConstructor) {
+  Closed c(StringDerived(3));
+  EXPECT_EQ(c.index(), 1);
+  EXPECT_EQ(c->value(), 3);
+}
+
+TEST(ClosedPolymorphicTest, InPlaceConstructor) {
+  Closed c(std::in_place_type<OffsetDerived>, 42);
+  EXPECT_EQ(c.index(), 2);
+  EXPECT_EQ((*c).value(), 42);
+}
+
+TEST(ClosedPolymorphicTest, ObjectIsStoredInline) {
+  Closed c(std::in_place_type<StringDerived>, 1);
+  auto* p = reinterpret_cast<const std::byte*>(&*c);
+  auto* begin = reinterpret_cast<const std::byte*>(&c);
+  EXPECT_GE(p, begin);
+  EXPECT_LT(p, begin + sizeof(c));
+}
+
+TEST(ClosedPolymorphicTest, BaseSubobjectAtNonZeroOffset) {
+  Closed c(std::in_place_type<OffsetDerived>, 7);
+  EXPECT_EQ(&*c, static_cast<Base*>(c.get_if<OffsetDerived>()));
+}
+
+TEST(ClosedPolymorphicTest, GetIf) {
+  Closed c(std::in_place_type<Derived>, 1);
+  EXPECT_NE(c.get_if<Derived>(), nullptr);
+  EXPECT_EQ(c.get_if<StringDerived>(), nullptr);
+  EXPECT_EQ(std::as_const(c).get_if<OffsetDerived>(), nullptr);
+}
+
+TEST(ClosedPolymorphicTest, CopiesAreDeep) {
+  Closed c(std::in_place_type<StringDerived>, 1);
+  auto cc = c;
+  cc->set_value(2);
+  EXPECT_EQ(c->value(), 1);
+  EXPECT_EQ(cc->value(), 2);
+  EXPECT_EQ(cc.index(), 1);
+}
+
+TEST(ClosedPolymorphicTest, CopyAssignmentChangesAlternative) {
+  Closed c(std::in_place_type<StringDerived>, 1);
+  Closed cc(std::in_place_type<OffsetDerived>, 2);
+  cc = c;
+  EXPECT_EQ(cc.index(), 1);
+  EXPECT_EQ(cc->value(), 1);
+}
+
+TEST(ClosedPolymorphicTest, MoveLeavesSourceValueless) {
+  Closed c(std::in_place_type<StringDerived>, 1);
+  auto cc = std::move(c);
+  EXPECT_TRUE(c.valueless_after_move());  // NOLINT(bugprone-use-after-move)
+  EXPECT_EQ(c.index(), Closed::npos);
+  EXPECT_EQ(cc->value(), 1);
+}
+
+TEST(ClosedPolymorphicTest, MoveAssignment) {
+  Closed c(std::in_place_type<Derived>, 1);
+  Closed cc(std::in_place_type<StringDerived>, 2);
+  cc = std::move(c);
+  EXPECT_TRUE(c.valueless_after_move());  // NOLINT(bugprone-use-after-move)
+  EXPECT_EQ(cc.index(), 0);
+  EXPECT_EQ(cc->value(), 1);
+}
+
+TEST(ClosedPolymorphicTest, CopyFromValueless) {
+  Closed c(std::in_place_type<Derived>, 1);
+  auto moved = std::move(c);
+  Closed cc(c);  // NOLINT(bugprone-use-after-move)
+  EXPECT_TRUE(cc.valueless_after_move());
+  moved = c;
+  EXPECT_TRUE(moved.valueless_after_move());
+}
+
+TEST(ClosedPolymorphicTest, Emplace) {
+  Closed c;
+  StringDerived& s = c.emplace<StringDerived>(5);
+  EXPECT_EQ(&s, c.get_if<StringDerived>());
+  EXPECT_EQ(c->value(), 5);
+}
+
+TEST(ClosedPolymorphicTest, Swap) {
+  Closed c(std::in_place_type<Derived>, 1);
+  Closed cc(std::in_place_type<StringDerived>, 2);
+  swap(c, cc);
+  EXPECT_EQ(c.index(), 1);
+  EXPECT_EQ(c->value(), 2);
+  EXPECT_EQ(cc.index(), 0);
+  EXPECT_EQ(cc->value(), 1);
+}
+
+#ifdef __cpp_exceptions
+class ThrowsOnCopy : public Base {
+ public:
+  ThrowsOnCopy() = default;
+
+  ThrowsOnCopy(const ThrowsOnCopy&) { throw std::runtime_error("copy"); }
+
+  int value() const override { return -1; }
+
+  void set_value(int) override {}
+};
+
+TEST(ClosedPolymorphicTest, CopyAssignmentThatThrowsKeepsValue) {
+  xyz::closed_polymorphic<Base, Derived, ThrowsOnCopy> c(
+      std::in_place_type<ThrowsOnCopy>);
+  xyz::closed_polymorphic<Base, Derived, ThrowsOnCopy> cc(
+      std::in_place_type<Derived>, 1);
+  EXPECT_THROW(cc = c, std::runtime_error);
+  EXPECT_EQ(cc->value(), 1);
+}
+#endif  // __cpp_exceptions
+
+}  // namespace
@@ -21,7 +21,13 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 // A set of consteval functions to check that constexpr functions can be
 // evaluated at compile time.
 
+#ifdef XYZ_INDIRECT_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
+#include "experimental/indirect_sbo.h"
+#endif  // XYZ_INDIRECT_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
+
+#ifndef XYZ_INDIRECT_H
 #include "indirect.h"
+#endif  // XYZ_INDIRECT_H
 
 namespace xyz::testing {
 struct ConstexprHashable {};
@@ -33,6 +33,10 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "experimental/polymorphic_sbo.h"
 #endif  // XYZ_POLYMORPHIC_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
 
+#ifdef XYZ_POLYMORPHIC_USES_EXPERIMENTAL_CACHED_POINTER
+#include "experimental/polymorphic_cached_pointer.h"
+#endif  // XYZ_POLYMORPHIC_USES_EXPERIMENTAL_CACHED_POINTER
+
 #ifndef XYZ_POLYMORPHIC_H_
 #include "polymorphic.h"
 #endif  // XYZ_POLYMORPHIC_H_
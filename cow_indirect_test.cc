@@ -0,0 +1,215 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+#include "experimental/cow_indirect.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "tagged_allocator.h"
+#include "tracking_allocator.h"
+
+namespace {
+
+TEST(CowIndirectTest, DefaultConstructor) {
+  xyz::cow_indirect<int> i;
+  EXPECT_EQ(*i, 0);
+  EXPECT_EQ(i.use_count(), 1);
+}
+
+TEST(CowIndirectTest, InPlaceConstructor) {
+  xyz::cow_indirect<std::string> i(std::in_place, 3, 'x');
+  EXPECT_EQ(*i, "xxx");
+}
+
+TEST(CowIndirectTest, CopiesShareTheOwnedObject) {
+  const xyz::cow_indirect<int> i(std::in_place, 42);
+  auto ii = i;
+  EXPECT_EQ(&*i, &*std::as_const(ii));
+  EXPECT_EQ(i.use_count(), 2);
+  EXPECT_EQ(ii.use_count(), 2);
+}
+
+TEST(CowIndirectTest, NonConstAccessCopiesSharedObject) {
+  xyz::cow_indirect<int> i(std::in_place, 42);
+  auto ii = i;
+  *ii = 101;
+  EXPECT_EQ(*std::as_const(i), 42);
+  EXPECT_EQ(*std::as_const(ii), 101);
+  EXPECT_EQ(i.use_count(), 1);
+  EXPECT_EQ(ii.use_count(), 1);
+}
+
+TEST(CowIndirectTest, NonConstAccessDoesNotCopyUniqueObject) {
+  xyz::cow_indirect<int> i(std::in_place, 42);
+  const auto* address = &*std::as_const(i);
+  *i = 101;
+  EXPECT_EQ(address, &*std::as_const(i));
+}
+
+TEST(CowIndirectTest, CopiesAfterNonConstAccessDoNotShare) {
+  xyz::cow_indirect<int> i(std::in_place, 42);
+  int& r = *i;
+  auto ii = i;
+  r = 101;
+  EXPECT_EQ(*std::as_const(i), 101);
+  EXPECT_EQ(*std::as_const(ii), 42);
+  EXPECT_EQ(i.use_count(), 1);
+  EXPECT_EQ(ii.use_count(), 1);
+
+  xyz::cow_indirect<int> iii(std::in_place, 7);
+  iii = i;
+  r = 202;
+  EXPECT_EQ(*std::as_const(iii), 101);
+}
+
+TEST(CowIndirectTest, CountAllocations) {
+  unsigned alloc_counter = 0;
+  unsigned dealloc_counter = 0;
+  {
+    xyz::cow_indirect<int, xyz::TrackingAllocator<int>> i(
+        std::allocator_arg,
+        xyz::TrackingAllocator<int>(&alloc_counter, &dealloc_counter),
+        std::in_place, 42);
+    auto ii = i;
+    auto iii = i;
+    EXPECT_EQ(alloc_counter, 1);
+    EXPECT_EQ(*std::as_const(ii), 42);
+    EXPECT_EQ(alloc_counter, 1);
+    *iii = 101;
+    EXPECT_EQ(alloc_counter, 2);
+    EXPECT_EQ(dealloc_counter, 0);
+  }
+  EXPECT_EQ(alloc_counter, 2);
+  EXPECT_EQ(dealloc_counter, 2);
+}
+
+TEST(CowIndirectTest, CopyAssignmentShares) {
+  xyz::cow_indirect<int> i(std::in_place, 42);
+  xyz::cow_indirect<int> ii(std::in_place, 101);
+  ii = i;
+  EXPECT_EQ(&*std::as_const(i), &*std::as_const(ii));
+  EXPECT_EQ(i.use_count(), 2);
+}
+
+TEST(CowIndirectTest, MoveLeavesValueless) {
+  xyz::cow_indirect<int> i(std::in_place, 42);
+  auto ii = i;
+  auto iii = std::move(i);
+  EXPECT_TRUE(
+      i.valueless_after_move());  // NOLINT(clang-analyzer-cplusplus.Move)
+  EXPECT_EQ(i.use_count(), 0);
+  EXPECT_EQ(iii.use_count(), 2);
+  ii = std::move(iii);
+  EXPECT_EQ(ii.use_count(), 1);
+}
+
+TEST(CowIndirectTest, AllocatorsThatDontCompareEqualCopyDeeply) {
+  xyz::TaggedAllocator<int> a(42);
+  xyz::TaggedAllocator<int> aa(101);
+  xyz::cow_indirect<int, xyz::TaggedAllocator<int>> i(std::allocator_arg, a,
+                                                      std::in_place, 42);
+  xyz::cow_indirect<int, xyz::TaggedAllocator<int>> ii(std::allocator_arg, aa,
+                                                       i);
+  EXPECT_EQ(i.use_count(), 1);
+  EXPECT_EQ(ii.use_count(), 1);
+  EXPECT_EQ(ii.get_allocator(), aa);
+  EXPECT_EQ(*std::as_const(ii), 42);
+
+  auto iii = i;
+  xyz::cow_indirect<int, xyz::TaggedAllocator<int>> iv(std::allocator_arg, aa,
+                                                       std::move(i));
+  EXPECT_EQ(iv.use_count(), 1);
+  EXPECT_EQ(iii.use_count(), 1);
+  EXPECT_EQ(*std::as_const(iv), 42);
+}
+
+TEST(CowIndirectTest, ConvertingAssignmentCopiesSharedObject) {
+  xyz::cow_indirect<int> i(std::in_place, 42);
+  auto ii = i;
+  ii = 101;
+  EXPECT_EQ(*std::as_const(i), 42);
+  EXPECT_EQ(*std::as_const(ii), 101);
+}
+
+TEST(CowIndirectTest, Comparison) {
+  xyz::cow_indirect<int> i(std::in_place, 42);
+  xyz::cow_indirect<int> ii(std::in_place, 101);
+  EXPECT_EQ(i, i);
+  EXPECT_NE(i, ii);
+  EXPECT_LT(i, ii);
+  EXPECT_EQ(i, 42);
+  EXPECT_GT(ii, 42);
+}
+
+TEST(CowIndirectTest, Hash) {
+  xyz::cow_indirect<int> i(std::in_place, 42);
+  EXPECT_EQ(std::hash<xyz::cow_indirect<int>>()(i), std::hash<int>()(42));
+}
+
+TEST(CowIndirectTest, Swap) {
+  xyz::cow_indirect<int> i(std::in_place, 42);
+  xyz::cow_indirect<int> ii(std::in_place, 101);
+  swap(i, ii);
+  EXPECT_EQ(*std::as_const(i), 101);
+  EXPECT_EQ(*std::as_const(ii), 42);
+}
+
+TEST(CowIndirectTest, NonAtomicReferenceCount) {
+  using CowInt = xyz::cow_indirect<int, std::allocator<int>,
+                                   xyz::non_atomic_reference_count>;
+  CowInt i(std::in_place, 42);
+  auto ii = i;
+  EXPECT_EQ(i.use_count(), 2);
+  *ii = 101;
+  EXPECT_EQ(*std::as_const(i), 42);
+  EXPECT_EQ(i.use_count(), 1);
+}
+
+TEST(CowIndirectTest, CopiesCanBeUsedFromManyThreads) {
+  const xyz::cow_indirect<std::vector<int>> shared(std::in_place, 1000, 1);
+  std::vector<std::thread> threads;
+  std::vector<int> sums(8);
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&shared, &sums, t] {
+      for (int n = 0; n < 100; ++n) {
+        auto copy = shared;
+        if (n % 2 == 0) {
+          (*copy)[0] = t;
+        }
+        sums[t] += (*std::as_const(copy))[1];
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (int sum : sums) {
+    EXPECT_EQ(sum, 100);
+  }
+  EXPECT_EQ(shared.use_count(), 1);
+  EXPECT_EQ((*shared)[0], 1);
+}
+
+}  // namespace
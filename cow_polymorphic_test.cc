@@ -0,0 +1,211 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+#include "experimental/cow_polymorphic.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "tagged_allocator.h"
+#include "tracking_allocator.h"
+
+namespace {
+
+class Base {
+ public:
+  virtual ~Base() = default;
+  virtual int value() const = 0;
+  virtual void set_value(int) = 0;
+};
+
+class Derived : public Base {
+ private:
+  int value_;
+
+ public:
+  Derived(int v) : value_(v) {}
+
+  Derived() : Derived(0) {}
+
+  int value() const override { return value_; }
+
+  void set_value(int v) override { value_ = v; }
+};
+
+TEST(CowPolymorphicTest, DefaultConstructor) {
+  xyz::cow_polymorphic<Derived> p;
+  EXPECT_EQ(std::as_const(p)->value(), 0);
+  EXPECT_EQ(p.use_count(), 1);
+}
+
+TEST(CowPolymorphicTest, InPlaceConstructor) {
+  xyz::cow_polymorphic<Base> p(std::in_place_type<Derived>, 42);
+  EXPECT_EQ(std::as_const(p)->value(), 42);
+}
+
+TEST(CowPolymorphicTest, CopiesShareTheOwnedObject) {
+  const xyz::cow_polymorphic<Base> p(std::in_place_type<Derived>, 42);
+  const auto pp = p;
+  EXPECT_EQ(&*p, &*pp);
+  EXPECT_EQ(p.use_count(), 2);
+}
+
+TEST(CowPolymorphicTest, NonConstAccessClonesSharedObject) {
+  xyz::cow_polymorphic<Base> p(std::in_place_type<Derived>, 42);
+  auto pp = p;
+  pp->set_value(101);
+  EXPECT_EQ(std::as_const(p)->value(), 42);
+  EXPECT_EQ(std::as_const(pp)->value(), 101);
+  EXPECT_EQ(p.use_count(), 1);
+  EXPECT_EQ(pp.use_count(), 1);
+}
+
+TEST(CowPolymorphicTest, NonConstAccessDoesNotCloneUniqueObject) {
+  xyz::cow_polymorphic<Base> p(std::in_place_type<Derived>, 42);
+  const auto* address = &*std::as_const(p);
+  (*p).set_value(101);
+  EXPECT_EQ(address, &*std::as_const(p));
+}
+
+TEST(CowPolymorphicTest, CopiesAfterNonConstAccessDoNotShare) {
+  xyz::cow_polymorphic<Base> p(std::in_place_type<Derived>, 42);
+  Base& r = *p;
+  auto pp = p;
+  r.set_value(101);
+  EXPECT_EQ(std::as_const(p)->value(), 101);
+  EXPECT_EQ(std::as_const(pp)->value(), 42);
+  EXPECT_EQ(p.use_count(), 1);
+  EXPECT_EQ(pp.use_count(), 1);
+
+  xyz::cow_polymorphic<Base> ppp(std::in_place_type<Derived>, 7);
+  ppp = p;
+  r.set_value(202);
+  EXPECT_EQ(std::as_const(ppp)->value(), 101);
+}
+
+TEST(CowPolymorphicTest, CountAllocations) {
+  unsigned alloc_counter = 0;
+  unsigned dealloc_counter = 0;
+  {
+    xyz::cow_polymorphic<Base, xyz::TrackingAllocator<Base>> p(
+        std::allocator_arg,
+        xyz::TrackingAllocator<Base>(&alloc_counter, &dealloc_counter),
+        std::in_place_type<Derived>, 42);
+    auto pp = p;
+    auto ppp = p;
+    EXPECT_EQ(alloc_counter, 1);
+    EXPECT_EQ(std::as_const(pp)->value(), 42);
+    EXPECT_EQ(alloc_counter, 1);
+    ppp->set_value(101);
+    EXPECT_EQ(alloc_counter, 2);
+    EXPECT_EQ(dealloc_counter, 0);
+  }
+  EXPECT_EQ(alloc_counter, 2);
+  EXPECT_EQ(dealloc_counter, 2);
+}
+
+TEST(CowPolymorphicTest, CopyAssignmentShares) {
+  xyz::cow_polymorphic<Base> p(std::in_place_type<Derived>, 42);
+  xyz::cow_polymorphic<Base> pp(std::in_place_type<Derived>, 101);
+  pp = p;
+  EXPECT_EQ(&*std::as_const(p), &*std::as_const(pp));
+  EXPECT_EQ(p.use_count(), 2);
+}
+
+TEST(CowPolymorphicTest, MoveLeavesValueless) {
+  xyz::cow_polymorphic<Base> p(std::in_place_type<Derived>, 42);
+  auto pp = p;
+  auto ppp = std::move(p);
+  EXPECT_TRUE(
+      p.valueless_after_move());  // NOLINT(clang-analyzer-cplusplus.Move)
+  EXPECT_EQ(p.use_count(), 0);
+  EXPECT_EQ(ppp.use_count(), 2);
+  pp = std::move(ppp);
+  EXPECT_EQ(pp.use_count(), 1);
+}
+
+TEST(CowPolymorphicTest, AllocatorsThatDontCompareEqualCopyDeeply) {
+  xyz::TaggedAllocator<Base> a(42);
+  xyz::TaggedAllocator<Base> aa(101);
+  xyz::cow_polymorphic<Base, xyz::TaggedAllocator<Base>> p(
+      std::allocator_arg, a, std::in_place_type<Derived>, 42);
+  xyz::cow_polymorphic<Base, xyz::TaggedAllocator<Base>> pp(std::allocator_arg,
+                                                            aa, p);
+  EXPECT_EQ(p.use_count(), 1);
+  EXPECT_EQ(pp.use_count(), 1);
+  EXPECT_EQ(pp.get_allocator(), aa);
+  EXPECT_EQ(std::as_const(pp)->value(), 42);
+
+  auto ppp = p;
+  xyz::cow_polymorphic<Base, xyz::TaggedAllocator<Base>> pppp(
+      std::allocator_arg, aa, std::move(p));
+  EXPECT_EQ(pppp.use_count(), 1);
+  EXPECT_EQ(ppp.use_count(), 1);
+  EXPECT_EQ(std::as_const(pppp)->value(), 42);
+}
+
+TEST(CowPolymorphicTest, Swap) {
+  xyz::cow_polymorphic<Base> p(std::in_place_type<Derived>, 42);
+  xyz::cow_polymorphic<Base> pp(std::in_place_type<Derived>, 101);
+  swap(p, pp);
+  EXPECT_EQ(std::as_const(p)->value(), 101);
+  EXPECT_EQ(std::as_const(pp)->value(), 42);
+}
+
+TEST(CowPolymorphicTest, NonAtomicReferenceCount) {
+  using CowBase = xyz::cow_polymorphic<Base, std::allocator<Base>,
+                                       xyz::non_atomic_reference_count>;
+  CowBase p(std::in_place_type<Derived>, 42);
+  auto pp = p;
+  EXPECT_EQ(p.use_count(), 2);
+  pp->set_value(101);
+  EXPECT_EQ(std::as_const(p)->value(), 42);
+  EXPECT_EQ(p.use_count(), 1);
+}
+
+TEST(CowPolymorphicTest, CopiesCanBeUsedFromManyThreads) {
+  const xyz::cow_polymorphic<Base> shared(std::in_place_type<Derived>, 1);
+  std::vector<std::thread> threads;
+  std::vector<int> sums(8);
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&shared, &sums, t] {
+      for (int n = 0; n < 100; ++n) {
+        auto copy = shared;
+        sums[t] += std::as_const(copy)->value();
+        if (n % 2 == 0) {
+          copy->set_value(t);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (int sum : sums) {
+    EXPECT_EQ(sum, 100);
+  }
+  EXPECT_EQ(shared.use_count(), 1);
+  EXPECT_EQ(shared->value(), 1);
+}
+
+}  // namespace
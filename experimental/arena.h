@@ -0,0 +1,212 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+// An experimental request-scoped arena for indirect and polymorphic.
+//
+// An arena hands out memory by bumping a pointer through large blocks and
+// gives it all back at once when it is released or destroyed. Deallocating
+// through an arena_allocator does nothing, so tearing down a request-local
+// object graph costs one destructor call per object and one free per block.
+// arena_allocator declares `releases_in_bulk`, so indirect and polymorphic
+// skip destruction entirely when their value type is trivially destructible.
+//
+// arena_allocator constructs objects with uses-allocator construction, so
+// allocator-aware members of objects it constructs, including nested indirect
+// and polymorphic members and standard containers, draw from the same arena.
+//
+// An arena is not thread-safe. Objects allocated from an arena that are not
+// trivially destructible must be destroyed before the arena is released.
+//
+// compact(v, a) deep-copies a tree of indirect or polymorphic nodes into a
+// single block of an arena. It copies the tree twice: once into a scratch
+// arena to measure it and once into `a`. Nodes are laid out in the order the
+// copy constructs them. A node whose copy constructor copies its children
+// recursively is laid out depth-first. A node that uses copy_children from
+// experimental/recursive_indirect.h has the children of each node laid out
+// next to each other instead.
+
+#ifndef XYZ_ARENA_H_
+#define XYZ_ARENA_H_
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace xyz {
+
+class arena {
+ public:
+  static constexpr std::size_t default_block_size = std::size_t(1) << 16;
+
+  explicit arena(std::size_t block_size = default_block_size) noexcept
+      : block_size_(block_size) {}
+
+  arena(const arena&) = delete;
+  arena& operator=(const arena&) = delete;
+
+  ~arena() { release(); }
+
+  [[nodiscard]] void* allocate(std::size_t bytes, std::size_t alignment) {
+    std::uintptr_t p = align_up(reinterpret_cast<std::uintptr_t>(current_),
+                                alignment);
+    if (current_ == nullptr ||
+        p + bytes > reinterpret_cast<std::uintptr_t>(end_)) {
+      add_block(bytes + alignment);
+      p = align_up(reinterpret_cast<std::uintptr_t>(current_), alignment);
+    }
+    bytes_allocated_ += p + bytes - reinterpret_cast<std::uintptr_t>(current_);
+    current_ = reinterpret_cast<std::byte*>(p + bytes);
+    return reinterpret_cast<void*>(p);
+  }
+
+  // Ensures that allocations totalling `bytes`, including their alignment
+  // padding, are made from a single block.
+  void reserve(std::size_t bytes) {
+    if (current_ != nullptr &&
+        static_cast<std::size_t>(end_ - current_) >= bytes) {
+      return;
+    }
+    add_block(bytes);
+  }
+
+  // Returns all memory allocated from the arena to the system.
+  void release() noexcept {
+    while (blocks_ != nullptr) {
+      block* next = blocks_->next_;
+      ::operator delete(static_cast<void*>(blocks_), blocks_->size_);
+      blocks_ = next;
+    }
+    current_ = nullptr;
+    end_ = nullptr;
+    block_count_ = 0;
+    bytes_allocated_ = 0;
+  }
+
+  // The number of blocks requested from the system since the last release.
+  [[nodiscard]] std::size_t block_count() const noexcept {
+    return block_count_;
+  }
+
+  // The number of bytes allocated since the last release, including
+  // alignment padding but not the unused ends of full blocks.
+  [[nodiscard]] std::size_t bytes_allocated() const noexcept {
+    return bytes_allocated_;
+  }
+
+ private:
+  struct alignas(std::max_align_t) block {
+    block* next_;
+    std::size_t size_;
+  };
+
+  block* blocks_ = nullptr;
+  std::byte* current_ = nullptr;
+  std::byte* end_ = nullptr;
+  std::size_t block_count_ = 0;
+  std::size_t bytes_allocated_ = 0;
+  std::size_t block_size_;
+
+  static std::uintptr_t align_up(std::uintptr_t p,
+                                 std::size_t alignment) noexcept {
+    return (p + alignment - 1) & ~(std::uintptr_t(alignment) - 1);
+  }
+
+  void add_block(std::size_t min_bytes) {
+    std::size_t bytes =
+        sizeof(block) + (min_bytes > block_size_ ? min_bytes : block_size_);
+    block* b = static_cast<block*>(::operator new(bytes));
+    b->next_ = blocks_;
+    b->size_ = bytes;
+    blocks_ = b;
+    ++block_count_;
+    current_ = reinterpret_cast<std::byte*>(b + 1);
+    end_ = reinterpret_cast<std::byte*>(b) + bytes;
+  }
+};
+
+template <class T>
+class arena_allocator {
+  arena* arena_;
+
+  template <class U>
+  friend class arena_allocator;
+
+ public:
+  using value_type = T;
+  using releases_in_bulk = std::true_type;
+
+  explicit arena_allocator(arena& a) noexcept : arena_(&a) {}
+
+  template <class U>
+  arena_allocator(const arena_allocator<U>& other) noexcept
+      : arena_(other.arena_) {}
+
+  [[nodiscard]] T* allocate(std::size_t n) {
+    return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  // Memory is reclaimed when the arena is released.
+  void deallocate(T*, std::size_t) noexcept {}
+
+  template <class U, class... Ts>
+  void construct(U* p, Ts&&... ts) {
+    std::uninitialized_construct_using_allocator(p, *this,
+                                                 std::forward<Ts>(ts)...);
+  }
+
+  [[nodiscard]] arena* get_arena() const noexcept { return arena_; }
+
+  template <class U>
+  friend bool operator==(const arena_allocator& lhs,
+                         const arena_allocator<U>& rhs) noexcept {
+    return lhs.get_arena() == rhs.get_arena();
+  }
+};
+
+// Returns a deep copy of `v` allocated from a single block of `a`. V is an
+// allocator-aware value type, such as an indirect or polymorphic, whose
+// allocator can be constructed from an arena.
+//
+// The size of the copy is measured by first copying `v` into a scratch arena,
+// so compacting costs two copies. Copies of the result stay in `a`.
+template <class V>
+[[nodiscard]] V compact(const V& v, arena& a)
+  requires std::constructible_from<typename V::allocator_type, arena&>
+{
+  using allocator_type = typename V::allocator_type;
+  std::size_t bytes = 0;
+  {
+    arena scratch;
+    V probe(std::allocator_arg, allocator_type(scratch), v);
+    // Each new block can change the padding before its first allocation.
+    bytes = scratch.bytes_allocated() +
+            scratch.block_count() * alignof(std::max_align_t);
+  }
+  a.reserve(bytes);
+  return V(std::allocator_arg, allocator_type(a), v);
+}
+
+}  // namespace xyz
+
+#endif  // XYZ_ARENA_H_
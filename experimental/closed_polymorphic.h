@@ -0,0 +1,299 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+// An experimental sibling of polymorphic for a closed set of derived types.
+//
+// closed_polymorphic<T, Us...> owns an object of one of the types `Us`, each
+// of which derives from T. The object is stored inline in storage large
+// enough for the largest alternative, so no allocation is made. Copy, move
+// and destroy dispatch on a compact index with a switch rather than through a
+// control block. The owned object is accessed as a T through operator* and
+// operator->.
+//
+// As with polymorphic, a closed_polymorphic that has been moved from is
+// valueless.
+
+#ifndef XYZ_CLOSED_POLYMORPHIC_H_
+#define XYZ_CLOSED_POLYMORPHIC_H_
+
+#include <algorithm>
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace xyz {
+
+namespace detail {
+
+template <class U, class... Us>
+inline constexpr std::size_t closed_index_of = [] {
+  constexpr bool matches[] = {std::same_as<U, Us>...};
+  for (std::size_t i = 0; i < sizeof...(Us); ++i) {
+    if (matches[i]) return i;
+  }
+  return sizeof...(Us);
+}();
+
+template <class U, class... Us>
+concept one_of = (std::same_as<U, Us> || ...);
+
+}  // namespace detail
+
+template <class T, class... Us>
+class closed_polymorphic {
+  static_assert(sizeof...(Us) > 0);
+  static_assert((std::derived_from<Us, T> && ...));
+  static_assert((std::copy_constructible<Us> && ...));
+  static_assert((std::same_as<std::remove_cvref_t<Us>, Us> && ...));
+
+ public:
+  using index_type = std::conditional_t<
+      (sizeof...(Us) < std::numeric_limits<std::uint8_t>::max()),
+      std::uint8_t, std::uint16_t>;
+
+  // The index of a valueless closed_polymorphic.
+  static constexpr index_type npos = static_cast<index_type>(sizeof...(Us));
+
+ private:
+  template <std::size_t I>
+  using alternative = std::tuple_element_t<I, std::tuple<Us...>>;
+
+  alignas(Us...) std::byte storage_[std::max({sizeof(Us)...})];
+  index_type index_ = npos;
+
+  template <class U>
+  U* as() noexcept {
+    return std::launder(reinterpret_cast<U*>(storage_));
+  }
+
+  template <class U>
+  const U* as() const noexcept {
+    return std::launder(reinterpret_cast<const U*>(storage_));
+  }
+
+  // Calls f.template operator()<U>() where U is the owned object's type.
+  // The fold over `Is` compiles to a switch on the index.
+  template <class F>
+  static decltype(auto) dispatch(index_type index, F&& f) {
+    return dispatch_impl(index, std::forward<F>(f),
+                         std::index_sequence_for<Us...>{});
+  }
+
+  template <class F, std::size_t... Is>
+  static decltype(auto) dispatch_impl(index_type index, F&& f,
+                                      std::index_sequence<Is...>) {
+    using R = decltype(f.template operator()<alternative<0>>());
+    if constexpr (std::is_void_v<R>) {
+      ((index == Is ? (f.template operator()<alternative<Is>>(), true)
+                    : false) ||
+       ...);
+    } else {
+      R r{};
+      ((index == Is ? (r = f.template operator()<alternative<Is>>(), true)
+                    : false) ||
+       ...);
+      return r;
+    }
+  }
+
+  template <class U, class... Ts>
+  void construct(Ts&&... ts) {
+    ::new (static_cast<void*>(storage_)) U(std::forward<Ts>(ts)...);
+    index_ = static_cast<index_type>(detail::closed_index_of<U, Us...>);
+  }
+
+  void copy_from(const closed_polymorphic& other) {
+    dispatch(other.index_, [&]<class U>() { construct<U>(*other.as<U>()); });
+  }
+
+  void move_from(closed_polymorphic& other) {
+    dispatch(other.index_,
+             [&]<class U>() { construct<U>(std::move(*other.as<U>())); });
+    other.reset();
+  }
+
+  void reset() noexcept {
+    if (index_ == npos) return;
+    dispatch(index_, [this]<class U>() noexcept { std::destroy_at(as<U>()); });
+    index_ = npos;
+  }
+
+ public:
+  using value_type = T;
+  using pointer = T*;
+  using const_pointer = const T*;
+
+  //
+  // Constructors.
+  //
+
+  constexpr closed_polymorphic()
+    requires std::default_initializable<alternative<0>>
+  {
+    construct<alternative<0>>();
+  }
+
+  template <class U>
+  constexpr explicit closed_polymorphic(U&& u)
+    requires detail::one_of<std::remove_cvref_t<U>, Us...>
+  {
+    construct<std::remove_cvref_t<U>>(std::forward<U>(u));
+  }
+
+  template <class U, class... Ts>
+  explicit constexpr closed_polymorphic(std::in_place_type_t<U>, Ts&&... ts)
+    requires detail::one_of<U, Us...> && std::constructible_from<U, Ts&&...>
+  {
+    construct<U>(std::forward<Ts>(ts)...);
+  }
+
+  template <class U, class I, class... Ts>
+  explicit constexpr closed_polymorphic(std::in_place_type_t<U>,
+                                        std::initializer_list<I> ilist,
+                                        Ts&&... ts)
+    requires detail::one_of<U, Us...> &&
+             std::constructible_from<U, std::initializer_list<I>, Ts&&...>
+  {
+    construct<U>(ilist, std::forward<Ts>(ts)...);
+  }
+
+  constexpr closed_polymorphic(const closed_polymorphic& other) {
+    if (!other.valueless_after_move()) copy_from(other);
+  }
+
+  constexpr closed_polymorphic(closed_polymorphic&& other) noexcept(
+      (std::is_nothrow_move_constructible_v<Us> && ...)) {
+    if (!other.valueless_after_move()) move_from(other);
+  }
+
+  //
+  // Destructor.
+  //
+
+  constexpr ~closed_polymorphic() { reset(); }
+
+  //
+  // Assignment operators.
+  //
+
+  constexpr closed_polymorphic& operator=(const closed_polymorphic& other) {
+    if (this == &other) return *this;
+    if (other.valueless_after_move()) {
+      reset();
+    } else {
+      // Copying could throw so copy before destroying the owned object.
+      closed_polymorphic tmp(other);
+      reset();
+      move_from(tmp);
+    }
+    return *this;
+  }
+
+  constexpr closed_polymorphic& operator=(closed_polymorphic&& other) noexcept(
+      (std::is_nothrow_move_constructible_v<Us> && ...)) {
+    if (this == &other) return *this;
+    reset();
+    if (!other.valueless_after_move()) move_from(other);
+    return *this;
+  }
+
+  //
+  // Accessors.
+  //
+
+  [[nodiscard]] constexpr pointer operator->() noexcept {
+    assert(!valueless_after_move());  // LCOV_EXCL_LINE
+    return dispatch(index_, [this]<class U>() -> T* { return as<U>(); });
+  }
+
+  [[nodiscard]] constexpr const_pointer operator->() const noexcept {
+    assert(!valueless_after_move());  // LCOV_EXCL_LINE
+    return dispatch(index_,
+                    [this]<class U>() -> const T* { return as<U>(); });
+  }
+
+  [[nodiscard]] constexpr T& operator*() noexcept { return *operator->(); }
+
+  [[nodiscard]] constexpr const T& operator*() const noexcept {
+    return *operator->();
+  }
+
+  [[nodiscard]] constexpr bool valueless_after_move() const noexcept {
+    return index_ == npos;
+  }
+
+  // Returns the position of the owned object's type in `Us`, or npos if
+  // valueless.
+  [[nodiscard]] constexpr index_type index() const noexcept { return index_; }
+
+  template <class U>
+  [[nodiscard]] constexpr U* get_if() noexcept
+    requires detail::one_of<U, Us...>
+  {
+    return index_ == detail::closed_index_of<U, Us...> ? as<U>() : nullptr;
+  }
+
+  template <class U>
+  [[nodiscard]] constexpr const U* get_if() const noexcept
+    requires detail::one_of<U, Us...>
+  {
+    return index_ == detail::closed_index_of<U, Us...> ? as<U>() : nullptr;
+  }
+
+  //
+  // Modifiers.
+  //
+
+  // Destroys the owned object and constructs a U in its place. If the
+  // constructor throws, this closed_polymorphic is valueless.
+  template <class U, class... Ts>
+  constexpr U& emplace(Ts&&... ts)
+    requires detail::one_of<U, Us...> && std::constructible_from<U, Ts&&...>
+  {
+    reset();
+    construct<U>(std::forward<Ts>(ts)...);
+    return *as<U>();
+  }
+
+  constexpr void swap(closed_polymorphic& other) noexcept(
+      (std::is_nothrow_move_constructible_v<Us> && ...)) {
+    closed_polymorphic tmp(std::move(other));
+    other = std::move(*this);
+    *this = std::move(tmp);
+  }
+
+  friend constexpr void swap(
+      closed_polymorphic& lhs,
+      closed_polymorphic& rhs) noexcept(noexcept(lhs.swap(rhs))) {
+    lhs.swap(rhs);
+  }
+};
+
+}  // namespace xyz
+
+#endif  // XYZ_CLOSED_POLYMORPHIC_H_
@@ -0,0 +1,2 @@
+// A cc file for cow_indirect to ensure that the header file can be compiled.
+#include "experimental/cow_indirect.h"  // NOLINT
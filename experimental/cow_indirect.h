@@ -0,0 +1,522 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+// An experimental copy-on-write sibling of indirect.
+//
+// Copies share a single reference-counted allocation when their allocators
+// compare equal. Const access never copies; the first non-const access to an
+// object that is shared makes a deep copy with the allocator of the
+// cow_indirect being accessed. The reference-count policy `R` is one of the
+// policies in reference_count.h.
+//
+// A non-const access hands out a reference that may be used after the
+// cow_indirect is copied, so it also marks the owned object as unshareable:
+// later copies make a deep copy rather than sharing an object that could be
+// written to through that reference. The object stays unshareable until it
+// is released.
+
+#ifndef XYZ_COW_INDIRECT_H_
+#define XYZ_COW_INDIRECT_H_
+
+#include <cassert>
+#include <compare>
+#include <concepts>
+#include <initializer_list>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "experimental/reference_count.h"
+#include "indirect.h"
+
+namespace xyz {
+
+template <class T, class A = std::allocator<T>,
+          class R = atomic_reference_count>
+class cow_indirect;
+
+template <class>
+inline constexpr bool is_cow_indirect_v = false;
+
+template <class T, class A, class R>
+inline constexpr bool is_cow_indirect_v<cow_indirect<T, A, R>> = true;
+
+template <class T, class A, class R>
+class cow_indirect {
+  using allocator_traits = std::allocator_traits<A>;
+
+  struct shared_object {
+    R count_;
+    bool shareable_ = true;
+
+    union uninitialized_storage {
+      T t_;
+
+      constexpr uninitialized_storage() {}
+
+      constexpr ~uninitialized_storage() {}
+    } storage_;
+
+    // A user-provided constructor avoids zero-initializing the storage.
+    constexpr shared_object() {}
+  };
+
+  using so_allocator = typename std::allocator_traits<
+      A>::template rebind_alloc<shared_object>;
+  using so_alloc_traits = std::allocator_traits<so_allocator>;
+  using so_pointer = typename so_alloc_traits::pointer;
+
+ public:
+  using value_type = T;
+  using allocator_type = A;
+  using pointer = typename allocator_traits::pointer;
+  using const_pointer = typename allocator_traits::const_pointer;
+  using reference_count_type = R;
+
+  //
+  // Constructors.
+  //
+
+  explicit constexpr cow_indirect()
+    requires std::default_initializable<A>
+      : alloc_() {
+    static_assert(std::default_initializable<T>);
+    p_ = construct_from(alloc_);
+  }
+
+  template <class U = T>
+  explicit constexpr cow_indirect(U&& u)
+    requires(!std::same_as<std::remove_cvref_t<U>, cow_indirect> &&
+             !std::same_as<std::remove_cvref_t<U>, std::in_place_t> &&
+             std::constructible_from<T, U> && std::default_initializable<A>)
+      : alloc_() {
+    p_ = construct_from(alloc_, std::forward<U>(u));
+  }
+
+  template <class... Us>
+  explicit constexpr cow_indirect(std::in_place_t, Us&&... us)
+    requires std::constructible_from<T, Us&&...> &&
+             std::default_initializable<A>
+      : alloc_() {
+    p_ = construct_from(alloc_, std::forward<Us>(us)...);
+  }
+
+  template <class U = T, class... Us>
+  explicit constexpr cow_indirect(std::in_place_t,
+                                  std::initializer_list<U> ilist, Us&&... us)
+    requires std::constructible_from<T, std::initializer_list<U>&, Us...> &&
+             std::default_initializable<A>
+      : alloc_() {
+    p_ = construct_from(alloc_, ilist, std::forward<Us>(us)...);
+  }
+
+  constexpr cow_indirect(const cow_indirect& other)
+      : cow_indirect(std::allocator_arg,
+                     allocator_traits::select_on_container_copy_construction(
+                         other.alloc_),
+                     other) {}
+
+  constexpr cow_indirect(cow_indirect&& other) noexcept(
+      allocator_traits::is_always_equal::value)
+      : cow_indirect(std::allocator_arg, other.alloc_, std::move(other)) {}
+
+  //
+  // Allocator-extended constructors.
+  //
+
+  explicit constexpr cow_indirect(std::allocator_arg_t, const A& alloc)
+      : alloc_(alloc) {
+    p_ = construct_from(alloc_);
+  }
+
+  template <class U = T>
+  explicit constexpr cow_indirect(std::allocator_arg_t, const A& alloc, U&& u)
+    requires(!std::same_as<std::remove_cvref_t<U>, cow_indirect> &&
+             !std::same_as<std::remove_cvref_t<U>, std::in_place_t> &&
+             std::constructible_from<T, U>)
+      : alloc_(alloc) {
+    p_ = construct_from(alloc_, std::forward<U>(u));
+  }
+
+  template <class... Us>
+  explicit constexpr cow_indirect(std::allocator_arg_t, const A& alloc,
+                                  std::in_place_t, Us&&... us)
+    requires std::constructible_from<T, Us&&...>
+      : alloc_(alloc) {
+    p_ = construct_from(alloc_, std::forward<Us>(us)...);
+  }
+
+  template <class U = T, class... Us>
+  explicit constexpr cow_indirect(std::allocator_arg_t, const A& alloc,
+                                  std::in_place_t,
+                                  std::initializer_list<U> ilist, Us&&... us)
+    requires std::constructible_from<T, std::initializer_list<U>&, Us...>
+      : alloc_(alloc) {
+    p_ = construct_from(alloc_, ilist, std::forward<Us>(us)...);
+  }
+
+  constexpr cow_indirect(std::allocator_arg_t, const A& alloc,
+                         const cow_indirect& other)
+      : alloc_(alloc) {
+    static_assert(std::copy_constructible<T>);
+
+    if (other.valueless_after_move()) {
+      p_ = nullptr;
+    } else if (alloc_ == other.alloc_ && other.p_->shareable_) {
+      p_ = share(other.p_);
+    } else {
+      p_ = construct_from(alloc_, *other);
+    }
+  }
+
+  constexpr cow_indirect(
+      std::allocator_arg_t, const A& alloc,
+      cow_indirect&& other) noexcept(allocator_traits::is_always_equal::value)
+      : p_(nullptr), alloc_(alloc) {
+    if constexpr (allocator_traits::is_always_equal::value) {
+      std::swap(p_, other.p_);
+    } else {
+      if (alloc_ == other.alloc_) {
+        std::swap(p_, other.p_);
+      } else {
+        if (!other.valueless_after_move()) {
+          p_ = take_value_from(alloc_, other);
+          other.reset();
+        }
+      }
+    }
+  }
+
+  //
+  // Destructor.
+  //
+
+  constexpr ~cow_indirect() { reset(); }
+
+  //
+  // Assignment.
+  //
+
+  constexpr cow_indirect& operator=(const cow_indirect& other) {
+    static_assert(std::copy_constructible<T>);
+
+    if (this == &other) return *this;
+
+    // Check to see if the allocators need to be updated.
+    // We defer actually updating the allocator until later because it may be
+    // needed to release the current shared object.
+    bool update_alloc =
+        allocator_traits::propagate_on_container_copy_assignment::value;
+
+    if (other.valueless_after_move()) {
+      reset();
+    } else {
+      const A& alloc = update_alloc ? other.alloc_ : alloc_;
+      // Constructing a new object could throw so we need to defer resetting
+      // or updating allocators until this is done.
+      auto tmp = alloc == other.alloc_ && other.p_->shareable_
+                     ? share(other.p_)
+                     : construct_from(alloc, *other);
+      reset();
+      p_ = tmp;
+    }
+    if (update_alloc) {
+      alloc_ = other.alloc_;
+    }
+    return *this;
+  }
+
+  constexpr cow_indirect& operator=(cow_indirect&& other) noexcept(
+      allocator_traits::propagate_on_container_move_assignment::value ||
+      allocator_traits::is_always_equal::value) {
+    if (this == &other) return *this;
+
+    // Check to see if the allocators need to be updated.
+    // We defer actually updating the allocator until later because it may be
+    // needed to release the current shared object.
+    bool update_alloc =
+        allocator_traits::propagate_on_container_move_assignment::value;
+
+    if (other.valueless_after_move()) {
+      reset();
+    } else {
+      if (alloc_ == other.alloc_) {
+        std::swap(p_, other.p_);
+        other.reset();
+      } else {
+        // Constructing a new object could throw so we need to defer resetting
+        // or updating allocators until this is done.
+        auto tmp = take_value_from(update_alloc ? other.alloc_ : alloc_, other);
+        reset();
+        other.reset();
+        p_ = tmp;
+      }
+    }
+    if (update_alloc) {
+      alloc_ = other.alloc_;
+    }
+    return *this;
+  }
+
+  template <class U>
+  constexpr cow_indirect& operator=(U&& u)
+    requires(!std::same_as<std::remove_cvref_t<U>, cow_indirect> &&
+             std::constructible_from<T, U> && std::assignable_from<T&, U>)
+  {
+    if (valueless_after_move()) {
+      p_ = construct_from(alloc_, std::forward<U>(u));
+    } else if (is_unique()) {
+      p_->storage_.t_ = std::forward<U>(u);
+    } else {
+      auto tmp = construct_from(alloc_, std::forward<U>(u));
+      reset();
+      p_ = tmp;
+    }
+    return *this;
+  }
+
+  //
+  // Accessors.
+  //
+  // Non-const accessors make a deep copy if the object is shared and can
+  // throw.
+  //
+
+  [[nodiscard]] constexpr const T& operator*() const& noexcept {
+    assert(!valueless_after_move());  // LCOV_EXCL_LINE
+    return p_->storage_.t_;
+  }
+
+  [[nodiscard]] constexpr T& operator*() & {
+    assert(!valueless_after_move());  // LCOV_EXCL_LINE
+    detach();
+    return p_->storage_.t_;
+  }
+
+  [[nodiscard]] constexpr T&& operator*() && {
+    assert(!valueless_after_move());  // LCOV_EXCL_LINE
+    detach();
+    return std::move(p_->storage_.t_);
+  }
+
+  [[nodiscard]] constexpr const T&& operator*() const&& noexcept {
+    assert(!valueless_after_move());  // LCOV_EXCL_LINE
+    return std::move(p_->storage_.t_);
+  }
+
+  [[nodiscard]] constexpr const_pointer operator->() const noexcept {
+    assert(!valueless_after_move());  // LCOV_EXCL_LINE
+    return std::pointer_traits<const_pointer>::pointer_to(p_->storage_.t_);
+  }
+
+  [[nodiscard]] constexpr pointer operator->() {
+    assert(!valueless_after_move());  // LCOV_EXCL_LINE
+    detach();
+    return std::pointer_traits<pointer>::pointer_to(p_->storage_.t_);
+  }
+
+  [[nodiscard]] constexpr bool valueless_after_move() const noexcept {
+    return p_ == nullptr;
+  }
+
+  // Returns the number of cow_indirect objects sharing the owned object, or
+  // zero if valueless.
+  [[nodiscard]] constexpr std::size_t use_count() const noexcept {
+    return p_ == nullptr ? 0 : p_->count_.count();
+  }
+
+  constexpr allocator_type get_allocator() const noexcept { return alloc_; }
+
+  //
+  // Modifiers.
+  //
+
+  constexpr void swap(cow_indirect& other) noexcept(
+      std::allocator_traits<A>::propagate_on_container_swap::value ||
+      std::allocator_traits<A>::is_always_equal::value) {
+    if constexpr (allocator_traits::propagate_on_container_swap::value) {
+      // If allocators move with their allocated objects, we can swap both.
+      std::swap(alloc_, other.alloc_);
+      std::swap(p_, other.p_);
+      return;
+    } else /* constexpr */ {
+      if (alloc_ == other.alloc_) {
+        std::swap(p_, other.p_);
+      } else {
+        unreachable();  // LCOV_EXCL_LINE
+      }
+    }
+  }
+
+  friend constexpr void swap(cow_indirect& lhs, cow_indirect& rhs) noexcept(
+      noexcept(lhs.swap(rhs))) {
+    lhs.swap(rhs);
+  }
+
+  //
+  // Comparison operators.
+  //
+
+  template <class U, class AA, class RR>
+  [[nodiscard]] friend constexpr bool operator==(
+      const cow_indirect& lhs,
+      const cow_indirect<U, AA, RR>& rhs) noexcept(noexcept(*lhs == *rhs)) {
+    if (lhs.valueless_after_move()) {
+      return rhs.valueless_after_move();
+    }
+    if (rhs.valueless_after_move()) {
+      return false;
+    }
+    return *lhs == *rhs;
+  }
+
+  template <class U>
+  [[nodiscard]] friend constexpr bool operator==(
+      const cow_indirect& lhs, const U& rhs) noexcept(noexcept(*lhs == rhs))
+    requires(!is_cow_indirect_v<U>)
+  {
+    if (lhs.valueless_after_move()) {
+      return false;
+    }
+    return *lhs == rhs;
+  }
+
+  template <class U, class AA, class RR>
+  [[nodiscard]] friend constexpr auto operator<=>(
+      const cow_indirect& lhs, const cow_indirect<U, AA, RR>& rhs)
+      -> detail::synth_three_way_result<T, U> {
+    if (lhs.valueless_after_move() || rhs.valueless_after_move()) {
+      return !lhs.valueless_after_move() <=> !rhs.valueless_after_move();
+    }
+    return detail::synth_three_way(*lhs, *rhs);
+  }
+
+  template <class U>
+  [[nodiscard]] friend constexpr auto operator<=>(const cow_indirect& lhs,
+                                                  const U& rhs) -> auto
+    requires(!is_cow_indirect_v<U>)
+  {
+    // Define and call a lambda to allow requirements to be checked before
+    // the return type is determined.
+    // This avoids a recursive check inside __partially_ordered_with.
+    return [](const auto& lhs,
+              const auto& rhs) -> detail::synth_three_way_result<T, U> {
+      if (lhs.valueless_after_move()) {
+        return std::strong_ordering::less;
+      }
+      return detail::synth_three_way(*lhs, rhs);
+    }(lhs, rhs);
+  }
+
+ private:
+  so_pointer p_;
+
+#if defined(_MSC_VER)
+  // https://devblogs.microsoft.com/cppblog/msvc-cpp20-and-the-std-cpp20-switch/#msvc-extensions-and-abi
+  [[msvc::no_unique_address]] A alloc_;
+#else
+  [[no_unique_address]] A alloc_;
+#endif
+
+  [[nodiscard]] constexpr bool is_unique() const noexcept {
+    return p_->count_.count() == 1;
+  }
+
+  // Makes the owned object unique to this cow_indirect by copying it if it is
+  // shared, and marks it unshareable as a reference to it is about to be
+  // handed out.
+  constexpr void detach() {
+    if (!is_unique()) {
+      auto tmp = construct_from(alloc_, std::as_const(p_->storage_.t_));
+      reset();
+      p_ = tmp;
+    }
+    p_->shareable_ = false;
+  }
+
+  constexpr void reset() noexcept {
+    if (p_ == nullptr) return;
+    release(alloc_, p_);
+    p_ = nullptr;
+  }
+
+  [[nodiscard]] constexpr static so_pointer share(so_pointer p) noexcept {
+    p->count_.increment();
+    return p;
+  }
+
+  // Constructs a new shared object from the value owned by `other`. The value
+  // is moved if `other` is its only owner and copied otherwise.
+  [[nodiscard]] constexpr static so_pointer take_value_from(
+      A alloc, cow_indirect& other) {
+    if (other.is_unique()) {
+      return construct_from(alloc, std::move(other.p_->storage_.t_));
+    }
+    return construct_from(alloc, std::as_const(other.p_->storage_.t_));
+  }
+
+  template <typename... Ts>
+  [[nodiscard]] constexpr static so_pointer construct_from(A alloc,
+                                                          Ts&&... ts) {
+    so_allocator so_alloc(alloc);
+    so_pointer mem = so_alloc_traits::allocate(so_alloc, 1);
+    try {
+      std::construct_at(std::to_address(mem));
+      allocator_traits::construct(alloc, std::addressof(mem->storage_.t_),
+                                  std::forward<Ts>(ts)...);
+      return mem;
+    } catch (...) {
+      std::destroy_at(std::to_address(mem));
+      so_alloc_traits::deallocate(so_alloc, mem, 1);
+      throw;
+    }
+  }
+
+  constexpr static void release(A alloc, so_pointer p) noexcept {
+    if (!p->count_.decrement()) return;
+    allocator_traits::destroy(alloc, std::addressof(p->storage_.t_));
+    std::destroy_at(std::to_address(p));
+    so_allocator so_alloc(alloc);
+    so_alloc_traits::deallocate(so_alloc, p, 1);
+  }
+};
+
+template <typename Value>
+cow_indirect(Value) -> cow_indirect<Value>;
+
+template <typename Alloc, typename Value>
+cow_indirect(std::allocator_arg_t, Alloc, Value) -> cow_indirect<
+    Value, typename std::allocator_traits<Alloc>::template rebind_alloc<Value>>;
+
+}  // namespace xyz
+
+template <class T, class Alloc, class R>
+  requires xyz::is_hashable<T>
+struct std::hash<xyz::cow_indirect<T, Alloc, R>> {
+  constexpr std::size_t operator()(
+      const xyz::cow_indirect<T, Alloc, R>& key) const {
+    if (key.valueless_after_move()) {
+      return static_cast<std::size_t>(-1);  // Implementation defined value.
+    }
+    return std::hash<T>{}(*key);
+  }
+};
+
+#endif  // XYZ_COW_INDIRECT_H_
@@ -0,0 +1,2 @@
+// A cc file for cow_polymorphic to ensure that the header file can be compiled.
+#include "experimental/cow_polymorphic.h"  // NOLINT
@@ -0,0 +1,94 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+// An experimental algorithm that groups a range of polymorphic objects by the
+// type of the object each one owns.
+//
+// It works with any polymorphic that has a type_id(): the one in polymorphic.h
+// and the one in polymorphic_no_vtable.h. It is kept out of those headers so
+// that they do not pull in <algorithm>, <numeric> and <vector>.
+
+#ifndef XYZ_GROUP_BY_DYNAMIC_TYPE_H_
+#define XYZ_GROUP_BY_DYNAMIC_TYPE_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+namespace xyz {
+
+// Reorders the polymorphic objects in [first, last) so that objects of the
+// same type are adjacent. Groups are ordered by the first appearance of their
+// type, and objects within a group keep their relative order. Valueless
+// objects form a group of their own.
+//
+// Types are compared with type_id() and objects are moved into place by
+// swapping, so no owned object is copied or moved. As with swap, the
+// allocators of the objects must compare equal unless they propagate on swap.
+//
+// Virtual calls made while iterating over a grouped range go to the same
+// target until the type changes, which indirect branch predictors handle far
+// better than a random interleaving of types.
+template <class I, class S>
+void group_by_dynamic_type(I first, S last) {
+  static_assert(std::random_access_iterator<I> &&
+                std::sized_sentinel_for<S, I>);
+  using type_id_type = typename std::iter_value_t<I>::type_id_type;
+
+  const auto n = static_cast<std::size_t>(last - first);
+  std::vector<type_id_type> types;
+  std::vector<std::size_t> counts;
+  // The group of each object, later replaced by its destination.
+  std::vector<std::size_t> dest(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    type_id_type type = first[i].type_id();
+    auto g = static_cast<std::size_t>(
+        std::find(types.begin(), types.end(), type) - types.begin());
+    if (g == types.size()) {
+      types.push_back(type);
+      counts.push_back(0);
+    }
+    ++counts[g];
+    dest[i] = g;
+  }
+  if (types.size() < 2) return;
+
+  std::exclusive_scan(counts.begin(), counts.end(), counts.begin(),
+                      std::size_t{0});
+  for (auto& d : dest) {
+    d = counts[d]++;
+  }
+
+  // Each swap puts one object in its final position.
+  for (std::size_t i = 0; i < n; ++i) {
+    while (dest[i] != i) {
+      std::size_t j = dest[i];
+      std::iter_swap(first + i, first + j);
+      std::swap(dest[i], dest[j]);
+    }
+  }
+}
+
+}  // namespace xyz
+
+#endif  // XYZ_GROUP_BY_DYNAMIC_TYPE_H_
@@ -0,0 +1,2 @@
+// A cc file for indirect_sbo to ensure that the header file can be compiled.
+#include "experimental/indirect_sbo.h"  // NOLINT
@@ -0,0 +1,268 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+// An experimental thread-safe instrumented allocator for indirect and
+// polymorphic.
+//
+// instrumented_allocator forwards to an upstream allocator and records every
+// allocation and deallocation in an allocation_stats: counts, bytes, live and
+// peak bytes and a histogram of allocation sizes. Unlike the test helper
+// TrackingAllocator it is safe to use from several threads at once.
+//
+// Counts, bytes and the histogram are kept in shards, one of which is picked
+// for each thread, so that threads do not contend on the same cache lines.
+// Live allocations, live bytes and peak bytes need a single total and are kept
+// in shared atomics.
+// A snapshot sums the shards with relaxed loads; it is exact when no thread
+// is allocating while it is taken.
+
+#ifndef XYZ_INSTRUMENTED_ALLOCATOR_H_
+#define XYZ_INSTRUMENTED_ALLOCATOR_H_
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <type_traits>
+
+namespace xyz {
+
+// The state of an allocation_stats at the time it was taken.
+struct allocation_snapshot {
+  static constexpr std::size_t size_class_count = 16;
+
+  std::uint64_t allocations = 0;
+  std::uint64_t deallocations = 0;
+  std::uint64_t bytes_allocated = 0;
+  std::uint64_t bytes_deallocated = 0;
+  std::int64_t live_allocations = 0;
+  std::int64_t live_bytes = 0;
+  std::int64_t peak_bytes = 0;
+  // Size class `i` counts allocations of up to `16 << i` bytes. The last size
+  // class also counts every larger allocation.
+  std::array<std::uint64_t, size_class_count> size_histogram{};
+
+  static constexpr std::size_t size_class(std::size_t bytes) noexcept {
+    if (bytes <= 16) return 0;
+    std::size_t c = static_cast<std::size_t>(std::bit_width(bytes - 1)) - 4;
+    return c < size_class_count ? c : size_class_count - 1;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os,
+                                  const allocation_snapshot& s) {
+    os << "allocations: " << s.allocations
+       << ", deallocations: " << s.deallocations
+       << ", bytes allocated: " << s.bytes_allocated
+       << ", bytes deallocated: " << s.bytes_deallocated
+       << ", live allocations: " << s.live_allocations
+       << ", live bytes: " << s.live_bytes
+       << ", peak bytes: " << s.peak_bytes << "\n";
+    for (std::size_t i = 0; i < size_class_count; ++i) {
+      if (s.size_histogram[i] == 0) continue;
+      if (i + 1 == size_class_count) {
+        os << "  > " << (std::size_t(16) << (i - 1));
+      } else {
+        os << "  <= " << (std::size_t(16) << i);
+      }
+      os << " bytes: " << s.size_histogram[i] << "\n";
+    }
+    return os;
+  }
+};
+
+class allocation_stats {
+ public:
+  static constexpr std::size_t size_class_count =
+      allocation_snapshot::size_class_count;
+  static constexpr std::size_t shard_count = 16;
+
+  allocation_stats() = default;
+  allocation_stats(const allocation_stats&) = delete;
+  allocation_stats& operator=(const allocation_stats&) = delete;
+
+  void record_allocation(std::size_t bytes) noexcept {
+    shard& s = shards_[this_thread_shard()];
+    s.allocations_.fetch_add(1, std::memory_order_relaxed);
+    s.bytes_allocated_.fetch_add(bytes, std::memory_order_relaxed);
+    s.size_histogram_[allocation_snapshot::size_class(bytes)].fetch_add(
+        1, std::memory_order_relaxed);
+    live_allocations_.fetch_add(1, std::memory_order_relaxed);
+
+    auto live = live_bytes_.fetch_add(static_cast<std::int64_t>(bytes),
+                                      std::memory_order_relaxed) +
+                static_cast<std::int64_t>(bytes);
+    auto peak = peak_bytes_.load(std::memory_order_relaxed);
+    while (live > peak && !peak_bytes_.compare_exchange_weak(
+                              peak, live, std::memory_order_relaxed)) {
+    }
+  }
+
+  void record_deallocation(std::size_t bytes) noexcept {
+    shard& s = shards_[this_thread_shard()];
+    s.deallocations_.fetch_add(1, std::memory_order_relaxed);
+    s.bytes_deallocated_.fetch_add(bytes, std::memory_order_relaxed);
+    live_allocations_.fetch_sub(1, std::memory_order_relaxed);
+    live_bytes_.fetch_sub(static_cast<std::int64_t>(bytes),
+                          std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] allocation_snapshot snapshot() const noexcept {
+    allocation_snapshot result;
+    for (const shard& s : shards_) {
+      result.allocations += s.allocations_.load(std::memory_order_relaxed);
+      result.deallocations +=
+          s.deallocations_.load(std::memory_order_relaxed);
+      result.bytes_allocated +=
+          s.bytes_allocated_.load(std::memory_order_relaxed);
+      result.bytes_deallocated +=
+          s.bytes_deallocated_.load(std::memory_order_relaxed);
+      for (std::size_t i = 0; i < size_class_count; ++i) {
+        result.size_histogram[i] +=
+            s.size_histogram_[i].load(std::memory_order_relaxed);
+      }
+    }
+    result.live_allocations =
+        live_allocations_.load(std::memory_order_relaxed);
+    result.live_bytes = live_bytes_.load(std::memory_order_relaxed);
+    result.peak_bytes = peak_bytes_.load(std::memory_order_relaxed);
+    return result;
+  }
+
+  // Clears the counts and the histogram and sets the peak to the current
+  // live bytes. Live allocations and bytes are kept so that memory allocated
+  // before the reset is accounted for when it is deallocated.
+  void reset() noexcept {
+    for (shard& s : shards_) {
+      s.allocations_.store(0, std::memory_order_relaxed);
+      s.deallocations_.store(0, std::memory_order_relaxed);
+      s.bytes_allocated_.store(0, std::memory_order_relaxed);
+      s.bytes_deallocated_.store(0, std::memory_order_relaxed);
+      for (auto& count : s.size_histogram_) {
+        count.store(0, std::memory_order_relaxed);
+      }
+    }
+    peak_bytes_.store(live_bytes_.load(std::memory_order_relaxed),
+                      std::memory_order_relaxed);
+  }
+
+ private:
+  struct alignas(64) shard {
+    std::atomic<std::uint64_t> allocations_{0};
+    std::atomic<std::uint64_t> deallocations_{0};
+    std::atomic<std::uint64_t> bytes_allocated_{0};
+    std::atomic<std::uint64_t> bytes_deallocated_{0};
+    std::array<std::atomic<std::uint64_t>, size_class_count> size_histogram_{};
+  };
+
+  std::array<shard, shard_count> shards_;
+  alignas(64) std::atomic<std::int64_t> live_allocations_{0};
+  std::atomic<std::int64_t> live_bytes_{0};
+  std::atomic<std::int64_t> peak_bytes_{0};
+
+  // Threads are given shards in the order they first allocate.
+  static std::size_t this_thread_shard() noexcept {
+    static std::atomic<std::size_t> next_shard{0};
+    thread_local std::size_t shard_index =
+        next_shard.fetch_add(1, std::memory_order_relaxed) % shard_count;
+    return shard_index;
+  }
+};
+
+template <class T, class A = std::allocator<T>>
+class instrumented_allocator {
+  using upstream_traits = std::allocator_traits<A>;
+
+  allocation_stats* stats_;
+#if defined(_MSC_VER)
+  [[msvc::no_unique_address]] A upstream_;
+#else
+  [[no_unique_address]] A upstream_;
+#endif
+
+  template <class U, class AA>
+  friend class instrumented_allocator;
+
+ public:
+  using value_type = T;
+  using pointer = typename upstream_traits::pointer;
+  using const_pointer = typename upstream_traits::const_pointer;
+  using void_pointer = typename upstream_traits::void_pointer;
+  using const_void_pointer = typename upstream_traits::const_void_pointer;
+  using size_type = typename upstream_traits::size_type;
+  using difference_type = typename upstream_traits::difference_type;
+
+  // Propagation follows the upstream allocator. Instrumented allocators with
+  // different stats compare unequal, so they are never always equal.
+  using propagate_on_container_copy_assignment =
+      typename upstream_traits::propagate_on_container_copy_assignment;
+  using propagate_on_container_move_assignment =
+      typename upstream_traits::propagate_on_container_move_assignment;
+  using propagate_on_container_swap =
+      typename upstream_traits::propagate_on_container_swap;
+  using is_always_equal = std::false_type;
+
+  template <class U>
+  struct rebind {
+    using other = instrumented_allocator<
+        U, typename upstream_traits::template rebind_alloc<U>>;
+  };
+
+  explicit instrumented_allocator(allocation_stats& stats,
+                                  const A& upstream = A()) noexcept
+      : stats_(&stats), upstream_(upstream) {}
+
+  template <class U, class AA>
+  instrumented_allocator(const instrumented_allocator<U, AA>& other) noexcept
+      : stats_(other.stats_), upstream_(other.upstream_) {}
+
+  [[nodiscard]] pointer allocate(size_type n) {
+    pointer p = upstream_traits::allocate(upstream_, n);
+    stats_->record_allocation(n * sizeof(T));
+    return p;
+  }
+
+  void deallocate(pointer p, size_type n) noexcept {
+    stats_->record_deallocation(n * sizeof(T));
+    upstream_traits::deallocate(upstream_, p, n);
+  }
+
+  instrumented_allocator select_on_container_copy_construction() const {
+    return instrumented_allocator(
+        *stats_, upstream_traits::select_on_container_copy_construction(
+                     upstream_));
+  }
+
+  [[nodiscard]] allocation_stats* stats() const noexcept { return stats_; }
+
+  [[nodiscard]] const A& upstream() const noexcept { return upstream_; }
+
+  template <class U, class AA>
+  friend bool operator==(const instrumented_allocator& lhs,
+                         const instrumented_allocator<U, AA>& rhs) noexcept {
+    return lhs.stats() == rhs.stats() && lhs.upstream() == rhs.upstream();
+  }
+};
+
+}  // namespace xyz
+
+#endif  // XYZ_INSTRUMENTED_ALLOCATOR_H_
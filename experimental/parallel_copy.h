@@ -0,0 +1,234 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+// An experimental parallel deep copy for vectors of indirect and polymorphic.
+//
+// Copying a large vector of indirect or polymorphic makes one allocation per
+// element, so the copy is bound by the allocator rather than by memory
+// bandwidth. parallel_copy splits the vector into contiguous chunks and
+// copies each chunk on its own thread into a shared buffer. The copies are
+// then moved into the result, which only moves pointers.
+//
+// By default each element is copy-constructed. Copies are only made in
+// parallel when the element's allocator is always equal: a stateful allocator
+// may not be safe to use from several threads, so the copy then runs on the
+// calling thread. A stateful allocator can be used in parallel by passing
+// `make_allocator`, which is called on the calling thread with the index of
+// each chunk and returns the allocator for that chunk's copies.
+//
+// A vector whose allocator does uses-allocator construction of its elements,
+// such as std::pmr::vector, would copy every element again with its own
+// allocator when the copies are moved into it. Its elements are therefore
+// copied with the result's allocator, as a serial copy would, and only in
+// parallel if that allocator is always equal. Such vectors cannot be copied
+// with `make_allocator`.
+//
+// If a copy throws, every copy that was made is destroyed and the exception
+// from the earliest failing chunk is rethrown, so the strong exception
+// guarantee of a serial copy is kept.
+
+#ifndef XYZ_PARALLEL_COPY_H_
+#define XYZ_PARALLEL_COPY_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace xyz {
+
+// The smallest number of elements that is given a thread of its own.
+inline constexpr std::size_t parallel_copy_min_chunk_size = 1024;
+
+namespace detail {
+
+// True if the allocator of a vector constructs its elements with
+// uses-allocator construction, so that it copies an element moved into it
+// from another allocator.
+template <class T, class A>
+constexpr bool vector_propagates_allocator() {
+  return std::uses_allocator_v<T, A> &&
+         requires(A& alloc, T* p, T&& t) { alloc.construct(p, std::move(t)); };
+}
+
+template <class T, class A = std::allocator<T>>
+constexpr bool copies_in_parallel() {
+  if constexpr (vector_propagates_allocator<T, A>()) {
+    return std::allocator_traits<A>::is_always_equal::value;
+  } else if constexpr (requires { typename T::allocator_type; }) {
+    return std::allocator_traits<
+        typename T::allocator_type>::is_always_equal::value;
+  } else {
+    return true;
+  }
+}
+
+inline std::size_t parallel_copy_chunks(std::size_t size,
+                                        std::size_t num_threads) {
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  std::size_t max_chunks = std::max<std::size_t>(
+      1, (size + parallel_copy_min_chunk_size - 1) /
+             parallel_copy_min_chunk_size);
+  return std::min(num_threads, max_chunks);
+}
+
+// Copies `v` into a new vector with allocator `alloc` using
+// `construct(chunk, element, where)` to make each copy, with one thread for
+// each of `chunks` chunks.
+template <class T, class A, class Construct>
+std::vector<T, A> parallel_copy(const std::vector<T, A>& v, const A& alloc,
+                                std::size_t chunks, Construct& construct) {
+  const std::size_t size = v.size();
+  std::vector<T, A> result(alloc);
+  if (size == 0) return result;
+  result.reserve(size);
+
+  std::vector<std::exception_ptr> errors(chunks);
+  std::allocator<T> buffer_alloc;
+  T* buffer = buffer_alloc.allocate(size);
+
+  auto chunk_begin = [&](std::size_t c) { return size * c / chunks; };
+
+  // Each chunk destroys its own copies if one of them throws.
+  auto copy_chunk = [&](std::size_t c) noexcept {
+    const std::size_t first = chunk_begin(c);
+    const std::size_t last = chunk_begin(c + 1);
+    std::size_t i = first;
+    try {
+      for (; i != last; ++i) {
+        construct(c, v[i], buffer + i);
+      }
+    } catch (...) {
+      std::destroy(buffer + first, buffer + i);
+      errors[c] = std::current_exception();
+    }
+  };
+
+  {
+    std::vector<std::jthread> workers;
+    std::size_t c = 1;
+    try {
+      workers.reserve(chunks - 1);
+      for (; c != chunks; ++c) {
+        workers.emplace_back(copy_chunk, c);
+      }
+    } catch (...) {
+      // Chunks that could not be given a thread are copied below.
+    }
+    copy_chunk(0);
+    for (; c != chunks; ++c) {
+      copy_chunk(c);
+    }
+  }  // Joins the workers.
+
+  auto error = std::find_if(errors.begin(), errors.end(),
+                            [](const auto& e) { return e != nullptr; });
+  if (error != errors.end()) {
+    for (std::size_t c = 0; c != chunks; ++c) {
+      if (errors[c] == nullptr) {
+        std::destroy(buffer + chunk_begin(c), buffer + chunk_begin(c + 1));
+      }
+    }
+    buffer_alloc.deallocate(buffer, size);
+    std::rethrow_exception(*error);
+  }
+
+  // Moving indirect and polymorphic only moves pointers, but the move
+  // constructor of an allocator may throw. Elements that the vector
+  // constructs with its own allocator were copied with that allocator.
+  try {
+    for (std::size_t i = 0; i != size; ++i) {
+      result.push_back(std::move(buffer[i]));
+    }
+  } catch (...) {
+    std::destroy(buffer, buffer + size);
+    buffer_alloc.deallocate(buffer, size);
+    throw;
+  }
+  std::destroy(buffer, buffer + size);
+  buffer_alloc.deallocate(buffer, size);
+  return result;
+}
+
+}  // namespace detail
+
+// Returns a copy of `v` made with up to `num_threads` threads, or one per
+// hardware thread if `num_threads` is zero. Each element is copy-constructed.
+template <class T, class A>
+std::vector<T, A> parallel_copy(const std::vector<T, A>& v,
+                                std::size_t num_threads) {
+  const A alloc =
+      std::allocator_traits<A>::select_on_container_copy_construction(
+          v.get_allocator());
+  const std::size_t chunks =
+      detail::copies_in_parallel<T, A>()
+          ? detail::parallel_copy_chunks(v.size(), num_threads)
+          : 1;
+  auto construct = [&alloc](std::size_t, const T& t, T* where) {
+    if constexpr (detail::vector_propagates_allocator<T, A>()) {
+      std::uninitialized_construct_using_allocator(where, alloc, t);
+    } else {
+      std::construct_at(where, t);
+    }
+  };
+  return detail::parallel_copy(v, alloc, chunks, construct);
+}
+
+// Returns a copy of `v` made with up to `num_threads` threads, or one per
+// hardware thread if `num_threads` is zero. The elements of chunk `i` are
+// copied with `T(std::allocator_arg, make_allocator(i), element)`.
+// Vectors that propagate their allocator to their elements are not
+// supported.
+template <class T, class A, class MakeAllocator>
+  requires(!detail::vector_propagates_allocator<T, A>())
+std::vector<T, A> parallel_copy(const std::vector<T, A>& v,
+                                std::size_t num_threads,
+                                MakeAllocator make_allocator) {
+  using element_allocator =
+      std::remove_cvref_t<std::invoke_result_t<MakeAllocator&, std::size_t>>;
+  static_assert(std::is_constructible_v<T, std::allocator_arg_t,
+                                        const element_allocator&, const T&>);
+
+  const std::size_t chunks =
+      detail::parallel_copy_chunks(v.size(), num_threads);
+  std::vector<element_allocator> allocators;
+  allocators.reserve(chunks);
+  for (std::size_t c = 0; c != chunks; ++c) {
+    allocators.push_back(make_allocator(c));
+  }
+  auto construct = [&allocators](std::size_t c, const T& t, T* where) {
+    std::construct_at(where, std::allocator_arg, allocators[c], t);
+  };
+  return detail::parallel_copy(
+      v,
+      std::allocator_traits<A>::select_on_container_copy_construction(
+          v.get_allocator()),
+      chunks, construct);
+}
+
+}  // namespace xyz
+
+#endif  // XYZ_PARALLEL_COPY_H_
@@ -0,0 +1,3 @@
+// A cc file for polymorphic_batched_clone to ensure that the header file can
+// be compiled.
+#include "experimental/polymorphic_batched_clone.h"  // NOLINT
@@ -0,0 +1,766 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+// An experimental implementation of polymorphic with a batched clone of
+// ranges.
+//
+// xyz::clone_range copies a range of polymorphic objects into a few large
+// allocations rather than one allocation per object. Copies made by it share
+// their batch, which is released when the last of them is destroyed, so a
+// single surviving copy keeps its whole batch alive. Batches are limited to
+// clone_range_max_batch_bytes to bound the memory that one copy can retain.
+//
+// Supporting batches adds two virtual functions to every control block, which
+// is why this lives outside polymorphic.h.
+
+#ifndef XYZ_POLYMORPHIC_H_
+#define XYZ_POLYMORPHIC_H_
+
+#include <atomic>
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#ifndef XYZ_POLYMORPHIC_HAS_EXTENDED_CONSTRUCTORS
+#define XYZ_POLYMORPHIC_HAS_EXTENDED_CONSTRUCTORS 1
+#endif  // XYZ_POLYMORPHIC_HAS_EXTENDED_CONSTRUCTORS
+
+#define XYZ_POLYMORPHIC_HAS_CLONE_RANGE 1
+#define XYZ_POLYMORPHIC_HAS_TYPE_ID 1
+#define XYZ_POLYMORPHIC_HAS_VISIT 1
+#define XYZ_POLYMORPHIC_HAS_LIFECYCLE_HOOKS 1
+
+namespace xyz {
+
+// The largest allocation that clone_range makes for a batch of copies, unless
+// a single copy needs more.
+inline constexpr std::size_t clone_range_max_batch_bytes = 64 * 1024;
+
+#ifndef XYZ_UNREACHABLE_DEFINED
+#define XYZ_UNREACHABLE_DEFINED
+
+[[noreturn]] inline void unreachable() {  // LCOV_EXCL_LINE
+#if (__cpp_lib_unreachable >= 202202L)
+  std::unreachable();  // LCOV_EXCL_LINE
+#elif defined(_MSC_VER)
+  __assume(false);  // LCOV_EXCL_LINE
+#else
+  __builtin_unreachable();  // LCOV_EXCL_LINE
+#endif
+}
+#endif  // XYZ_UNREACHABLE_DEFINED
+
+#ifndef XYZ_LIFECYCLE_HOOKS_DEFINED
+#define XYZ_LIFECYCLE_HOOKS_DEFINED
+
+enum class lifecycle_event { construct, copy, move, destroy };
+
+// An allocator can declare `using lifecycle_hooks = H;` to observe the owned
+// objects that indirect and polymorphic create and destroy with it. After an
+// owned object of dynamic type U is constructed, and before it is destroyed,
+// `H::template on_lifecycle_event<U>(event, size, alloc)` is called, where
+// `size` is the number of bytes allocated to hold the object. The call must
+// not throw. Hooks are not called during constant evaluation, and nothing is
+// called for allocators without hooks.
+template <class A>
+struct allocator_lifecycle_hooks {
+  using type = void;
+};
+
+template <class A>
+  requires requires { typename A::lifecycle_hooks; }
+struct allocator_lifecycle_hooks<A> {
+  using type = typename A::lifecycle_hooks;
+};
+
+template <class A>
+inline constexpr bool allocator_has_lifecycle_hooks_v =
+    !std::is_void_v<typename allocator_lifecycle_hooks<A>::type>;
+
+namespace detail {
+
+template <class U, class A>
+constexpr void notify_lifecycle_event(lifecycle_event event, std::size_t size,
+                                      const A& alloc) noexcept {
+  if constexpr (allocator_has_lifecycle_hooks_v<A>) {
+    using hooks = typename allocator_lifecycle_hooks<A>::type;
+    static_assert(
+        noexcept(hooks::template on_lifecycle_event<U>(event, size, alloc)),
+        "Lifecycle hooks must be noexcept");
+    if (!std::is_constant_evaluated()) {
+      hooks::template on_lifecycle_event<U>(event, size, alloc);
+    }
+  }
+}
+
+}  // namespace detail
+
+#endif  // XYZ_LIFECYCLE_HOOKS_DEFINED
+
+template <class I, class S, class O, class AA>
+O clone_range(I first, S last, O out, const AA& alloc);
+
+template <class T, class A = std::allocator<T>>
+class polymorphic {
+  // A single allocation shared by the control blocks created by clone_range.
+  // The first element is a header holding the number of live control blocks
+  // (plus one while clone_range is running) and the size of the allocation.
+  // Control blocks are constructed in the elements that follow it.
+  struct alignas(std::max_align_t) batch {
+    std::atomic<std::size_t> count_;
+    std::size_t size_;
+  };
+
+  using batch_allocator =
+      typename std::allocator_traits<A>::template rebind_alloc<batch>;
+  using batch_alloc_traits = std::allocator_traits<batch_allocator>;
+  using batch_pointer = typename batch_alloc_traits::pointer;
+
+  // Each derived type is identified by the address of its tag. The tags are
+  // not const so that identical constants cannot be merged by the linker.
+  template <class U>
+  static inline char type_tag = 0;
+
+  struct control_block {
+    using allocator_traits = std::allocator_traits<A>;
+    typename allocator_traits::pointer p_;
+
+    virtual constexpr ~control_block() = default;
+    virtual constexpr const char* type_id() const noexcept = 0;
+    virtual constexpr void destroy(A& alloc) = 0;
+    virtual constexpr control_block* clone(const A& alloc) = 0;
+    virtual constexpr control_block* move(const A& alloc) = 0;
+
+    // The number of batch elements needed to clone this control block into a
+    // batch, or zero if it cannot be batched.
+    virtual std::size_t batch_size() const noexcept = 0;
+    virtual control_block* clone_into(const A& alloc, batch_pointer b,
+                                      batch* mem) = 0;
+  };
+
+  template <class U>
+  class batched_control_block;
+
+  template <class U>
+  static constexpr std::size_t batch_size_for() noexcept {
+    if constexpr (alignof(batched_control_block<U>) > alignof(batch)) {
+      return 0;
+    } else {
+      return (sizeof(batched_control_block<U>) + sizeof(batch) - 1) /
+             sizeof(batch);
+    }
+  }
+
+  template <class U>
+  static control_block* clone_into_batch(const A& alloc, batch_pointer b,
+                                         batch* mem, const U& u) {
+    using cb_allocator = typename std::allocator_traits<
+        A>::template rebind_alloc<batched_control_block<U>>;
+    using cb_alloc_traits = std::allocator_traits<cb_allocator>;
+    cb_allocator cb_alloc(alloc);
+    auto* cb = static_cast<batched_control_block<U>*>(static_cast<void*>(mem));
+    cb_alloc_traits::construct(cb_alloc, cb, alloc, b, u);
+    std::to_address(b)->count_.fetch_add(1, std::memory_order_relaxed);
+    detail::notify_lifecycle_event<U>(lifecycle_event::copy,
+                                      batch_size_for<U>() * sizeof(batch),
+                                      alloc);
+    return cb;
+  }
+
+  static void release_batch(const A& alloc, batch_pointer b) noexcept {
+    batch* header = std::to_address(b);
+    if (header->count_.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+    auto size = header->size_;
+    std::destroy_at(header);
+    batch_allocator b_alloc(alloc);
+    batch_alloc_traits::deallocate(b_alloc, b, size);
+  }
+
+  // The object that direct and batched control blocks hold.
+  template <class U>
+  class object_control_block : public control_block {
+   protected:
+    union uninitialized_storage {
+      U u_;
+
+      constexpr uninitialized_storage() {}
+
+      constexpr ~uninitialized_storage() {}
+    } storage_;
+
+   public:
+    constexpr U* get() noexcept { return std::addressof(storage_.u_); }
+
+    constexpr const char* type_id() const noexcept override {
+      return &type_tag<U>;
+    }
+
+    std::size_t batch_size() const noexcept override {
+      return batch_size_for<U>();
+    }
+
+    control_block* clone_into(const A& alloc, batch_pointer b,
+                              batch* mem) override {
+      return clone_into_batch(alloc, b, mem, storage_.u_);
+    }
+  };
+
+  template <class U>
+  class direct_control_block final : public object_control_block<U> {
+    using object_control_block<U>::storage_;
+
+    using cb_allocator = typename std::allocator_traits<
+        A>::template rebind_alloc<direct_control_block<U>>;
+    using cb_alloc_traits = std::allocator_traits<cb_allocator>;
+
+   public:
+    template <class... Ts>
+    constexpr direct_control_block(const A& alloc, Ts&&... ts) {
+      cb_allocator cb_alloc(alloc);
+      cb_alloc_traits::construct(cb_alloc, std::addressof(storage_.u_),
+                                 std::forward<Ts>(ts)...);
+      control_block::p_ = std::addressof(storage_.u_);
+    }
+
+    constexpr control_block* clone(const A& alloc) override {
+      return allocate_control_block<U, lifecycle_event::copy>(alloc,
+                                                              storage_.u_);
+    }
+
+    constexpr control_block* move(const A& alloc) override {
+      return allocate_control_block<U, lifecycle_event::move>(
+          alloc, std::move(storage_.u_));
+    }
+
+    constexpr void destroy(A& alloc) override {
+      detail::notify_lifecycle_event<U>(lifecycle_event::destroy,
+                                        sizeof(direct_control_block), alloc);
+      cb_allocator cb_alloc(alloc);
+      cb_alloc_traits::destroy(cb_alloc, std::addressof(storage_.u_));
+      cb_alloc_traits::deallocate(
+          cb_alloc,
+          std::pointer_traits<typename cb_alloc_traits::pointer>::pointer_to(
+              *this),
+          1);
+    }
+  };
+
+  // A control block constructed inside a batch by clone_range. Copies and
+  // moves of it are allocated individually.
+  template <class U>
+  class batched_control_block final : public object_control_block<U> {
+    using object_control_block<U>::storage_;
+
+    batch_pointer batch_;
+
+    using cb_allocator = typename std::allocator_traits<
+        A>::template rebind_alloc<batched_control_block<U>>;
+    using cb_alloc_traits = std::allocator_traits<cb_allocator>;
+
+   public:
+    batched_control_block(const A& alloc, batch_pointer b, const U& u)
+        : batch_(b) {
+      cb_allocator cb_alloc(alloc);
+      cb_alloc_traits::construct(cb_alloc, std::addressof(storage_.u_), u);
+      control_block::p_ = std::addressof(storage_.u_);
+    }
+
+    control_block* clone(const A& alloc) override {
+      return allocate_control_block<U, lifecycle_event::copy>(alloc,
+                                                              storage_.u_);
+    }
+
+    control_block* move(const A& alloc) override {
+      return allocate_control_block<U, lifecycle_event::move>(
+          alloc, std::move(storage_.u_));
+    }
+
+    void destroy(A& alloc) override {
+      detail::notify_lifecycle_event<U>(lifecycle_event::destroy,
+                                        batch_size_for<U>() * sizeof(batch),
+                                        alloc);
+      cb_allocator cb_alloc(alloc);
+      cb_alloc_traits::destroy(cb_alloc, std::addressof(storage_.u_));
+      release_batch(alloc, batch_);
+    }
+  };
+
+  control_block* cb_;
+
+#if defined(_MSC_VER)
+  // https://devblogs.microsoft.com/cppblog/msvc-cpp20-and-the-std-cpp20-switch/#msvc-extensions-and-abi
+  [[msvc::no_unique_address]] A alloc_;
+#else
+  [[no_unique_address]] A alloc_;
+#endif
+
+  using allocator_traits = std::allocator_traits<A>;
+
+  template <class U, lifecycle_event Event = lifecycle_event::construct,
+            class... Ts>
+  [[nodiscard]] constexpr static control_block* allocate_control_block(
+      const A& alloc, Ts&&... ts) {
+    using cb_allocator = typename std::allocator_traits<
+        A>::template rebind_alloc<direct_control_block<U>>;
+    cb_allocator cb_alloc(alloc);
+    using cb_alloc_traits = std::allocator_traits<cb_allocator>;
+    auto mem = cb_alloc_traits::allocate(cb_alloc, 1);
+    try {
+      cb_alloc_traits::construct(cb_alloc, std::to_address(mem), alloc,
+                                 std::forward<Ts>(ts)...);
+      detail::notify_lifecycle_event<U>(
+          Event, sizeof(direct_control_block<U>), alloc);
+      return std::to_address(mem);
+    } catch (...) {
+      cb_alloc_traits::deallocate(cb_alloc, mem, 1);
+      throw;
+    }
+  }
+
+  template <class U, class... Ts>
+  [[nodiscard]] constexpr control_block* create_control_block(
+      Ts&&... ts) const {
+    return allocate_control_block<U>(alloc_, std::forward<Ts>(ts)...);
+  }
+
+  struct adopt_control_block_t {};
+
+  // Used by clone_range to take ownership of a control block.
+  constexpr polymorphic(adopt_control_block_t, const A& alloc,
+                        control_block* cb) noexcept
+      : cb_(cb), alloc_(alloc) {}
+
+  template <class I, class S, class O, class AA>
+  friend O clone_range(I first, S last, O out, const AA& alloc);
+
+ public:
+  using value_type = T;
+  using allocator_type = A;
+  using pointer = typename allocator_traits::pointer;
+  using const_pointer = typename allocator_traits::const_pointer;
+  using type_id_type = const char*;
+
+  //
+  // Constructors.
+  //
+
+  explicit constexpr polymorphic()
+    requires std::default_initializable<A>
+      : polymorphic(std::allocator_arg_t{}, A{}) {
+    static_assert(std::default_initializable<T> && std::copy_constructible<T>);
+  }
+
+  template <class U>
+  constexpr explicit polymorphic(U&& u)
+    requires(!std::same_as<polymorphic, std::remove_cvref_t<U>>) &&
+            std::copy_constructible<std::remove_cvref_t<U>> &&
+            std::derived_from<std::remove_cvref_t<U>, T> &&
+            std::default_initializable<A>
+      : polymorphic(std::allocator_arg_t{}, A{}, std::forward<U>(u)) {}
+
+  template <class U, class... Ts>
+  explicit constexpr polymorphic(std::in_place_type_t<U>, Ts&&... ts)
+    requires std::same_as<std::remove_cvref_t<U>, U> &&
+             std::constructible_from<U, Ts&&...> &&
+             std::copy_constructible<U> && std::derived_from<U, T> &&
+             std::default_initializable<A>
+      : polymorphic(std::allocator_arg_t{}, A{}, std::in_place_type<U>,
+                    std::forward<Ts>(ts)...) {}
+
+  template <class U, class I, class... Ts>
+  explicit constexpr polymorphic(std::in_place_type_t<U>,
+                                 std::initializer_list<I> ilist, Ts&&... ts)
+    requires std::same_as<std::remove_cvref_t<U>, U> &&
+             std::constructible_from<U, std::initializer_list<I>, Ts&&...> &&
+             std::copy_constructible<U> && std::derived_from<U, T> &&
+             std::default_initializable<A>
+      : polymorphic(std::allocator_arg_t{}, A{}, std::in_place_type<U>, ilist,
+                    std::forward<Ts>(ts)...) {}
+
+  constexpr polymorphic(const polymorphic& other)
+      : polymorphic(std::allocator_arg_t{},
+                    allocator_traits::select_on_container_copy_construction(
+                        other.alloc_),
+                    other) {}
+
+  constexpr polymorphic(polymorphic&& other) noexcept(
+      allocator_traits::is_always_equal::value)
+      : polymorphic(std::allocator_arg_t{}, other.alloc_, std::move(other)) {}
+
+  //
+  // Allocator-extended constructors.
+  //
+
+  explicit constexpr polymorphic(std::allocator_arg_t, const A& alloc)
+      : alloc_(alloc) {
+    static_assert(std::default_initializable<T> && std::copy_constructible<T>);
+
+    cb_ = create_control_block<T>();
+  }
+
+  template <class U>
+  constexpr explicit polymorphic(std::allocator_arg_t, const A& alloc, U&& u)
+    requires(not std::same_as<polymorphic, std::remove_cvref_t<U>>) &&
+            std::copy_constructible<std::remove_cvref_t<U>> &&
+            std::derived_from<std::remove_cvref_t<U>, T>
+      : alloc_(alloc) {
+    cb_ = create_control_block<std::remove_cvref_t<U>>(std::forward<U>(u));
+  }
+
+  template <class U, class... Ts>
+  explicit constexpr polymorphic(std::allocator_arg_t, const A& alloc,
+                                 std::in_place_type_t<U>, Ts&&... ts)
+    requires std::same_as<std::remove_cvref_t<U>, U> &&
+             std::constructible_from<U, Ts&&...> &&
+             std::copy_constructible<U> && std::derived_from<U, T>
+      : alloc_(alloc) {
+    cb_ = create_control_block<U>(std::forward<Ts>(ts)...);
+  }
+
+  template <class U, class I, class... Ts>
+  explicit constexpr polymorphic(std::allocator_arg_t, const A& alloc,
+                                 std::in_place_type_t<U>,
+                                 std::initializer_list<I> ilist, Ts&&... ts)
+    requires std::same_as<std::remove_cvref_t<U>, U> &&
+             std::constructible_from<U, std::initializer_list<I>, Ts&&...> &&
+             std::copy_constructible<U> && std::derived_from<U, T>
+      : alloc_(alloc) {
+    cb_ = create_control_block<U>(ilist, std::forward<Ts>(ts)...);
+  }
+
+  constexpr polymorphic(std::allocator_arg_t, const A& alloc,
+                        const polymorphic& other)
+      : alloc_(alloc) {
+    if (!other.valueless_after_move()) {
+      cb_ = other.cb_->clone(alloc_);
+    } else {
+      cb_ = nullptr;
+    }
+  }
+
+  constexpr polymorphic(
+      std::allocator_arg_t, const A& alloc,
+      polymorphic&& other) noexcept(allocator_traits::is_always_equal::value)
+      : alloc_(alloc) {
+    if constexpr (allocator_traits::is_always_equal::value) {
+      cb_ = std::exchange(other.cb_, nullptr);
+    } else {
+      if (alloc_ == other.alloc_) {
+        cb_ = std::exchange(other.cb_, nullptr);
+      } else {
+        if (!other.valueless_after_move()) {
+          cb_ = other.cb_->move(alloc_);
+        } else {
+          cb_ = nullptr;
+        }
+      }
+    }
+  }
+
+  //
+  // Destructor.
+  //
+
+  constexpr ~polymorphic() { reset(); }
+
+  //
+  // Assignment operators.
+  //
+
+  constexpr polymorphic& operator=(const polymorphic& other) {
+    if (this == &other) return *this;
+
+    // Check to see if the allocators need to be updated.
+    // We defer actually updating the allocator until later because it may be
+    // needed to delete the current control block.
+    bool update_alloc =
+        allocator_traits::propagate_on_container_copy_assignment::value;
+
+    if (other.valueless_after_move()) {
+      reset();
+    } else {
+      // Constructing a new control block could throw so we need to defer
+      // resetting or updating allocators until this is done.
+
+      // Inlining the allocator into the construct_from call confuses LCOV.
+      auto tmp = other.cb_->clone(update_alloc ? other.alloc_ : alloc_);
+      reset();
+      cb_ = tmp;
+    }
+    if (update_alloc) {
+      alloc_ = other.alloc_;
+    }
+    return *this;
+  }
+
+  constexpr polymorphic& operator=(polymorphic&& other) noexcept(
+      allocator_traits::propagate_on_container_move_assignment::value ||
+      allocator_traits::is_always_equal::value) {
+    if (this == &other) return *this;
+
+    // Check to see if the allocators need to be updated.
+    // We defer actually updating the allocator until later because it may be
+    // needed to delete the current control block.
+    bool update_alloc =
+        allocator_traits::propagate_on_container_move_assignment::value;
+
+    if (other.valueless_after_move()) {
+      reset();
+    } else {
+      if (alloc_ == other.alloc_) {
+        std::swap(cb_, other.cb_);
+        other.reset();
+      } else {
+        // Constructing a new control block could throw so we need to defer
+        // resetting or updating allocators until this is done.
+
+        // Inlining the allocator into the construct_from call confuses LCOV.
+        auto tmp = other.cb_->move(update_alloc ? other.alloc_ : alloc_);
+        reset();
+        cb_ = tmp;
+      }
+    }
+
+    if (update_alloc) {
+      alloc_ = other.alloc_;
+    }
+    return *this;
+  }
+
+  //
+  // Accessors.
+  //
+
+  [[nodiscard]] constexpr pointer operator->() noexcept {
+    assert(!valueless_after_move());  // LCOV_EXCL_LINE
+    return cb_->p_;
+  }
+
+  [[nodiscard]] constexpr const_pointer operator->() const noexcept {
+    assert(!valueless_after_move());  // LCOV_EXCL_LINE
+    return cb_->p_;
+  }
+
+  [[nodiscard]] constexpr T& operator*() noexcept {
+    assert(!valueless_after_move());  // LCOV_EXCL_LINE
+    return *cb_->p_;
+  }
+
+  [[nodiscard]] constexpr const T& operator*() const noexcept {
+    assert(!valueless_after_move());  // LCOV_EXCL_LINE
+    return *cb_->p_;
+  }
+
+  [[nodiscard]] constexpr bool valueless_after_move() const noexcept {
+    return cb_ == nullptr;
+  }
+
+  // An identifier for the type of the owned object that does not need RTTI.
+  // It is null for a valueless polymorphic.
+  [[nodiscard]] constexpr type_id_type type_id() const noexcept {
+    return cb_ == nullptr ? nullptr : cb_->type_id();
+  }
+
+  // The identifier that type_id() returns when the owned object is a U.
+  template <class U>
+  [[nodiscard]] static constexpr type_id_type type_id_of() noexcept
+    requires std::derived_from<U, T>
+  {
+    return &type_tag<U>;
+  }
+
+  // Returns true if the type of the owned object is exactly U.
+  template <class U>
+  [[nodiscard]] constexpr bool holds_type() const noexcept
+    requires std::derived_from<U, T>
+  {
+    return cb_ != nullptr && cb_->type_id() == type_id_of<U>();
+  }
+
+  // Returns a pointer to the owned object if its type is exactly U and null
+  // otherwise. The pointer is taken from the control block that holds the U,
+  // so T may be a virtual base of U.
+  template <class U>
+  [[nodiscard]] constexpr U* get_if() noexcept
+    requires std::derived_from<U, T>
+  {
+    return holds_type<U>() ? static_cast<object_control_block<U>*>(cb_)->get()
+                           : nullptr;
+  }
+
+  template <class U>
+  [[nodiscard]] constexpr const U* get_if() const noexcept
+    requires std::derived_from<U, T>
+  {
+    return holds_type<U>() ? static_cast<object_control_block<U>*>(cb_)->get()
+                           : nullptr;
+  }
+
+  constexpr allocator_type get_allocator() const noexcept { return alloc_; }
+
+  //
+  // Modifiers.
+  //
+
+  constexpr void swap(polymorphic& other) noexcept(
+      std::allocator_traits<A>::propagate_on_container_swap::value ||
+      std::allocator_traits<A>::is_always_equal::value) {
+    if constexpr (allocator_traits::propagate_on_container_swap::value) {
+      // If allocators move with their allocated objects, we can swap both.
+      std::swap(alloc_, other.alloc_);
+      std::swap(cb_, other.cb_);
+      return;
+    } else /* constexpr */ {
+      if (alloc_ == other.alloc_) {
+        std::swap(cb_, other.cb_);
+      } else {
+        unreachable();  // LCOV_EXCL_LINE
+      }
+    }
+  }
+
+  friend constexpr void swap(polymorphic& lhs, polymorphic& rhs) noexcept(
+      noexcept(lhs.swap(rhs))) {
+    lhs.swap(rhs);
+  }
+
+ private:
+  constexpr void reset() noexcept {
+    if (cb_ != nullptr) {
+      cb_->destroy(alloc_);
+      cb_ = nullptr;
+    }
+  }
+};
+
+// Copies the polymorphic objects in [first, last) to `out`, as if by
+// `*out++ = polymorphic(std::allocator_arg, alloc, *it)`, and returns the
+// advanced output iterator.
+//
+// The storage for the copies is computed up front and allocated from `alloc`
+// in batches of up to clone_range_max_batch_bytes. A batch is released when
+// the last copy in it is destroyed. Copies of types that cannot share an
+// allocation are allocated individually.
+template <class I, class S, class O, class AA>
+O clone_range(I first, S last, O out, const AA& alloc) {
+  static_assert(std::forward_iterator<I> && std::sentinel_for<S, I>);
+  using P = std::iter_value_t<I>;
+  using A = typename P::allocator_type;
+  static_assert(std::same_as<P, polymorphic<typename P::value_type, A>>);
+  using batch = typename P::batch;
+  using batch_alloc_traits = typename P::batch_alloc_traits;
+  constexpr std::size_t max_size = clone_range_max_batch_bytes / sizeof(batch);
+
+  A a(alloc);
+  while (first != last) {
+    // Find the copies that fit in the next batch, which holds at least one.
+    std::size_t size = 1;
+    I batch_last = first;
+    for (; batch_last != last; ++batch_last) {
+      const P& p = *batch_last;
+      std::size_t n = p.valueless_after_move() ? 0 : p.cb_->batch_size();
+      if (size > 1 && size + n > max_size) break;
+      size += n;
+    }
+
+    if (size == 1) {
+      for (; first != batch_last; ++first, ++out) {
+        *out = P(std::allocator_arg, a, *first);
+      }
+      continue;
+    }
+
+    typename P::batch_allocator b_alloc(a);
+    typename P::batch_pointer b = batch_alloc_traits::allocate(b_alloc, size);
+    batch* header = std::construct_at(std::to_address(b));
+    header->count_.store(1, std::memory_order_relaxed);
+    header->size_ = size;
+
+    // The header holds a reference until every copy has been made so that it
+    // is released exactly once whether or not copying throws.
+    try {
+      batch* mem = header + 1;
+      for (; first != batch_last; ++first, ++out) {
+        const P& p = *first;
+        typename P::control_block* cb = nullptr;
+        if (!p.valueless_after_move()) {
+          if (auto n = p.cb_->batch_size(); n != 0) {
+            cb = p.cb_->clone_into(a, b, mem);
+            mem += n;
+          } else {
+            cb = p.cb_->clone(a);
+          }
+        }
+        *out = P(typename P::adopt_control_block_t{}, a, cb);
+      }
+    } catch (...) {
+      P::release_batch(a, b);
+      throw;
+    }
+    P::release_batch(a, b);
+  }
+  return out;
+}
+
+namespace detail {
+
+template <class R, class P, class F>
+constexpr R visit_as(P& p, F& f) {
+  return static_cast<R>(std::invoke(f, *p));
+}
+
+template <class R, class U, class... Us, class P, class F>
+constexpr R visit_as(P& p, F& f) {
+  if (auto* u = p.template get_if<U>()) {
+    return static_cast<R>(std::invoke(f, *u));
+  }
+  return visit_as<R, Us...>(p, f);
+}
+
+}  // namespace detail
+
+// Calls `f` with the object owned by `p` as a U& if its type is exactly one
+// of `Us`, and as a T& otherwise. Each listed type is checked with one
+// comparison of type_id(); no dynamic_cast is made. `f` must be invocable
+// with T& and each U&, and the result of invoking it with T& is returned.
+// `p` must not be valueless.
+template <class... Us, class T, class A, class F>
+constexpr decltype(auto) visit(polymorphic<T, A>& p, F&& f) {
+  assert(!p.valueless_after_move());  // LCOV_EXCL_LINE
+  using R = std::invoke_result_t<F&, T&>;
+  return detail::visit_as<R, Us...>(p, f);
+}
+
+template <class... Us, class T, class A, class F>
+constexpr decltype(auto) visit(const polymorphic<T, A>& p, F&& f) {
+  assert(!p.valueless_after_move());  // LCOV_EXCL_LINE
+  using R = std::invoke_result_t<F&, const T&>;
+  return detail::visit_as<R, Us...>(p, f);
+}
+
+}  // namespace xyz
+
+#endif  // XYZ_POLYMORPHIC_H_
@@ -0,0 +1,3 @@
+// A cc file for polymorphic_cached_pointer to ensure that the header file can be
+// compiled.
+#include "experimental/polymorphic_cached_pointer.h"  // NOLINT
@@ -0,0 +1,438 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+// An experimental value-semantic, unordered collection of objects derived
+// from T that stores the objects of each derived type U in a contiguous bucket
+// of its own.
+//
+// for_each_as<U...>(f) calls f with each object of the listed derived types
+// as a U&, one bucket at a time, so that calls through U can be devirtualized
+// when U is final. for_each(f) calls f with every object as a T&, walking
+// each bucket contiguously. The T subobjects of a bucket are located by a
+// function set for U when the bucket is created, and f is called from a loop
+// in for_each, so it can be inlined. The virtual calls that f makes are not
+// devirtualized, as that needs U to be known where f is called: use
+// for_each_as when the derived types are known.
+//
+// Copying a polymorphic_collection copies each object as its derived type, as
+// copying a polymorphic does. Objects are not kept in insertion order.
+// Inserting an object of type U invalidates references to other objects of
+// type U.
+
+#ifndef XYZ_POLYMORPHIC_COLLECTION_H_
+#define XYZ_POLYMORPHIC_COLLECTION_H_
+
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace xyz {
+
+template <class T, class A = std::allocator<T>>
+class polymorphic_collection {
+  // Each derived type is identified by the address of its tag. The tags are
+  // not const so that identical constants cannot be merged by the linker.
+  template <class U>
+  static inline char type_tag = 0;
+
+  // The T subobjects of a bucket: `size` of them, the first at `first` and
+  // each of the others `stride` bytes after the one before.
+  struct base_range {
+    T* first;
+    std::size_t size;
+    std::size_t stride;
+  };
+
+  // A bucket holds every object of one derived type. `bases_` converts the
+  // objects to T with a static_cast from U.
+  struct bucket {
+    using bases_fn = base_range (*)(bucket& b) noexcept;
+
+    const char* tag_;
+    bases_fn bases_;
+
+    constexpr bucket(const char* tag, bases_fn bases)
+        : tag_(tag), bases_(bases) {}
+
+    virtual constexpr ~bucket() = default;
+    virtual constexpr void destroy(A& alloc) = 0;
+    virtual constexpr bucket* clone(const A& alloc) const = 0;
+    virtual constexpr bucket* move(const A& alloc) = 0;
+    virtual constexpr std::size_t size() const noexcept = 0;
+    virtual constexpr void clear() noexcept = 0;
+  };
+
+  template <class U>
+  class direct_bucket final : public bucket {
+    using u_allocator =
+        typename std::allocator_traits<A>::template rebind_alloc<U>;
+    using b_allocator = typename std::allocator_traits<
+        A>::template rebind_alloc<direct_bucket>;
+    using b_alloc_traits = std::allocator_traits<b_allocator>;
+
+   public:
+    std::vector<U, u_allocator> objects_;
+
+    explicit direct_bucket(const A& alloc)
+        : bucket(&type_tag<U>, &bases_of), objects_(u_allocator(alloc)) {}
+
+    static base_range bases_of(bucket& b) noexcept {
+      auto& objects = static_cast<direct_bucket&>(b).objects_;
+      if (objects.empty()) return {nullptr, 0, sizeof(U)};
+      return {static_cast<T*>(objects.data()), objects.size(), sizeof(U)};
+    }
+
+    direct_bucket(const A& alloc, const direct_bucket& other)
+        : bucket(other), objects_(other.objects_, u_allocator(alloc)) {}
+
+    direct_bucket(const A& alloc, direct_bucket&& other)
+        : bucket(other),
+          objects_(std::move(other.objects_), u_allocator(alloc)) {}
+
+    template <class... Ts>
+    static direct_bucket* create(const A& alloc, Ts&&... ts) {
+      b_allocator b_alloc(alloc);
+      auto mem = b_alloc_traits::allocate(b_alloc, 1);
+      try {
+        b_alloc_traits::construct(b_alloc, mem, alloc,
+                                  std::forward<Ts>(ts)...);
+        return mem;
+      } catch (...) {
+        b_alloc_traits::deallocate(b_alloc, mem, 1);
+        throw;
+      }
+    }
+
+    constexpr bucket* clone(const A& alloc) const override {
+      return create(alloc, *this);
+    }
+
+    constexpr bucket* move(const A& alloc) override {
+      return create(alloc, std::move(*this));
+    }
+
+    constexpr void destroy(A& alloc) override {
+      b_allocator b_alloc(alloc);
+      b_alloc_traits::destroy(b_alloc, this);
+      b_alloc_traits::deallocate(b_alloc, this, 1);
+    }
+
+    constexpr std::size_t size() const noexcept override {
+      return objects_.size();
+    }
+
+    constexpr void clear() noexcept override { objects_.clear(); }
+  };
+
+  using bucket_allocator =
+      typename std::allocator_traits<A>::template rebind_alloc<bucket*>;
+
+  using allocator_traits = std::allocator_traits<A>;
+
+#if defined(_MSC_VER)
+  // https://devblogs.microsoft.com/cppblog/msvc-cpp20-and-the-std-cpp20-switch/#msvc-extensions-and-abi
+  [[msvc::no_unique_address]] A alloc_;
+#else
+  [[no_unique_address]] A alloc_;
+#endif
+  std::vector<bucket*, bucket_allocator> buckets_;
+
+  template <class U>
+  constexpr direct_bucket<U>* find_bucket() const noexcept {
+    for (bucket* b : buckets_) {
+      if (b->tag_ == &type_tag<U>) return static_cast<direct_bucket<U>*>(b);
+    }
+    return nullptr;
+  }
+
+  template <class U>
+  constexpr direct_bucket<U>& get_or_create_bucket() {
+    if (auto* b = find_bucket<U>()) return *b;
+    buckets_.reserve(buckets_.size() + 1);
+    auto* b = direct_bucket<U>::create(alloc_);
+    buckets_.push_back(b);
+    return *b;
+  }
+
+  template <class Self, class F>
+  static constexpr void for_each_base(Self& self, F& f) {
+    using base_type = std::conditional_t<std::is_const_v<Self>, const T, T>;
+    for (bucket* b : self.buckets_) {
+      base_range r = b->bases_(*b);
+      auto* p = reinterpret_cast<std::byte*>(r.first);
+      for (std::size_t i = 0; i < r.size; ++i, p += r.stride) {
+        f(static_cast<base_type&>(*std::launder(reinterpret_cast<T*>(p))));
+      }
+    }
+  }
+
+  template <class U, class Self, class F>
+  static constexpr void for_each_derived(Self& self, F& f) {
+    using derived_type = std::conditional_t<std::is_const_v<Self>, const U, U>;
+    if (auto* b = self.template find_bucket<U>()) {
+      for (derived_type& u : b->objects_) {
+        f(u);
+      }
+    }
+  }
+
+ public:
+  using value_type = T;
+  using allocator_type = A;
+  using size_type = std::size_t;
+
+  //
+  // Constructors.
+  //
+
+  constexpr polymorphic_collection()
+    requires std::default_initializable<A>
+      : polymorphic_collection(std::allocator_arg_t{}, A{}) {}
+
+  explicit constexpr polymorphic_collection(std::allocator_arg_t,
+                                            const A& alloc)
+      : alloc_(alloc), buckets_(bucket_allocator(alloc)) {}
+
+  constexpr polymorphic_collection(const polymorphic_collection& other)
+      : polymorphic_collection(
+            std::allocator_arg_t{},
+            allocator_traits::select_on_container_copy_construction(
+                other.alloc_),
+            other) {}
+
+  constexpr polymorphic_collection(std::allocator_arg_t, const A& alloc,
+                                   const polymorphic_collection& other)
+      : alloc_(alloc), buckets_(bucket_allocator(alloc)) {
+    buckets_.reserve(other.buckets_.size());
+    try {
+      for (bucket* b : other.buckets_) {
+        buckets_.push_back(b->clone(alloc_));
+      }
+    } catch (...) {
+      reset();
+      throw;
+    }
+  }
+
+  constexpr polymorphic_collection(polymorphic_collection&& other) noexcept
+      : alloc_(other.alloc_), buckets_(std::move(other.buckets_)) {
+    other.buckets_.clear();
+  }
+
+  constexpr polymorphic_collection(std::allocator_arg_t, const A& alloc,
+                                   polymorphic_collection&& other) noexcept(
+      allocator_traits::is_always_equal::value)
+      : polymorphic_collection(std::allocator_arg_t{}, alloc) {
+    if constexpr (allocator_traits::is_always_equal::value) {
+      buckets_ = std::move(other.buckets_);
+      other.buckets_.clear();
+    } else {
+      if (alloc_ == other.alloc_) {
+        buckets_ = std::move(other.buckets_);
+        other.buckets_.clear();
+      } else {
+        buckets_.reserve(other.buckets_.size());
+        try {
+          for (bucket* b : other.buckets_) {
+            buckets_.push_back(b->move(alloc_));
+          }
+        } catch (...) {
+          reset();
+          throw;
+        }
+        other.reset();
+      }
+    }
+  }
+
+  //
+  // Destructor.
+  //
+
+  constexpr ~polymorphic_collection() { reset(); }
+
+  //
+  // Assignment operators.
+  //
+
+  constexpr polymorphic_collection& operator=(
+      const polymorphic_collection& other) {
+    if (this == &other) return *this;
+    bool update_alloc =
+        allocator_traits::propagate_on_container_copy_assignment::value;
+    // Copying could throw so build the copy before releasing our buckets.
+    polymorphic_collection tmp(std::allocator_arg_t{},
+                               update_alloc ? other.alloc_ : alloc_, other);
+    reset();
+    if (update_alloc) {
+      alloc_ = other.alloc_;
+    }
+    buckets_ = std::move(tmp.buckets_);
+    tmp.buckets_.clear();
+    return *this;
+  }
+
+  constexpr polymorphic_collection& operator=(
+      polymorphic_collection&& other) noexcept(
+      allocator_traits::propagate_on_container_move_assignment::value ||
+      allocator_traits::is_always_equal::value) {
+    if (this == &other) return *this;
+    bool update_alloc =
+        allocator_traits::propagate_on_container_move_assignment::value;
+    if (update_alloc || alloc_ == other.alloc_) {
+      reset();
+      if (update_alloc) {
+        alloc_ = other.alloc_;
+      }
+      buckets_ = std::move(other.buckets_);
+      other.buckets_.clear();
+    } else {
+      polymorphic_collection tmp(std::allocator_arg_t{}, alloc_,
+                                 std::move(other));
+      reset();
+      buckets_ = std::move(tmp.buckets_);
+      tmp.buckets_.clear();
+    }
+    return *this;
+  }
+
+  //
+  // Accessors.
+  //
+
+  [[nodiscard]] constexpr bool empty() const noexcept { return size() == 0; }
+
+  [[nodiscard]] constexpr size_type size() const noexcept {
+    size_type n = 0;
+    for (bucket* b : buckets_) {
+      n += b->size();
+    }
+    return n;
+  }
+
+  // Returns the number of objects whose dynamic type is U.
+  template <class U>
+  [[nodiscard]] constexpr size_type count() const noexcept {
+    auto* b = find_bucket<U>();
+    return b == nullptr ? 0 : b->size();
+  }
+
+  constexpr allocator_type get_allocator() const noexcept { return alloc_; }
+
+  //
+  // Iteration.
+  //
+
+  // Calls `f` with every object as a T&, bucket by bucket.
+  template <class F>
+  constexpr void for_each(F f) {
+    for_each_base(*this, f);
+  }
+
+  template <class F>
+  constexpr void for_each(F f) const {
+    for_each_base(*this, f);
+  }
+
+  // Calls `f` with every object whose dynamic type is one of `Us` as a U&.
+  template <class... Us, class F>
+  constexpr void for_each_as(F f)
+    requires(sizeof...(Us) > 0) && (std::derived_from<Us, T> && ...)
+  {
+    (for_each_derived<Us>(*this, f), ...);
+  }
+
+  template <class... Us, class F>
+  constexpr void for_each_as(F f) const
+    requires(sizeof...(Us) > 0) && (std::derived_from<Us, T> && ...)
+  {
+    (for_each_derived<Us>(*this, f), ...);
+  }
+
+  //
+  // Modifiers.
+  //
+
+  template <class U>
+  constexpr void reserve(size_type n)
+    requires std::copy_constructible<U> && std::derived_from<U, T>
+  {
+    get_or_create_bucket<U>().objects_.reserve(n);
+  }
+
+  template <class U>
+  constexpr void insert(U&& u)
+    requires std::copy_constructible<std::remove_cvref_t<U>> &&
+             std::derived_from<std::remove_cvref_t<U>, T>
+  {
+    emplace<std::remove_cvref_t<U>>(std::forward<U>(u));
+  }
+
+  template <class U, class... Ts>
+  constexpr U& emplace(Ts&&... ts)
+    requires std::same_as<std::remove_cvref_t<U>, U> &&
+             std::constructible_from<U, Ts&&...> &&
+             std::copy_constructible<U> && std::derived_from<U, T>
+  {
+    return get_or_create_bucket<U>().objects_.emplace_back(
+        std::forward<Ts>(ts)...);
+  }
+
+  // Destroys every object but keeps the buckets and their capacity.
+  constexpr void clear() noexcept {
+    for (bucket* b : buckets_) {
+      b->clear();
+    }
+  }
+
+  constexpr void swap(polymorphic_collection& other) noexcept(
+      allocator_traits::propagate_on_container_swap::value ||
+      allocator_traits::is_always_equal::value) {
+    if constexpr (allocator_traits::propagate_on_container_swap::value) {
+      std::swap(alloc_, other.alloc_);
+    } else {
+      assert(alloc_ == other.alloc_);  // LCOV_EXCL_LINE
+    }
+    buckets_.swap(other.buckets_);
+  }
+
+  friend constexpr void swap(
+      polymorphic_collection& lhs,
+      polymorphic_collection& rhs) noexcept(noexcept(lhs.swap(rhs))) {
+    lhs.swap(rhs);
+  }
+
+ private:
+  constexpr void reset() noexcept {
+    for (bucket* b : buckets_) {
+      b->destroy(alloc_);
+    }
+    buckets_.clear();
+  }
+};
+
+}  // namespace xyz
+
+#endif  // XYZ_POLYMORPHIC_COLLECTION_H_
@@ -0,0 +1,3 @@
+// A cc file for polymorphic_inline_vtable to ensure that the header file can be
+// compiled.
+#include "experimental/polymorphic_inline_vtable.h"  // NOLINT
@@ -0,0 +1,2 @@
+// A cc file for polymorphic_sbo to ensure that the header file can be compiled.
+#include "experimental/polymorphic_sbo.h"  // NOLINT
@@ -0,0 +1,547 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+// An experimental implementation of polymorphic with a small buffer
+// optimization.
+//
+// Derived types no larger than `Size` bytes, no more aligned than `Align` and
+// with a non-throwing move constructor have their control block constructed in
+// a buffer inside the polymorphic object. Other derived types, and all types
+// during constant evaluation, are allocated with the allocator as in
+// polymorphic.h.
+
+#ifndef XYZ_POLYMORPHIC_H_
+#define XYZ_POLYMORPHIC_H_
+
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#ifndef XYZ_POLYMORPHIC_HAS_EXTENDED_CONSTRUCTORS
+#define XYZ_POLYMORPHIC_HAS_EXTENDED_CONSTRUCTORS 1
+#endif  // XYZ_POLYMORPHIC_HAS_EXTENDED_CONSTRUCTORS
+
+#ifndef XYZ_POLYMORPHIC_SBO_DEFAULT_SIZE
+#define XYZ_POLYMORPHIC_SBO_DEFAULT_SIZE (3 * sizeof(void*))
+#endif  // XYZ_POLYMORPHIC_SBO_DEFAULT_SIZE
+
+#ifndef XYZ_POLYMORPHIC_SBO_DEFAULT_ALIGNMENT
+#define XYZ_POLYMORPHIC_SBO_DEFAULT_ALIGNMENT alignof(void*)
+#endif  // XYZ_POLYMORPHIC_SBO_DEFAULT_ALIGNMENT
+
+namespace xyz {
+
+#ifndef XYZ_UNREACHABLE_DEFINED
+#define XYZ_UNREACHABLE_DEFINED
+
+[[noreturn]] inline void unreachable() {  // LCOV_EXCL_LINE
+#if (__cpp_lib_unreachable >= 202202L)
+  std::unreachable();  // LCOV_EXCL_LINE
+#elif defined(_MSC_VER)
+  __assume(false);  // LCOV_EXCL_LINE
+#else
+  __builtin_unreachable();  // LCOV_EXCL_LINE
+#endif
+}
+#endif  // XYZ_UNREACHABLE_DEFINED
+
+template <class T, class A = std::allocator<T>,
+          std::size_t Size = XYZ_POLYMORPHIC_SBO_DEFAULT_SIZE,
+          std::size_t Align = XYZ_POLYMORPHIC_SBO_DEFAULT_ALIGNMENT>
+class polymorphic {
+  struct control_block {
+    using allocator_traits = std::allocator_traits<A>;
+    typename allocator_traits::pointer p_;
+
+    virtual constexpr ~control_block() = default;
+    virtual constexpr void destroy(A& alloc) = 0;
+    virtual constexpr control_block* clone(const A& alloc,
+                                           std::byte* buffer) = 0;
+    virtual constexpr control_block* move(const A& alloc,
+                                          std::byte* buffer) = 0;
+
+    // Moves the control block into `buffer` if it is stored inline and
+    // returns the address of the control block that now owns the object.
+    virtual constexpr control_block* relocate(std::byte* buffer) noexcept = 0;
+  };
+
+  static constexpr std::size_t round_up(std::size_t n, std::size_t align) {
+    return (n + align - 1) / align * align;
+  }
+
+  static constexpr std::size_t buffer_alignment =
+      Align > alignof(control_block) ? Align : alignof(control_block);
+
+  static constexpr std::size_t buffer_size = round_up(
+      round_up(sizeof(control_block), Align) + Size, buffer_alignment);
+
+  template <class U>
+  static constexpr bool is_stored_inline =
+      sizeof(U) <= Size && alignof(U) <= Align &&
+      std::is_nothrow_move_constructible_v<U>;
+
+  template <class U>
+  class direct_control_block final : public control_block {
+    union uninitialized_storage {
+      U u_;
+
+      constexpr uninitialized_storage() {}
+
+      constexpr ~uninitialized_storage() {}
+    } storage_;
+
+    using cb_allocator = typename std::allocator_traits<
+        A>::template rebind_alloc<direct_control_block<U>>;
+    using cb_alloc_traits = std::allocator_traits<cb_allocator>;
+
+   public:
+    template <class... Ts>
+    constexpr direct_control_block(const A& alloc, Ts&&... ts) {
+      cb_allocator cb_alloc(alloc);
+      cb_alloc_traits::construct(cb_alloc, std::addressof(storage_.u_),
+                                 std::forward<Ts>(ts)...);
+      control_block::p_ = std::addressof(storage_.u_);
+    }
+
+    constexpr control_block* clone(const A& alloc, std::byte*) override {
+      cb_allocator cb_alloc(alloc);
+      auto mem = cb_alloc_traits::allocate(cb_alloc, 1);
+      try {
+        cb_alloc_traits::construct(cb_alloc, mem, alloc, storage_.u_);
+        return mem;
+      } catch (...) {
+        cb_alloc_traits::deallocate(cb_alloc, mem, 1);
+        throw;
+      }
+    }
+
+    constexpr control_block* move(const A& alloc, std::byte*) override {
+      cb_allocator cb_alloc(alloc);
+      auto mem = cb_alloc_traits::allocate(cb_alloc, 1);
+      try {
+        cb_alloc_traits::construct(cb_alloc, mem, alloc,
+                                   std::move(storage_.u_));
+        return mem;
+      } catch (...) {
+        cb_alloc_traits::deallocate(cb_alloc, mem, 1);
+        throw;
+      }
+    }
+
+    constexpr control_block* relocate(std::byte*) noexcept override {
+      return this;
+    }
+
+    constexpr void destroy(A& alloc) override {
+      cb_allocator cb_alloc(alloc);
+      cb_alloc_traits::destroy(cb_alloc, std::addressof(storage_.u_));
+      cb_alloc_traits::deallocate(cb_alloc, this, 1);
+    }
+  };
+
+  template <class U>
+  class inline_control_block final : public control_block {
+    union uninitialized_storage {
+      U u_;
+
+      constexpr uninitialized_storage() {}
+
+      constexpr ~uninitialized_storage() {}
+    } storage_;
+
+    using cb_allocator = typename std::allocator_traits<
+        A>::template rebind_alloc<inline_control_block<U>>;
+    using cb_alloc_traits = std::allocator_traits<cb_allocator>;
+
+    struct relocate_tag {};
+
+    constexpr inline_control_block(relocate_tag, U&& u) noexcept {
+      std::construct_at(std::addressof(storage_.u_), std::move(u));
+      control_block::p_ = std::addressof(storage_.u_);
+    }
+
+   public:
+    template <class... Ts>
+    constexpr inline_control_block(const A& alloc, Ts&&... ts) {
+      cb_allocator cb_alloc(alloc);
+      cb_alloc_traits::construct(cb_alloc, std::addressof(storage_.u_),
+                                 std::forward<Ts>(ts)...);
+      control_block::p_ = std::addressof(storage_.u_);
+    }
+
+    constexpr control_block* clone(const A& alloc,
+                                   std::byte* buffer) override {
+      return ::new (static_cast<void*>(buffer))
+          inline_control_block(alloc, storage_.u_);
+    }
+
+    constexpr control_block* move(const A& alloc, std::byte* buffer) override {
+      return ::new (static_cast<void*>(buffer))
+          inline_control_block(alloc, std::move(storage_.u_));
+    }
+
+    constexpr control_block* relocate(std::byte* buffer) noexcept override {
+      auto cb = ::new (static_cast<void*>(buffer))
+          inline_control_block(relocate_tag{}, std::move(storage_.u_));
+      std::destroy_at(std::addressof(storage_.u_));
+      std::destroy_at(this);
+      return cb;
+    }
+
+    constexpr void destroy(A& alloc) override {
+      cb_allocator cb_alloc(alloc);
+      cb_alloc_traits::destroy(cb_alloc, std::addressof(storage_.u_));
+      std::destroy_at(this);
+    }
+  };
+
+  control_block* cb_;
+
+  alignas(buffer_alignment) std::byte buffer_[buffer_size];
+
+#if defined(_MSC_VER)
+  // https://devblogs.microsoft.com/cppblog/msvc-cpp20-and-the-std-cpp20-switch/#msvc-extensions-and-abi
+  [[msvc::no_unique_address]] A alloc_;
+#else
+  [[no_unique_address]] A alloc_;
+#endif
+
+  using allocator_traits = std::allocator_traits<A>;
+
+  template <class U, class... Ts>
+  [[nodiscard]] constexpr control_block* create_control_block(Ts&&... ts) {
+    if constexpr (is_stored_inline<U>) {
+      static_assert(sizeof(inline_control_block<U>) <= buffer_size);
+      static_assert(alignof(inline_control_block<U>) <= buffer_alignment);
+      // Placement new is not usable in constant evaluation so we fall back to
+      // the allocator.
+      if (!std::is_constant_evaluated()) {
+        return ::new (static_cast<void*>(buffer_))
+            inline_control_block<U>(alloc_, std::forward<Ts>(ts)...);
+      }
+    }
+    using cb_allocator = typename std::allocator_traits<
+        A>::template rebind_alloc<direct_control_block<U>>;
+    cb_allocator cb_alloc(alloc_);
+    using cb_alloc_traits = std::allocator_traits<cb_allocator>;
+    auto mem = cb_alloc_traits::allocate(cb_alloc, 1);
+    try {
+      cb_alloc_traits::construct(cb_alloc, mem, alloc_,
+                                 std::forward<Ts>(ts)...);
+      return mem;
+    } catch (...) {
+      cb_alloc_traits::deallocate(cb_alloc, mem, 1);
+      throw;
+    }
+  }
+
+ public:
+  using value_type = T;
+  using allocator_type = A;
+  using pointer = typename allocator_traits::pointer;
+  using const_pointer = typename allocator_traits::const_pointer;
+
+  //
+  // Constructors.
+  //
+
+  explicit constexpr polymorphic()
+    requires std::default_initializable<A>
+      : polymorphic(std::allocator_arg_t{}, A{}) {
+    static_assert(std::default_initializable<T> && std::copy_constructible<T>);
+  }
+
+  template <class U>
+  constexpr explicit polymorphic(U&& u)
+    requires(!std::same_as<polymorphic, std::remove_cvref_t<U>>) &&
+            std::copy_constructible<std::remove_cvref_t<U>> &&
+            std::derived_from<std::remove_cvref_t<U>, T> &&
+            std::default_initializable<A>
+      : polymorphic(std::allocator_arg_t{}, A{}, std::forward<U>(u)) {}
+
+  template <class U, class... Ts>
+  explicit constexpr polymorphic(std::in_place_type_t<U>, Ts&&... ts)
+    requires std::same_as<std::remove_cvref_t<U>, U> &&
+             std::constructible_from<U, Ts&&...> &&
+             std::copy_constructible<U> && std::derived_from<U, T> &&
+             std::default_initializable<A>
+      : polymorphic(std::allocator_arg_t{}, A{}, std::in_place_type<U>,
+                    std::forward<Ts>(ts)...) {}
+
+  template <class U, class I, class... Ts>
+  explicit constexpr polymorphic(std::in_place_type_t<U>,
+                                 std::initializer_list<I> ilist, Ts&&... ts)
+    requires std::same_as<std::remove_cvref_t<U>, U> &&
+             std::constructible_from<U, std::initializer_list<I>, Ts&&...> &&
+             std::copy_constructible<U> && std::derived_from<U, T> &&
+             std::default_initializable<A>
+      : polymorphic(std::allocator_arg_t{}, A{}, std::in_place_type<U>, ilist,
+                    std::forward<Ts>(ts)...) {}
+
+  constexpr polymorphic(const polymorphic& other)
+      : polymorphic(std::allocator_arg_t{},
+                    allocator_traits::select_on_container_copy_construction(
+                        other.alloc_),
+                    other) {}
+
+  constexpr polymorphic(polymorphic&& other) noexcept(
+      allocator_traits::is_always_equal::value)
+      : polymorphic(std::allocator_arg_t{}, other.alloc_, std::move(other)) {}
+
+  //
+  // Allocator-extended constructors.
+  //
+
+  explicit constexpr polymorphic(std::allocator_arg_t, const A& alloc)
+      : alloc_(alloc) {
+    static_assert(std::default_initializable<T> && std::copy_constructible<T>);
+
+    cb_ = create_control_block<T>();
+  }
+
+  template <class U>
+  constexpr explicit polymorphic(std::allocator_arg_t, const A& alloc, U&& u)
+    requires(not std::same_as<polymorphic, std::remove_cvref_t<U>>) &&
+            std::copy_constructible<std::remove_cvref_t<U>> &&
+            std::derived_from<std::remove_cvref_t<U>, T>
+      : alloc_(alloc) {
+    cb_ = create_control_block<std::remove_cvref_t<U>>(std::forward<U>(u));
+  }
+
+  template <class U, class... Ts>
+  explicit constexpr polymorphic(std::allocator_arg_t, const A& alloc,
+                                 std::in_place_type_t<U>, Ts&&... ts)
+    requires std::same_as<std::remove_cvref_t<U>, U> &&
+             std::constructible_from<U, Ts&&...> &&
+             std::copy_constructible<U> && std::derived_from<U, T>
+      : alloc_(alloc) {
+    cb_ = create_control_block<U>(std::forward<Ts>(ts)...);
+  }
+
+  template <class U, class I, class... Ts>
+  explicit constexpr polymorphic(std::allocator_arg_t, const A& alloc,
+                                 std::in_place_type_t<U>,
+                                 std::initializer_list<I> ilist, Ts&&... ts)
+    requires std::same_as<std::remove_cvref_t<U>, U> &&
+             std::constructible_from<U, std::initializer_list<I>, Ts&&...> &&
+             std::copy_constructible<U> && std::derived_from<U, T>
+      : alloc_(alloc) {
+    cb_ = create_control_block<U>(ilist, std::forward<Ts>(ts)...);
+  }
+
+  constexpr polymorphic(std::allocator_arg_t, const A& alloc,
+                        const polymorphic& other)
+      : alloc_(alloc) {
+    if (!other.valueless_after_move()) {
+      cb_ = other.cb_->clone(alloc_, buffer_);
+    } else {
+      cb_ = nullptr;
+    }
+  }
+
+  constexpr polymorphic(
+      std::allocator_arg_t, const A& alloc,
+      polymorphic&& other) noexcept(allocator_traits::is_always_equal::value)
+      : alloc_(alloc) {
+    if constexpr (allocator_traits::is_always_equal::value) {
+      take_from(other);
+    } else {
+      if (alloc_ == other.alloc_) {
+        take_from(other);
+      } else {
+        if (!other.valueless_after_move()) {
+          cb_ = other.cb_->move(alloc_, buffer_);
+        } else {
+          cb_ = nullptr;
+        }
+      }
+    }
+  }
+
+  //
+  // Destructor.
+  //
+
+  constexpr ~polymorphic() { reset(); }
+
+  //
+  // Assignment operators.
+  //
+
+  constexpr polymorphic& operator=(const polymorphic& other) {
+    if (this == &other) return *this;
+
+    // Check to see if the allocators need to be updated.
+    // We defer actually updating the allocator until later because it may be
+    // needed to delete the current control block.
+    bool update_alloc =
+        allocator_traits::propagate_on_container_copy_assignment::value;
+
+    if (other.valueless_after_move()) {
+      reset();
+    } else {
+      // Constructing a new control block could throw so we need to defer
+      // resetting or updating allocators until this is done. Inline control
+      // blocks are built in a temporary buffer and relocated afterwards.
+      alignas(buffer_alignment) std::byte tmp_buffer[buffer_size];
+
+      // Inlining the allocator into the construct_from call confuses LCOV.
+      auto tmp =
+          other.cb_->clone(update_alloc ? other.alloc_ : alloc_, tmp_buffer);
+      reset();
+      cb_ = relocate(tmp, buffer_);
+    }
+    if (update_alloc) {
+      alloc_ = other.alloc_;
+    }
+    return *this;
+  }
+
+  constexpr polymorphic& operator=(polymorphic&& other) noexcept(
+      allocator_traits::propagate_on_container_move_assignment::value ||
+      allocator_traits::is_always_equal::value) {
+    if (this == &other) return *this;
+
+    // Check to see if the allocators need to be updated.
+    // We defer actually updating the allocator until later because it may be
+    // needed to delete the current control block.
+    bool update_alloc =
+        allocator_traits::propagate_on_container_move_assignment::value;
+
+    if (other.valueless_after_move()) {
+      reset();
+    } else {
+      if (alloc_ == other.alloc_) {
+        reset();
+        take_from(other);
+      } else {
+        // Constructing a new control block could throw so we need to defer
+        // resetting or updating allocators until this is done.
+        alignas(buffer_alignment) std::byte tmp_buffer[buffer_size];
+
+        // Inlining the allocator into the construct_from call confuses LCOV.
+        auto tmp =
+            other.cb_->move(update_alloc ? other.alloc_ : alloc_, tmp_buffer);
+        reset();
+        cb_ = relocate(tmp, buffer_);
+      }
+    }
+
+    if (update_alloc) {
+      alloc_ = other.alloc_;
+    }
+    return *this;
+  }
+
+  //
+  // Accessors.
+  //
+
+  [[nodiscard]] constexpr pointer operator->() noexcept {
+    assert(!valueless_after_move());  // LCOV_EXCL_LINE
+    return cb_->p_;
+  }
+
+  [[nodiscard]] constexpr const_pointer operator->() const noexcept {
+    assert(!valueless_after_move());  // LCOV_EXCL_LINE
+    return cb_->p_;
+  }
+
+  [[nodiscard]] constexpr T& operator*() noexcept {
+    assert(!valueless_after_move());  // LCOV_EXCL_LINE
+    return *cb_->p_;
+  }
+
+  [[nodiscard]] constexpr const T& operator*() const noexcept {
+    assert(!valueless_after_move());  // LCOV_EXCL_LINE
+    return *cb_->p_;
+  }
+
+  [[nodiscard]] constexpr bool valueless_after_move() const noexcept {
+    return cb_ == nullptr;
+  }
+
+  constexpr allocator_type get_allocator() const noexcept { return alloc_; }
+
+  //
+  // Modifiers.
+  //
+
+  constexpr void swap(polymorphic& other) noexcept(
+      std::allocator_traits<A>::propagate_on_container_swap::value ||
+      std::allocator_traits<A>::is_always_equal::value) {
+    if (this == &other) return;
+
+    if constexpr (allocator_traits::propagate_on_container_swap::value) {
+      // If allocators move with their allocated objects, we can swap both.
+      std::swap(alloc_, other.alloc_);
+      swap_control_blocks(other);
+      return;
+    } else /* constexpr */ {
+      if (alloc_ == other.alloc_) {
+        swap_control_blocks(other);
+      } else {
+        unreachable();  // LCOV_EXCL_LINE
+      }
+    }
+  }
+
+  friend constexpr void swap(polymorphic& lhs, polymorphic& rhs) noexcept(
+      noexcept(lhs.swap(rhs))) {
+    lhs.swap(rhs);
+  }
+
+ private:
+  constexpr void reset() noexcept {
+    if (cb_ != nullptr) {
+      cb_->destroy(alloc_);
+      cb_ = nullptr;
+    }
+  }
+
+  [[nodiscard]] static constexpr control_block* relocate(
+      control_block* cb, std::byte* buffer) noexcept {
+    // Control blocks are never stored inline during constant evaluation.
+    if (cb == nullptr || std::is_constant_evaluated()) return cb;
+    return cb->relocate(buffer);
+  }
+
+  // Takes ownership of the object owned by `other`, which is left valueless.
+  // The allocators of `this` and `other` must compare equal.
+  constexpr void take_from(polymorphic& other) noexcept {
+    cb_ = relocate(std::exchange(other.cb_, nullptr), buffer_);
+  }
+
+  constexpr void swap_control_blocks(polymorphic& other) noexcept {
+    alignas(buffer_alignment) std::byte tmp_buffer[buffer_size];
+    control_block* tmp = relocate(other.cb_, tmp_buffer);
+    other.cb_ = relocate(cb_, other.buffer_);
+    cb_ = relocate(tmp, buffer_);
+  }
+};
+
+}  // namespace xyz
+
+#endif  // XYZ_POLYMORPHIC_H_
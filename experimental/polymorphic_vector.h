@@ -0,0 +1,643 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+// An experimental value-semantic sequence of objects derived from T.
+//
+// polymorphic_vector<T> behaves like std::vector<polymorphic<T>> without
+// valueless elements, but stores its elements back to back in a single byte
+// buffer instead of one allocation per element. An offset table records where
+// each element and its T subobject live and how to copy, move and destroy it.
+// Copying a polymorphic_vector copies each element as its derived type, as
+// copying a polymorphic does.
+//
+// Growing the buffer moves every element (or copies it if its move
+// constructor can throw) and invalidates references and iterators. Derived
+// types must not be over-aligned.
+
+#ifndef XYZ_POLYMORPHIC_VECTOR_H_
+#define XYZ_POLYMORPHIC_VECTOR_H_
+
+#include <algorithm>
+#include <cassert>
+#include <compare>
+#include <concepts>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace xyz {
+
+template <class T, class A = std::allocator<T>>
+class polymorphic_vector {
+  // The buffer is allocated in units of storage so that every offset that is
+  // a multiple of a derived type's alignment is suitably aligned.
+  struct alignas(std::max_align_t) storage {
+    std::byte bytes_[alignof(std::max_align_t)];
+  };
+
+  using storage_allocator =
+      typename std::allocator_traits<A>::template rebind_alloc<storage>;
+  using storage_alloc_traits = std::allocator_traits<storage_allocator>;
+  using storage_pointer = typename storage_alloc_traits::pointer;
+
+  // How to copy, move and destroy an element of a particular derived type.
+  struct element_ops {
+    void (*copy_)(const A& alloc, std::byte* dst, const std::byte* src);
+    void (*move_)(const A& alloc, std::byte* dst, std::byte* src);
+    void (*destroy_)(const A& alloc, std::byte* p) noexcept;
+  };
+
+  template <class U>
+  static U* as(std::byte* p) noexcept {
+    return std::launder(reinterpret_cast<U*>(p));
+  }
+
+  template <class U>
+  static const U* as(const std::byte* p) noexcept {
+    return std::launder(reinterpret_cast<const U*>(p));
+  }
+
+  template <class U, class... Ts>
+  static U* construct_element(const A& alloc, std::byte* p, Ts&&... ts) {
+    using u_allocator =
+        typename std::allocator_traits<A>::template rebind_alloc<U>;
+    using u_alloc_traits = std::allocator_traits<u_allocator>;
+    u_allocator u_alloc(alloc);
+    U* u = reinterpret_cast<U*>(p);
+    u_alloc_traits::construct(u_alloc, u, std::forward<Ts>(ts)...);
+    return as<U>(p);
+  }
+
+  template <class U>
+  static constexpr element_ops ops_for{
+      [](const A& alloc, std::byte* dst, const std::byte* src) {
+        construct_element<U>(alloc, dst, *as<U>(src));
+      },
+      [](const A& alloc, std::byte* dst, std::byte* src) {
+        construct_element<U>(alloc, dst, std::move_if_noexcept(*as<U>(src)));
+      },
+      [](const A& alloc, std::byte* p) noexcept {
+        using u_allocator =
+            typename std::allocator_traits<A>::template rebind_alloc<U>;
+        using u_alloc_traits = std::allocator_traits<u_allocator>;
+        u_allocator u_alloc(alloc);
+        u_alloc_traits::destroy(u_alloc, as<U>(p));
+      }};
+
+  // `offset_` locates the derived object and `base_offset_` its T subobject.
+  struct entry {
+    std::size_t offset_;
+    std::size_t base_offset_;
+    const element_ops* ops_;
+  };
+
+  using entry_allocator =
+      typename std::allocator_traits<A>::template rebind_alloc<entry>;
+
+  using allocator_traits = std::allocator_traits<A>;
+
+#if defined(_MSC_VER)
+  // https://devblogs.microsoft.com/cppblog/msvc-cpp20-and-the-std-cpp20-switch/#msvc-extensions-and-abi
+  [[msvc::no_unique_address]] A alloc_;
+#else
+  [[no_unique_address]] A alloc_;
+#endif
+  storage_pointer data_ = nullptr;
+  std::size_t capacity_ = 0;  // In bytes.
+  std::size_t used_ = 0;      // In bytes.
+  std::vector<entry, entry_allocator> entries_;
+
+  template <bool Const>
+  class iterator_base {
+    friend class polymorphic_vector;
+    friend class iterator_base<!Const>;
+
+    using byte_type = std::conditional_t<Const, const std::byte, std::byte>;
+
+    const entry* e_ = nullptr;
+    byte_type* data_ = nullptr;
+
+    iterator_base(const entry* e, byte_type* data) noexcept
+        : e_(e), data_(data) {}
+
+   public:
+    using iterator_concept = std::random_access_iterator_tag;
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using reference = std::conditional_t<Const, const T&, T&>;
+    using pointer = std::conditional_t<Const, const T*, T*>;
+
+    iterator_base() = default;
+
+    template <bool OtherConst>
+    iterator_base(const iterator_base<OtherConst>& other) noexcept
+      requires(Const && !OtherConst)
+        : e_(other.e_), data_(other.data_) {}
+
+    reference operator*() const noexcept {
+      return *as<T>(data_ + e_->base_offset_);
+    }
+
+    pointer operator->() const noexcept { return std::addressof(**this); }
+
+    reference operator[](difference_type n) const noexcept {
+      return *(*this + n);
+    }
+
+    iterator_base& operator++() noexcept {
+      ++e_;
+      return *this;
+    }
+
+    iterator_base operator++(int) noexcept {
+      auto tmp = *this;
+      ++e_;
+      return tmp;
+    }
+
+    iterator_base& operator--() noexcept {
+      --e_;
+      return *this;
+    }
+
+    iterator_base operator--(int) noexcept {
+      auto tmp = *this;
+      --e_;
+      return tmp;
+    }
+
+    iterator_base& operator+=(difference_type n) noexcept {
+      e_ += n;
+      return *this;
+    }
+
+    iterator_base& operator-=(difference_type n) noexcept {
+      e_ -= n;
+      return *this;
+    }
+
+    friend iterator_base operator+(iterator_base it,
+                                   difference_type n) noexcept {
+      return it += n;
+    }
+
+    friend iterator_base operator+(difference_type n,
+                                   iterator_base it) noexcept {
+      return it += n;
+    }
+
+    friend iterator_base operator-(iterator_base it,
+                                   difference_type n) noexcept {
+      return it -= n;
+    }
+
+    friend difference_type operator-(const iterator_base& lhs,
+                                     const iterator_base& rhs) noexcept {
+      return lhs.e_ - rhs.e_;
+    }
+
+    friend bool operator==(const iterator_base& lhs,
+                           const iterator_base& rhs) noexcept {
+      return lhs.e_ == rhs.e_;
+    }
+
+    friend std::strong_ordering operator<=>(const iterator_base& lhs,
+                                            const iterator_base& rhs) noexcept {
+      return std::compare_three_way{}(lhs.e_, rhs.e_);
+    }
+  };
+
+ public:
+  using value_type = T;
+  using allocator_type = A;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = T&;
+  using const_reference = const T&;
+  using iterator = iterator_base<false>;
+  using const_iterator = iterator_base<true>;
+
+  //
+  // Constructors.
+  //
+
+  constexpr polymorphic_vector()
+    requires std::default_initializable<A>
+      : polymorphic_vector(std::allocator_arg_t{}, A{}) {}
+
+  explicit constexpr polymorphic_vector(std::allocator_arg_t, const A& alloc)
+      : alloc_(alloc), entries_(entry_allocator(alloc)) {}
+
+  constexpr polymorphic_vector(const polymorphic_vector& other)
+      : polymorphic_vector(
+            std::allocator_arg_t{},
+            allocator_traits::select_on_container_copy_construction(
+                other.alloc_),
+            other) {}
+
+  constexpr polymorphic_vector(std::allocator_arg_t, const A& alloc,
+                               const polymorphic_vector& other)
+      : alloc_(alloc), entries_(entry_allocator(alloc)) {
+    assign_from(other,
+                [](const entry& e, const A& a, std::byte* dst,
+                   const std::byte* src) { e.ops_->copy_(a, dst, src); });
+  }
+
+  constexpr polymorphic_vector(polymorphic_vector&& other) noexcept
+      : alloc_(other.alloc_),
+        data_(std::exchange(other.data_, nullptr)),
+        capacity_(std::exchange(other.capacity_, 0)),
+        used_(std::exchange(other.used_, 0)),
+        entries_(std::move(other.entries_)) {
+    other.entries_.clear();
+  }
+
+  constexpr polymorphic_vector(std::allocator_arg_t, const A& alloc,
+                               polymorphic_vector&& other) noexcept(
+      allocator_traits::is_always_equal::value)
+      : alloc_(alloc), entries_(entry_allocator(alloc)) {
+    if (alloc_ == other.alloc_) {
+      steal_from(other);
+    } else {
+      assign_from(other,
+                  [](const entry& e, const A& a, std::byte* dst,
+                     std::byte* src) { e.ops_->move_(a, dst, src); });
+      other.clear();
+    }
+  }
+
+  //
+  // Destructor.
+  //
+
+  constexpr ~polymorphic_vector() { reset(); }
+
+  //
+  // Assignment operators.
+  //
+
+  constexpr polymorphic_vector& operator=(const polymorphic_vector& other) {
+    if (this == &other) return *this;
+    bool update_alloc =
+        allocator_traits::propagate_on_container_copy_assignment::value;
+    // Copying could throw so build the copy before releasing our elements.
+    polymorphic_vector tmp(std::allocator_arg_t{},
+                           update_alloc ? other.alloc_ : alloc_, other);
+    reset();
+    if (update_alloc) {
+      alloc_ = other.alloc_;
+    }
+    steal_from(tmp);
+    return *this;
+  }
+
+  constexpr polymorphic_vector& operator=(polymorphic_vector&& other) noexcept(
+      allocator_traits::propagate_on_container_move_assignment::value ||
+      allocator_traits::is_always_equal::value) {
+    if (this == &other) return *this;
+    bool update_alloc =
+        allocator_traits::propagate_on_container_move_assignment::value;
+    if (update_alloc || alloc_ == other.alloc_) {
+      reset();
+      if (update_alloc) {
+        alloc_ = other.alloc_;
+      }
+      steal_from(other);
+    } else {
+      polymorphic_vector tmp(std::allocator_arg_t{}, alloc_, std::move(other));
+      reset();
+      steal_from(tmp);
+    }
+    return *this;
+  }
+
+  //
+  // Accessors.
+  //
+
+  [[nodiscard]] constexpr T& operator[](size_type i) noexcept {
+    assert(i < size());  // LCOV_EXCL_LINE
+    return *as<T>(bytes() + entries_[i].base_offset_);
+  }
+
+  [[nodiscard]] constexpr const T& operator[](size_type i) const noexcept {
+    assert(i < size());  // LCOV_EXCL_LINE
+    return *as<T>(bytes() + entries_[i].base_offset_);
+  }
+
+  [[nodiscard]] constexpr T& at(size_type i) {
+    if (i >= size()) throw std::out_of_range("polymorphic_vector::at");
+    return (*this)[i];
+  }
+
+  [[nodiscard]] constexpr const T& at(size_type i) const {
+    if (i >= size()) throw std::out_of_range("polymorphic_vector::at");
+    return (*this)[i];
+  }
+
+  [[nodiscard]] constexpr T& front() noexcept { return (*this)[0]; }
+
+  [[nodiscard]] constexpr const T& front() const noexcept {
+    return (*this)[0];
+  }
+
+  [[nodiscard]] constexpr T& back() noexcept { return (*this)[size() - 1]; }
+
+  [[nodiscard]] constexpr const T& back() const noexcept {
+    return (*this)[size() - 1];
+  }
+
+  [[nodiscard]] constexpr iterator begin() noexcept {
+    return iterator(entries_.data(), bytes());
+  }
+
+  [[nodiscard]] constexpr iterator end() noexcept {
+    return iterator(entries_.data() + entries_.size(), bytes());
+  }
+
+  [[nodiscard]] constexpr const_iterator begin() const noexcept {
+    return const_iterator(entries_.data(), bytes());
+  }
+
+  [[nodiscard]] constexpr const_iterator end() const noexcept {
+    return const_iterator(entries_.data() + entries_.size(), bytes());
+  }
+
+  [[nodiscard]] constexpr const_iterator cbegin() const noexcept {
+    return begin();
+  }
+
+  [[nodiscard]] constexpr const_iterator cend() const noexcept {
+    return end();
+  }
+
+  [[nodiscard]] constexpr bool empty() const noexcept {
+    return entries_.empty();
+  }
+
+  [[nodiscard]] constexpr size_type size() const noexcept {
+    return entries_.size();
+  }
+
+  // The number of bytes of the element buffer in use, including padding.
+  [[nodiscard]] constexpr size_type size_in_bytes() const noexcept {
+    return used_;
+  }
+
+  // The number of bytes of the element buffer.
+  [[nodiscard]] constexpr size_type capacity_in_bytes() const noexcept {
+    return capacity_;
+  }
+
+  constexpr allocator_type get_allocator() const noexcept { return alloc_; }
+
+  //
+  // Modifiers.
+  //
+
+  // Reserves room for `n` elements in the offset table and `bytes` bytes in
+  // the element buffer.
+  constexpr void reserve(size_type n, size_type bytes) {
+    entries_.reserve(n);
+    if (bytes > capacity_) {
+      reallocate(bytes);
+    }
+  }
+
+  template <class U>
+  constexpr void push_back(U&& u)
+    requires std::copy_constructible<std::remove_cvref_t<U>> &&
+             std::derived_from<std::remove_cvref_t<U>, T>
+  {
+    emplace_back<std::remove_cvref_t<U>>(std::forward<U>(u));
+  }
+
+  template <class U, class... Ts>
+  constexpr U& emplace_back(Ts&&... ts)
+    requires std::same_as<std::remove_cvref_t<U>, U> &&
+             std::constructible_from<U, Ts&&...> &&
+             std::copy_constructible<U> && std::derived_from<U, T>
+  {
+    static_assert(alignof(U) <= alignof(std::max_align_t),
+                  "polymorphic_vector does not support over-aligned types");
+    if (entries_.size() == entries_.capacity()) {
+      entries_.reserve(std::max<size_type>(2 * entries_.size(), 8));
+    }
+    size_type offset = align_up(used_, alignof(U));
+    size_type end = offset + sizeof(U);
+    U* u;
+    if (end <= capacity_) {
+      u = construct_element<U>(alloc_, bytes() + offset,
+                               std::forward<Ts>(ts)...);
+    } else {
+      // Construct the new element before moving the existing ones as the
+      // arguments could refer to an element of this polymorphic_vector.
+      size_type capacity = std::max(2 * capacity_, end);
+      storage_allocator s_alloc(alloc_);
+      storage_pointer data =
+          storage_alloc_traits::allocate(s_alloc, units_for(capacity));
+      std::byte* new_bytes = to_bytes(data);
+      try {
+        u = construct_element<U>(alloc_, new_bytes + offset,
+                                 std::forward<Ts>(ts)...);
+      } catch (...) {
+        storage_alloc_traits::deallocate(s_alloc, data, units_for(capacity));
+        throw;
+      }
+      try {
+        relocate_to(new_bytes);
+      } catch (...) {
+        ops_for<U>.destroy_(alloc_, new_bytes + offset);
+        storage_alloc_traits::deallocate(s_alloc, data, units_for(capacity));
+        throw;
+      }
+      release_storage();
+      data_ = data;
+      capacity_ = capacity;
+    }
+    size_type base_offset =
+        offset + static_cast<size_type>(
+                     reinterpret_cast<std::byte*>(static_cast<T*>(u)) -
+                     reinterpret_cast<std::byte*>(u));
+    entries_.push_back(entry{offset, base_offset, &ops_for<U>});
+    used_ = end;
+    return *u;
+  }
+
+  constexpr void pop_back() noexcept {
+    assert(!empty());  // LCOV_EXCL_LINE
+    const entry& e = entries_.back();
+    e.ops_->destroy_(alloc_, bytes() + e.offset_);
+    used_ = e.offset_;
+    entries_.pop_back();
+  }
+
+  constexpr void clear() noexcept {
+    destroy_elements();
+    entries_.clear();
+    used_ = 0;
+  }
+
+  constexpr void swap(polymorphic_vector& other) noexcept(
+      allocator_traits::propagate_on_container_swap::value ||
+      allocator_traits::is_always_equal::value) {
+    if constexpr (allocator_traits::propagate_on_container_swap::value) {
+      std::swap(alloc_, other.alloc_);
+    } else {
+      assert(alloc_ == other.alloc_);  // LCOV_EXCL_LINE
+    }
+    std::swap(data_, other.data_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(used_, other.used_);
+    entries_.swap(other.entries_);
+  }
+
+  friend constexpr void swap(
+      polymorphic_vector& lhs,
+      polymorphic_vector& rhs) noexcept(noexcept(lhs.swap(rhs))) {
+    lhs.swap(rhs);
+  }
+
+ private:
+  static constexpr size_type align_up(size_type n, size_type a) noexcept {
+    return (n + a - 1) / a * a;
+  }
+
+  static constexpr size_type units_for(size_type bytes) noexcept {
+    return (bytes + sizeof(storage) - 1) / sizeof(storage);
+  }
+
+  static std::byte* to_bytes(storage_pointer p) noexcept {
+    return p == nullptr ? nullptr
+                        : reinterpret_cast<std::byte*>(std::to_address(p));
+  }
+
+  std::byte* bytes() noexcept { return to_bytes(data_); }
+
+  const std::byte* bytes() const noexcept { return to_bytes(data_); }
+
+  // Copies or moves the elements of `other` into a new buffer laid out
+  // identically. Offsets are relative to a max-aligned buffer so the offset
+  // table can be copied as is.
+  template <class V, class F>
+  void assign_from(V& other, F construct) {
+    if (other.empty()) return;
+    entries_.reserve(other.entries_.size());
+    size_type capacity = other.used_;
+    storage_allocator s_alloc(alloc_);
+    storage_pointer data =
+        storage_alloc_traits::allocate(s_alloc, units_for(capacity));
+    std::byte* dst = to_bytes(data);
+    auto* src = other.bytes();
+    size_type i = 0;
+    try {
+      for (; i < other.entries_.size(); ++i) {
+        const entry& e = other.entries_[i];
+        construct(e, alloc_, dst + e.offset_, src + e.offset_);
+      }
+    } catch (...) {
+      while (i-- > 0) {
+        const entry& e = other.entries_[i];
+        e.ops_->destroy_(alloc_, dst + e.offset_);
+      }
+      storage_alloc_traits::deallocate(s_alloc, data, units_for(capacity));
+      throw;
+    }
+    entries_.assign(other.entries_.begin(), other.entries_.end());
+    data_ = data;
+    capacity_ = capacity;
+    used_ = other.used_;
+  }
+
+  // Takes the buffer and offset table of `other`. This polymorphic_vector must
+  // hold no buffer and its allocator must be able to deallocate the buffer.
+  void steal_from(polymorphic_vector& other) noexcept {
+    data_ = std::exchange(other.data_, nullptr);
+    capacity_ = std::exchange(other.capacity_, 0);
+    used_ = std::exchange(other.used_, 0);
+    entries_ = std::move(other.entries_);
+    other.entries_.clear();
+  }
+
+  // Moves the elements into `dst`, a buffer of at least `used_` bytes, and
+  // destroys the originals. On exception `dst` holds no elements.
+  void relocate_to(std::byte* dst) {
+    std::byte* src = bytes();
+    size_type i = 0;
+    try {
+      for (; i < entries_.size(); ++i) {
+        const entry& e = entries_[i];
+        e.ops_->move_(alloc_, dst + e.offset_, src + e.offset_);
+      }
+    } catch (...) {
+      while (i-- > 0) {
+        const entry& e = entries_[i];
+        e.ops_->destroy_(alloc_, dst + e.offset_);
+      }
+      throw;
+    }
+    destroy_elements();
+  }
+
+  void reallocate(size_type capacity) {
+    storage_allocator s_alloc(alloc_);
+    storage_pointer data =
+        storage_alloc_traits::allocate(s_alloc, units_for(capacity));
+    try {
+      relocate_to(to_bytes(data));
+    } catch (...) {
+      storage_alloc_traits::deallocate(s_alloc, data, units_for(capacity));
+      throw;
+    }
+    release_storage();
+    data_ = data;
+    capacity_ = capacity;
+  }
+
+  void destroy_elements() noexcept {
+    std::byte* p = bytes();
+    for (const entry& e : entries_) {
+      e.ops_->destroy_(alloc_, p + e.offset_);
+    }
+  }
+
+  void release_storage() noexcept {
+    if (data_ == nullptr) return;
+    storage_allocator s_alloc(alloc_);
+    storage_alloc_traits::deallocate(s_alloc, data_, units_for(capacity_));
+    data_ = nullptr;
+    capacity_ = 0;
+  }
+
+  void reset() noexcept {
+    clear();
+    release_storage();
+  }
+};
+
+}  // namespace xyz
+
+#endif  // XYZ_POLYMORPHIC_VECTOR_H_
@@ -0,0 +1,254 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+// An experimental pooling allocator for indirect and polymorphic.
+//
+// indirect<T, A> allocates sizeof(T) bytes and polymorphic<T, A> allocates
+// one control block whose size depends only on the derived type. These sizes
+// are known at compile time and come from a small set, so a size_class_pool
+// keeps one free list per multiple of `granularity` bytes up to
+// `max_block_size`. pool_allocator<T> computes the size class for a single T
+// at compile time. Larger or over-aligned requests go to operator new.
+//
+// A size_class_pool is not thread-safe and must outlive every allocator and
+// object that uses it. Memory is returned to the system when the pool is
+// destroyed.
+
+#ifndef XYZ_POOL_ALLOCATOR_H_
+#define XYZ_POOL_ALLOCATOR_H_
+
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <type_traits>
+
+namespace xyz {
+
+class size_class_pool {
+ public:
+  static constexpr std::size_t granularity = alignof(std::max_align_t);
+  static constexpr std::size_t max_block_size = 512;
+  static constexpr std::size_t size_class_count =
+      max_block_size / granularity;
+
+  static constexpr std::size_t default_blocks_per_chunk = 64;
+
+  // Returns the index of the size class for `bytes`.
+  static constexpr std::size_t size_class(std::size_t bytes) noexcept {
+    return bytes == 0 ? 0 : (bytes - 1) / granularity;
+  }
+
+  static constexpr bool is_pooled(std::size_t bytes,
+                                  std::size_t alignment) noexcept {
+    return bytes <= max_block_size && alignment <= granularity;
+  }
+
+  explicit size_class_pool(
+      std::size_t blocks_per_chunk = default_blocks_per_chunk) noexcept
+      : blocks_per_chunk_(blocks_per_chunk == 0 ? 1 : blocks_per_chunk) {}
+
+  size_class_pool(const size_class_pool&) = delete;
+  size_class_pool& operator=(const size_class_pool&) = delete;
+
+  ~size_class_pool() {
+    while (chunks_ != nullptr) {
+      chunk* next = chunks_->next_;
+      ::operator delete(static_cast<void*>(chunks_), chunks_->bytes_);
+      chunks_ = next;
+    }
+  }
+
+  // Allocates a block from size class `Class`.
+  template <std::size_t Class>
+  [[nodiscard]] void* allocate() {
+    static_assert(Class < size_class_count);
+    return allocate_from(Class);
+  }
+
+  template <std::size_t Class>
+  void deallocate(void* p) noexcept {
+    static_assert(Class < size_class_count);
+    deallocate_to(Class, p);
+  }
+
+  [[nodiscard]] void* allocate(std::size_t bytes, std::size_t alignment) {
+    if (!is_pooled(bytes, alignment)) {
+      return allocate_unpooled(bytes, alignment);
+    }
+    return allocate_from(size_class(bytes));
+  }
+
+  void deallocate(void* p, std::size_t bytes, std::size_t alignment) noexcept {
+    if (!is_pooled(bytes, alignment)) {
+      deallocate_unpooled(p, bytes, alignment);
+      return;
+    }
+    deallocate_to(size_class(bytes), p);
+  }
+
+  // Pre-warms the pool so that `count` blocks of `bytes` bytes can be
+  // allocated without further requests to the system.
+  void reserve(std::size_t bytes, std::size_t count) {
+    if (!is_pooled(bytes, granularity)) return;
+    std::size_t c = size_class(bytes);
+    std::size_t available = 0;
+    for (block* b = free_lists_[c]; b != nullptr; b = b->next_) {
+      ++available;
+    }
+    if (available < count) {
+      refill(c, count - available);
+    }
+  }
+
+  // The number of chunks requested from the system.
+  [[nodiscard]] std::size_t chunk_count() const noexcept {
+    return chunk_count_;
+  }
+
+ private:
+  struct block {
+    block* next_;
+  };
+
+  struct alignas(std::max_align_t) chunk {
+    chunk* next_;
+    std::size_t bytes_;
+  };
+
+  std::array<block*, size_class_count> free_lists_{};
+  chunk* chunks_ = nullptr;
+  std::size_t chunk_count_ = 0;
+  std::size_t blocks_per_chunk_;
+
+  [[nodiscard]] void* allocate_from(std::size_t c) {
+    if (free_lists_[c] == nullptr) {
+      refill(c, blocks_per_chunk_);
+    }
+    block* b = free_lists_[c];
+    free_lists_[c] = b->next_;
+    return b;
+  }
+
+  void deallocate_to(std::size_t c, void* p) noexcept {
+    block* b = static_cast<block*>(p);
+    b->next_ = free_lists_[c];
+    free_lists_[c] = b;
+  }
+
+  // Allocates a chunk of `count` blocks for size class `c` and pushes them
+  // onto its free list.
+  void refill(std::size_t c, std::size_t count) {
+    std::size_t block_size = (c + 1) * granularity;
+    std::size_t bytes = sizeof(chunk) + count * block_size;
+    chunk* ch = static_cast<chunk*>(::operator new(bytes));
+    ch->next_ = chunks_;
+    ch->bytes_ = bytes;
+    chunks_ = ch;
+    ++chunk_count_;
+
+    std::byte* first = reinterpret_cast<std::byte*>(ch + 1);
+    for (std::size_t i = count; i > 0; --i) {
+      deallocate_to(c, first + (i - 1) * block_size);
+    }
+  }
+
+  [[nodiscard]] static void* allocate_unpooled(std::size_t bytes,
+                                               std::size_t alignment) {
+    if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+      return ::operator new(bytes, std::align_val_t(alignment));
+    }
+    return ::operator new(bytes);
+  }
+
+  static void deallocate_unpooled(void* p, std::size_t bytes,
+                                  std::size_t alignment) noexcept {
+    if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+      ::operator delete(p, bytes, std::align_val_t(alignment));
+      return;
+    }
+    ::operator delete(p, bytes);
+  }
+};
+
+template <class T>
+class pool_allocator {
+  size_class_pool* pool_;
+
+  template <class U>
+  friend class pool_allocator;
+
+  static constexpr bool is_pooled =
+      size_class_pool::is_pooled(sizeof(T), alignof(T));
+
+ public:
+  using value_type = T;
+
+  explicit pool_allocator(size_class_pool& pool) noexcept : pool_(&pool) {}
+
+  template <class U>
+  pool_allocator(const pool_allocator<U>& other) noexcept
+      : pool_(other.pool_) {}
+
+  [[nodiscard]] T* allocate(std::size_t n) {
+    // Single objects, which is all indirect and polymorphic allocate, use a
+    // size class computed at compile time.
+    if constexpr (is_pooled) {
+      if (n == 1) {
+        return static_cast<T*>(
+            pool_->allocate<size_class_pool::size_class(sizeof(T))>());
+      }
+    }
+    if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
+      throw std::bad_array_new_length();
+    }
+    return static_cast<T*>(pool_->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T* p, std::size_t n) noexcept {
+    if constexpr (is_pooled) {
+      if (n == 1) {
+        pool_->deallocate<size_class_pool::size_class(sizeof(T))>(p);
+        return;
+      }
+    }
+    pool_->deallocate(p, n * sizeof(T), alignof(T));
+  }
+
+  // Pre-warms the pool so that `count` objects of type T can be allocated
+  // without further requests to the system.
+  void reserve(std::size_t count) {
+    if constexpr (is_pooled) {
+      pool_->reserve(sizeof(T), count);
+    }
+  }
+
+  [[nodiscard]] size_class_pool* pool() const noexcept { return pool_; }
+
+  template <class U>
+  friend bool operator==(const pool_allocator& lhs,
+                         const pool_allocator<U>& rhs) noexcept {
+    return lhs.pool() == rhs.pool();
+  }
+};
+
+}  // namespace xyz
+
+#endif  // XYZ_POOL_ALLOCATOR_H_
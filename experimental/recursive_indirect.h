@@ -0,0 +1,171 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+// Experimental iterative copy and destruction for recursive indirect values.
+//
+// A type whose objects own other objects of the same type through indirect,
+// such as the node of a tree or a list, is copied and destroyed recursively
+// by default, so the depth of the structure is limited by the size of the
+// stack. A node type can instead copy and destroy its descendants with an
+// explicit work list by calling copy_children from its copy constructor and
+// destroy_children from its destructor. It declares where its children are
+// and how to copy a node without them:
+//
+//   struct Node {
+//     int value;
+//     std::vector<xyz::indirect<Node>> children;
+//     static constexpr auto indirect_children = &Node::children;
+//
+//     Node(const Node& other) : Node(xyz::without_children, other) {
+//       xyz::copy_children(other, *this);
+//     }
+//     Node(xyz::without_children_t, const Node& other) : value(other.value) {}
+//     ~Node() { xyz::destroy_children(*this); }
+//   };
+//
+// `indirect_children` points to a sequence container of indirect<Node, A>
+// and the without_children constructor copies everything else, leaving that
+// container empty. An allocator-aware node's without_children constructor
+// also takes an allocator, as its copy constructor does. Every node copied by copy_children is a complete object
+// when it returns.
+
+#ifndef XYZ_RECURSIVE_INDIRECT_H_
+#define XYZ_RECURSIVE_INDIRECT_H_
+
+#include <deque>
+#include <memory>
+#include <ranges>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "indirect.h"
+
+namespace xyz {
+
+struct without_children_t {
+  explicit without_children_t() = default;
+};
+
+inline constexpr without_children_t without_children{};
+
+template <class T>
+concept recursive_indirect_node = requires(T& t) {
+  { t.*T::indirect_children } -> std::ranges::range;
+};
+
+namespace detail {
+
+template <class T>
+using indirect_children_type =
+    std::remove_cvref_t<decltype(std::declval<T&>().*T::indirect_children)>;
+
+template <class T>
+using indirect_child_type = typename indirect_children_type<T>::value_type;
+
+// The allocator that copying `children` would give a copy of `child`: the
+// container's own allocator if it does uses-allocator construction and the
+// child's selected copy otherwise.
+template <class Children, class Child>
+auto child_copy_allocator(const Children& children, const Child& child) {
+  using child_allocator = typename Child::allocator_type;
+  if constexpr (requires { typename Children::allocator_type; } &&
+                std::uses_allocator_v<Child,
+                                      typename Children::allocator_type>) {
+    return child_allocator(children.get_allocator());
+  } else {
+    return std::allocator_traits<child_allocator>::
+        select_on_container_copy_construction(child.get_allocator());
+  }
+}
+
+}  // namespace detail
+
+// Appends copies of the children of `from`, and of all their descendants, to
+// the children of `to` without recursion. Each child gets the allocator that
+// copying the container of children would give it. The children of a node
+// are copied one after another, before any of their descendants. If a copy
+// throws, the children copied so far are left in `to`.
+template <recursive_indirect_node T>
+void copy_children(const T& from, T& to) {
+  using child_type = detail::indirect_child_type<T>;
+
+  std::vector<std::pair<const T*, T*>> work{{&from, &to}};
+  while (!work.empty()) {
+    auto [source, dest] = work.back();
+    work.pop_back();
+    const auto& source_children = source->*T::indirect_children;
+    auto& dest_children = dest->*T::indirect_children;
+    if constexpr (requires { dest_children.reserve(source_children.size()); }) {
+      dest_children.reserve(dest_children.size() + source_children.size());
+    }
+    for (const child_type& child : source_children) {
+      if (child.valueless_after_move()) {
+        dest_children.push_back(child);
+        continue;
+      }
+      dest_children.push_back(child_type(
+          std::allocator_arg,
+          detail::child_copy_allocator(dest_children, child), std::in_place,
+          without_children, *child));
+      // Nodes owned by indirect do not move when their container grows.
+      work.emplace_back(&*child, &*dest_children.back());
+    }
+  }
+}
+
+// Destroys the descendants of `node` without recursion and leaves its
+// children empty. Descendants are detached from their parents before the
+// parents are destroyed, so a destructor that calls destroy_children finds
+// nothing left to do. If the work list cannot be allocated, the remaining
+// descendants are destroyed recursively.
+template <recursive_indirect_node T>
+void destroy_children(T& node) noexcept {
+  using child_type = detail::indirect_child_type<T>;
+
+  auto& children = node.*T::indirect_children;
+  if (children.empty()) return;
+
+  // A deque does not move its elements as it grows, so detaching a child
+  // only ever moves its pointer.
+  std::deque<child_type> work;
+  auto detach = [&work](T& n) noexcept {
+    auto& c = n.*T::indirect_children;
+    try {
+      for (auto& child : c) {
+        if (!child.valueless_after_move()) work.push_back(std::move(child));
+      }
+    } catch (...) {
+      // Destroy the remaining children here.
+    }
+    c.clear();
+  };
+
+  detach(node);
+  while (!work.empty()) {
+    child_type child = std::move(work.back());
+    work.pop_back();
+    detach(*child);
+  }
+}
+
+}  // namespace xyz
+
+#endif  // XYZ_RECURSIVE_INDIRECT_H_
@@ -0,0 +1,67 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+// Reference-count policies for the copy-on-write value types in
+// cow_indirect.h and cow_polymorphic.h.
+//
+// A policy is default constructed with a count of one. `increment` adds a
+// reference, `decrement` removes one and returns true if it was the last, and
+// `count` returns the current number of references.
+
+#ifndef XYZ_REFERENCE_COUNT_H_
+#define XYZ_REFERENCE_COUNT_H_
+
+#include <atomic>
+#include <cstddef>
+
+namespace xyz {
+
+// Reference counting that is safe when copies sharing an object are used
+// from different threads.
+class atomic_reference_count {
+  std::atomic<std::size_t> count_{1};
+
+ public:
+  void increment() noexcept { count_.fetch_add(1, std::memory_order_relaxed); }
+
+  [[nodiscard]] bool decrement() noexcept {
+    return count_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+  }
+
+  [[nodiscard]] std::size_t count() const noexcept {
+    return count_.load(std::memory_order_acquire);
+  }
+};
+
+// Reference counting for copies that are only used from a single thread.
+class non_atomic_reference_count {
+  std::size_t count_ = 1;
+
+ public:
+  constexpr void increment() noexcept { ++count_; }
+
+  [[nodiscard]] constexpr bool decrement() noexcept { return --count_ == 0; }
+
+  [[nodiscard]] constexpr std::size_t count() const noexcept { return count_; }
+};
+
+}  // namespace xyz
+
+#endif  // XYZ_REFERENCE_COUNT_H_
@@ -0,0 +1,262 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+// An experimental thread-caching allocator for indirect and polymorphic.
+//
+// Every thread owns a cache with one free list per size class. Blocks are
+// carved from chunks aligned to `chunk_size`, and each chunk records the
+// cache that owns it. A block freed by its owning thread goes back on that
+// thread's free list without synchronization. A block freed by any other
+// thread is pushed onto a lock-free remote-free list in the owning cache,
+// which the owner drains when its local free list runs out.
+//
+// thread_caching_allocator is stateless, so all instances compare equal on
+// every thread and moves and swaps of indirect and polymorphic stay on the
+// pointer-swap path.
+//
+// When a thread exits its cache is put aside and adopted by the next thread
+// that starts allocating. Allocations made later in the same thread's exit,
+// from other thread_local destructors, come from a shared cache under a lock,
+// and frees go through the remote-free path. Memory is retained for the life
+// of the process.
+// Requests larger than `max_block_size` or more aligned than
+// std::max_align_t go to operator new.
+
+#ifndef XYZ_THREAD_CACHING_ALLOCATOR_H_
+#define XYZ_THREAD_CACHING_ALLOCATOR_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace xyz {
+
+namespace detail {
+
+class thread_cache {
+ public:
+  static constexpr std::size_t granularity = alignof(std::max_align_t);
+  static constexpr std::size_t max_block_size = 512;
+  static constexpr std::size_t size_class_count =
+      max_block_size / granularity;
+  static constexpr std::size_t chunk_size = std::size_t(1) << 16;
+
+  static constexpr std::size_t size_class(std::size_t bytes) noexcept {
+    return bytes == 0 ? 0 : (bytes - 1) / granularity;
+  }
+
+  static constexpr bool is_cached(std::size_t bytes,
+                                  std::size_t alignment) noexcept {
+    return bytes <= max_block_size && alignment <= granularity;
+  }
+
+  // Allocates a block from the calling thread's cache. Once the thread has
+  // handed its cache back it may no longer touch it, as another thread may
+  // have adopted it, so it allocates from the shared cache instead.
+  [[nodiscard]] static void* allocate_block(std::size_t c) {
+    if (!exited()) {
+      thread_local owner o;
+      return o.cache_->allocate(c);
+    }
+    registry& r = get_registry();
+    std::lock_guard<std::mutex> lock(r.mutex_);
+    if (r.shared_ == nullptr) r.shared_ = new thread_cache;
+    return r.shared_->allocate(c);
+  }
+
+  [[nodiscard]] void* allocate(std::size_t c) {
+    block* b = free_lists_[c];
+    if (b == nullptr) {
+      b = remote_free_lists_[c].exchange(nullptr, std::memory_order_acquire);
+      if (b == nullptr) return carve(c);
+    }
+    free_lists_[c] = b->next_;
+    return b;
+  }
+
+  // Returns a block to the cache that owns it.
+  static void deallocate(std::size_t c, void* p) noexcept {
+    block* b = static_cast<block*>(p);
+    thread_cache* owner = chunk_of(p)->owner_;
+    if (owner == local_if_initialized()) {
+      b->next_ = owner->free_lists_[c];
+      owner->free_lists_[c] = b;
+      return;
+    }
+    std::atomic<block*>& head = owner->remote_free_lists_[c];
+    b->next_ = head.load(std::memory_order_relaxed);
+    while (!head.compare_exchange_weak(b->next_, b, std::memory_order_release,
+                                       std::memory_order_relaxed)) {
+    }
+  }
+
+ private:
+  struct block {
+    block* next_;
+  };
+
+  struct alignas(std::max_align_t) chunk {
+    thread_cache* owner_;
+  };
+
+  struct registry {
+    std::mutex mutex_;
+    std::vector<thread_cache*> idle_;
+    // Used by threads which have handed their cache back. It is never the
+    // current cache of any thread, so blocks are always freed to it remotely.
+    thread_cache* shared_ = nullptr;
+  };
+
+  // Acquires a cache for a thread and puts it aside when the thread exits.
+  struct owner {
+    thread_cache* cache_;
+
+    owner() : cache_(acquire()) { current() = cache_; }
+
+    ~owner() {
+      current() = nullptr;
+      exited() = true;
+      registry& r = get_registry();
+      std::lock_guard<std::mutex> lock(r.mutex_);
+      r.idle_.push_back(cache_);
+    }
+  };
+
+  std::array<block*, size_class_count> free_lists_{};
+  // Kept on a separate cache line from the owner's free lists.
+  alignas(64) std::array<std::atomic<block*>, size_class_count>
+      remote_free_lists_{};
+  std::array<std::byte*, size_class_count> bump_{};
+  std::array<std::byte*, size_class_count> bump_end_{};
+
+  // The registry is never destroyed so that threads which outlive static
+  // destruction can still release their caches.
+  static registry& get_registry() {
+    static registry* r = new registry;
+    return *r;
+  }
+
+  static thread_cache*& current() noexcept {
+    thread_local thread_cache* c = nullptr;
+    return c;
+  }
+
+  // Trivially destructible, so it can still be read after owner is destroyed.
+  static bool& exited() noexcept {
+    thread_local bool e = false;
+    return e;
+  }
+
+  // Unlike allocate_block(), does not create a cache for threads which only
+  // free.
+  static thread_cache* local_if_initialized() noexcept { return current(); }
+
+  static thread_cache* acquire() {
+    registry& r = get_registry();
+    {
+      std::lock_guard<std::mutex> lock(r.mutex_);
+      if (!r.idle_.empty()) {
+        thread_cache* c = r.idle_.back();
+        r.idle_.pop_back();
+        return c;
+      }
+    }
+    return new thread_cache;
+  }
+
+  static chunk* chunk_of(void* p) noexcept {
+    return reinterpret_cast<chunk*>(reinterpret_cast<std::uintptr_t>(p) &
+                                    ~(std::uintptr_t(chunk_size) - 1));
+  }
+
+  [[nodiscard]] void* carve(std::size_t c) {
+    std::size_t block_size = (c + 1) * granularity;
+    if (bump_[c] == bump_end_[c]) {
+      chunk* ch = static_cast<chunk*>(
+          ::operator new(chunk_size, std::align_val_t(chunk_size)));
+      ch->owner_ = this;
+      bump_[c] = reinterpret_cast<std::byte*>(ch + 1);
+      bump_end_[c] = bump_[c] + ((chunk_size - sizeof(chunk)) / block_size) *
+                                    block_size;
+    }
+    void* p = bump_[c];
+    bump_[c] += block_size;
+    return p;
+  }
+};
+
+}  // namespace detail
+
+template <class T>
+class thread_caching_allocator {
+  using cache = detail::thread_cache;
+
+  static constexpr bool is_cached = cache::is_cached(sizeof(T), alignof(T));
+  static constexpr std::size_t size_class = cache::size_class(sizeof(T));
+
+ public:
+  using value_type = T;
+  using is_always_equal = std::true_type;
+
+  thread_caching_allocator() noexcept = default;
+
+  template <class U>
+  thread_caching_allocator(const thread_caching_allocator<U>&) noexcept {}
+
+  [[nodiscard]] T* allocate(std::size_t n) {
+    if constexpr (is_cached) {
+      if (n == 1) return static_cast<T*>(cache::allocate_block(size_class));
+    }
+    if (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+      return static_cast<T*>(
+          ::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+    }
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, std::size_t n) noexcept {
+    if constexpr (is_cached) {
+      if (n == 1) {
+        cache::deallocate(size_class, p);
+        return;
+      }
+    }
+    if (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+      ::operator delete(p, n * sizeof(T), std::align_val_t(alignof(T)));
+      return;
+    }
+    ::operator delete(p, n * sizeof(T));
+  }
+
+  template <class U>
+  friend bool operator==(const thread_caching_allocator&,
+                         const thread_caching_allocator<U>&) noexcept {
+    return true;
+  }
+};
+
+}  // namespace xyz
+
+#endif  // XYZ_THREAD_CACHING_ALLOCATOR_H_
@@ -0,0 +1,211 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+// An experimental census of the live objects owned by polymorphic, by
+// derived type.
+//
+// type_census is a lifecycle hooks policy (see polymorphic.h) that keeps a
+// record for each type U of owned object: the name and size of U and the
+// number of live objects, their peak and the bytes allocated to hold them.
+// A polymorphic takes part in the census when its allocator declares
+// `using lifecycle_hooks = xyz::type_census;`, which census_allocator adds to
+// any allocator. indirect takes part in the same way.
+//
+// The record for U is registered the first time an object of type U is
+// constructed and is never removed. Counts are updated with relaxed atomics,
+// so a snapshot taken while other threads construct or destroy objects may
+// be momentarily inconsistent between types.
+
+#ifndef XYZ_TYPE_CENSUS_H_
+#define XYZ_TYPE_CENSUS_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+#include "polymorphic.h"
+
+namespace xyz {
+
+namespace detail {
+
+// The name of U taken from the signature of this function, so that RTTI is
+// not needed.
+template <class U>
+constexpr std::string_view census_type_name() {
+#if defined(__clang__) || defined(__GNUC__)
+  std::string_view signature = __PRETTY_FUNCTION__;
+  std::string_view prefix = "U = ";
+  auto first = signature.find(prefix);
+  if (first == std::string_view::npos) return "unknown";
+  first += prefix.size();
+  return signature.substr(first,
+                          signature.find_first_of(";]", first) - first);
+#elif defined(_MSC_VER)
+  std::string_view signature = __FUNCSIG__;
+  std::string_view prefix = "census_type_name<";
+  auto first = signature.find(prefix);
+  auto last = signature.rfind(">(void)");
+  if (first == std::string_view::npos || last == std::string_view::npos) {
+    return "unknown";
+  }
+  first += prefix.size();
+  return signature.substr(first, last - first);
+#else
+  return "unknown";
+#endif
+}
+
+}  // namespace detail
+
+// The census of one type at the time it was taken.
+struct type_census_entry {
+  std::string_view name;
+  std::size_t size = 0;
+  std::int64_t live = 0;
+  std::int64_t peak_live = 0;
+  std::int64_t live_bytes = 0;
+  std::uint64_t constructed = 0;
+};
+
+class type_census {
+  struct record {
+    std::string_view name_;
+    std::size_t size_;
+    std::atomic<std::int64_t> live_{0};
+    std::atomic<std::int64_t> peak_live_{0};
+    std::atomic<std::int64_t> live_bytes_{0};
+    std::atomic<std::uint64_t> constructed_{0};
+    record* next_ = nullptr;
+
+    record(std::string_view name, std::size_t size) noexcept
+        : name_(name), size_(size) {
+      std::atomic<record*>& h = head();
+      next_ = h.load(std::memory_order_relaxed);
+      while (!h.compare_exchange_weak(next_, this, std::memory_order_release,
+                                      std::memory_order_relaxed)) {
+      }
+    }
+  };
+
+  static std::atomic<record*>& head() noexcept {
+    static constinit std::atomic<record*> h{nullptr};
+    return h;
+  }
+
+  template <class U>
+  static record& record_for() noexcept {
+    static record r(detail::census_type_name<U>(), sizeof(U));
+    return r;
+  }
+
+ public:
+  template <class U, class A>
+  static void on_lifecycle_event(lifecycle_event event, std::size_t size,
+                                 const A&) noexcept {
+    record& r = record_for<U>();
+    const auto bytes = static_cast<std::int64_t>(size);
+    if (event == lifecycle_event::destroy) {
+      r.live_.fetch_sub(1, std::memory_order_relaxed);
+      r.live_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+      return;
+    }
+    r.constructed_.fetch_add(1, std::memory_order_relaxed);
+    r.live_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    auto live = r.live_.fetch_add(1, std::memory_order_relaxed) + 1;
+    auto peak = r.peak_live_.load(std::memory_order_relaxed);
+    while (live > peak && !r.peak_live_.compare_exchange_weak(
+                              peak, live, std::memory_order_relaxed)) {
+    }
+  }
+
+  // Returns the census of every type that has been seen, with the most live
+  // bytes first.
+  [[nodiscard]] static std::vector<type_census_entry> snapshot() {
+    std::vector<type_census_entry> entries;
+    for (const record* r = head().load(std::memory_order_acquire);
+         r != nullptr; r = r->next_) {
+      entries.push_back({r->name_, r->size_,
+                         r->live_.load(std::memory_order_relaxed),
+                         r->peak_live_.load(std::memory_order_relaxed),
+                         r->live_bytes_.load(std::memory_order_relaxed),
+                         r->constructed_.load(std::memory_order_relaxed)});
+    }
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const auto& lhs, const auto& rhs) {
+                       return lhs.live_bytes > rhs.live_bytes;
+                     });
+    return entries;
+  }
+
+  // Returns the census of U.
+  template <class U>
+  [[nodiscard]] static type_census_entry entry_for() noexcept {
+    const record& r = record_for<U>();
+    return {r.name_,
+            r.size_,
+            r.live_.load(std::memory_order_relaxed),
+            r.peak_live_.load(std::memory_order_relaxed),
+            r.live_bytes_.load(std::memory_order_relaxed),
+            r.constructed_.load(std::memory_order_relaxed)};
+  }
+
+  // Writes one line for each type with live objects, with the most live
+  // bytes first.
+  static void dump(std::ostream& os) {
+    for (const type_census_entry& e : snapshot()) {
+      if (e.live == 0) continue;
+      os << e.name << ": live " << e.live << ", live bytes " << e.live_bytes
+         << ", peak live " << e.peak_live << ", sizeof " << e.size << "\n";
+    }
+  }
+};
+
+// An allocator that forwards to A and adds polymorphic and indirect objects
+// allocated with it to the type_census.
+template <class T, class A = std::allocator<T>>
+class census_allocator : public A {
+ public:
+  using value_type = T;
+  using lifecycle_hooks = type_census;
+
+  template <class U>
+  struct rebind {
+    using other = census_allocator<
+        U, typename std::allocator_traits<A>::template rebind_alloc<U>>;
+  };
+
+  census_allocator() = default;
+
+  census_allocator(const A& upstream) noexcept : A(upstream) {}
+
+  template <class U, class AA>
+  census_allocator(const census_allocator<U, AA>& other) noexcept
+      : A(static_cast<const AA&>(other)) {}
+};
+
+}  // namespace xyz
+
+#endif  // XYZ_TYPE_CENSUS_H_
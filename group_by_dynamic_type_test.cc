@@ -0,0 +1,118 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+#include "experimental/group_by_dynamic_type.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#ifdef XYZ_POLYMORPHIC_NO_VTABLE
+#include "polymorphic_no_vtable.h"
+#endif  // XYZ_POLYMORPHIC_NO_VTABLE
+
+#ifndef XYZ_POLYMORPHIC_H_
+#include "polymorphic.h"
+#endif  // XYZ_POLYMORPHIC_H_
+
+namespace {
+
+class Base {
+ public:
+  virtual ~Base() = default;
+  virtual int value() const = 0;
+};
+
+class Derived : public Base {
+ private:
+  int value_;
+
+ public:
+  Derived(int v) : value_(v) {}
+
+  int value() const override { return value_; }
+};
+
+class OtherBase {
+ public:
+  virtual ~OtherBase() = default;
+  int other_value_ = 0;
+};
+
+// The Base subobject of an OffsetDerived is not at its start.
+class OffsetDerived : public OtherBase, public Base {
+ private:
+  int value_;
+
+ public:
+  OffsetDerived(int v) : value_(v) {}
+
+  int value() const override { return value_; }
+};
+
+TEST(GroupByDynamicTypeTest, GroupsByTypeInOrderOfFirstAppearance) {
+  std::vector<xyz::polymorphic<Base>> v;
+  v.emplace_back(std::in_place_type<Derived>, 0);
+  v.emplace_back(std::in_place_type<OffsetDerived>, 1);
+  v.emplace_back(std::in_place_type<Derived>, 2);
+  v.emplace_back(std::in_place_type<Derived>, 3);
+  v.emplace_back(std::in_place_type<OffsetDerived>, 4);
+  {
+    auto tmp = std::move(v[3]);  // Make v[3] valueless.
+  }
+  v.emplace_back(std::in_place_type<Derived>, 5);
+
+  std::vector<const Base*> addresses;
+  for (const auto& p : v) {
+    addresses.push_back(p.valueless_after_move() ? nullptr : &*p);
+  }
+
+  xyz::group_by_dynamic_type(v.begin(), v.end());
+
+  const std::vector<int> expected_values = {0, 2, 5, 1, 4};
+  const std::vector<size_t> expected_positions = {0, 2, 5, 1, 4};
+  ASSERT_EQ(v.size(), 6u);
+  for (size_t i = 0; i < expected_values.size(); ++i) {
+    EXPECT_EQ(v[i]->value(), expected_values[i]);
+    // The owned objects are not copied or moved.
+    EXPECT_EQ(&*v[i], addresses[expected_positions[i]]);
+  }
+  EXPECT_TRUE(v[0].holds_type<Derived>());
+  EXPECT_TRUE(v[2].holds_type<Derived>());
+  EXPECT_TRUE(v[3].holds_type<OffsetDerived>());
+  EXPECT_TRUE(v[4].holds_type<OffsetDerived>());
+  EXPECT_TRUE(v[5].valueless_after_move());
+}
+
+TEST(GroupByDynamicTypeTest, EmptyAndSingleType) {
+  std::vector<xyz::polymorphic<Base>> v;
+  xyz::group_by_dynamic_type(v.begin(), v.end());
+  EXPECT_TRUE(v.empty());
+
+  v.emplace_back(std::in_place_type<Derived>, 1);
+  v.emplace_back(std::in_place_type<Derived>, 2);
+  xyz::group_by_dynamic_type(v.begin(), v.end());
+  EXPECT_EQ(v[0]->value(), 1);
+  EXPECT_EQ(v[1]->value(), 2);
+}
+
+}  // namespace
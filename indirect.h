@@ -24,11 +24,17 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <cassert>
 #include <compare>
 #include <concepts>
+#include <cstddef>
+#include <cstring>
 #include <initializer_list>
 #include <memory>
 #include <type_traits>
 #include <utility>
 
+#define XYZ_INDIRECT_HAS_LIFECYCLE_HOOKS 1
+#define XYZ_INDIRECT_HAS_TRIVIAL_RELOCATION 1
+#define XYZ_INDIRECT_HAS_ASSUMED_EQUAL_ALLOCATORS 1
+
 namespace xyz {
 
 #ifndef XYZ_UNREACHABLE_DEFINED
@@ -45,6 +51,158 @@ namespace xyz {
 }
 #endif  // XYZ_UNREACHABLE_DEFINED
 
+#ifndef XYZ_ALLOCATOR_RELEASES_IN_BULK_DEFINED
+#define XYZ_ALLOCATOR_RELEASES_IN_BULK_DEFINED
+
+// An allocator that reclaims all of its memory at once, such as an arena, can
+// declare `using releases_in_bulk = std::true_type;`. Objects allocated with it
+// are not deallocated individually and trivially destructible objects are not
+// destroyed.
+template <class A>
+struct allocator_releases_in_bulk : std::false_type {};
+
+template <class A>
+  requires requires { typename A::releases_in_bulk; }
+struct allocator_releases_in_bulk<A> : A::releases_in_bulk {};
+
+template <class A>
+inline constexpr bool allocator_releases_in_bulk_v =
+    allocator_releases_in_bulk<A>::value;
+
+#endif  // XYZ_ALLOCATOR_RELEASES_IN_BULK_DEFINED
+
+#ifndef XYZ_ALLOCATOR_IS_ASSUMED_EQUAL_DEFINED
+#define XYZ_ALLOCATOR_IS_ASSUMED_EQUAL_DEFINED
+
+// An allocator whose objects are known to compare equal wherever values are
+// moved, such as std::pmr::polymorphic_allocator when every value uses the
+// same memory resource, can declare `using is_assumed_equal = std::true_type;`
+// or specialize allocator_is_assumed_equal. Moves and swaps are then noexcept
+// and take ownership without reallocating. Moving between allocators that are
+// not equal fails an assertion; without assertions the move reallocates and
+// std::terminate is called if that throws.
+template <class A>
+struct allocator_is_assumed_equal : std::false_type {};
+
+template <class A>
+  requires requires { typename A::is_assumed_equal; }
+struct allocator_is_assumed_equal<A> : A::is_assumed_equal {};
+
+template <class A>
+inline constexpr bool allocator_is_assumed_equal_v =
+    allocator_is_assumed_equal<A>::value;
+
+#endif  // XYZ_ALLOCATOR_IS_ASSUMED_EQUAL_DEFINED
+
+#ifndef XYZ_LIFECYCLE_HOOKS_DEFINED
+#define XYZ_LIFECYCLE_HOOKS_DEFINED
+
+enum class lifecycle_event { construct, copy, move, destroy };
+
+// An allocator can declare `using lifecycle_hooks = H;` to observe the owned
+// objects that indirect and polymorphic create and destroy with it. After an
+// owned object of dynamic type U is constructed, and before it is destroyed,
+// `H::template on_lifecycle_event<U>(event, size, alloc)` is called, where
+// `size` is the number of bytes allocated to hold the object. The call must
+// not throw. Hooks are not called during constant evaluation, and nothing is
+// called for allocators without hooks.
+template <class A>
+struct allocator_lifecycle_hooks {
+  using type = void;
+};
+
+template <class A>
+  requires requires { typename A::lifecycle_hooks; }
+struct allocator_lifecycle_hooks<A> {
+  using type = typename A::lifecycle_hooks;
+};
+
+template <class A>
+inline constexpr bool allocator_has_lifecycle_hooks_v =
+    !std::is_void_v<typename allocator_lifecycle_hooks<A>::type>;
+
+namespace detail {
+
+template <class U, class A>
+constexpr void notify_lifecycle_event(lifecycle_event event, std::size_t size,
+                                      const A& alloc) noexcept {
+  if constexpr (allocator_has_lifecycle_hooks_v<A>) {
+    using hooks = typename allocator_lifecycle_hooks<A>::type;
+    static_assert(
+        noexcept(hooks::template on_lifecycle_event<U>(event, size, alloc)),
+        "Lifecycle hooks must be noexcept");
+    if (!std::is_constant_evaluated()) {
+      hooks::template on_lifecycle_event<U>(event, size, alloc);
+    }
+  }
+}
+
+}  // namespace detail
+
+#endif  // XYZ_LIFECYCLE_HOOKS_DEFINED
+
+#ifndef XYZ_TRIVIALLY_RELOCATABLE_DEFINED
+#define XYZ_TRIVIALLY_RELOCATABLE_DEFINED
+
+// A type is trivially relocatable if moving an object to new storage and
+// destroying the original is equivalent to copying its bytes. Trivially
+// copyable types and std::allocator are trivially relocatable, and a type can
+// declare `using trivially_relocatable = std::true_type;` to opt in.
+template <class T>
+struct is_trivially_relocatable : std::is_trivially_copyable<T> {};
+
+template <class T>
+  requires requires { typename T::trivially_relocatable; }
+struct is_trivially_relocatable<T> : T::trivially_relocatable {};
+
+template <class T>
+struct is_trivially_relocatable<std::allocator<T>> : std::true_type {};
+
+template <class T>
+inline constexpr bool is_trivially_relocatable_v =
+    is_trivially_relocatable<T>::value;
+
+// Moves the object at `source` to the uninitialized storage at `dest` and ends
+// the lifetime of the object at `source`.
+template <class T>
+  requires is_trivially_relocatable_v<T> ||
+           std::is_nothrow_move_constructible_v<T>
+T* relocate_at(T* source, T* dest) noexcept {
+  if constexpr (is_trivially_relocatable_v<T>) {
+    std::memmove(static_cast<void*>(dest), static_cast<const void*>(source),
+                 sizeof(T));
+    return std::launder(dest);
+  } else {
+    T* result = std::construct_at(dest, std::move(*source));
+    std::destroy_at(source);
+    return result;
+  }
+}
+
+// Relocates the objects in [first, last) to the uninitialized storage
+// starting at `dest` and returns the end of the relocated objects. The
+// ranges may overlap if `dest` is before `first`.
+template <class T>
+  requires is_trivially_relocatable_v<T> ||
+           std::is_nothrow_move_constructible_v<T>
+T* uninitialized_relocate(T* first, T* last, T* dest) noexcept {
+  if constexpr (is_trivially_relocatable_v<T>) {
+    const auto n = static_cast<std::size_t>(last - first);
+    if (n != 0) {
+      std::memmove(static_cast<void*>(dest), static_cast<const void*>(first),
+                   n * sizeof(T));
+    }
+    return dest + n;
+  } else {
+    for (; first != last; ++first, ++dest) {
+      relocate_at(first, dest);
+    }
+    return dest;
+  }
+}
+
+#endif  // XYZ_TRIVIALLY_RELOCATABLE_DEFINED
+
 namespace detail {
 
 // See: https://eel.is/c++draft/expos.only.entity
@@ -89,6 +247,12 @@ class indirect {
   using pointer = typename allocator_traits::pointer;
   using const_pointer = typename allocator_traits::const_pointer;
 
+  // An indirect is a pointer and an allocator, neither of which refers to the
+  // indirect itself.
+  using trivially_relocatable =
+      std::bool_constant<is_trivially_relocatable_v<A> &&
+                         is_trivially_relocatable_v<pointer>>;
+
   //
   // Constructors.
   //
@@ -135,7 +299,8 @@ class indirect {
   }
 
   constexpr indirect(indirect&& other) noexcept(
-      allocator_traits::is_always_equal::value)
+      allocator_traits::is_always_equal::value ||
+      allocator_is_assumed_equal_v<A>)
       : indirect(std::allocator_arg, other.alloc_, std::move(other)) {}
 
   //
@@ -191,23 +356,27 @@ class indirect {
       p_ = nullptr;
       return;
     }
-    p_ = construct_from(alloc_, *other);
+    p_ = construct_from<lifecycle_event::copy>(alloc_, *other);
   }
 
-  constexpr indirect(
-      std::allocator_arg_t, const A& alloc,
-      indirect&& other) noexcept(allocator_traits::is_always_equal::value)
+  constexpr indirect(std::allocator_arg_t, const A& alloc,
+                     indirect&& other) noexcept(
+      allocator_traits::is_always_equal::value ||
+      allocator_is_assumed_equal_v<A>)
       : p_(nullptr), alloc_(alloc) {
     static_assert(std::move_constructible<T>);
 
     if constexpr (allocator_traits::is_always_equal::value) {
       std::swap(p_, other.p_);
     } else {
+      assert(!allocator_is_assumed_equal_v<A> ||
+             alloc_ == other.alloc_);  // LCOV_EXCL_LINE
       if (alloc_ == other.alloc_) {
         std::swap(p_, other.p_);
       } else {
         if (!other.valueless_after_move()) {
-          p_ = construct_from(alloc_, std::move(*other));
+          p_ = construct_from<lifecycle_event::move>(alloc_,
+                                                     std::move(*other));
           other.reset();
         } else {
           p_ = nullptr;
@@ -246,8 +415,8 @@ class indirect {
       } else {
         // Constructing a new object could throw so we need to defer resetting
         // or updating allocators until this is done.
-        auto tmp =
-            construct_from(update_alloc ? other.alloc_ : alloc_, *other.p_);
+        auto tmp = construct_from<lifecycle_event::copy>(
+            update_alloc ? other.alloc_ : alloc_, *other.p_);
         reset();
         p_ = tmp;
       }
@@ -260,7 +429,8 @@ class indirect {
 
   constexpr indirect& operator=(indirect&& other) noexcept(
       allocator_traits::propagate_on_container_move_assignment::value ||
-      allocator_traits::is_always_equal::value) {
+      allocator_traits::is_always_equal::value ||
+      allocator_is_assumed_equal_v<A>) {
     static_assert(std::move_constructible<T>);
 
     if (this == &other) return *this;
@@ -274,14 +444,16 @@ class indirect {
     if (other.valueless_after_move()) {
       reset();
     } else {
+      assert(!allocator_is_assumed_equal_v<A> ||
+             alloc_ == other.alloc_);  // LCOV_EXCL_LINE
       if (alloc_ == other.alloc_) {
         std::swap(p_, other.p_);
         other.reset();
       } else {
         // Constructing a new object could throw so we need to defer resetting
         // or updating allocators until this is done.
-        auto tmp = construct_from(update_alloc ? other.alloc_ : alloc_,
-                                  std::move(*other.p_));
+        auto tmp = construct_from<lifecycle_event::move>(
+            update_alloc ? other.alloc_ : alloc_, std::move(*other.p_));
         reset();
         other.reset();
         p_ = tmp;
@@ -352,7 +524,8 @@ class indirect {
 
   constexpr void swap(indirect& other) noexcept(
       std::allocator_traits<A>::propagate_on_container_swap::value ||
-      std::allocator_traits<A>::is_always_equal::value) {
+      std::allocator_traits<A>::is_always_equal::value ||
+      allocator_is_assumed_equal_v<A>) {
     if constexpr (allocator_traits::propagate_on_container_swap::value) {
       // If allocators move with their allocated objects, we can swap both.
       std::swap(alloc_, other.alloc_);
@@ -438,17 +611,25 @@ class indirect {
 #endif
 
   constexpr void reset() noexcept {
+    if constexpr (allocator_releases_in_bulk_v<A> &&
+                  std::is_trivially_destructible_v<T> &&
+                  !allocator_has_lifecycle_hooks_v<A>) {
+      p_ = nullptr;
+      return;
+    }
     if (p_ == nullptr) return;
     destroy_with(alloc_, p_);
     p_ = nullptr;
   }
 
-  template <typename... Ts>
+  template <lifecycle_event Event = lifecycle_event::construct,
+            typename... Ts>
   [[nodiscard]] constexpr static pointer construct_from(A alloc, Ts&&... ts) {
     pointer mem = allocator_traits::allocate(alloc, 1);
     try {
       allocator_traits::construct(alloc, std::to_address(mem),
                                   std::forward<Ts>(ts)...);
+      detail::notify_lifecycle_event<T>(Event, sizeof(T), alloc);
       return mem;
     } catch (...) {
       allocator_traits::deallocate(alloc, mem, 1);
@@ -457,8 +638,12 @@ class indirect {
   }
 
   constexpr static void destroy_with(A alloc, pointer p) {
+    detail::notify_lifecycle_event<T>(lifecycle_event::destroy, sizeof(T),
+                                      alloc);
     allocator_traits::destroy(alloc, std::to_address(p));
-    allocator_traits::deallocate(alloc, p, 1);
+    if constexpr (!allocator_releases_in_bulk_v<A>) {
+      allocator_traits::deallocate(alloc, p, 1);
+    }
   }
 };
 
@@ -22,6 +22,10 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "indirect_cxx14.h"
 #endif  // XYZ_INDIRECT_CXX_14
 
+#ifdef XYZ_INDIRECT_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
+#include "experimental/indirect_sbo.h"
+#endif  // XYZ_INDIRECT_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
+
 #ifndef XYZ_INDIRECT_H
 #include "indirect.h"
 #endif  // XYZ_INDIRECT_H
@@ -59,6 +63,13 @@ using std::in_place_t;
 
 namespace {
 
+#ifdef XYZ_INDIRECT_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
+// Small objects are stored inside the indirect object.
+constexpr unsigned ALLOCATIONS_PER_OBJECT = 0;
+#else
+constexpr unsigned ALLOCATIONS_PER_OBJECT = 1;
+#endif  // XYZ_INDIRECT_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
+
 TEST(IndirectTest, DefaultConstructor) {
   xyz::indirect<int> i;
   EXPECT_EQ(*i, 0);
@@ -188,6 +199,8 @@ TEST(IndirectTest, CopiesAreDistinct) {
   EXPECT_NE(&*i, &*ii);
 }
 
+#ifndef XYZ_INDIRECT_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
+// Objects stored inline are moved rather than transferred.
 TEST(IndirectTest, MovePreservesIndirectObjectAddress) {
   xyz::indirect<int> i(xyz::in_place_t{}, 42);
   auto* address = &*i;
@@ -197,6 +210,7 @@ TEST(IndirectTest, MovePreservesIndirectObjectAddress) {
       i.valueless_after_move());  // NOLINT(clang-analyzer-cplusplus.Move)
   EXPECT_EQ(address, &*ii);
 }
+#endif  // XYZ_INDIRECT_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
 
 TEST(IndirectTest, AllocatorExtendedCopy) {
   xyz::indirect<int> i(xyz::in_place_t{}, 42);
@@ -205,6 +219,7 @@ TEST(IndirectTest, AllocatorExtendedCopy) {
   EXPECT_NE(&*i, &*ii);
 }
 
+#ifndef XYZ_INDIRECT_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
 TEST(IndirectTest, AllocatorExtendedMove) {
   xyz::indirect<int> i(xyz::in_place_t{}, 42);
   auto* address = &*i;
@@ -214,6 +229,7 @@ TEST(IndirectTest, AllocatorExtendedMove) {
       i.valueless_after_move());  // NOLINT(clang-analyzer-cplusplus.Move)
   EXPECT_EQ(address, &*ii);
 }
+#endif  // XYZ_INDIRECT_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
 
 TEST(IndirectTest, CopyAssignment) {
   xyz::indirect<int> i(xyz::in_place_t{}, 42);
@@ -598,7 +614,7 @@ TEST(IndirectTest, GetAllocator) {
 
   xyz::indirect<int, xyz::TrackingAllocator<int>> i(std::allocator_arg, a,
                                                     xyz::in_place_t{}, 42);
-  EXPECT_EQ(alloc_counter, 1);
+  EXPECT_EQ(alloc_counter, ALLOCATIONS_PER_OBJECT);
   EXPECT_EQ(dealloc_counter, 0);
 
   auto tracking_allocator = i.get_allocator();
@@ -614,11 +630,11 @@ TEST(IndirectTest, CountAllocationsForInPlaceConstruction) {
         std::allocator_arg,
         xyz::TrackingAllocator<int>(&alloc_counter, &dealloc_counter),
         xyz::in_place_t{}, 42);
-    EXPECT_EQ(alloc_counter, 1);
+    EXPECT_EQ(alloc_counter, ALLOCATIONS_PER_OBJECT);
     EXPECT_EQ(dealloc_counter, 0);
   }
-  EXPECT_EQ(alloc_counter, 1);
-  EXPECT_EQ(dealloc_counter, 1);
+  EXPECT_EQ(alloc_counter, ALLOCATIONS_PER_OBJECT);
+  EXPECT_EQ(dealloc_counter, ALLOCATIONS_PER_OBJECT);
 }
 
 TEST(IndirectTest, CountAllocationsForCopyConstruction) {
@@ -629,12 +645,12 @@ TEST(IndirectTest, CountAllocationsForCopyConstruction) {
         std::allocator_arg,
         xyz::TrackingAllocator<int>(&alloc_counter, &dealloc_counter),
         xyz::in_place_t{}, 42);
-    EXPECT_EQ(alloc_counter, 1);
+    EXPECT_EQ(alloc_counter, ALLOCATIONS_PER_OBJECT);
     EXPECT_EQ(dealloc_counter, 0);
     xyz::indirect<int, xyz::TrackingAllocator<int>> ii(i);
   }
-  EXPECT_EQ(alloc_counter, 2);
-  EXPECT_EQ(dealloc_counter, 2);
+  EXPECT_EQ(alloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
+  EXPECT_EQ(dealloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
 }
 
 TEST(IndirectTest, CountAllocationsForCopyAssignment) {
@@ -649,12 +665,12 @@ TEST(IndirectTest, CountAllocationsForCopyAssignment) {
         std::allocator_arg,
         xyz::TrackingAllocator<int>(&alloc_counter, &dealloc_counter),
         xyz::in_place_t{}, 101);
-    EXPECT_EQ(alloc_counter, 2);
+    EXPECT_EQ(alloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
     EXPECT_EQ(dealloc_counter, 0);
     ii = i;  // Will not allocate as int is assignable.
   }
-  EXPECT_EQ(alloc_counter, 2);
-  EXPECT_EQ(dealloc_counter, 2);
+  EXPECT_EQ(alloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
+  EXPECT_EQ(dealloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
 }
 
 TEST(IndirectTest, CountAllocationsForMoveAssignment) {
@@ -669,12 +685,12 @@ TEST(IndirectTest, CountAllocationsForMoveAssignment) {
         std::allocator_arg,
         xyz::TrackingAllocator<int>(&alloc_counter, &dealloc_counter),
         xyz::in_place_t{}, 101);
-    EXPECT_EQ(alloc_counter, 2);
+    EXPECT_EQ(alloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
     EXPECT_EQ(dealloc_counter, 0);
     ii = std::move(i);
   }
-  EXPECT_EQ(alloc_counter, 2);
-  EXPECT_EQ(dealloc_counter, 2);
+  EXPECT_EQ(alloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
+  EXPECT_EQ(dealloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
 }
 
 template <typename T>
@@ -708,12 +724,12 @@ TEST(IndirectTest,
         std::allocator_arg,
         NonEqualTrackingAllocator<int>(&alloc_counter, &dealloc_counter),
         xyz::in_place_t{}, 101);
-    EXPECT_EQ(alloc_counter, 2);
+    EXPECT_EQ(alloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
     EXPECT_EQ(dealloc_counter, 0);
     ii = i;
   }
-  EXPECT_EQ(alloc_counter, 3);
-  EXPECT_EQ(dealloc_counter, 3);
+  EXPECT_EQ(alloc_counter, 3 * ALLOCATIONS_PER_OBJECT);
+  EXPECT_EQ(dealloc_counter, 3 * ALLOCATIONS_PER_OBJECT);
 }
 
 TEST(IndirectTest,
@@ -729,14 +745,14 @@ TEST(IndirectTest,
         std::allocator_arg,
         NonEqualTrackingAllocator<int>(&alloc_counter, &dealloc_counter),
         xyz::in_place_t{}, 101);
-    EXPECT_EQ(alloc_counter, 2);
+    EXPECT_EQ(alloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
     EXPECT_EQ(dealloc_counter, 0);
     ii = std::move(i);  // This will copy as allocators don't compare equal.
     EXPECT_TRUE(
         i.valueless_after_move());  // NOLINT(clang-analyzer-cplusplus.Move)
   }
-  EXPECT_EQ(alloc_counter, 3);
-  EXPECT_EQ(dealloc_counter, 3);
+  EXPECT_EQ(alloc_counter, 3 * ALLOCATIONS_PER_OBJECT);
+  EXPECT_EQ(dealloc_counter, 3 * ALLOCATIONS_PER_OBJECT);
 }
 
 TEST(IndirectTest, CountAllocationsForAssignmentToMovedFromObject) {
@@ -751,10 +767,11 @@ TEST(IndirectTest, CountAllocationsForAssignmentToMovedFromObject) {
         std::allocator_arg,
         xyz::TrackingAllocator<int>(&alloc_counter, &dealloc_counter),
         xyz::in_place_t{}, 101);
-    EXPECT_EQ(alloc_counter, 2);
+    EXPECT_EQ(alloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
     EXPECT_EQ(dealloc_counter, 0);
     ii = std::move(i);
-    EXPECT_EQ(dealloc_counter, 1);  // ii's value is destroyed.
+    // ii's value is destroyed.
+    EXPECT_EQ(dealloc_counter, ALLOCATIONS_PER_OBJECT);
     xyz::indirect<int, xyz::TrackingAllocator<int>> iii(
         std::allocator_arg,
         xyz::TrackingAllocator<int>(&alloc_counter, &dealloc_counter),
@@ -762,11 +779,11 @@ TEST(IndirectTest, CountAllocationsForAssignmentToMovedFromObject) {
     EXPECT_TRUE(
         i.valueless_after_move());  // NOLINT(clang-analyzer-cplusplus.Move)
     i = iii;  // This will cause an allocation as i is valueless.
-    EXPECT_EQ(alloc_counter, 4);
-    EXPECT_EQ(dealloc_counter, 1);
+    EXPECT_EQ(alloc_counter, 4 * ALLOCATIONS_PER_OBJECT);
+    EXPECT_EQ(dealloc_counter, ALLOCATIONS_PER_OBJECT);
   }
-  EXPECT_EQ(alloc_counter, 4);
-  EXPECT_EQ(dealloc_counter, 4);
+  EXPECT_EQ(alloc_counter, 4 * ALLOCATIONS_PER_OBJECT);
+  EXPECT_EQ(dealloc_counter, 4 * ALLOCATIONS_PER_OBJECT);
 }
 
 TEST(IndirectTest, CountAllocationsForMoveConstruction) {
@@ -777,12 +794,12 @@ TEST(IndirectTest, CountAllocationsForMoveConstruction) {
         std::allocator_arg,
         xyz::TrackingAllocator<int>(&alloc_counter, &dealloc_counter),
         xyz::in_place_t{}, 42);
-    EXPECT_EQ(alloc_counter, 1);
+    EXPECT_EQ(alloc_counter, ALLOCATIONS_PER_OBJECT);
     EXPECT_EQ(dealloc_counter, 0);
     xyz::indirect<int, xyz::TrackingAllocator<int>> ii(std::move(i));
   }
-  EXPECT_EQ(alloc_counter, 1);
-  EXPECT_EQ(dealloc_counter, 1);
+  EXPECT_EQ(alloc_counter, ALLOCATIONS_PER_OBJECT);
+  EXPECT_EQ(dealloc_counter, ALLOCATIONS_PER_OBJECT);
 }
 
 TEST(IndirectTest,
@@ -794,14 +811,14 @@ TEST(IndirectTest,
         std::allocator_arg,
         NonEqualTrackingAllocator<int>(&alloc_counter, &dealloc_counter),
         xyz::in_place_t{}, 42);
-    EXPECT_EQ(alloc_counter, 1);
+    EXPECT_EQ(alloc_counter, ALLOCATIONS_PER_OBJECT);
     EXPECT_EQ(dealloc_counter, 0);
     xyz::indirect<int, NonEqualTrackingAllocator<int>> ii(std::move(i));
     EXPECT_TRUE(
         i.valueless_after_move());  // NOLINT(clang-analyzer-cplusplus.Move)
   }
-  EXPECT_EQ(alloc_counter, 2);
-  EXPECT_EQ(dealloc_counter, 2);
+  EXPECT_EQ(alloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
+  EXPECT_EQ(dealloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
 }
 
 template <typename T>
@@ -822,14 +839,14 @@ TEST(IndirectTest, NonMemberSwapWhenAllocatorsDontCompareEqual) {
         std::allocator_arg,
         POCSTrackingAllocator<int>(&alloc_counter, &dealloc_counter),
         xyz::in_place_t{}, 101);
-    EXPECT_EQ(alloc_counter, 2);
+    EXPECT_EQ(alloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
     EXPECT_EQ(dealloc_counter, 0);
     swap(i, ii);
     EXPECT_EQ(*i, 101);
     EXPECT_EQ(*ii, 42);
   }
-  EXPECT_EQ(alloc_counter, 2);
-  EXPECT_EQ(dealloc_counter, 2);
+  EXPECT_EQ(alloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
+  EXPECT_EQ(dealloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
 }
 
 TEST(IndirectTest, MemberSwapWhenAllocatorsDontCompareEqual) {
@@ -844,14 +861,14 @@ TEST(IndirectTest, MemberSwapWhenAllocatorsDontCompareEqual) {
         std::allocator_arg,
         POCSTrackingAllocator<int>(&alloc_counter, &dealloc_counter),
         xyz::in_place_t{}, 101);
-    EXPECT_EQ(alloc_counter, 2);
+    EXPECT_EQ(alloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
     EXPECT_EQ(dealloc_counter, 0);
     i.swap(ii);
     EXPECT_EQ(*i, 101);
     EXPECT_EQ(*ii, 42);
   }
-  EXPECT_EQ(alloc_counter, 2);
-  EXPECT_EQ(dealloc_counter, 2);
+  EXPECT_EQ(alloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
+  EXPECT_EQ(dealloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
 }
 
 struct ThrowsOnConstruction {
@@ -905,8 +922,8 @@ TEST(IndirectTest, ConstructorWithExceptionsTrackingAllocations) {
                                 &alloc_counter, &dealloc_counter));
   };
   EXPECT_THROW(construct(), ThrowsOnConstruction::Exception);
-  EXPECT_EQ(alloc_counter, 1);
-  EXPECT_EQ(dealloc_counter, 1);
+  EXPECT_EQ(alloc_counter, ALLOCATIONS_PER_OBJECT);
+  EXPECT_EQ(dealloc_counter, ALLOCATIONS_PER_OBJECT);
 }
 
 #ifdef XYZ_HAS_STD_OPTIONAL
@@ -949,12 +966,23 @@ TEST(IndirectTest, InteractionWithUnorderedMap) {
   }
 }
 
+#ifdef XYZ_INDIRECT_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
+TEST(IndirectTest, InteractionWithSizedAllocators) {
+  EXPECT_TRUE(xyz::static_test<sizeof(xyz::indirect<int>) ==
+                               sizeof(int*) + XYZ_INDIRECT_SBO_DEFAULT_SIZE>());
+  EXPECT_TRUE(xyz::static_test<
+              sizeof(xyz::indirect<int, xyz::TrackingAllocator<int>>) ==
+              (sizeof(int*) + XYZ_INDIRECT_SBO_DEFAULT_SIZE +
+               sizeof(xyz::TrackingAllocator<int>))>());
+}
+#else
 TEST(IndirectTest, InteractionWithSizedAllocators) {
   EXPECT_TRUE(xyz::static_test<sizeof(xyz::indirect<int>) == sizeof(int*)>());
   EXPECT_TRUE(xyz::static_test<
               sizeof(xyz::indirect<int, xyz::TrackingAllocator<int>>) ==
               (sizeof(int*) + sizeof(xyz::TrackingAllocator<int>))>());
 }
+#endif  // XYZ_INDIRECT_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
 
 #ifdef XYZ_HAS_STD_MEMORY_RESOURCE
 TEST(IndirectTest, InteractionWithPMRAllocators) {
@@ -1063,6 +1091,113 @@ TEST(IndirectTest, SupportNonCopyableType) {
       i.valueless_after_move());  // NOLINT(clang-analyzer-cplusplus.Move)
 }
 
+#ifdef XYZ_INDIRECT_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
+using LargeArray = std::array<int, 64>;
+
+struct ThrowsOnMoveConstruction {
+  int value_ = 0;
+
+  ThrowsOnMoveConstruction() = default;
+  ThrowsOnMoveConstruction(const ThrowsOnMoveConstruction&) = default;
+  ThrowsOnMoveConstruction(ThrowsOnMoveConstruction&&) noexcept(false) {}
+};
+
+TEST(IndirectTest, SmallBufferStoresSmallObjectsInline) {
+  unsigned alloc_counter = 0;
+  unsigned dealloc_counter = 0;
+  {
+    xyz::indirect<int, xyz::TrackingAllocator<int>> i(
+        std::allocator_arg,
+        xyz::TrackingAllocator<int>(&alloc_counter, &dealloc_counter),
+        xyz::in_place_t{}, 42);
+    auto* begin = reinterpret_cast<const std::byte*>(&i);
+    auto* address = reinterpret_cast<const std::byte*>(&*i);
+    EXPECT_GE(address, begin);
+    EXPECT_LT(address, begin + sizeof(i));
+
+    auto ii = i;
+    auto iii = std::move(i);
+    EXPECT_TRUE(
+        i.valueless_after_move());  // NOLINT(clang-analyzer-cplusplus.Move)
+    EXPECT_EQ(*ii, 42);
+    EXPECT_EQ(*iii, 42);
+    i = ii;
+    EXPECT_EQ(*i, 42);
+  }
+  EXPECT_EQ(alloc_counter, 0);
+  EXPECT_EQ(dealloc_counter, 0);
+}
+
+TEST(IndirectTest, SmallBufferAllocatesLargeObjects) {
+  unsigned alloc_counter = 0;
+  unsigned dealloc_counter = 0;
+  {
+    xyz::indirect<LargeArray, xyz::TrackingAllocator<LargeArray>> i(
+        std::allocator_arg,
+        xyz::TrackingAllocator<LargeArray>(&alloc_counter, &dealloc_counter),
+        xyz::in_place_t{}, LargeArray{42});
+    EXPECT_EQ(alloc_counter, 1);
+    auto ii = i;
+    EXPECT_EQ(alloc_counter, 2);
+    auto* address = &*i;
+    auto iii = std::move(i);
+    EXPECT_EQ(alloc_counter, 2);
+    EXPECT_EQ(address, &*iii);
+    EXPECT_EQ((*ii)[0], 42);
+  }
+  EXPECT_EQ(alloc_counter, 2);
+  EXPECT_EQ(dealloc_counter, 2);
+}
+
+TEST(IndirectTest, SmallBufferAllocatesObjectsWithThrowingMoves) {
+  unsigned alloc_counter = 0;
+  unsigned dealloc_counter = 0;
+  {
+    xyz::indirect<ThrowsOnMoveConstruction,
+                  xyz::TrackingAllocator<ThrowsOnMoveConstruction>>
+        i(std::allocator_arg,
+          xyz::TrackingAllocator<ThrowsOnMoveConstruction>(&alloc_counter,
+                                                           &dealloc_counter));
+    auto ii = std::move(i);
+    EXPECT_TRUE(
+        i.valueless_after_move());  // NOLINT(clang-analyzer-cplusplus.Move)
+  }
+  EXPECT_EQ(alloc_counter, 1);
+  EXPECT_EQ(dealloc_counter, 1);
+}
+
+TEST(IndirectTest, SmallBufferSwapInlineObjects) {
+  xyz::indirect<int> i(xyz::in_place_t{}, 42);
+  xyz::indirect<int> ii(xyz::in_place_t{}, 101);
+  swap(i, ii);
+  EXPECT_EQ(*i, 101);
+  EXPECT_EQ(*ii, 42);
+  xyz::indirect<int> iii(std::move(ii));
+  i.swap(ii);
+  EXPECT_TRUE(
+      i.valueless_after_move());  // NOLINT(clang-analyzer-cplusplus.Move)
+  EXPECT_EQ(*ii, 101);
+}
+
+TEST(IndirectTest, SmallBufferCustomCapacity) {
+  using IndirectArray =
+      xyz::indirect<LargeArray, xyz::TrackingAllocator<LargeArray>,
+                    sizeof(LargeArray), alignof(LargeArray)>;
+  unsigned alloc_counter = 0;
+  unsigned dealloc_counter = 0;
+  {
+    IndirectArray i(
+        std::allocator_arg,
+        xyz::TrackingAllocator<LargeArray>(&alloc_counter, &dealloc_counter),
+        xyz::in_place_t{}, LargeArray{42});
+    IndirectArray ii(i);
+    EXPECT_EQ(i, ii);
+  }
+  EXPECT_EQ(alloc_counter, 0);
+  EXPECT_EQ(dealloc_counter, 0);
+}
+#endif  // XYZ_INDIRECT_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
+
 }  // namespace
 
 struct NonThreeWayComparable {
@@ -1100,3 +1235,232 @@ TEST(IndirectTest, NonThreeWayComparable) {
   EXPECT_TRUE(i != ii);
 }
 #endif  // XYZ_HAS_STD_THREE_WAY_COMPARISON
+
+#ifdef XYZ_INDIRECT_HAS_LIFECYCLE_HOOKS
+struct LifecycleRecord {
+  xyz::lifecycle_event event;
+  std::size_t size;
+  std::size_t tag;
+};
+
+struct RecordingLifecycleHooks {
+  static std::vector<LifecycleRecord>& records() {
+    static std::vector<LifecycleRecord> r;
+    return r;
+  }
+
+  template <class U, class A>
+  static void on_lifecycle_event(xyz::lifecycle_event event, std::size_t size,
+                                 const A& alloc) noexcept {
+    records().push_back({event, size, alloc.tag});
+  }
+};
+
+template <typename T>
+struct HookedAllocator : xyz::TaggedAllocator<T> {
+  using lifecycle_hooks = RecordingLifecycleHooks;
+
+  using xyz::TaggedAllocator<T>::TaggedAllocator;
+
+  template <typename Other>
+  struct rebind {
+    using other = HookedAllocator<Other>;
+  };
+};
+
+static_assert(xyz::allocator_has_lifecycle_hooks_v<HookedAllocator<int>>);
+static_assert(!xyz::allocator_has_lifecycle_hooks_v<std::allocator<int>>);
+
+TEST(IndirectTest, LifecycleHooksSeeConstructCopyAndDestroy) {
+  using event = xyz::lifecycle_event;
+  auto& records = RecordingLifecycleHooks::records();
+  records.clear();
+  {
+    xyz::indirect<int, HookedAllocator<int>> a(std::allocator_arg,
+                                               HookedAllocator<int>(1), 42);
+    xyz::indirect<int, HookedAllocator<int>> b(a);
+    xyz::indirect<int, HookedAllocator<int>> c(std::move(a));
+    EXPECT_EQ(*b, 42);
+    EXPECT_EQ(*c, 42);
+  }
+  ASSERT_EQ(records.size(), 4u);
+  EXPECT_EQ(records[0].event, event::construct);
+  EXPECT_EQ(records[1].event, event::copy);
+  // Moving with an equal allocator transfers ownership: there is no event.
+  EXPECT_EQ(records[2].event, event::destroy);
+  EXPECT_EQ(records[3].event, event::destroy);
+  for (const auto& r : records) {
+    EXPECT_EQ(r.size, sizeof(int));
+    EXPECT_EQ(r.tag, 1u);
+  }
+}
+
+TEST(IndirectTest, LifecycleHooksSeeMoveToADifferentAllocator) {
+  using event = xyz::lifecycle_event;
+  auto& records = RecordingLifecycleHooks::records();
+  xyz::indirect<int, HookedAllocator<int>> a(std::allocator_arg,
+                                             HookedAllocator<int>(1), 42);
+  records.clear();
+  xyz::indirect<int, HookedAllocator<int>> b(std::allocator_arg,
+                                             HookedAllocator<int>(2),
+                                             std::move(a));
+  ASSERT_EQ(records.size(), 2u);
+  EXPECT_EQ(records[0].event, event::move);
+  EXPECT_EQ(records[0].tag, 2u);
+  EXPECT_EQ(records[1].event, event::destroy);
+  EXPECT_EQ(records[1].tag, 1u);
+}
+#endif  // XYZ_INDIRECT_HAS_LIFECYCLE_HOOKS
+
+#ifdef XYZ_INDIRECT_HAS_TRIVIAL_RELOCATION
+template <typename T>
+struct NonRelocatableAllocator : std::allocator<T> {
+  using trivially_relocatable = std::false_type;
+
+  NonRelocatableAllocator() = default;
+
+  template <typename U>
+  NonRelocatableAllocator(const NonRelocatableAllocator<U>&) noexcept {}
+
+  template <typename Other>
+  struct rebind {
+    using other = NonRelocatableAllocator<Other>;
+  };
+};
+
+static_assert(xyz::is_trivially_relocatable_v<xyz::indirect<int>>);
+static_assert(xyz::is_trivially_relocatable_v<
+              xyz::indirect<int, xyz::TaggedAllocator<int>>>);
+static_assert(!xyz::is_trivially_relocatable_v<
+              xyz::indirect<int, NonRelocatableAllocator<int>>>);
+#ifdef XYZ_HAS_STD_MEMORY_RESOURCE
+static_assert(xyz::is_trivially_relocatable_v<
+              xyz::indirect<int, std::pmr::polymorphic_allocator<int>>>);
+#endif  // XYZ_HAS_STD_MEMORY_RESOURCE
+
+TEST(IndirectTest, RelocateAtKeepsOwnedObject) {
+  alignas(xyz::indirect<int>) unsigned char source[sizeof(xyz::indirect<int>)];
+  alignas(xyz::indirect<int>) unsigned char dest[sizeof(xyz::indirect<int>)];
+  auto* s = ::new (source) xyz::indirect<int>(std::in_place, 42);
+  const int* owned = &**s;
+
+  xyz::indirect<int>* d =
+      xyz::relocate_at(s, reinterpret_cast<xyz::indirect<int>*>(dest));
+  EXPECT_EQ(&**d, owned);
+  EXPECT_EQ(**d, 42);
+  std::destroy_at(d);
+}
+
+template <typename I>
+void ExpectUninitializedRelocateShiftsLeft(const I& value) {
+  std::allocator<I> alloc;
+  constexpr std::size_t n = 5;
+  I* p = alloc.allocate(n);
+  std::vector<const int*> owned;
+  for (std::size_t i = 0; i < n; ++i) {
+    std::construct_at(p + i, std::allocator_arg, value.get_allocator(),
+                      static_cast<int>(i));
+    owned.push_back(&*p[i]);
+  }
+
+  // Erase the first element by relocating the rest over it.
+  std::destroy_at(p);
+  I* end = xyz::uninitialized_relocate(p + 1, p + n, p);
+  ASSERT_EQ(end, p + n - 1);
+  for (std::size_t i = 0; i + 1 < n; ++i) {
+    EXPECT_EQ(*p[i], static_cast<int>(i + 1));
+    EXPECT_EQ(&*p[i], owned[i + 1]);
+  }
+  std::destroy(p, end);
+  alloc.deallocate(p, n);
+}
+
+TEST(IndirectTest, UninitializedRelocateTrivially) {
+  ExpectUninitializedRelocateShiftsLeft(
+      xyz::indirect<int, xyz::TaggedAllocator<int>>(
+          std::allocator_arg, xyz::TaggedAllocator<int>(1), 0));
+}
+
+TEST(IndirectTest, UninitializedRelocateByMoving) {
+  ExpectUninitializedRelocateShiftsLeft(
+      xyz::indirect<int, NonRelocatableAllocator<int>>(std::in_place, 0));
+}
+#endif  // XYZ_INDIRECT_HAS_TRIVIAL_RELOCATION
+
+#if defined(XYZ_INDIRECT_HAS_ASSUMED_EQUAL_ALLOCATORS) && \
+    defined(XYZ_HAS_STD_MEMORY_RESOURCE)
+// A polymorphic allocator for values that all share one memory resource.
+template <typename T>
+struct SharedResourceAllocator : std::pmr::polymorphic_allocator<T> {
+  using is_assumed_equal = std::true_type;
+
+  using std::pmr::polymorphic_allocator<T>::polymorphic_allocator;
+
+  template <typename U>
+  SharedResourceAllocator(const std::pmr::polymorphic_allocator<U>& other)
+      : std::pmr::polymorphic_allocator<T>(other.resource()) {}
+
+  template <typename Other>
+  struct rebind {
+    using other = SharedResourceAllocator<Other>;
+  };
+};
+
+struct CountsCopies {
+  static inline int copies = 0;
+  int value;
+
+  CountsCopies(int v) : value(v) {}
+  CountsCopies(const CountsCopies& other) : value(other.value) { ++copies; }
+};
+
+using SharedIndirect =
+    xyz::indirect<CountsCopies, SharedResourceAllocator<CountsCopies>>;
+using PmrIndirect =
+    xyz::indirect<CountsCopies, std::pmr::polymorphic_allocator<CountsCopies>>;
+
+static_assert(
+    xyz::allocator_is_assumed_equal_v<SharedResourceAllocator<CountsCopies>>);
+static_assert(std::is_nothrow_move_constructible_v<SharedIndirect>);
+static_assert(std::is_nothrow_move_assignable_v<SharedIndirect>);
+static_assert(std::is_nothrow_swappable_v<SharedIndirect>);
+static_assert(!std::is_nothrow_move_constructible_v<PmrIndirect>);
+
+template <typename I>
+int CopiesWhenGrowingPmrVector() {
+  std::pmr::unsynchronized_pool_resource resource;
+  std::pmr::vector<I> values{&resource};
+  CountsCopies::copies = 0;
+  for (int i = 0; i < 100; ++i) {
+    values.emplace_back(std::in_place, i);
+  }
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(values[i]->value, i);
+  }
+  return CountsCopies::copies;
+}
+
+TEST(IndirectTest, AssumedEqualAllocatorsMoveOnReallocation) {
+  EXPECT_GT(CopiesWhenGrowingPmrVector<PmrIndirect>(), 0);
+  EXPECT_EQ(CopiesWhenGrowingPmrVector<SharedIndirect>(), 0);
+}
+
+TEST(IndirectTest, AssumedEqualAllocatorsMoveAndSwap) {
+  std::pmr::unsynchronized_pool_resource resource;
+  SharedResourceAllocator<CountsCopies> alloc(&resource);
+  SharedIndirect a(std::allocator_arg, alloc, std::in_place, 1);
+  CountsCopies::copies = 0;
+  const CountsCopies* owned = &*a;
+
+  SharedIndirect b(std::move(a));
+  EXPECT_EQ(&*b, owned);
+  EXPECT_TRUE(a.valueless_after_move());
+
+  SharedIndirect c(std::allocator_arg, alloc, std::in_place, 3);
+  swap(b, c);
+  EXPECT_EQ(b->value, 3);
+  EXPECT_EQ(&*c, owned);
+  EXPECT_EQ(CountsCopies::copies, 0);
+}
+#endif  // XYZ_INDIRECT_HAS_ASSUMED_EQUAL_ALLOCATORS &&
+        // XYZ_HAS_STD_MEMORY_RESOURCE
@@ -0,0 +1,262 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+#include "experimental/instrumented_allocator.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "indirect.h"
+#include "polymorphic.h"
+
+namespace {
+
+TEST(InstrumentedAllocatorTest, SizeClasses) {
+  using S = xyz::allocation_snapshot;
+  EXPECT_EQ(S::size_class(1), 0);
+  EXPECT_EQ(S::size_class(16), 0);
+  EXPECT_EQ(S::size_class(17), 1);
+  EXPECT_EQ(S::size_class(32), 1);
+  EXPECT_EQ(S::size_class(33), 2);
+  EXPECT_EQ(S::size_class(std::size_t(16) << 14), 14);
+  EXPECT_EQ(S::size_class((std::size_t(16) << 14) + 1), 15);
+  EXPECT_EQ(S::size_class(std::size_t(1) << 40), 15);
+}
+
+TEST(InstrumentedAllocatorTest, CountsAllocationsAndBytes) {
+  xyz::allocation_stats stats;
+  xyz::instrumented_allocator<std::int64_t> a(stats);
+  std::int64_t* p = a.allocate(1);
+  std::int64_t* pp = a.allocate(100);
+
+  auto s = stats.snapshot();
+  EXPECT_EQ(s.allocations, 2);
+  EXPECT_EQ(s.bytes_allocated, 808);
+  EXPECT_EQ(s.live_bytes, 808);
+  EXPECT_EQ(s.live_allocations, 2);
+  EXPECT_EQ(s.size_histogram[0], 1);
+  EXPECT_EQ(s.size_histogram[xyz::allocation_snapshot::size_class(800)], 1);
+
+  a.deallocate(pp, 100);
+  a.deallocate(p, 1);
+  s = stats.snapshot();
+  EXPECT_EQ(s.deallocations, 2);
+  EXPECT_EQ(s.bytes_deallocated, 808);
+  EXPECT_EQ(s.live_allocations, 0);
+  EXPECT_EQ(s.live_bytes, 0);
+  EXPECT_EQ(s.peak_bytes, 808);
+}
+
+TEST(InstrumentedAllocatorTest, PeakAndReset) {
+  xyz::allocation_stats stats;
+  xyz::instrumented_allocator<char> a(stats);
+  char* p = a.allocate(1000);
+  a.deallocate(p, 1000);
+  char* pp = a.allocate(10);
+  EXPECT_EQ(stats.snapshot().peak_bytes, 1000);
+
+  stats.reset();
+  auto s = stats.snapshot();
+  EXPECT_EQ(s.allocations, 0);
+  EXPECT_EQ(s.live_allocations, 1);
+  EXPECT_EQ(s.live_bytes, 10);
+  EXPECT_EQ(s.peak_bytes, 10);
+
+  // Memory allocated before the reset is still accounted for when it is
+  // deallocated after it.
+  a.deallocate(pp, 10);
+  s = stats.snapshot();
+  EXPECT_EQ(s.deallocations, 1);
+  EXPECT_EQ(s.live_allocations, 0);
+  EXPECT_EQ(s.live_bytes, 0);
+}
+
+// Propagation and pointer types follow the upstream allocator.
+static_assert(std::is_same_v<
+              std::allocator_traits<xyz::instrumented_allocator<int>>::pointer,
+              int*>);
+static_assert(std::allocator_traits<xyz::instrumented_allocator<int>>::
+                  propagate_on_container_move_assignment::value);
+static_assert(!std::allocator_traits<xyz::instrumented_allocator<int>>::
+                  propagate_on_container_copy_assignment::value);
+static_assert(!std::allocator_traits<xyz::instrumented_allocator<int>>::
+                  propagate_on_container_swap::value);
+static_assert(!std::allocator_traits<
+              xyz::instrumented_allocator<int>>::is_always_equal::value);
+
+TEST(InstrumentedAllocatorTest, Equality) {
+  xyz::allocation_stats stats;
+  xyz::allocation_stats other_stats;
+  xyz::instrumented_allocator<int> a(stats);
+  xyz::instrumented_allocator<double> b(stats);
+  xyz::instrumented_allocator<int> c(other_stats);
+  EXPECT_TRUE(a == b);
+  EXPECT_FALSE(a == c);
+}
+
+// A pointer type that is a class, to check that instrumented_allocator uses
+// the pointer type of its upstream allocator.
+template <class T>
+class FancyPointer {
+  T* p_ = nullptr;
+
+ public:
+  FancyPointer() = default;
+
+  explicit FancyPointer(T* p) : p_(p) {}
+
+  T* get() const { return p_; }
+
+  T& operator*() const { return *p_; }
+
+  T* operator->() const { return p_; }
+
+  friend bool operator==(const FancyPointer&, const FancyPointer&) = default;
+};
+
+template <class T>
+struct FancyAllocator {
+  using value_type = T;
+  using pointer = FancyPointer<T>;
+
+  FancyAllocator() = default;
+
+  template <class U>
+  FancyAllocator(const FancyAllocator<U>&) {}
+
+  pointer allocate(std::size_t n) {
+    return pointer(std::allocator<T>().allocate(n));
+  }
+
+  void deallocate(pointer p, std::size_t n) {
+    std::allocator<T>().deallocate(p.get(), n);
+  }
+
+  friend bool operator==(const FancyAllocator&,
+                         const FancyAllocator&) = default;
+};
+
+TEST(InstrumentedAllocatorTest, FancyPointers) {
+  xyz::allocation_stats stats;
+  xyz::instrumented_allocator<int, FancyAllocator<int>> a(stats);
+  FancyPointer<int> p = a.allocate(2);
+  *p = 42;
+  EXPECT_EQ(*p, 42);
+  EXPECT_EQ(stats.snapshot().live_bytes, 2 * sizeof(int));
+  a.deallocate(p, 2);
+  EXPECT_EQ(stats.snapshot().live_allocations, 0);
+}
+
+TEST(InstrumentedAllocatorTest, Indirect) {
+  xyz::allocation_stats stats;
+  using A = xyz::instrumented_allocator<int>;
+  {
+    xyz::indirect<int, A> i(std::allocator_arg, A(stats), 42);
+    auto ii = i;
+    EXPECT_EQ(*ii, 42);
+    auto s = stats.snapshot();
+    EXPECT_EQ(s.allocations, 2);
+    EXPECT_EQ(s.live_bytes, 2 * sizeof(int));
+  }
+  auto s = stats.snapshot();
+  EXPECT_EQ(s.deallocations, 2);
+  EXPECT_EQ(s.live_bytes, 0);
+}
+
+class Base {
+ public:
+  virtual ~Base() = default;
+  virtual int value() const = 0;
+};
+
+class Derived : public Base {
+  int value_;
+
+ public:
+  Derived(int v) : value_(v) {}
+  int value() const override { return value_; }
+};
+
+TEST(InstrumentedAllocatorTest, Polymorphic) {
+  xyz::allocation_stats stats;
+  using A = xyz::instrumented_allocator<Base>;
+  {
+    xyz::polymorphic<Base, A> p(std::allocator_arg, A(stats),
+                                std::in_place_type<Derived>, 42);
+    auto pp = p;
+    EXPECT_EQ(pp->value(), 42);
+    auto s = stats.snapshot();
+    EXPECT_EQ(s.allocations, 2);
+    // Control blocks are larger than the objects they own.
+    EXPECT_GT(s.live_bytes, 2 * sizeof(Derived));
+    EXPECT_EQ(s.peak_bytes, s.live_bytes);
+  }
+  EXPECT_EQ(stats.snapshot().live_bytes, 0);
+}
+
+TEST(InstrumentedAllocatorTest, CountsAcrossThreads) {
+  xyz::allocation_stats stats;
+  using A = xyz::instrumented_allocator<std::int64_t>;
+  constexpr int thread_count = 8;
+  constexpr int allocations_per_thread = 10000;
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_count; ++t) {
+    threads.emplace_back([&stats] {
+      for (int i = 0; i < allocations_per_thread; ++i) {
+        xyz::indirect<std::int64_t, A> v(std::allocator_arg, A(stats), i);
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+
+  auto s = stats.snapshot();
+  constexpr std::uint64_t total = thread_count * allocations_per_thread;
+  EXPECT_EQ(s.allocations, total);
+  EXPECT_EQ(s.deallocations, total);
+  EXPECT_EQ(s.bytes_allocated, total * sizeof(std::int64_t));
+  EXPECT_EQ(s.size_histogram[0], total);
+  EXPECT_EQ(s.live_bytes, 0);
+  EXPECT_GE(s.peak_bytes, static_cast<std::int64_t>(sizeof(std::int64_t)));
+  EXPECT_LE(s.peak_bytes,
+            static_cast<std::int64_t>(thread_count * sizeof(std::int64_t)));
+}
+
+TEST(InstrumentedAllocatorTest, Report) {
+  xyz::allocation_stats stats;
+  xyz::instrumented_allocator<char> a(stats);
+  char* p = a.allocate(24);
+  std::ostringstream os;
+  os << stats.snapshot();
+  EXPECT_NE(os.str().find("allocations: 1"), std::string::npos);
+  EXPECT_NE(os.str().find("peak bytes: 24"), std::string::npos);
+  EXPECT_NE(os.str().find("<= 32 bytes: 1"), std::string::npos);
+  a.deallocate(p, 24);
+}
+
+}  // namespace
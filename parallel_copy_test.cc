@@ -0,0 +1,281 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+#include "experimental/parallel_copy.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "feature_check.h"
+#include "indirect.h"
+#include "polymorphic.h"
+#include "tagged_allocator.h"
+#ifdef XYZ_HAS_STD_MEMORY_RESOURCE
+#include <memory_resource>
+#endif  // XYZ_HAS_STD_MEMORY_RESOURCE
+
+namespace {
+
+constexpr std::size_t large_size = 10 * xyz::parallel_copy_min_chunk_size + 7;
+
+class Base {
+ public:
+  virtual ~Base() = default;
+  virtual int value() const = 0;
+};
+
+class Derived : public Base {
+ private:
+  int value_;
+
+ public:
+  Derived(int v) : value_(v) {}
+
+  int value() const override { return value_; }
+};
+
+class Derived2 : public Base {
+ private:
+  int value_;
+
+ public:
+  Derived2(int v) : value_(v) {}
+
+  int value() const override { return 2 * value_; }
+};
+
+// Counts live instances and throws when copying an instance with the value
+// `throw_on`.
+class Counted : public Base {
+ private:
+  int value_;
+
+ public:
+  static inline std::atomic<int> instances = 0;
+  static inline int throw_on = -1;
+
+  Counted(int v) : value_(v) { ++instances; }
+
+  Counted(const Counted& other) : value_(other.value_) {
+    if (value_ == throw_on) throw std::runtime_error("copy failed");
+    ++instances;
+  }
+
+  ~Counted() override { --instances; }
+
+  int value() const override { return value_; }
+};
+
+TEST(ParallelCopyTest, CopiesIndirect) {
+  std::vector<xyz::indirect<int>> v;
+  for (std::size_t i = 0; i < large_size; ++i) {
+    v.emplace_back(std::in_place, static_cast<int>(i));
+  }
+
+  auto copy = xyz::parallel_copy(v, 4);
+
+  ASSERT_EQ(copy.size(), v.size());
+  for (std::size_t i = 0; i < v.size(); ++i) {
+    EXPECT_EQ(*copy[i], *v[i]);
+    EXPECT_NE(&*copy[i], &*v[i]);
+  }
+}
+
+TEST(ParallelCopyTest, CopiesPolymorphic) {
+  std::vector<xyz::polymorphic<Base>> v;
+  for (std::size_t i = 0; i < large_size; ++i) {
+    if (i % 3 == 0) {
+      v.emplace_back(std::in_place_type<Derived2>, static_cast<int>(i));
+    } else {
+      v.emplace_back(std::in_place_type<Derived>, static_cast<int>(i));
+    }
+  }
+
+  auto copy = xyz::parallel_copy(v, 0);
+
+  ASSERT_EQ(copy.size(), v.size());
+  for (std::size_t i = 0; i < v.size(); ++i) {
+    EXPECT_EQ(copy[i]->value(), v[i]->value());
+    EXPECT_NE(&*copy[i], &*v[i]);
+  }
+}
+
+TEST(ParallelCopyTest, CopiesEmptyAndSmallVectors) {
+  std::vector<xyz::indirect<int>> empty;
+  EXPECT_TRUE(xyz::parallel_copy(empty, 4).empty());
+
+  std::vector<xyz::indirect<int>> small;
+  small.emplace_back(std::in_place, 42);
+  auto copy = xyz::parallel_copy(small, 4);
+  ASSERT_EQ(copy.size(), 1u);
+  EXPECT_EQ(*copy[0], 42);
+}
+
+TEST(ParallelCopyTest, CopiesValuelessElements) {
+  std::vector<xyz::indirect<int>> v;
+  for (std::size_t i = 0; i < large_size; ++i) {
+    v.emplace_back(std::in_place, static_cast<int>(i));
+  }
+  auto tmp = std::move(v[large_size / 2]);
+
+  auto copy = xyz::parallel_copy(v, 4);
+
+  EXPECT_TRUE(copy[large_size / 2].valueless_after_move());
+  EXPECT_EQ(*copy[large_size - 1], static_cast<int>(large_size - 1));
+}
+
+TEST(ParallelCopyTest, UsesPerChunkAllocators) {
+  using I = xyz::indirect<int, xyz::TaggedAllocator<int>>;
+  std::vector<I> v;
+  for (std::size_t i = 0; i < large_size; ++i) {
+    v.emplace_back(std::allocator_arg, xyz::TaggedAllocator<int>(99),
+                   static_cast<int>(i));
+  }
+
+  auto copy = xyz::parallel_copy(v, 4, [](std::size_t chunk) {
+    return xyz::TaggedAllocator<int>(chunk);
+  });
+
+  ASSERT_EQ(copy.size(), v.size());
+  std::size_t previous_tag = 0;
+  for (std::size_t i = 0; i < v.size(); ++i) {
+    EXPECT_EQ(*copy[i], *v[i]);
+    // Chunks are contiguous and numbered in order.
+    std::size_t tag = copy[i].get_allocator().tag;
+    EXPECT_LT(tag, 4u);
+    EXPECT_GE(tag, previous_tag);
+    previous_tag = tag;
+  }
+  EXPECT_EQ(previous_tag, 3u);
+}
+
+TEST(ParallelCopyTest, StatefulAllocatorCopiesOnCallingThread) {
+  using I = xyz::indirect<int, xyz::TaggedAllocator<int>>;
+  static_assert(!xyz::detail::copies_in_parallel<I>());
+  std::vector<I> v;
+  for (std::size_t i = 0; i < large_size; ++i) {
+    v.emplace_back(std::allocator_arg, xyz::TaggedAllocator<int>(7),
+                   static_cast<int>(i));
+  }
+
+  auto copy = xyz::parallel_copy(v, 4);
+
+  ASSERT_EQ(copy.size(), v.size());
+  for (std::size_t i = 0; i < v.size(); ++i) {
+    EXPECT_EQ(*copy[i], *v[i]);
+    EXPECT_EQ(copy[i].get_allocator().tag, 7u);
+  }
+}
+
+TEST(ParallelCopyTest, ThrowingCopyDestroysAllCopies) {
+  std::vector<xyz::polymorphic<Base>> v;
+  for (std::size_t i = 0; i < large_size; ++i) {
+    v.emplace_back(std::in_place_type<Counted>, static_cast<int>(i));
+  }
+  ASSERT_EQ(Counted::instances, static_cast<int>(large_size));
+
+  Counted::throw_on = static_cast<int>(large_size / 2);
+  EXPECT_THROW(xyz::parallel_copy(v, 4), std::runtime_error);
+  Counted::throw_on = -1;
+
+  EXPECT_EQ(Counted::instances, static_cast<int>(large_size));
+  for (std::size_t i = 0; i < v.size(); ++i) {
+    EXPECT_EQ(v[i]->value(), static_cast<int>(i));
+  }
+}
+
+#ifdef XYZ_HAS_STD_MEMORY_RESOURCE
+// Counts the allocations made from it.
+class CountingResource : public std::pmr::memory_resource {
+ public:
+  std::size_t allocations = 0;
+
+ private:
+  void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+    ++allocations;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void* p, std::size_t bytes,
+                     std::size_t alignment) override {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+  }
+
+  bool do_is_equal(
+      const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+};
+
+using PmrIndirect = xyz::indirect<int, std::pmr::polymorphic_allocator<int>>;
+
+struct MakePmrAllocator {
+  std::pmr::polymorphic_allocator<int> operator()(std::size_t) const {
+    return {};
+  }
+};
+
+template <class V, class MakeAllocator>
+concept CopiesWithChunkAllocators =
+    requires(const V& v, MakeAllocator make_allocator) {
+      xyz::parallel_copy(v, 4, make_allocator);
+    };
+
+// A pmr vector would copy elements made with chunk allocators again.
+static_assert(!CopiesWithChunkAllocators<std::pmr::vector<PmrIndirect>,
+                                         MakePmrAllocator>);
+static_assert(CopiesWithChunkAllocators<
+              std::vector<xyz::indirect<int, xyz::TaggedAllocator<int>>>,
+              decltype([](std::size_t c) {
+                return xyz::TaggedAllocator<int>(c);
+              })>);
+
+TEST(ParallelCopyTest, PmrVectorCopiesEachElementOnce) {
+  CountingResource source;
+  CountingResource target;
+  std::pmr::vector<PmrIndirect> v(&source);
+  for (std::size_t i = 0; i < large_size; ++i) {
+    v.emplace_back(std::in_place, static_cast<int>(i));
+  }
+
+  // The copy uses the default resource, as copying a pmr vector does.
+  std::pmr::memory_resource* previous =
+      std::pmr::set_default_resource(&target);
+  auto copy = xyz::parallel_copy(v, 4);
+  std::pmr::set_default_resource(previous);
+
+  // One allocation for each element and one for the vector's buffer.
+  EXPECT_EQ(target.allocations, large_size + 1);
+  ASSERT_EQ(copy.size(), v.size());
+  EXPECT_EQ(copy.get_allocator().resource(), &target);
+  for (std::size_t i = 0; i < v.size(); ++i) {
+    EXPECT_EQ(*copy[i], *v[i]);
+    EXPECT_EQ(copy[i].get_allocator().resource(), &target);
+  }
+}
+#endif  // XYZ_HAS_STD_MEMORY_RESOURCE
+
+}  // namespace
@@ -23,14 +23,24 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <cassert>
 #include <concepts>
+#include <cstddef>
+#include <cstring>
+#include <functional>
 #include <initializer_list>
 #include <memory>
+#include <type_traits>
 #include <utility>
 
 #ifndef XYZ_POLYMORPHIC_HAS_EXTENDED_CONSTRUCTORS
 #define XYZ_POLYMORPHIC_HAS_EXTENDED_CONSTRUCTORS 1
 #endif  // XYZ_POLYMORPHIC_HAS_EXTENDED_CONSTRUCTORS
 
+#define XYZ_POLYMORPHIC_HAS_TYPE_ID 1
+#define XYZ_POLYMORPHIC_HAS_VISIT 1
+#define XYZ_POLYMORPHIC_HAS_LIFECYCLE_HOOKS 1
+#define XYZ_POLYMORPHIC_HAS_TRIVIAL_RELOCATION 1
+#define XYZ_POLYMORPHIC_HAS_ASSUMED_EQUAL_ALLOCATORS 1
+
 namespace xyz {
 
 #ifndef XYZ_UNREACHABLE_DEFINED
@@ -47,13 +57,171 @@ namespace xyz {
 }
 #endif  // XYZ_UNREACHABLE_DEFINED
 
+#ifndef XYZ_ALLOCATOR_RELEASES_IN_BULK_DEFINED
+#define XYZ_ALLOCATOR_RELEASES_IN_BULK_DEFINED
+
+// An allocator that reclaims all of its memory at once, such as an arena, can
+// declare `using releases_in_bulk = std::true_type;`. Objects allocated with it
+// are not deallocated individually and trivially destructible objects are not
+// destroyed.
+template <class A>
+struct allocator_releases_in_bulk : std::false_type {};
+
+template <class A>
+  requires requires { typename A::releases_in_bulk; }
+struct allocator_releases_in_bulk<A> : A::releases_in_bulk {};
+
+template <class A>
+inline constexpr bool allocator_releases_in_bulk_v =
+    allocator_releases_in_bulk<A>::value;
+
+#endif  // XYZ_ALLOCATOR_RELEASES_IN_BULK_DEFINED
+
+#ifndef XYZ_ALLOCATOR_IS_ASSUMED_EQUAL_DEFINED
+#define XYZ_ALLOCATOR_IS_ASSUMED_EQUAL_DEFINED
+
+// An allocator whose objects are known to compare equal wherever values are
+// moved, such as std::pmr::polymorphic_allocator when every value uses the
+// same memory resource, can declare `using is_assumed_equal = std::true_type;`
+// or specialize allocator_is_assumed_equal. Moves and swaps are then noexcept
+// and take ownership without reallocating. Moving between allocators that are
+// not equal fails an assertion; without assertions the move reallocates and
+// std::terminate is called if that throws.
+template <class A>
+struct allocator_is_assumed_equal : std::false_type {};
+
+template <class A>
+  requires requires { typename A::is_assumed_equal; }
+struct allocator_is_assumed_equal<A> : A::is_assumed_equal {};
+
+template <class A>
+inline constexpr bool allocator_is_assumed_equal_v =
+    allocator_is_assumed_equal<A>::value;
+
+#endif  // XYZ_ALLOCATOR_IS_ASSUMED_EQUAL_DEFINED
+
+#ifndef XYZ_LIFECYCLE_HOOKS_DEFINED
+#define XYZ_LIFECYCLE_HOOKS_DEFINED
+
+enum class lifecycle_event { construct, copy, move, destroy };
+
+// An allocator can declare `using lifecycle_hooks = H;` to observe the owned
+// objects that indirect and polymorphic create and destroy with it. After an
+// owned object of dynamic type U is constructed, and before it is destroyed,
+// `H::template on_lifecycle_event<U>(event, size, alloc)` is called, where
+// `size` is the number of bytes allocated to hold the object. The call must
+// not throw. Hooks are not called during constant evaluation, and nothing is
+// called for allocators without hooks.
+template <class A>
+struct allocator_lifecycle_hooks {
+  using type = void;
+};
+
+template <class A>
+  requires requires { typename A::lifecycle_hooks; }
+struct allocator_lifecycle_hooks<A> {
+  using type = typename A::lifecycle_hooks;
+};
+
+template <class A>
+inline constexpr bool allocator_has_lifecycle_hooks_v =
+    !std::is_void_v<typename allocator_lifecycle_hooks<A>::type>;
+
+namespace detail {
+
+template <class U, class A>
+constexpr void notify_lifecycle_event(lifecycle_event event, std::size_t size,
+                                      const A& alloc) noexcept {
+  if constexpr (allocator_has_lifecycle_hooks_v<A>) {
+    using hooks = typename allocator_lifecycle_hooks<A>::type;
+    static_assert(
+        noexcept(hooks::template on_lifecycle_event<U>(event, size, alloc)),
+        "Lifecycle hooks must be noexcept");
+    if (!std::is_constant_evaluated()) {
+      hooks::template on_lifecycle_event<U>(event, size, alloc);
+    }
+  }
+}
+
+}  // namespace detail
+
+#endif  // XYZ_LIFECYCLE_HOOKS_DEFINED
+
+#ifndef XYZ_TRIVIALLY_RELOCATABLE_DEFINED
+#define XYZ_TRIVIALLY_RELOCATABLE_DEFINED
+
+// A type is trivially relocatable if moving an object to new storage and
+// destroying the original is equivalent to copying its bytes. Trivially
+// copyable types and std::allocator are trivially relocatable, and a type can
+// declare `using trivially_relocatable = std::true_type;` to opt in.
+template <class T>
+struct is_trivially_relocatable : std::is_trivially_copyable<T> {};
+
+template <class T>
+  requires requires { typename T::trivially_relocatable; }
+struct is_trivially_relocatable<T> : T::trivially_relocatable {};
+
+template <class T>
+struct is_trivially_relocatable<std::allocator<T>> : std::true_type {};
+
+template <class T>
+inline constexpr bool is_trivially_relocatable_v =
+    is_trivially_relocatable<T>::value;
+
+// Moves the object at `source` to the uninitialized storage at `dest` and ends
+// the lifetime of the object at `source`.
+template <class T>
+  requires is_trivially_relocatable_v<T> ||
+           std::is_nothrow_move_constructible_v<T>
+T* relocate_at(T* source, T* dest) noexcept {
+  if constexpr (is_trivially_relocatable_v<T>) {
+    std::memmove(static_cast<void*>(dest), static_cast<const void*>(source),
+                 sizeof(T));
+    return std::launder(dest);
+  } else {
+    T* result = std::construct_at(dest, std::move(*source));
+    std::destroy_at(source);
+    return result;
+  }
+}
+
+// Relocates the objects in [first, last) to the uninitialized storage
+// starting at `dest` and returns the end of the relocated objects. The
+// ranges may overlap if `dest` is before `first`.
+template <class T>
+  requires is_trivially_relocatable_v<T> ||
+           std::is_nothrow_move_constructible_v<T>
+T* uninitialized_relocate(T* first, T* last, T* dest) noexcept {
+  if constexpr (is_trivially_relocatable_v<T>) {
+    const auto n = static_cast<std::size_t>(last - first);
+    if (n != 0) {
+      std::memmove(static_cast<void*>(dest), static_cast<const void*>(first),
+                   n * sizeof(T));
+    }
+    return dest + n;
+  } else {
+    for (; first != last; ++first, ++dest) {
+      relocate_at(first, dest);
+    }
+    return dest;
+  }
+}
+
+#endif  // XYZ_TRIVIALLY_RELOCATABLE_DEFINED
+
 template <class T, class A = std::allocator<T>>
 class polymorphic {
+  // Each derived type is identified by the address of its tag. The tags are
+  // not const so that identical constants cannot be merged by the linker.
+  template <class U>
+  static inline char type_tag = 0;
+
   struct control_block {
     using allocator_traits = std::allocator_traits<A>;
     typename allocator_traits::pointer p_;
 
     virtual constexpr ~control_block() = default;
+    virtual constexpr const char* type_id() const noexcept = 0;
     virtual constexpr void destroy(A& alloc) = 0;
     virtual constexpr control_block* clone(const A& alloc) = 0;
     virtual constexpr control_block* move(const A& alloc) = 0;
@@ -82,11 +250,19 @@ class polymorphic {
       control_block::p_ = std::addressof(storage_.u_);
     }
 
+    constexpr U* get() noexcept { return std::addressof(storage_.u_); }
+
+    constexpr const char* type_id() const noexcept override {
+      return &type_tag<U>;
+    }
+
     constexpr control_block* clone(const A& alloc) override {
       cb_allocator cb_alloc(alloc);
       auto mem = cb_alloc_traits::allocate(cb_alloc, 1);
       try {
         cb_alloc_traits::construct(cb_alloc, mem, alloc, storage_.u_);
+        detail::notify_lifecycle_event<U>(lifecycle_event::copy,
+                                          sizeof(direct_control_block), alloc);
         return mem;
       } catch (...) {
         cb_alloc_traits::deallocate(cb_alloc, mem, 1);
@@ -100,6 +276,8 @@ class polymorphic {
       try {
         cb_alloc_traits::construct(cb_alloc, mem, alloc,
                                    std::move(storage_.u_));
+        detail::notify_lifecycle_event<U>(lifecycle_event::move,
+                                          sizeof(direct_control_block), alloc);
         return mem;
       } catch (...) {
         cb_alloc_traits::deallocate(cb_alloc, mem, 1);
@@ -108,9 +286,13 @@ class polymorphic {
     }
 
     constexpr void destroy(A& alloc) override {
+      detail::notify_lifecycle_event<U>(lifecycle_event::destroy,
+                                        sizeof(direct_control_block), alloc);
       cb_allocator cb_alloc(alloc);
       cb_alloc_traits::destroy(cb_alloc, std::addressof(storage_.u_));
-      cb_alloc_traits::deallocate(cb_alloc, this, 1);
+      if constexpr (!allocator_releases_in_bulk_v<A>) {
+        cb_alloc_traits::deallocate(cb_alloc, this, 1);
+      }
     }
   };
 
@@ -125,17 +307,28 @@ class polymorphic {
 
   using allocator_traits = std::allocator_traits<A>;
 
-  template <class U, class... Ts>
-  [[nodiscard]] constexpr control_block* create_control_block(
-      Ts&&... ts) const {
+  template <class U, lifecycle_event Event = lifecycle_event::construct,
+            class... Ts>
+  [[nodiscard]] constexpr static control_block* allocate_control_block(
+      const A& alloc, Ts&&... ts) {
+    // Destruction is skipped when T is trivially destructible, so U must be
+    // too.
+    static_assert(!allocator_releases_in_bulk_v<A> ||
+                      !std::is_trivially_destructible_v<T> ||
+                      std::is_trivially_destructible_v<U>,
+                  "Allocators that release in bulk require types derived "
+                  "from a trivially destructible base to be trivially "
+                  "destructible");
     using cb_allocator = typename std::allocator_traits<
         A>::template rebind_alloc<direct_control_block<U>>;
-    cb_allocator cb_alloc(alloc_);
+    cb_allocator cb_alloc(alloc);
     using cb_alloc_traits = std::allocator_traits<cb_allocator>;
     auto mem = cb_alloc_traits::allocate(cb_alloc, 1);
     try {
-      cb_alloc_traits::construct(cb_alloc, mem, alloc_,
+      cb_alloc_traits::construct(cb_alloc, mem, alloc,
                                  std::forward<Ts>(ts)...);
+      detail::notify_lifecycle_event<U>(
+          Event, sizeof(direct_control_block<U>), alloc);
       return mem;
     } catch (...) {
       cb_alloc_traits::deallocate(cb_alloc, mem, 1);
@@ -143,11 +336,23 @@ class polymorphic {
     }
   }
 
+  template <class U, class... Ts>
+  [[nodiscard]] constexpr control_block* create_control_block(
+      Ts&&... ts) const {
+    return allocate_control_block<U>(alloc_, std::forward<Ts>(ts)...);
+  }
+
  public:
   using value_type = T;
   using allocator_type = A;
   using pointer = typename allocator_traits::pointer;
   using const_pointer = typename allocator_traits::const_pointer;
+  using type_id_type = const char*;
+
+  // A polymorphic is a pointer to its control block and an allocator, neither
+  // of which refers to the polymorphic itself.
+  using trivially_relocatable =
+      std::bool_constant<is_trivially_relocatable_v<A>>;
 
   //
   // Constructors.
@@ -193,7 +398,8 @@ class polymorphic {
                     other) {}
 
   constexpr polymorphic(polymorphic&& other) noexcept(
-      allocator_traits::is_always_equal::value)
+      allocator_traits::is_always_equal::value ||
+      allocator_is_assumed_equal_v<A>)
       : polymorphic(std::allocator_arg_t{}, other.alloc_, std::move(other)) {}
 
   //
@@ -247,13 +453,16 @@ class polymorphic {
     }
   }
 
-  constexpr polymorphic(
-      std::allocator_arg_t, const A& alloc,
-      polymorphic&& other) noexcept(allocator_traits::is_always_equal::value)
+  constexpr polymorphic(std::allocator_arg_t, const A& alloc,
+                        polymorphic&& other) noexcept(
+      allocator_traits::is_always_equal::value ||
+      allocator_is_assumed_equal_v<A>)
       : alloc_(alloc) {
     if constexpr (allocator_traits::is_always_equal::value) {
       cb_ = std::exchange(other.cb_, nullptr);
     } else {
+      assert(!allocator_is_assumed_equal_v<A> ||
+             alloc_ == other.alloc_);  // LCOV_EXCL_LINE
       if (alloc_ == other.alloc_) {
         cb_ = std::exchange(other.cb_, nullptr);
       } else {
@@ -304,7 +513,8 @@ class polymorphic {
 
   constexpr polymorphic& operator=(polymorphic&& other) noexcept(
       allocator_traits::propagate_on_container_move_assignment::value ||
-      allocator_traits::is_always_equal::value) {
+      allocator_traits::is_always_equal::value ||
+      allocator_is_assumed_equal_v<A>) {
     if (this == &other) return *this;
 
     // Check to see if the allocators need to be updated.
@@ -316,6 +526,8 @@ class polymorphic {
     if (other.valueless_after_move()) {
       reset();
     } else {
+      assert(!allocator_is_assumed_equal_v<A> ||
+             alloc_ == other.alloc_);  // LCOV_EXCL_LINE
       if (alloc_ == other.alloc_) {
         std::swap(cb_, other.cb_);
         other.reset();
@@ -364,6 +576,47 @@ class polymorphic {
     return cb_ == nullptr;
   }
 
+  // An identifier for the type of the owned object that does not need RTTI.
+  // It is null for a valueless polymorphic.
+  [[nodiscard]] constexpr type_id_type type_id() const noexcept {
+    return cb_ == nullptr ? nullptr : cb_->type_id();
+  }
+
+  // The identifier that type_id() returns when the owned object is a U.
+  template <class U>
+  [[nodiscard]] static constexpr type_id_type type_id_of() noexcept
+    requires std::derived_from<U, T>
+  {
+    return &type_tag<U>;
+  }
+
+  // Returns true if the type of the owned object is exactly U.
+  template <class U>
+  [[nodiscard]] constexpr bool holds_type() const noexcept
+    requires std::derived_from<U, T>
+  {
+    return cb_ != nullptr && cb_->type_id() == type_id_of<U>();
+  }
+
+  // Returns a pointer to the owned object if its type is exactly U and null
+  // otherwise. The pointer is taken from the control block that holds the U,
+  // so T may be a virtual base of U.
+  template <class U>
+  [[nodiscard]] constexpr U* get_if() noexcept
+    requires std::derived_from<U, T>
+  {
+    return holds_type<U>() ? static_cast<direct_control_block<U>*>(cb_)->get()
+                           : nullptr;
+  }
+
+  template <class U>
+  [[nodiscard]] constexpr const U* get_if() const noexcept
+    requires std::derived_from<U, T>
+  {
+    return holds_type<U>() ? static_cast<direct_control_block<U>*>(cb_)->get()
+                           : nullptr;
+  }
+
   constexpr allocator_type get_allocator() const noexcept { return alloc_; }
 
   //
@@ -372,7 +625,8 @@ class polymorphic {
 
   constexpr void swap(polymorphic& other) noexcept(
       std::allocator_traits<A>::propagate_on_container_swap::value ||
-      std::allocator_traits<A>::is_always_equal::value) {
+      std::allocator_traits<A>::is_always_equal::value ||
+      allocator_is_assumed_equal_v<A>) {
     if constexpr (allocator_traits::propagate_on_container_swap::value) {
       // If allocators move with their allocated objects, we can swap both.
       std::swap(alloc_, other.alloc_);
@@ -394,6 +648,12 @@ class polymorphic {
 
  private:
   constexpr void reset() noexcept {
+    if constexpr (allocator_releases_in_bulk_v<A> &&
+                  std::is_trivially_destructible_v<T> &&
+                  !allocator_has_lifecycle_hooks_v<A>) {
+      cb_ = nullptr;
+      return;
+    }
     if (cb_ != nullptr) {
       cb_->destroy(alloc_);
       cb_ = nullptr;
@@ -401,6 +661,42 @@ class polymorphic {
   }
 };
 
+namespace detail {
+
+template <class R, class P, class F>
+constexpr R visit_as(P& p, F& f) {
+  return static_cast<R>(std::invoke(f, *p));
+}
+
+template <class R, class U, class... Us, class P, class F>
+constexpr R visit_as(P& p, F& f) {
+  if (auto* u = p.template get_if<U>()) {
+    return static_cast<R>(std::invoke(f, *u));
+  }
+  return visit_as<R, Us...>(p, f);
+}
+
+}  // namespace detail
+
+// Calls `f` with the object owned by `p` as a U& if its type is exactly one
+// of `Us`, and as a T& otherwise. Each listed type is checked with one
+// comparison of type_id(); no dynamic_cast is made. `f` must be invocable
+// with T& and each U&, and the result of invoking it with T& is returned.
+// `p` must not be valueless.
+template <class... Us, class T, class A, class F>
+constexpr decltype(auto) visit(polymorphic<T, A>& p, F&& f) {
+  assert(!p.valueless_after_move());  // LCOV_EXCL_LINE
+  using R = std::invoke_result_t<F&, T&>;
+  return detail::visit_as<R, Us...>(p, f);
+}
+
+template <class... Us, class T, class A, class F>
+constexpr decltype(auto) visit(const polymorphic<T, A>& p, F&& f) {
+  assert(!p.valueless_after_move());  // LCOV_EXCL_LINE
+  using R = std::invoke_result_t<F&, const T&>;
+  return detail::visit_as<R, Us...>(p, f);
+}
+
 }  // namespace xyz
 
 #endif  // XYZ_POLYMORPHIC_H_
@@ -0,0 +1,245 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+#include "experimental/polymorphic_collection.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include "tagged_allocator.h"
+#include "tracking_allocator.h"
+
+namespace {
+
+class Base {
+ public:
+  virtual ~Base() = default;
+  virtual int value() const = 0;
+  virtual void set_value(int) = 0;
+};
+
+class Derived final : public Base {
+ private:
+  int value_;
+
+ public:
+  Derived(int v) : value_(v) {}
+
+  int value() const override { return value_; }
+
+  void set_value(int v) override { value_ = v; }
+};
+
+class StringDerived final : public Base {
+ private:
+  std::string s_;
+
+ public:
+  StringDerived(int v) : s_(100, static_cast<char>('a' + v)) {}
+
+  int value() const override { return s_[0] - 'a'; }
+
+  void set_value(int v) override { s_.assign(100, static_cast<char>('a' + v)); }
+};
+
+// A derived type whose Base subobject is not at offset zero.
+class Padding {
+ public:
+  virtual ~Padding() = default;
+  std::int64_t padding_ = 0;
+};
+
+class OffsetDerived final : public Padding, public Base {
+ private:
+  int value_;
+
+ public:
+  OffsetDerived(int v) : value_(v) {}
+
+  int value() const override { return value_; }
+
+  void set_value(int v) override { value_ = v; }
+};
+
+int Sum(const xyz::polymorphic_collection<Base>& c) {
+  int sum = 0;
+  c.for_each([&](const Base& b) { sum += b.value(); });
+  return sum;
+}
+
+TEST(PolymorphicCollectionTest, DefaultConstructor) {
+  xyz::polymorphic_collection<Base> c;
+  EXPECT_TRUE(c.empty());
+  EXPECT_EQ(c.size(), 0);
+}
+
+TEST(PolymorphicCollectionTest, EmplaceAndInsert) {
+  xyz::polymorphic_collection<Base> c;
+  Derived& d = c.emplace<Derived>(1);
+  EXPECT_EQ(d.value(), 1);
+  c.insert(StringDerived(2));
+  const Derived d3(3);
+  c.insert(d3);
+  EXPECT_EQ(c.size(), 3);
+  EXPECT_EQ(c.count<Derived>(), 2);
+  EXPECT_EQ(c.count<StringDerived>(), 1);
+  EXPECT_EQ(c.count<OffsetDerived>(), 0);
+}
+
+TEST(PolymorphicCollectionTest, ForEachVisitsEveryObject) {
+  xyz::polymorphic_collection<Base> c;
+  for (int i = 0; i < 26; ++i) {
+    switch (i % 3) {
+      case 0:
+        c.emplace<Derived>(i);
+        break;
+      case 1:
+        c.emplace<StringDerived>(i);
+        break;
+      default:
+        c.emplace<OffsetDerived>(i);
+        break;
+    }
+  }
+  EXPECT_EQ(Sum(c), 325);
+  c.for_each([](Base& b) { b.set_value(1); });
+  EXPECT_EQ(Sum(c), 26);
+}
+
+TEST(PolymorphicCollectionTest, ForEachAsVisitsListedTypes) {
+  xyz::polymorphic_collection<Base> c;
+  c.emplace<Derived>(1);
+  c.emplace<Derived>(2);
+  c.emplace<StringDerived>(4);
+  c.emplace<OffsetDerived>(8);
+
+  int sum = 0;
+  c.for_each_as<Derived>([&](Derived& d) { sum += d.value(); });
+  EXPECT_EQ(sum, 3);
+
+  sum = 0;
+  std::as_const(c).for_each_as<StringDerived, OffsetDerived>(
+      [&](const Base& b) { sum += b.value(); });
+  EXPECT_EQ(sum, 12);
+}
+
+TEST(PolymorphicCollectionTest, BaseSubobjectAtNonZeroOffset) {
+  xyz::polymorphic_collection<Base> c;
+  OffsetDerived& d = c.emplace<OffsetDerived>(5);
+  const Base* seen = nullptr;
+  c.for_each([&](const Base& b) { seen = &b; });
+  EXPECT_EQ(seen, static_cast<const Base*>(&d));
+}
+
+TEST(PolymorphicCollectionTest, CopiesAreDeep) {
+  xyz::polymorphic_collection<Base> c;
+  c.emplace<Derived>(1);
+  c.emplace<StringDerived>(2);
+  auto cc = c;
+  cc.for_each([](Base& b) { b.set_value(b.value() * 10); });
+  EXPECT_EQ(Sum(c), 3);
+  EXPECT_EQ(Sum(cc), 30);
+  EXPECT_EQ(cc.count<StringDerived>(), 1);
+}
+
+TEST(PolymorphicCollectionTest, CopyAssignment) {
+  xyz::polymorphic_collection<Base> c;
+  c.emplace<Derived>(1);
+  xyz::polymorphic_collection<Base> cc;
+  cc.emplace<StringDerived>(2);
+  cc = c;
+  EXPECT_EQ(cc.size(), 1);
+  EXPECT_EQ(cc.count<StringDerived>(), 0);
+  EXPECT_EQ(Sum(cc), 1);
+}
+
+TEST(PolymorphicCollectionTest, MoveConstructionKeepsObjects) {
+  xyz::polymorphic_collection<Base> c;
+  Derived& d = c.emplace<Derived>(1);
+  auto cc = std::move(c);
+  EXPECT_TRUE(c.empty());  // NOLINT(bugprone-use-after-move)
+  const Base* seen = nullptr;
+  cc.for_each([&](const Base& b) { seen = &b; });
+  EXPECT_EQ(seen, &d);
+}
+
+TEST(PolymorphicCollectionTest, MoveAssignment) {
+  xyz::polymorphic_collection<Base> c;
+  c.emplace<Derived>(1);
+  xyz::polymorphic_collection<Base> cc;
+  cc.emplace<StringDerived>(2);
+  cc = std::move(c);
+  EXPECT_EQ(cc.size(), 1);
+  EXPECT_EQ(Sum(cc), 1);
+}
+
+TEST(PolymorphicCollectionTest, ClearKeepsCapacity) {
+  xyz::polymorphic_collection<Base> c;
+  c.reserve<Derived>(10);
+  Derived& d = c.emplace<Derived>(1);
+  c.clear();
+  EXPECT_TRUE(c.empty());
+  EXPECT_EQ(&c.emplace<Derived>(2), &d);
+}
+
+TEST(PolymorphicCollectionTest, Swap) {
+  xyz::polymorphic_collection<Base> c;
+  c.emplace<Derived>(1);
+  xyz::polymorphic_collection<Base> cc;
+  swap(c, cc);
+  EXPECT_TRUE(c.empty());
+  EXPECT_EQ(Sum(cc), 1);
+}
+
+TEST(PolymorphicCollectionTest, AllocatorIsUsedForBucketsAndObjects) {
+  unsigned alloc_counter = 0;
+  unsigned dealloc_counter = 0;
+  {
+    xyz::polymorphic_collection<Base, xyz::TrackingAllocator<Base>> c(
+        std::allocator_arg,
+        xyz::TrackingAllocator<Base>(&alloc_counter, &dealloc_counter));
+    c.emplace<Derived>(1);
+    // The bucket table, the bucket and the objects of the bucket.
+    EXPECT_EQ(alloc_counter, 3);
+    auto cc = c;
+    EXPECT_EQ(alloc_counter, 6);
+  }
+  EXPECT_EQ(alloc_counter, dealloc_counter);
+}
+
+TEST(PolymorphicCollectionTest, AllocatorExtendedCopyAndMove) {
+  xyz::polymorphic_collection<Base, xyz::TaggedAllocator<Base>> c(
+      std::allocator_arg, xyz::TaggedAllocator<Base>(1));
+  c.emplace<StringDerived>(4);
+  xyz::polymorphic_collection<Base, xyz::TaggedAllocator<Base>> copy(
+      std::allocator_arg, xyz::TaggedAllocator<Base>(2), c);
+  EXPECT_EQ(copy.get_allocator().tag, 2);
+  EXPECT_EQ(copy.count<StringDerived>(), 1);
+  xyz::polymorphic_collection<Base, xyz::TaggedAllocator<Base>> moved(
+      std::allocator_arg, xyz::TaggedAllocator<Base>(3), std::move(c));
+  EXPECT_EQ(moved.get_allocator().tag, 3);
+  EXPECT_EQ(moved.count<StringDerived>(), 1);
+  EXPECT_TRUE(c.empty());  // NOLINT(bugprone-use-after-move)
+}
+
+}  // namespace
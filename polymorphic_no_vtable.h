@@ -23,14 +23,19 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <cassert>
 #include <concepts>
+#include <functional>
 #include <initializer_list>
 #include <memory>
+#include <type_traits>
 #include <utility>
 
 #ifndef XYZ_POLYMORPHIC_HAS_EXTENDED_CONSTRUCTORS
 #define XYZ_POLYMORPHIC_HAS_EXTENDED_CONSTRUCTORS 1
 #endif  // XYZ_POLYMORPHIC_HAS_EXTENDED_CONSTRUCTORS
 
+#define XYZ_POLYMORPHIC_HAS_TYPE_ID 1
+#define XYZ_POLYMORPHIC_HAS_VISIT 1
+
 namespace xyz {
 
 #ifndef XYZ_UNREACHABLE_DEFINED
@@ -53,7 +58,7 @@ class polymorphic {
     using allocator_traits = std::allocator_traits<A>;
     typename allocator_traits::pointer p_;
 
-    enum class Action { Destroy, Clone, Move };
+    enum class Action { Destroy, Clone, Move, TypeId };
     control_block* (*h_)(Action, control_block* self, const A& alloc);
 
     constexpr void destroy(const A& alloc) { h_(Action::Destroy, this, alloc); }
@@ -67,6 +72,12 @@ class polymorphic {
     }
   };
 
+  // Each derived type is identified by the address of its tag. The tags are
+  // not const so that they cannot be merged by the linker, and a handler that
+  // returns its tag cannot be folded with the handler of another type.
+  template <class U>
+  static inline control_block type_tag{};
+
   template <class U>
   class direct_control_block final : public control_block {
     union uninitialized_storage {
@@ -85,6 +96,7 @@ class polymorphic {
 
     static constexpr control_block* handler(Action action, control_block* self,
                                             const A& alloc) {
+      if (action == Action::TypeId) return &type_tag<U>;
       direct_control_block* dis = static_cast<direct_control_block*>(self);
       cb_allocator cb_alloc(alloc);
       if (action == Action::Destroy) {
@@ -108,6 +120,8 @@ class polymorphic {
     }
 
    public:
+    static constexpr auto handler_ptr() noexcept { return &handler; }
+
     template <class... Ts>
     constexpr direct_control_block(const A& alloc, Ts&&... ts) {
       cb_allocator cb_alloc(alloc);
@@ -116,6 +130,8 @@ class polymorphic {
       control_block::p_ = std::addressof(storage_.u_);
       control_block::h_ = &handler;
     }
+
+    constexpr U* get() noexcept { return std::addressof(storage_.u_); }
   };
 
   control_block* cb_;
@@ -152,6 +168,7 @@ class polymorphic {
   using allocator_type = A;
   using pointer = typename allocator_traits::pointer;
   using const_pointer = typename allocator_traits::const_pointer;
+  using type_id_type = const void*;
 
   //
   // Constructors.
@@ -368,6 +385,60 @@ class polymorphic {
     return cb_ == nullptr;
   }
 
+  // An identifier for the type of the owned object that does not need RTTI.
+  // It is null for a valueless polymorphic.
+  [[nodiscard]] constexpr type_id_type type_id() const noexcept {
+    if (cb_ == nullptr) return nullptr;
+    return cb_->h_(control_block::Action::TypeId, cb_, alloc_);
+  }
+
+  // The identifier that type_id() returns when the owned object is a U.
+  template <class U>
+  [[nodiscard]] static constexpr type_id_type type_id_of() noexcept
+    requires std::derived_from<U, T>
+  {
+    // An abstract type is never the type of the owned object.
+    if constexpr (std::is_abstract_v<U>) {
+      return nullptr;
+    } else {
+      return &type_tag<U>;
+    }
+  }
+
+  // Returns true if the type of the owned object is exactly U.
+  template <class U>
+  [[nodiscard]] constexpr bool holds_type() const noexcept
+    requires std::derived_from<U, T>
+  {
+    // Comparing handlers avoids calling one. The handler of U returns the tag
+    // of U, so it is not the handler of any other type.
+    if constexpr (std::is_abstract_v<U>) {
+      return false;
+    } else {
+      return cb_ != nullptr &&
+             cb_->h_ == direct_control_block<U>::handler_ptr();
+    }
+  }
+
+  // Returns a pointer to the owned object if its type is exactly U and null
+  // otherwise. The pointer is taken from the control block that holds the U,
+  // so T may be a virtual base of U.
+  template <class U>
+  [[nodiscard]] constexpr U* get_if() noexcept
+    requires std::derived_from<U, T>
+  {
+    return holds_type<U>() ? static_cast<direct_control_block<U>*>(cb_)->get()
+                           : nullptr;
+  }
+
+  template <class U>
+  [[nodiscard]] constexpr const U* get_if() const noexcept
+    requires std::derived_from<U, T>
+  {
+    return holds_type<U>() ? static_cast<direct_control_block<U>*>(cb_)->get()
+                           : nullptr;
+  }
+
   constexpr allocator_type get_allocator() const noexcept { return alloc_; }
 
   //
@@ -405,6 +476,42 @@ class polymorphic {
   }
 };
 
+namespace detail {
+
+template <class R, class P, class F>
+constexpr R visit_as(P& p, F& f) {
+  return static_cast<R>(std::invoke(f, *p));
+}
+
+template <class R, class U, class... Us, class P, class F>
+constexpr R visit_as(P& p, F& f) {
+  if (auto* u = p.template get_if<U>()) {
+    return static_cast<R>(std::invoke(f, *u));
+  }
+  return visit_as<R, Us...>(p, f);
+}
+
+}  // namespace detail
+
+// Calls `f` with the object owned by `p` as a U& if its type is exactly one
+// of `Us`, and as a T& otherwise. Each listed type is checked with one
+// comparison of type_id(); no dynamic_cast is made. `f` must be invocable
+// with T& and each U&, and the result of invoking it with T& is returned.
+// `p` must not be valueless.
+template <class... Us, class T, class A, class F>
+constexpr decltype(auto) visit(polymorphic<T, A>& p, F&& f) {
+  assert(!p.valueless_after_move());  // LCOV_EXCL_LINE
+  using R = std::invoke_result_t<F&, T&>;
+  return detail::visit_as<R, Us...>(p, f);
+}
+
+template <class... Us, class T, class A, class F>
+constexpr decltype(auto) visit(const polymorphic<T, A>& p, F&& f) {
+  assert(!p.valueless_after_move());  // LCOV_EXCL_LINE
+  using R = std::invoke_result_t<F&, const T&>;
+  return detail::visit_as<R, Us...>(p, f);
+}
+
 }  // namespace xyz
 
 #endif  // XYZ_POLYMORPHIC_H_
@@ -26,6 +26,22 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "polymorphic_no_vtable.h"
 #endif  // XYZ_POLYMORPHIC_NO_VTABLE
 
+#ifdef XYZ_POLYMORPHIC_USES_EXPERIMENTAL_INLINE_VTABLE
+#include "experimental/polymorphic_inline_vtable.h"
+#endif  // XYZ_POLYMORPHIC_USES_EXPERIMENTAL_INLINE_VTABLE
+
+#ifdef XYZ_POLYMORPHIC_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
+#include "experimental/polymorphic_sbo.h"
+#endif  // XYZ_POLYMORPHIC_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
+
+#ifdef XYZ_POLYMORPHIC_USES_EXPERIMENTAL_CACHED_POINTER
+#include "experimental/polymorphic_cached_pointer.h"
+#endif  // XYZ_POLYMORPHIC_USES_EXPERIMENTAL_CACHED_POINTER
+
+#ifdef XYZ_POLYMORPHIC_USES_EXPERIMENTAL_BATCHED_CLONE
+#include "experimental/polymorphic_batched_clone.h"
+#endif  // XYZ_POLYMORPHIC_USES_EXPERIMENTAL_BATCHED_CLONE
+
 #ifndef XYZ_POLYMORPHIC_H_
 #include "polymorphic.h"
 #endif  // XYZ_POLYMORPHIC_H_
@@ -35,6 +51,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <array>
 #include <cstddef>
 #include <exception>
+#include <iterator>
 #include <map>
 #include <memory>
 #include <stdexcept>
@@ -62,6 +79,13 @@ using std::in_place_type_t;
 
 namespace {
 
+#ifdef XYZ_POLYMORPHIC_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
+// Small derived types are stored inside the polymorphic object.
+constexpr unsigned ALLOCATIONS_PER_OBJECT = 0;
+#else
+constexpr unsigned ALLOCATIONS_PER_OBJECT = 1;
+#endif  // XYZ_POLYMORPHIC_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
+
 class Base {
  public:
   virtual ~Base() = default;
@@ -380,7 +404,7 @@ TEST(PolymorphicTest, GetAllocator) {
       std::allocator_arg,
       xyz::TrackingAllocator<Base>(&alloc_counter, &dealloc_counter),
       xyz::in_place_type_t<Derived>{}, 42);
-  EXPECT_EQ(alloc_counter, 1);
+  EXPECT_EQ(alloc_counter, ALLOCATIONS_PER_OBJECT);
   EXPECT_EQ(dealloc_counter, 0);
 
   auto tracking_allocator = p.get_allocator();
@@ -395,7 +419,7 @@ TEST(PolymorphicTest, TrackingAllocatorDefaultConstructor) {
   xyz::polymorphic<Derived, xyz::TrackingAllocator<Derived>> p(
       std::allocator_arg,
       xyz::TrackingAllocator<Derived>(&alloc_counter, &dealloc_counter));
-  EXPECT_EQ(alloc_counter, 1);
+  EXPECT_EQ(alloc_counter, ALLOCATIONS_PER_OBJECT);
   EXPECT_EQ(dealloc_counter, 0);
 
   auto tracking_allocator = p.get_allocator();
@@ -411,11 +435,11 @@ TEST(PolymorphicTest, CountAllocationsForInPlaceConstruction) {
         std::allocator_arg,
         xyz::TrackingAllocator<Base>(&alloc_counter, &dealloc_counter),
         xyz::in_place_type_t<Derived>{}, 42);
-    EXPECT_EQ(alloc_counter, 1);
+    EXPECT_EQ(alloc_counter, ALLOCATIONS_PER_OBJECT);
     EXPECT_EQ(dealloc_counter, 0);
   }
-  EXPECT_EQ(alloc_counter, 1);
-  EXPECT_EQ(dealloc_counter, 1);
+  EXPECT_EQ(alloc_counter, ALLOCATIONS_PER_OBJECT);
+  EXPECT_EQ(dealloc_counter, ALLOCATIONS_PER_OBJECT);
 }
 
 TEST(PolymorphicTest, CountAllocationsForDerivedTypeConstruction) {
@@ -426,11 +450,11 @@ TEST(PolymorphicTest, CountAllocationsForDerivedTypeConstruction) {
         std::allocator_arg,
         xyz::TrackingAllocator<Base>(&alloc_counter, &dealloc_counter),
         xyz::in_place_type_t<Derived>{}, 42);
-    EXPECT_EQ(alloc_counter, 1);
+    EXPECT_EQ(alloc_counter, ALLOCATIONS_PER_OBJECT);
     EXPECT_EQ(dealloc_counter, 0);
   }
-  EXPECT_EQ(alloc_counter, 1);
-  EXPECT_EQ(dealloc_counter, 1);
+  EXPECT_EQ(alloc_counter, ALLOCATIONS_PER_OBJECT);
+  EXPECT_EQ(dealloc_counter, ALLOCATIONS_PER_OBJECT);
 }
 
 TEST(PolymorphicTest, CountAllocationsForCopyConstruction) {
@@ -441,12 +465,12 @@ TEST(PolymorphicTest, CountAllocationsForCopyConstruction) {
         std::allocator_arg,
         xyz::TrackingAllocator<Derived>(&alloc_counter, &dealloc_counter),
         xyz::in_place_type_t<Derived>{}, 42);
-    EXPECT_EQ(alloc_counter, 1);
+    EXPECT_EQ(alloc_counter, ALLOCATIONS_PER_OBJECT);
     EXPECT_EQ(dealloc_counter, 0);
     xyz::polymorphic<Derived, xyz::TrackingAllocator<Derived>> pp(p);
   }
-  EXPECT_EQ(alloc_counter, 2);
-  EXPECT_EQ(dealloc_counter, 2);
+  EXPECT_EQ(alloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
+  EXPECT_EQ(dealloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
 }
 
 TEST(PolymorphicTest, CountAllocationsForCopyAssignment) {
@@ -461,12 +485,12 @@ TEST(PolymorphicTest, CountAllocationsForCopyAssignment) {
         std::allocator_arg,
         xyz::TrackingAllocator<Derived>(&alloc_counter, &dealloc_counter),
         xyz::in_place_type_t<Derived>{}, 101);
-    EXPECT_EQ(alloc_counter, 2);
+    EXPECT_EQ(alloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
     EXPECT_EQ(dealloc_counter, 0);
     pp = p;
   }
-  EXPECT_EQ(alloc_counter, 3);
-  EXPECT_EQ(dealloc_counter, 3);
+  EXPECT_EQ(alloc_counter, 3 * ALLOCATIONS_PER_OBJECT);
+  EXPECT_EQ(dealloc_counter, 3 * ALLOCATIONS_PER_OBJECT);
 }
 
 TEST(PolymorphicTest, CountAllocationsForMoveAssignment) {
@@ -481,12 +505,12 @@ TEST(PolymorphicTest, CountAllocationsForMoveAssignment) {
         std::allocator_arg,
         xyz::TrackingAllocator<Derived>(&alloc_counter, &dealloc_counter),
         xyz::in_place_type_t<Derived>{}, 101);
-    EXPECT_EQ(alloc_counter, 2);
+    EXPECT_EQ(alloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
     EXPECT_EQ(dealloc_counter, 0);
     pp = std::move(p);
   }
-  EXPECT_EQ(alloc_counter, 2);
-  EXPECT_EQ(dealloc_counter, 2);
+  EXPECT_EQ(alloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
+  EXPECT_EQ(dealloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
 }
 
 template <typename T>
@@ -523,12 +547,12 @@ TEST(PolymorphicTest,
         std::allocator_arg,
         NonEqualTrackingAllocator<Derived>(&alloc_counter, &dealloc_counter),
         xyz::in_place_type_t<Derived>{}, 101);
-    EXPECT_EQ(alloc_counter, 2);
+    EXPECT_EQ(alloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
     EXPECT_EQ(dealloc_counter, 0);
     pp = std::move(p);  // This will copy as allocators don't compare equal.
   }
-  EXPECT_EQ(alloc_counter, 3);
-  EXPECT_EQ(dealloc_counter, 3);
+  EXPECT_EQ(alloc_counter, 3 * ALLOCATIONS_PER_OBJECT);
+  EXPECT_EQ(dealloc_counter, 3 * ALLOCATIONS_PER_OBJECT);
 }
 
 TEST(PolymorphicTest, CountAllocationsForMoveConstruction) {
@@ -539,12 +563,12 @@ TEST(PolymorphicTest, CountAllocationsForMoveConstruction) {
         std::allocator_arg,
         xyz::TrackingAllocator<Derived>(&alloc_counter, &dealloc_counter),
         xyz::in_place_type_t<Derived>{}, 42);
-    EXPECT_EQ(alloc_counter, 1);
+    EXPECT_EQ(alloc_counter, ALLOCATIONS_PER_OBJECT);
     EXPECT_EQ(dealloc_counter, 0);
     xyz::polymorphic<Derived, xyz::TrackingAllocator<Derived>> pp(std::move(p));
   }
-  EXPECT_EQ(alloc_counter, 1);
-  EXPECT_EQ(dealloc_counter, 1);
+  EXPECT_EQ(alloc_counter, ALLOCATIONS_PER_OBJECT);
+  EXPECT_EQ(dealloc_counter, ALLOCATIONS_PER_OBJECT);
 }
 
 template <typename T>
@@ -570,14 +594,14 @@ TEST(PolymorphicTest, NonMemberSwapWhenAllocatorsDontCompareEqual) {
         std::allocator_arg,
         POCSTrackingAllocator<Derived>(&alloc_counter, &dealloc_counter),
         xyz::in_place_type_t<Derived>{}, 101);
-    EXPECT_EQ(alloc_counter, 2);
+    EXPECT_EQ(alloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
     EXPECT_EQ(dealloc_counter, 0);
     swap(p, pp);
     EXPECT_EQ(p->value(), 101);
     EXPECT_EQ(pp->value(), 42);
   }
-  EXPECT_EQ(alloc_counter, 2);
-  EXPECT_EQ(dealloc_counter, 2);
+  EXPECT_EQ(alloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
+  EXPECT_EQ(dealloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
 }
 
 TEST(PolymorphicTest, MemberSwapWhenAllocatorsDontCompareEqual) {
@@ -592,14 +616,14 @@ TEST(PolymorphicTest, MemberSwapWhenAllocatorsDontCompareEqual) {
         std::allocator_arg,
         POCSTrackingAllocator<Derived>(&alloc_counter, &dealloc_counter),
         xyz::in_place_type_t<Derived>{}, 101);
-    EXPECT_EQ(alloc_counter, 2);
+    EXPECT_EQ(alloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
     EXPECT_EQ(dealloc_counter, 0);
     p.swap(pp);
     EXPECT_EQ(p->value(), 101);
     EXPECT_EQ(pp->value(), 42);
   }
-  EXPECT_EQ(alloc_counter, 2);
-  EXPECT_EQ(dealloc_counter, 2);
+  EXPECT_EQ(alloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
+  EXPECT_EQ(dealloc_counter, 2 * ALLOCATIONS_PER_OBJECT);
 }
 
 struct ThrowsOnConstruction {
@@ -678,8 +702,8 @@ TEST(PolymorphicTest, ConstructorWithExceptionsTrackingAllocations) {
         xyz::in_place_type_t<ThrowsOnConstruction>{}, "unused");
   };
   EXPECT_THROW(construct(), ThrowsOnConstruction::Exception);
-  EXPECT_EQ(alloc_counter, 1);
-  EXPECT_EQ(dealloc_counter, 1);
+  EXPECT_EQ(alloc_counter, ALLOCATIONS_PER_OBJECT);
+  EXPECT_EQ(dealloc_counter, ALLOCATIONS_PER_OBJECT);
 }
 
 #ifdef XYZ_HAS_STD_OPTIONAL
@@ -870,4 +894,649 @@ TEST(PolymorphicTest, TaggedAllocatorsNotEqualMoveConstructFromValueless) {
       ppp.valueless_after_move());  // NOLINT(clang-analyzer-cplusplus.Move)
 }
 
+#ifdef XYZ_POLYMORPHIC_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
+class LargeDerived : public Base {
+ private:
+  std::array<int, 64> values_;
+
+ public:
+  LargeDerived(int v) { values_.fill(v); }
+
+  int value() const override { return values_[0]; }
+
+  void set_value(int v) override { values_.fill(v); }
+};
+
+TEST(PolymorphicTest, SmallBufferStoresSmallTypesInline) {
+  unsigned alloc_counter = 0;
+  unsigned dealloc_counter = 0;
+  {
+    xyz::polymorphic<Base, xyz::TrackingAllocator<Base>> p(
+        std::allocator_arg,
+        xyz::TrackingAllocator<Base>(&alloc_counter, &dealloc_counter),
+        xyz::in_place_type_t<Derived>{}, 42);
+    auto pp = p;
+    auto ppp = std::move(p);
+    EXPECT_EQ(pp->value(), 42);
+    EXPECT_EQ(ppp->value(), 42);
+  }
+  EXPECT_EQ(alloc_counter, 0);
+  EXPECT_EQ(dealloc_counter, 0);
+}
+
+TEST(PolymorphicTest, SmallBufferAllocatesLargeTypes) {
+  unsigned alloc_counter = 0;
+  unsigned dealloc_counter = 0;
+  {
+    xyz::polymorphic<Base, xyz::TrackingAllocator<Base>> p(
+        std::allocator_arg,
+        xyz::TrackingAllocator<Base>(&alloc_counter, &dealloc_counter),
+        xyz::in_place_type_t<LargeDerived>{}, 42);
+    EXPECT_EQ(alloc_counter, 1);
+    auto pp = p;
+    EXPECT_EQ(alloc_counter, 2);
+    auto ppp = std::move(p);
+    EXPECT_EQ(alloc_counter, 2);
+    EXPECT_EQ(ppp->value(), 42);
+  }
+  EXPECT_EQ(alloc_counter, 2);
+  EXPECT_EQ(dealloc_counter, 2);
+}
+
+TEST(PolymorphicTest, SmallBufferAllocatesTypesWithThrowingMoves) {
+  unsigned alloc_counter = 0;
+  unsigned dealloc_counter = 0;
+  {
+    xyz::polymorphic<ThrowsOnMoveConstruction,
+                     xyz::TrackingAllocator<ThrowsOnMoveConstruction>>
+        p(std::allocator_arg,
+          xyz::TrackingAllocator<ThrowsOnMoveConstruction>(&alloc_counter,
+                                                           &dealloc_counter));
+    auto pp = std::move(p);
+    EXPECT_TRUE(p.valueless_after_move());  // NOLINT
+  }
+  EXPECT_EQ(alloc_counter, 1);
+  EXPECT_EQ(dealloc_counter, 1);
+}
+
+TEST(PolymorphicTest, SmallBufferSwapInlineWithAllocated) {
+  xyz::polymorphic<Base> p(xyz::in_place_type_t<Derived>{}, 42);
+  xyz::polymorphic<Base> pp(xyz::in_place_type_t<LargeDerived>{}, 101);
+  swap(p, pp);
+  EXPECT_EQ(p->value(), 101);
+  EXPECT_EQ(pp->value(), 42);
+  pp.swap(p);
+  EXPECT_EQ(p->value(), 42);
+  EXPECT_EQ(pp->value(), 101);
+}
+
+TEST(PolymorphicTest, SmallBufferCustomCapacity) {
+  using Poly = xyz::polymorphic<Base, xyz::TrackingAllocator<Base>,
+                                sizeof(LargeDerived), alignof(LargeDerived)>;
+  unsigned alloc_counter = 0;
+  unsigned dealloc_counter = 0;
+  {
+    Poly p(std::allocator_arg,
+           xyz::TrackingAllocator<Base>(&alloc_counter, &dealloc_counter),
+           xyz::in_place_type_t<LargeDerived>{}, 42);
+    Poly pp(p);
+    EXPECT_EQ(pp->value(), 42);
+  }
+  EXPECT_EQ(alloc_counter, 0);
+  EXPECT_EQ(dealloc_counter, 0);
+}
+#endif  // XYZ_POLYMORPHIC_USES_EXPERIMENTAL_SMALL_BUFFER_OPTIMIZATION
+
+#ifdef XYZ_POLYMORPHIC_HAS_CLONE_RANGE
+class ThrowsOnNegativeCopy : public Base {
+ private:
+  int value_;
+
+ public:
+  ThrowsOnNegativeCopy(int v) : value_(v) {}
+
+  ThrowsOnNegativeCopy(const ThrowsOnNegativeCopy& other)
+      : value_(other.value_) {
+    if (value_ < 0) throw std::runtime_error("ThrowsOnNegativeCopy");
+  }
+
+  int value() const override { return value_; }
+
+  void set_value(int v) override { value_ = v; }
+};
+
+TEST(PolymorphicTest, CloneRangeCopiesValues) {
+  std::vector<xyz::polymorphic<Base>> v;
+  for (int i = 0; i < 8; ++i) {
+    v.emplace_back(xyz::in_place_type_t<Derived>{}, i);
+  }
+  xyz::polymorphic<Base> moved_from(std::move(v[3]));
+
+  std::vector<xyz::polymorphic<Base>> vv;
+  xyz::clone_range(v.begin(), v.end(), std::back_inserter(vv),
+                   v.front().get_allocator());
+
+  ASSERT_EQ(vv.size(), v.size());
+  for (size_t i = 0; i < v.size(); ++i) {
+    if (i == 3) {
+      EXPECT_TRUE(vv[i].valueless_after_move());
+      continue;
+    }
+    EXPECT_EQ(vv[i]->value(), static_cast<int>(i));
+    EXPECT_NE(&*vv[i], &*v[i]);
+  }
+}
+
+TEST(PolymorphicTest, CloneRangeAllocatesOnce) {
+  unsigned alloc_counter = 0;
+  unsigned dealloc_counter = 0;
+  xyz::TrackingAllocator<Base> alloc(&alloc_counter, &dealloc_counter);
+  using TrackedPolymorphic =
+      xyz::polymorphic<Base, xyz::TrackingAllocator<Base>>;
+  {
+    // Reserve storage as vectors of polymorphic objects with allocators that
+    // do not always compare equal copy their elements when they grow.
+    std::vector<TrackedPolymorphic> v;
+    v.reserve(8);
+    for (int i = 0; i < 8; ++i) {
+      v.emplace_back(std::allocator_arg, alloc, xyz::in_place_type_t<Derived>{},
+                     i);
+    }
+    EXPECT_EQ(alloc_counter, 8);
+
+    std::vector<TrackedPolymorphic> vv;
+    vv.reserve(8);
+    xyz::clone_range(v.begin(), v.end(), std::back_inserter(vv), alloc);
+    EXPECT_EQ(alloc_counter, 9);
+
+    // The shared allocation is released with the last copy.
+    vv.erase(vv.begin(), vv.begin() + 7);
+    EXPECT_EQ(dealloc_counter, 0);
+    auto copy = vv.back();
+    EXPECT_EQ(alloc_counter, 10);
+    vv.clear();
+    EXPECT_EQ(dealloc_counter, 1);
+  }
+  EXPECT_EQ(alloc_counter, 10);
+  EXPECT_EQ(dealloc_counter, 10);
+}
+
+TEST(PolymorphicTest, CloneRangeBoundsTheMemoryACopyRetains) {
+  unsigned alloc_counter = 0;
+  unsigned dealloc_counter = 0;
+  xyz::TrackingAllocator<Base> alloc(&alloc_counter, &dealloc_counter);
+  using TrackedPolymorphic =
+      xyz::polymorphic<Base, xyz::TrackingAllocator<Base>>;
+  constexpr std::size_t n = xyz::clone_range_max_batch_bytes / sizeof(Derived);
+  {
+    std::vector<TrackedPolymorphic> v;
+    v.reserve(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      v.emplace_back(std::allocator_arg, alloc, xyz::in_place_type_t<Derived>{},
+                     static_cast<int>(i));
+    }
+    alloc_counter = 0;
+
+    std::vector<TrackedPolymorphic> vv;
+    vv.reserve(n);
+    xyz::clone_range(v.begin(), v.end(), std::back_inserter(vv), alloc);
+    const unsigned batches = alloc_counter;
+    EXPECT_GT(batches, 1u);
+    EXPECT_LT(batches, n / 100);
+
+    // A surviving copy keeps only its own batch alive.
+    vv.erase(vv.begin(), vv.end() - 1);
+    EXPECT_EQ(dealloc_counter, batches - 1);
+    EXPECT_EQ(vv.back()->value(), static_cast<int>(n - 1));
+  }
+}
+
+TEST(PolymorphicTest, CloneRangeCopiesCanBeModifiedAndMoved) {
+  std::vector<xyz::polymorphic<Base>> v;
+  for (int i = 0; i < 4; ++i) {
+    v.emplace_back(xyz::in_place_type_t<Derived>{}, i);
+  }
+  std::vector<xyz::polymorphic<Base>> vv;
+  xyz::clone_range(v.begin(), v.end(), std::back_inserter(vv),
+                   std::allocator<Base>{});
+  vv[0]->set_value(42);
+  vv[1] = std::move(vv[2]);
+  vv[3] = vv[0];
+  EXPECT_EQ(vv[0]->value(), 42);
+  EXPECT_EQ(vv[1]->value(), 2);
+  EXPECT_EQ(vv[3]->value(), 42);
+  EXPECT_EQ(v[0]->value(), 0);
+}
+
+TEST(PolymorphicTest, CloneRangeWithThrowingCopy) {
+  unsigned alloc_counter = 0;
+  unsigned dealloc_counter = 0;
+  xyz::TrackingAllocator<Base> alloc(&alloc_counter, &dealloc_counter);
+  using TrackedPolymorphic =
+      xyz::polymorphic<Base, xyz::TrackingAllocator<Base>>;
+  {
+    std::vector<TrackedPolymorphic> v;
+    v.reserve(3);
+    v.emplace_back(std::allocator_arg, alloc, xyz::in_place_type_t<Derived>{},
+                   1);
+    v.emplace_back(std::allocator_arg, alloc, xyz::in_place_type_t<Derived>{},
+                   2);
+    v.emplace_back(std::allocator_arg, alloc,
+                   xyz::in_place_type_t<ThrowsOnNegativeCopy>{}, -1);
+
+    std::vector<TrackedPolymorphic> vv;
+    vv.reserve(3);
+    EXPECT_THROW(
+        xyz::clone_range(v.begin(), v.end(), std::back_inserter(vv), alloc),
+        std::runtime_error);
+    ASSERT_EQ(vv.size(), 2);
+    EXPECT_EQ(vv[1]->value(), 2);
+  }
+  EXPECT_EQ(alloc_counter, 4);
+  EXPECT_EQ(dealloc_counter, 4);
+}
+
+// A pointer that raw pointers convert to but that does not convert back.
+template <class T>
+class FancyPointer {
+  T* p_ = nullptr;
+
+  template <class U>
+  friend class FancyPointer;
+
+ public:
+  using element_type = T;
+
+  FancyPointer() = default;
+  FancyPointer(std::nullptr_t) {}
+  FancyPointer(T* p) : p_(p) {}
+
+  template <class U>
+    requires std::convertible_to<U*, T*>
+  FancyPointer(const FancyPointer<U>& other) : p_(other.p_) {}
+
+  template <class U = T>
+  static FancyPointer pointer_to(U& u) {
+    return FancyPointer(std::addressof(u));
+  }
+
+  T* operator->() const { return p_; }
+  T& operator*() const { return *p_; }
+
+  friend bool operator==(const FancyPointer&, const FancyPointer&) = default;
+};
+
+template <class T>
+struct FancyAllocator {
+  using value_type = T;
+  using pointer = FancyPointer<T>;
+
+  FancyAllocator() = default;
+
+  template <class U>
+  FancyAllocator(const FancyAllocator<U>&) {}
+
+  pointer allocate(std::size_t n) { return std::allocator<T>().allocate(n); }
+
+  void deallocate(pointer p, std::size_t n) {
+    std::allocator<T>().deallocate(p.operator->(), n);
+  }
+
+  friend bool operator==(const FancyAllocator&,
+                         const FancyAllocator&) = default;
+};
+
+TEST(PolymorphicTest, CloneRangeWithFancyPointers) {
+  using P = xyz::polymorphic<Base, FancyAllocator<Base>>;
+  std::vector<P> v;
+  for (int i = 0; i < 4; ++i) {
+    v.emplace_back(std::in_place_type<Derived>, i);
+  }
+  std::vector<P> vv;
+  xyz::clone_range(v.begin(), v.end(), std::back_inserter(vv),
+                   FancyAllocator<Base>{});
+  ASSERT_EQ(vv.size(), 4u);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(vv[i]->value(), i);
+  }
+}
+#endif  // XYZ_POLYMORPHIC_HAS_CLONE_RANGE
+
+#ifdef XYZ_POLYMORPHIC_HAS_VISIT
+class OtherDerived : public Base {
+ private:
+  int value_;
+
+ public:
+  OtherDerived(int v) : value_(v) {}
+
+  int value() const override { return value_; }
+
+  void set_value(int v) override { value_ = v; }
+};
+
+// Reports which overload `visit` called.
+struct WhichOverload {
+  int operator()(Derived&) const { return 1; }
+  int operator()(const Derived&) const { return 2; }
+  int operator()(OtherDerived&) const { return 3; }
+  int operator()(Base&) const { return 4; }
+  int operator()(const Base&) const { return 5; }
+};
+
+TEST(PolymorphicTest, VisitCallsOverloadForListedType) {
+  xyz::polymorphic<Base> p(std::in_place_type<Derived>, 42);
+  EXPECT_EQ((xyz::visit<OtherDerived, Derived>(p, WhichOverload{})), 1);
+  EXPECT_EQ((xyz::visit<OtherDerived, Derived>(std::as_const(p),
+                                               WhichOverload{})),
+            2);
+}
+
+TEST(PolymorphicTest, VisitFallsBackToBaseForUnlistedType) {
+  xyz::polymorphic<Base> p(std::in_place_type<OtherDerived>, 42);
+  EXPECT_EQ(xyz::visit<Derived>(p, WhichOverload{}), 4);
+  EXPECT_EQ(xyz::visit<Derived>(std::as_const(p), WhichOverload{}), 5);
+  EXPECT_EQ(xyz::visit(p, WhichOverload{}), 4);
+}
+
+TEST(PolymorphicTest, VisitPassesTheOwnedObject) {
+  xyz::polymorphic<Base> p(std::in_place_type<Derived>, 42);
+  xyz::visit<Derived>(p, [](Base& b) { b.set_value(b.value() + 1); });
+  EXPECT_EQ(p->value(), 43);
+  const Base* seen = nullptr;
+  xyz::visit<Derived>(p, [&](const Base& b) { seen = &b; });
+  EXPECT_EQ(seen, &*p);
+}
+
+TEST(PolymorphicTest, VisitDoesNotMatchBaseOfListedType) {
+  // The exact type is matched, not a type derived from a listed type.
+  class MoreDerived : public Derived {
+   public:
+    using Derived::Derived;
+  };
+  xyz::polymorphic<Base> p(std::in_place_type<MoreDerived>, 42);
+  EXPECT_EQ(xyz::visit<Derived>(p, WhichOverload{}), 4);
+}
+
+#ifdef XYZ_POLYMORPHIC_HAS_CLONE_RANGE
+TEST(PolymorphicTest, VisitMatchesCopiesMadeByCloneRange) {
+  std::vector<xyz::polymorphic<Base>> v;
+  v.emplace_back(std::in_place_type<Derived>, 1);
+  v.emplace_back(std::in_place_type<OtherDerived>, 2);
+  std::vector<xyz::polymorphic<Base>> vv;
+  xyz::clone_range(v.begin(), v.end(), std::back_inserter(vv),
+                   v.front().get_allocator());
+  EXPECT_EQ((xyz::visit<Derived, OtherDerived>(vv[0], WhichOverload{})), 1);
+  EXPECT_EQ((xyz::visit<Derived, OtherDerived>(vv[1], WhichOverload{})), 3);
+}
+#endif  // XYZ_POLYMORPHIC_HAS_CLONE_RANGE
+#endif  // XYZ_POLYMORPHIC_HAS_VISIT
+
+#ifdef XYZ_POLYMORPHIC_HAS_TYPE_ID
+class OtherBase {
+ public:
+  virtual ~OtherBase() = default;
+  int other_ = 0;
+};
+
+// A derived type whose Base subobject is not at offset zero.
+class OffsetDerived : public OtherBase, public Base {
+ private:
+  int value_;
+
+ public:
+  OffsetDerived(int v) : value_(v) {}
+
+  int value() const override { return value_; }
+
+  void set_value(int v) override { value_ = v; }
+};
+
+TEST(PolymorphicTest, HoldsType) {
+  xyz::polymorphic<Base> p(std::in_place_type<Derived>, 42);
+  EXPECT_TRUE(p.holds_type<Derived>());
+  EXPECT_FALSE(p.holds_type<OffsetDerived>());
+  EXPECT_FALSE(p.holds_type<Base>());
+}
+
+TEST(PolymorphicTest, TypeId) {
+  xyz::polymorphic<Base> p(std::in_place_type<Derived>, 42);
+  xyz::polymorphic<Base> pp(std::in_place_type<OffsetDerived>, 42);
+  EXPECT_EQ(p.type_id(), xyz::polymorphic<Base>::type_id_of<Derived>());
+  EXPECT_EQ(pp.type_id(),
+            xyz::polymorphic<Base>::type_id_of<OffsetDerived>());
+  EXPECT_NE(p.type_id(), pp.type_id());
+  auto copy = p;
+  EXPECT_EQ(copy.type_id(), p.type_id());
+  auto moved = std::move(p);
+  EXPECT_EQ(moved.type_id(), copy.type_id());
+  EXPECT_EQ(p.type_id(), nullptr);  // NOLINT(bugprone-use-after-move)
+  EXPECT_FALSE(p.holds_type<Derived>());
+}
+
+// Types whose copies, moves and destructors compile to the same code.
+template <int N>
+class SameLayoutDerived : public Base {
+ private:
+  int value_;
+
+ public:
+  SameLayoutDerived(int v) : value_(v) {}
+
+  int value() const override { return value_; }
+
+  void set_value(int v) override { value_ = v; }
+};
+
+TEST(PolymorphicTest, TypeIdsOfTypesWithTheSameLayoutDiffer) {
+  using A = SameLayoutDerived<0>;
+  using B = SameLayoutDerived<1>;
+  xyz::polymorphic<Base> a(std::in_place_type<A>, 42);
+  xyz::polymorphic<Base> b(std::in_place_type<B>, 42);
+  EXPECT_NE(xyz::polymorphic<Base>::type_id_of<A>(),
+            xyz::polymorphic<Base>::type_id_of<B>());
+  EXPECT_NE(a.type_id(), b.type_id());
+  EXPECT_TRUE(a.holds_type<A>());
+  EXPECT_FALSE(a.holds_type<B>());
+  EXPECT_EQ(b.get_if<A>(), nullptr);
+  EXPECT_NE(b.get_if<B>(), nullptr);
+}
+
+TEST(PolymorphicTest, GetIf) {
+  xyz::polymorphic<Base> p(std::in_place_type<OffsetDerived>, 42);
+  OffsetDerived* d = p.get_if<OffsetDerived>();
+  ASSERT_NE(d, nullptr);
+  EXPECT_EQ(static_cast<Base*>(d), &*p);
+  EXPECT_EQ(d->value(), 42);
+  EXPECT_EQ(p.get_if<Derived>(), nullptr);
+  EXPECT_EQ(std::as_const(p).get_if<OffsetDerived>(), d);
+}
+
+class VirtualBaseDerived : public virtual Base {
+ private:
+  int value_;
+
+ public:
+  VirtualBaseDerived(int v) : value_(v) {}
+
+  int value() const override { return value_; }
+
+  void set_value(int v) override { value_ = v; }
+};
+
+TEST(PolymorphicTest, GetIfWithAVirtualBase) {
+  xyz::polymorphic<Base> p(std::in_place_type<VirtualBaseDerived>, 42);
+  VirtualBaseDerived* d = p.get_if<VirtualBaseDerived>();
+  ASSERT_NE(d, nullptr);
+  EXPECT_EQ(static_cast<Base*>(d), &*p);
+  EXPECT_EQ(d->value(), 42);
+  EXPECT_EQ(std::as_const(p).get_if<VirtualBaseDerived>(), d);
+  EXPECT_EQ(p.get_if<Derived>(), nullptr);
+}
+#endif  // XYZ_POLYMORPHIC_HAS_TYPE_ID
+
+#ifdef XYZ_POLYMORPHIC_HAS_LIFECYCLE_HOOKS
+struct LifecycleRecord {
+  xyz::lifecycle_event event;
+  std::size_t size;
+  bool is_derived;
+};
+
+struct RecordingLifecycleHooks {
+  static std::vector<LifecycleRecord>& records() {
+    static std::vector<LifecycleRecord> r;
+    return r;
+  }
+
+  template <class U, class A>
+  static void on_lifecycle_event(xyz::lifecycle_event event, std::size_t size,
+                                 const A&) noexcept {
+    records().push_back({event, size, std::is_same_v<U, Derived>});
+  }
+};
+
+template <typename T>
+struct HookedAllocator : xyz::TaggedAllocator<T> {
+  using lifecycle_hooks = RecordingLifecycleHooks;
+
+  using xyz::TaggedAllocator<T>::TaggedAllocator;
+
+  template <typename Other>
+  struct rebind {
+    using other = HookedAllocator<Other>;
+  };
+};
+
+TEST(PolymorphicTest, LifecycleHooksSeeDynamicType) {
+  using event = xyz::lifecycle_event;
+  using P = xyz::polymorphic<Base, HookedAllocator<Base>>;
+  auto& records = RecordingLifecycleHooks::records();
+  records.clear();
+  {
+    P a(std::allocator_arg, HookedAllocator<Base>(1),
+        std::in_place_type<Derived>, 42);
+    P b(a);
+    P c(std::allocator_arg, HookedAllocator<Base>(2), std::move(a));
+    EXPECT_EQ(b->value(), 42);
+    EXPECT_EQ(c->value(), 42);
+  }
+  ASSERT_EQ(records.size(), 6u);
+  EXPECT_EQ(records[0].event, event::construct);
+  EXPECT_EQ(records[1].event, event::copy);
+  EXPECT_EQ(records[2].event, event::move);
+  EXPECT_EQ(records[3].event, event::destroy);
+  EXPECT_EQ(records[4].event, event::destroy);
+  EXPECT_EQ(records[5].event, event::destroy);
+  for (const auto& r : records) {
+    EXPECT_TRUE(r.is_derived);
+    EXPECT_GE(r.size, sizeof(Derived));
+  }
+}
+
+#ifdef XYZ_POLYMORPHIC_HAS_CLONE_RANGE
+TEST(PolymorphicTest, LifecycleHooksSeeCloneRange) {
+  using event = xyz::lifecycle_event;
+  using P = xyz::polymorphic<Base, HookedAllocator<Base>>;
+  auto& records = RecordingLifecycleHooks::records();
+  std::vector<P> v;
+  for (int i = 0; i < 4; ++i) {
+    v.emplace_back(std::allocator_arg, HookedAllocator<Base>(1),
+                   std::in_place_type<Derived>, i);
+  }
+  records.clear();
+  {
+    std::vector<P> vv;
+    vv.reserve(v.size());
+    xyz::clone_range(v.begin(), v.end(), std::back_inserter(vv),
+                     HookedAllocator<Base>(1));
+  }
+  ASSERT_EQ(records.size(), 8u);
+  for (std::size_t i = 0; i < 4; ++i) {
+    EXPECT_EQ(records[i].event, event::copy);
+    EXPECT_EQ(records[i + 4].event, event::destroy);
+  }
+}
+#endif  // XYZ_POLYMORPHIC_HAS_CLONE_RANGE
+#endif  // XYZ_POLYMORPHIC_HAS_LIFECYCLE_HOOKS
+
+#ifdef XYZ_POLYMORPHIC_HAS_TRIVIAL_RELOCATION
+static_assert(xyz::is_trivially_relocatable_v<xyz::polymorphic<Base>>);
+#ifdef XYZ_HAS_STD_MEMORY_RESOURCE
+static_assert(xyz::is_trivially_relocatable_v<
+              xyz::polymorphic<Base, std::pmr::polymorphic_allocator<Base>>>);
+#endif  // XYZ_HAS_STD_MEMORY_RESOURCE
+
+TEST(PolymorphicTest, UninitializedRelocateKeepsControlBlocks) {
+  using P = xyz::polymorphic<Base>;
+  std::allocator<P> alloc;
+  constexpr std::size_t n = 4;
+  P* p = alloc.allocate(n);
+  std::vector<const Base*> owned;
+  for (std::size_t i = 0; i < n; ++i) {
+    std::construct_at(p + i, std::in_place_type<Derived>,
+                      static_cast<int>(i));
+    owned.push_back(&*p[i]);
+  }
+
+  P* q = alloc.allocate(n);
+  P* end = xyz::uninitialized_relocate(p, p + n, q);
+  alloc.deallocate(p, n);
+  ASSERT_EQ(end, q + n);
+  for (std::size_t i = 0; i < n; ++i) {
+    EXPECT_EQ(q[i]->value(), static_cast<int>(i));
+    EXPECT_EQ(&*q[i], owned[i]);
+  }
+
+  std::destroy_at(q);
+  P* last = xyz::relocate_at(q + n - 1, q);
+  EXPECT_EQ((*last)->value(), static_cast<int>(n - 1));
+  std::destroy(q, q + n - 1);
+  alloc.deallocate(q, n);
+}
+#endif  // XYZ_POLYMORPHIC_HAS_TRIVIAL_RELOCATION
+
+#if defined(XYZ_POLYMORPHIC_HAS_ASSUMED_EQUAL_ALLOCATORS) && \
+    defined(XYZ_HAS_STD_MEMORY_RESOURCE)
+// A polymorphic allocator for values that all share one memory resource.
+template <typename T>
+struct SharedResourceAllocator : std::pmr::polymorphic_allocator<T> {
+  using is_assumed_equal = std::true_type;
+
+  using std::pmr::polymorphic_allocator<T>::polymorphic_allocator;
+
+  template <typename U>
+  SharedResourceAllocator(const std::pmr::polymorphic_allocator<U>& other)
+      : std::pmr::polymorphic_allocator<T>(other.resource()) {}
+
+  template <typename Other>
+  struct rebind {
+    using other = SharedResourceAllocator<Other>;
+  };
+};
+
+using SharedPolymorphic =
+    xyz::polymorphic<Base, SharedResourceAllocator<Base>>;
+
+static_assert(std::is_nothrow_move_constructible_v<SharedPolymorphic>);
+static_assert(std::is_nothrow_move_assignable_v<SharedPolymorphic>);
+static_assert(std::is_nothrow_swappable_v<SharedPolymorphic>);
+static_assert(!std::is_nothrow_move_constructible_v<
+              xyz::polymorphic<Base, std::pmr::polymorphic_allocator<Base>>>);
+
+TEST(PolymorphicTest, AssumedEqualAllocatorsMoveOnReallocation) {
+  std::pmr::unsynchronized_pool_resource resource;
+  std::pmr::vector<SharedPolymorphic> values{&resource};
+  std::vector<const Base*> owned;
+  for (int i = 0; i < 100; ++i) {
+    values.emplace_back(std::in_place_type<Derived>, i);
+    owned.push_back(&*values.back());
+  }
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(values[i]->value(), i);
+    EXPECT_EQ(&*values[i], owned[i]);
+  }
+}
+#endif  // XYZ_POLYMORPHIC_HAS_ASSUMED_EQUAL_ALLOCATORS &&
+        // XYZ_HAS_STD_MEMORY_RESOURCE
+
 }  // namespace
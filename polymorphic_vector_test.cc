@@ -0,0 +1,342 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+#include "experimental/polymorphic_vector.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "tagged_allocator.h"
+#include "tracking_allocator.h"
+
+namespace {
+
+class Base {
+ public:
+  virtual ~Base() = default;
+  virtual int value() const = 0;
+  virtual void set_value(int) = 0;
+};
+
+class Derived : public Base {
+ private:
+  int value_;
+
+ public:
+  Derived(int v) : value_(v) {}
+
+  int value() const override { return value_; }
+
+  void set_value(int v) override { value_ = v; }
+};
+
+// A larger derived type that owns heap memory.
+class StringDerived : public Base {
+ private:
+  std::string s_;
+
+ public:
+  StringDerived(int v) : s_(100, static_cast<char>('a' + v)) {}
+
+  int value() const override { return s_[0] - 'a'; }
+
+  void set_value(int v) override { s_.assign(100, static_cast<char>('a' + v)); }
+};
+
+// A derived type whose Base subobject is not at offset zero.
+class Padding {
+ public:
+  virtual ~Padding() = default;
+  std::int64_t padding_ = 0;
+};
+
+class OffsetDerived : public Padding, public Base {
+ private:
+  int value_;
+
+ public:
+  OffsetDerived(int v) : value_(v) {}
+
+  int value() const override { return value_; }
+
+  void set_value(int v) override { value_ = v; }
+};
+
+static_assert(std::random_access_iterator<
+              xyz::polymorphic_vector<Base>::iterator>);
+static_assert(std::random_access_iterator<
+              xyz::polymorphic_vector<Base>::const_iterator>);
+
+TEST(PolymorphicVectorTest, DefaultConstructor) {
+  xyz::polymorphic_vector<Base> v;
+  EXPECT_TRUE(v.empty());
+  EXPECT_EQ(v.size(), 0);
+  EXPECT_EQ(v.begin(), v.end());
+}
+
+TEST(PolymorphicVectorTest, EmplaceBack) {
+  xyz::polymorphic_vector<Base> v;
+  Derived& d = v.emplace_back<Derived>(42);
+  EXPECT_EQ(d.value(), 42);
+  EXPECT_EQ(v.size(), 1);
+  EXPECT_EQ(&v[0], &d);
+}
+
+TEST(PolymorphicVectorTest, PushBack) {
+  xyz::polymorphic_vector<Base> v;
+  v.push_back(Derived(1));
+  const Derived d(2);
+  v.push_back(d);
+  ASSERT_EQ(v.size(), 2);
+  EXPECT_EQ(v[0].value(), 1);
+  EXPECT_EQ(v[1].value(), 2);
+}
+
+TEST(PolymorphicVectorTest, ElementsAreContiguous) {
+  xyz::polymorphic_vector<Base> v;
+  v.emplace_back<Derived>(0);
+  v.emplace_back<Derived>(1);
+  auto* first = reinterpret_cast<const std::byte*>(&v[0]);
+  auto* second = reinterpret_cast<const std::byte*>(&v[1]);
+  EXPECT_EQ(second - first, static_cast<std::ptrdiff_t>(sizeof(Derived)));
+  EXPECT_EQ(v.size_in_bytes(), 2 * sizeof(Derived));
+}
+
+TEST(PolymorphicVectorTest, MixedDerivedTypesGrowTheBuffer) {
+  xyz::polymorphic_vector<Base> v;
+  for (int i = 0; i < 100; ++i) {
+    switch (i % 3) {
+      case 0:
+        v.emplace_back<Derived>(i % 26);
+        break;
+      case 1:
+        v.emplace_back<StringDerived>(i % 26);
+        break;
+      default:
+        v.emplace_back<OffsetDerived>(i % 26);
+        break;
+    }
+  }
+  ASSERT_EQ(v.size(), 100);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(v[i].value(), i % 26);
+  }
+  EXPECT_GE(v.capacity_in_bytes(), v.size_in_bytes());
+}
+
+TEST(PolymorphicVectorTest, BaseSubobjectAtNonZeroOffset) {
+  xyz::polymorphic_vector<Base> v;
+  v.emplace_back<Derived>(1);
+  OffsetDerived& d = v.emplace_back<OffsetDerived>(2);
+  EXPECT_EQ(&v[1], static_cast<Base*>(&d));
+  EXPECT_EQ(v[1].value(), 2);
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(&d) % alignof(OffsetDerived), 0);
+}
+
+TEST(PolymorphicVectorTest, EmplaceBackFromOwnElementWhileGrowing) {
+  xyz::polymorphic_vector<Base> v;
+  v.reserve(1, sizeof(StringDerived));
+  StringDerived& s = v.emplace_back<StringDerived>(3);
+  ASSERT_EQ(v.capacity_in_bytes(), v.size_in_bytes());
+  v.push_back(s);
+  ASSERT_EQ(v.size(), 2);
+  EXPECT_EQ(v[0].value(), 3);
+  EXPECT_EQ(v[1].value(), 3);
+}
+
+TEST(PolymorphicVectorTest, Iteration) {
+  xyz::polymorphic_vector<Base> v;
+  for (int i = 0; i < 10; ++i) {
+    v.emplace_back<Derived>(i);
+  }
+  int sum = std::accumulate(
+      v.begin(), v.end(), 0,
+      [](int acc, const Base& b) { return acc + b.value(); });
+  EXPECT_EQ(sum, 45);
+  for (Base& b : v) {
+    b.set_value(1);
+  }
+  const auto& cv = v;
+  EXPECT_EQ(std::accumulate(
+                cv.begin(), cv.end(), 0,
+                [](int acc, const Base& b) { return acc + b.value(); }),
+            10);
+  EXPECT_EQ(cv.end() - cv.begin(), 10);
+  EXPECT_EQ(cv.begin()[3].value(), 1);
+}
+
+TEST(PolymorphicVectorTest, CopiesAreDeep) {
+  xyz::polymorphic_vector<Base> v;
+  v.emplace_back<Derived>(1);
+  v.emplace_back<StringDerived>(2);
+  auto vv = v;
+  ASSERT_EQ(vv.size(), 2);
+  EXPECT_NE(&v[0], &vv[0]);
+  vv[0].set_value(10);
+  vv[1].set_value(20);
+  EXPECT_EQ(v[0].value(), 1);
+  EXPECT_EQ(v[1].value(), 2);
+  EXPECT_EQ(vv[0].value(), 10);
+  EXPECT_EQ(vv[1].value(), 20);
+  EXPECT_NE(dynamic_cast<StringDerived*>(&vv[1]), nullptr);
+}
+
+TEST(PolymorphicVectorTest, CopyAssignment) {
+  xyz::polymorphic_vector<Base> v;
+  v.emplace_back<Derived>(1);
+  xyz::polymorphic_vector<Base> vv;
+  vv.emplace_back<StringDerived>(2);
+  vv.emplace_back<StringDerived>(3);
+  vv = v;
+  ASSERT_EQ(vv.size(), 1);
+  EXPECT_EQ(vv[0].value(), 1);
+}
+
+TEST(PolymorphicVectorTest, MoveConstructor) {
+  xyz::polymorphic_vector<Base> v;
+  const Base& b = v.emplace_back<Derived>(1);
+  auto vv = std::move(v);
+  ASSERT_EQ(vv.size(), 1);
+  EXPECT_EQ(&vv[0], &b);
+  EXPECT_TRUE(v.empty());  // NOLINT(bugprone-use-after-move)
+}
+
+TEST(PolymorphicVectorTest, MoveAssignment) {
+  xyz::polymorphic_vector<Base> v;
+  const Base& b = v.emplace_back<Derived>(1);
+  xyz::polymorphic_vector<Base> vv;
+  vv.emplace_back<StringDerived>(2);
+  vv = std::move(v);
+  ASSERT_EQ(vv.size(), 1);
+  EXPECT_EQ(&vv[0], &b);
+}
+
+TEST(PolymorphicVectorTest, PopBackAndClear) {
+  xyz::polymorphic_vector<Base> v;
+  v.emplace_back<Derived>(1);
+  v.emplace_back<StringDerived>(2);
+  v.pop_back();
+  ASSERT_EQ(v.size(), 1);
+  EXPECT_EQ(v.size_in_bytes(), sizeof(Derived));
+  EXPECT_EQ(v.back().value(), 1);
+  v.clear();
+  EXPECT_TRUE(v.empty());
+  EXPECT_EQ(v.size_in_bytes(), 0);
+}
+
+TEST(PolymorphicVectorTest, At) {
+  xyz::polymorphic_vector<Base> v;
+  v.emplace_back<Derived>(1);
+  EXPECT_EQ(v.at(0).value(), 1);
+  EXPECT_THROW((void)v.at(1), std::out_of_range);
+}
+
+TEST(PolymorphicVectorTest, Swap) {
+  xyz::polymorphic_vector<Base> v;
+  v.emplace_back<Derived>(1);
+  xyz::polymorphic_vector<Base> vv;
+  swap(v, vv);
+  EXPECT_TRUE(v.empty());
+  ASSERT_EQ(vv.size(), 1);
+  EXPECT_EQ(vv[0].value(), 1);
+}
+
+TEST(PolymorphicVectorTest, AllocatorIsUsedForBufferAndOffsetTable) {
+  unsigned alloc_counter = 0;
+  unsigned dealloc_counter = 0;
+  {
+    xyz::polymorphic_vector<Base, xyz::TrackingAllocator<Base>> v(
+        std::allocator_arg,
+        xyz::TrackingAllocator<Base>(&alloc_counter, &dealloc_counter));
+    v.emplace_back<Derived>(1);
+    EXPECT_EQ(alloc_counter, 2);
+    auto vv = v;
+    EXPECT_EQ(alloc_counter, 4);
+  }
+  EXPECT_EQ(alloc_counter, dealloc_counter);
+}
+
+TEST(PolymorphicVectorTest, AllocatorExtendedCopyAndMove) {
+  xyz::polymorphic_vector<Base, xyz::TaggedAllocator<Base>> v(
+      std::allocator_arg, xyz::TaggedAllocator<Base>(1));
+  v.emplace_back<StringDerived>(4);
+  xyz::polymorphic_vector<Base, xyz::TaggedAllocator<Base>> copy(
+      std::allocator_arg, xyz::TaggedAllocator<Base>(2), v);
+  EXPECT_EQ(copy.get_allocator().tag, 2);
+  EXPECT_EQ(copy[0].value(), 4);
+  xyz::polymorphic_vector<Base, xyz::TaggedAllocator<Base>> moved(
+      std::allocator_arg, xyz::TaggedAllocator<Base>(3), std::move(v));
+  EXPECT_EQ(moved.get_allocator().tag, 3);
+  EXPECT_EQ(moved[0].value(), 4);
+}
+
+#ifdef __cpp_exceptions
+class ThrowsOnCopy : public Base {
+ public:
+  static inline int copies_before_throw = 0;
+
+  ThrowsOnCopy() = default;
+
+  ThrowsOnCopy(const ThrowsOnCopy&) {
+    if (copies_before_throw-- == 0) throw std::runtime_error("copy");
+  }
+
+  int value() const override { return -1; }
+
+  void set_value(int) override {}
+};
+
+TEST(PolymorphicVectorTest, CopyThatThrowsLeavesNoElements) {
+  unsigned alloc_counter = 0;
+  unsigned dealloc_counter = 0;
+  {
+    xyz::polymorphic_vector<Base, xyz::TrackingAllocator<Base>> v(
+        std::allocator_arg,
+        xyz::TrackingAllocator<Base>(&alloc_counter, &dealloc_counter));
+    v.emplace_back<StringDerived>(1);
+    v.emplace_back<ThrowsOnCopy>();
+    ThrowsOnCopy::copies_before_throw = 0;
+    EXPECT_THROW(auto vv = v, std::runtime_error);
+  }
+  EXPECT_EQ(alloc_counter, dealloc_counter);
+}
+
+TEST(PolymorphicVectorTest, GrowthThatThrowsLeavesElementsInPlace) {
+  xyz::polymorphic_vector<Base> v;
+  v.reserve(2, 2 * sizeof(ThrowsOnCopy));
+  v.emplace_back<ThrowsOnCopy>();
+  v.emplace_back<ThrowsOnCopy>();
+  const Base* first = &v[0];
+  // ThrowsOnCopy has no move constructor so growth copies the elements.
+  ThrowsOnCopy::copies_before_throw = 1;
+  EXPECT_THROW(v.emplace_back<Derived>(3), std::runtime_error);
+  ASSERT_EQ(v.size(), 2);
+  EXPECT_EQ(&v[0], first);
+}
+#endif  // __cpp_exceptions
+
+}  // namespace
@@ -0,0 +1,242 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+#include "experimental/pool_allocator.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <vector>
+
+#include "indirect.h"
+#include "polymorphic.h"
+
+namespace {
+
+TEST(SizeClassPoolTest, SizeClasses) {
+  using xyz::size_class_pool;
+  EXPECT_EQ(size_class_pool::size_class(1), 0);
+  EXPECT_EQ(size_class_pool::size_class(size_class_pool::granularity), 0);
+  EXPECT_EQ(size_class_pool::size_class(size_class_pool::granularity + 1), 1);
+  EXPECT_EQ(size_class_pool::size_class(size_class_pool::max_block_size),
+            size_class_pool::size_class_count - 1);
+}
+
+TEST(SizeClassPoolTest, ReusesDeallocatedBlocks) {
+  xyz::size_class_pool pool;
+  void* p = pool.allocate(24, alignof(std::max_align_t));
+  pool.deallocate(p, 24, alignof(std::max_align_t));
+  void* pp = pool.allocate(20, alignof(int));
+  EXPECT_EQ(p, pp);
+  pool.deallocate(pp, 20, alignof(int));
+}
+
+TEST(SizeClassPoolTest, SizeClassesDoNotShareBlocks) {
+  xyz::size_class_pool pool;
+  void* p = pool.allocate(8, alignof(int));
+  pool.deallocate(p, 8, alignof(int));
+  void* pp = pool.allocate(100, alignof(int));
+  EXPECT_NE(p, pp);
+  pool.deallocate(pp, 100, alignof(int));
+}
+
+TEST(SizeClassPoolTest, BlocksAreAligned) {
+  xyz::size_class_pool pool;
+  for (size_t bytes = 1; bytes <= xyz::size_class_pool::max_block_size;
+       bytes += 7) {
+    void* p = pool.allocate(bytes, alignof(std::max_align_t));
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(p) %
+                  alignof(std::max_align_t),
+              0);
+    pool.deallocate(p, bytes, alignof(std::max_align_t));
+  }
+}
+
+TEST(SizeClassPoolTest, LargeAllocationsAreNotPooled) {
+  xyz::size_class_pool pool;
+  constexpr size_t bytes = xyz::size_class_pool::max_block_size + 1;
+  void* p = pool.allocate(bytes, alignof(int));
+  EXPECT_EQ(pool.chunk_count(), 0);
+  pool.deallocate(p, bytes, alignof(int));
+}
+
+TEST(SizeClassPoolTest, ChunksHoldManyBlocks) {
+  xyz::size_class_pool pool(16);
+  std::array<void*, 16> blocks;
+  for (auto& p : blocks) p = pool.allocate(32, alignof(int));
+  EXPECT_EQ(pool.chunk_count(), 1);
+  void* p = pool.allocate(32, alignof(int));
+  EXPECT_EQ(pool.chunk_count(), 2);
+  pool.deallocate(p, 32, alignof(int));
+  for (auto& p : blocks) pool.deallocate(p, 32, alignof(int));
+}
+
+TEST(SizeClassPoolTest, ReservePreWarmsPool) {
+  xyz::size_class_pool pool(1);
+  pool.reserve(32, 100);
+  EXPECT_EQ(pool.chunk_count(), 1);
+  std::array<void*, 100> blocks;
+  for (auto& p : blocks) p = pool.allocate(32, alignof(int));
+  EXPECT_EQ(pool.chunk_count(), 1);
+  for (auto& p : blocks) pool.deallocate(p, 32, alignof(int));
+  pool.reserve(32, 50);
+  EXPECT_EQ(pool.chunk_count(), 1);
+}
+
+TEST(PoolAllocatorTest, Equality) {
+  xyz::size_class_pool pool;
+  xyz::size_class_pool other_pool;
+  xyz::pool_allocator<int> a(pool);
+  xyz::pool_allocator<double> b(a);
+  xyz::pool_allocator<int> c(other_pool);
+  EXPECT_EQ(a, b);
+  EXPECT_NE(a, c);
+  EXPECT_EQ(b.pool(), &pool);
+}
+
+TEST(PoolAllocatorTest, AllocatesArrays) {
+  xyz::size_class_pool pool;
+  xyz::pool_allocator<int> a(pool);
+  int* p = a.allocate(10);
+  std::fill(p, p + 10, 42);
+  a.deallocate(p, 10);
+  int* pp = a.allocate(1000);
+  a.deallocate(pp, 1000);
+  EXPECT_EQ(pool.chunk_count(), 1);
+}
+
+TEST(PoolAllocatorTest, AllocationSizeOverflowThrows) {
+  xyz::size_class_pool pool;
+  xyz::pool_allocator<std::array<char, 40>> a(pool);
+  EXPECT_THROW(
+      (void)a.allocate(std::numeric_limits<std::size_t>::max() / 20),
+      std::bad_array_new_length);
+  EXPECT_EQ(pool.chunk_count(), 0);
+}
+
+TEST(PoolAllocatorTest, OverAlignedTypesAreNotPooled) {
+  struct alignas(2 * alignof(std::max_align_t)) OverAligned {
+    char c;
+  };
+  xyz::size_class_pool pool;
+  xyz::pool_allocator<OverAligned> a(pool);
+  OverAligned* p = a.allocate(1);
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(p) % alignof(OverAligned), 0);
+  a.deallocate(p, 1);
+  EXPECT_EQ(pool.chunk_count(), 0);
+}
+
+TEST(PoolAllocatorTest, Reserve) {
+  xyz::size_class_pool pool(1);
+  xyz::pool_allocator<std::array<char, 40>> a(pool);
+  a.reserve(64);
+  EXPECT_EQ(pool.chunk_count(), 1);
+  std::vector<std::array<char, 40>*> objects;
+  for (int i = 0; i < 64; ++i) objects.push_back(a.allocate(1));
+  EXPECT_EQ(pool.chunk_count(), 1);
+  for (auto* p : objects) a.deallocate(p, 1);
+}
+
+TEST(PoolAllocatorTest, Indirect) {
+  xyz::size_class_pool pool;
+  using I = xyz::indirect<int, xyz::pool_allocator<int>>;
+  std::vector<I> v;
+  v.reserve(100);
+  for (int i = 0; i < 100; ++i) {
+    v.emplace_back(std::allocator_arg, xyz::pool_allocator<int>(pool), i);
+  }
+  auto vv = v;
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(*vv[i], i);
+    EXPECT_NE(&*vv[i], &*v[i]);
+  }
+  EXPECT_EQ(vv[0].get_allocator(), v[0].get_allocator());
+  EXPECT_EQ(pool.chunk_count(),
+            200 / xyz::size_class_pool::default_blocks_per_chunk + 1);
+}
+
+class Base {
+ public:
+  virtual ~Base() = default;
+  virtual int value() const = 0;
+};
+
+class Derived : public Base {
+  int value_;
+
+ public:
+  Derived(int v) : value_(v) {}
+  int value() const override { return value_; }
+};
+
+class LargeDerived : public Base {
+  std::array<int, 200> values_;
+
+ public:
+  LargeDerived(int v) { values_.fill(v); }
+  int value() const override { return values_[0]; }
+};
+
+TEST(PoolAllocatorTest, Polymorphic) {
+  xyz::size_class_pool pool;
+  using P = xyz::polymorphic<Base, xyz::pool_allocator<Base>>;
+  std::vector<P> v;
+  v.reserve(100);
+  for (int i = 0; i < 100; ++i) {
+    v.emplace_back(std::allocator_arg, xyz::pool_allocator<Base>(pool),
+                   std::in_place_type<Derived>, i);
+  }
+  auto vv = v;
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(vv[i]->value(), i);
+    EXPECT_NE(&*vv[i], &*v[i]);
+  }
+}
+
+TEST(PoolAllocatorTest, PolymorphicWithLargeDerivedType) {
+  xyz::size_class_pool pool;
+  using P = xyz::polymorphic<Base, xyz::pool_allocator<Base>>;
+  P p(std::allocator_arg, xyz::pool_allocator<Base>(pool),
+      std::in_place_type<LargeDerived>, 42);
+  P pp = p;
+  EXPECT_EQ(pp->value(), 42);
+  EXPECT_EQ(pool.chunk_count(), 0);
+}
+
+TEST(PoolAllocatorTest, PolymorphicReusesControlBlocks) {
+  xyz::size_class_pool pool;
+  using P = xyz::polymorphic<Base, xyz::pool_allocator<Base>>;
+  const Base* address = nullptr;
+  {
+    P p(std::allocator_arg, xyz::pool_allocator<Base>(pool),
+        std::in_place_type<Derived>, 42);
+    address = &*p;
+  }
+  P p(std::allocator_arg, xyz::pool_allocator<Base>(pool),
+      std::in_place_type<Derived>, 101);
+  EXPECT_EQ(&*p, address);
+}
+
+}  // namespace
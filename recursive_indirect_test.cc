@@ -0,0 +1,298 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+#include "experimental/recursive_indirect.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "feature_check.h"
+#include "indirect.h"
+#ifdef XYZ_HAS_STD_MEMORY_RESOURCE
+#include <memory_resource>
+#endif  // XYZ_HAS_STD_MEMORY_RESOURCE
+
+namespace {
+
+// A tree node that counts live instances and can be made to throw on copy.
+struct TreeNode {
+  static inline int instances = 0;
+  static inline int throw_on_copy = -1;
+
+  int value;
+  std::vector<xyz::indirect<TreeNode>> children;
+  // The sum of the values of the children, read from the copies when a node
+  // is copied.
+  int child_sum = 0;
+
+  static constexpr auto indirect_children = &TreeNode::children;
+
+  TreeNode(int v) : value(v) { ++instances; }
+
+  TreeNode(const TreeNode& other) : TreeNode(xyz::without_children, other) {
+    xyz::copy_children(other, *this);
+    for (const auto& child : children) {
+      if (!child.valueless_after_move()) child_sum += child->value;
+    }
+  }
+
+  TreeNode(xyz::without_children_t, const TreeNode& other)
+      : value(other.value) {
+    if (value == throw_on_copy) throw std::runtime_error("copy failed");
+    ++instances;
+  }
+
+  TreeNode(TreeNode&& other) noexcept
+      : value(other.value), children(std::move(other.children)) {
+    ++instances;
+  }
+
+  TreeNode& operator=(const TreeNode& other) {
+    TreeNode copy(other);
+    xyz::destroy_children(*this);
+    value = copy.value;
+    children = std::move(copy.children);
+    child_sum = copy.child_sum;
+    return *this;
+  }
+
+  ~TreeNode() {
+    xyz::destroy_children(*this);
+    --instances;
+  }
+};
+
+static_assert(xyz::recursive_indirect_node<TreeNode>);
+static_assert(!xyz::recursive_indirect_node<int>);
+
+// Builds a chain of `depth` nodes below a root with value `depth`.
+xyz::indirect<TreeNode> MakeChain(int depth) {
+  xyz::indirect<TreeNode> chain(std::in_place, 0);
+  for (int i = 1; i <= depth; ++i) {
+    xyz::indirect<TreeNode> parent(std::in_place, i);
+    parent->children.push_back(std::move(chain));
+    chain = std::move(parent);
+  }
+  return chain;
+}
+
+// Returns the depth of a chain, checking values without recursion.
+int ChainDepth(const xyz::indirect<TreeNode>& chain) {
+  int depth = 0;
+  const TreeNode* n = &*chain;
+  while (!n->children.empty()) {
+    EXPECT_EQ(n->children.size(), 1u);
+    EXPECT_EQ(n->value, n->children[0]->value + 1);
+    n = &*n->children[0];
+    ++depth;
+  }
+  return depth;
+}
+
+// Deep enough to overflow the stack if nodes were copied or destroyed
+// recursively.
+constexpr int deep = 100'000;
+
+TEST(RecursiveIndirectTest, DeepChainDestruction) {
+  {
+    auto chain = MakeChain(deep);
+    EXPECT_EQ(TreeNode::instances, deep + 1);
+  }
+  EXPECT_EQ(TreeNode::instances, 0);
+}
+
+TEST(RecursiveIndirectTest, DeepChainCopy) {
+  {
+    auto chain = MakeChain(deep);
+    auto copy = chain;
+    EXPECT_EQ(TreeNode::instances, 2 * (deep + 1));
+    EXPECT_EQ(ChainDepth(copy), deep);
+    EXPECT_NE(&*copy, &*chain);
+  }
+  EXPECT_EQ(TreeNode::instances, 0);
+}
+
+TEST(RecursiveIndirectTest, DeepChainCopyAssignment) {
+  {
+    auto chain = MakeChain(deep);
+    auto other = MakeChain(10);
+    other = chain;
+    EXPECT_EQ(TreeNode::instances, 2 * (deep + 1));
+    EXPECT_EQ(ChainDepth(other), deep);
+  }
+  EXPECT_EQ(TreeNode::instances, 0);
+}
+
+TEST(RecursiveIndirectTest, WideTreeCopy) {
+  {
+    xyz::indirect<TreeNode> tree(std::in_place, 0);
+    for (int i = 1; i <= 3; ++i) {
+      auto& child = tree->children.emplace_back(std::in_place, i);
+      for (int j = 1; j <= 3; ++j) {
+        child->children.emplace_back(std::in_place, 10 * i + j);
+      }
+    }
+    auto copy = tree;
+    EXPECT_EQ(TreeNode::instances, 2 * 13);
+    ASSERT_EQ(copy->children.size(), 3u);
+    for (int i = 1; i <= 3; ++i) {
+      const auto& child = copy->children[i - 1];
+      EXPECT_EQ(child->value, i);
+      ASSERT_EQ(child->children.size(), 3u);
+      for (int j = 1; j <= 3; ++j) {
+        EXPECT_EQ(child->children[j - 1]->value, 10 * i + j);
+      }
+    }
+  }
+  EXPECT_EQ(TreeNode::instances, 0);
+}
+
+TEST(RecursiveIndirectTest, CopiedChildrenAreCompleteInTheCopyConstructor) {
+  xyz::indirect<TreeNode> tree(std::in_place, 0);
+  for (int i = 1; i <= 4; ++i) {
+    tree->children.emplace_back(std::in_place, i);
+  }
+  auto copy = tree;
+  EXPECT_EQ(copy->child_sum, 1 + 2 + 3 + 4);
+}
+
+TEST(RecursiveIndirectTest, ValuelessChildrenAreCopied) {
+  {
+    xyz::indirect<TreeNode> tree(std::in_place, 0);
+    tree->children.emplace_back(std::in_place, 1);
+    auto moved = std::move(tree->children[0]);
+    auto copy = tree;
+    ASSERT_EQ(copy->children.size(), 1u);
+    EXPECT_TRUE(copy->children[0].valueless_after_move());
+  }
+  EXPECT_EQ(TreeNode::instances, 0);
+}
+
+TEST(RecursiveIndirectTest, CopyThrows) {
+  {
+    auto chain = MakeChain(1000);
+    TreeNode::throw_on_copy = 500;
+    EXPECT_THROW(
+        {
+          auto copy = chain;
+          (void)copy;
+        },
+        std::runtime_error);
+    // Every node that was copied has been destroyed.
+    EXPECT_EQ(TreeNode::instances, 1001);
+    // A copy that throws at the root is unwound as well.
+    TreeNode::throw_on_copy = 1000;
+    EXPECT_THROW(
+        {
+          auto copy = chain;
+          (void)copy;
+        },
+        std::runtime_error);
+    EXPECT_EQ(TreeNode::instances, 1001);
+    TreeNode::throw_on_copy = -1;
+
+    auto copy = chain;
+    EXPECT_EQ(ChainDepth(copy), 1000);
+  }
+  EXPECT_EQ(TreeNode::instances, 0);
+}
+
+TEST(RecursiveIndirectTest, WideTreeCopyThrows) {
+  constexpr int wide = 10'000;
+  {
+    xyz::indirect<TreeNode> tree(std::in_place, wide);
+    for (int i = 0; i < wide; ++i) {
+      tree->children.emplace_back(std::in_place, i);
+    }
+    // A child throws after others have been copied.
+    TreeNode::throw_on_copy = wide / 2;
+    EXPECT_THROW(
+        {
+          auto copy = tree;
+          (void)copy;
+        },
+        std::runtime_error);
+    EXPECT_EQ(TreeNode::instances, wide + 1);
+    TreeNode::throw_on_copy = -1;
+
+    auto copy = tree;
+    ASSERT_EQ(copy->children.size(), static_cast<std::size_t>(wide));
+    EXPECT_EQ(copy->children[wide / 2]->value, wide / 2);
+  }
+  EXPECT_EQ(TreeNode::instances, 0);
+}
+
+#ifdef XYZ_HAS_STD_MEMORY_RESOURCE
+// A node whose children are allocated with the node's memory resource.
+struct PmrNode {
+  using allocator_type = std::pmr::polymorphic_allocator<PmrNode>;
+  using Child = xyz::indirect<PmrNode, allocator_type>;
+
+  int value;
+  std::pmr::vector<Child> children;
+
+  static constexpr auto indirect_children = &PmrNode::children;
+
+  PmrNode(int v, const allocator_type& alloc = {})
+      : value(v), children(alloc) {}
+
+  PmrNode(const PmrNode& other, const allocator_type& alloc = {})
+      : PmrNode(xyz::without_children, other, alloc) {
+    xyz::copy_children(other, *this);
+  }
+
+  PmrNode(xyz::without_children_t, const PmrNode& other,
+          const allocator_type& alloc = {})
+      : value(other.value), children(alloc) {}
+
+  ~PmrNode() { xyz::destroy_children(*this); }
+};
+
+TEST(RecursiveIndirectTest, ChildrenUseTheAllocatorOfTheirContainer) {
+  std::pmr::monotonic_buffer_resource source_resource;
+  std::pmr::monotonic_buffer_resource copy_resource;
+  PmrNode::allocator_type source_alloc(&source_resource);
+  PmrNode::allocator_type copy_alloc(&copy_resource);
+
+  PmrNode::Child tree(std::allocator_arg, source_alloc, std::in_place, 0);
+  for (int i = 1; i <= 3; ++i) {
+    auto& child = tree->children.emplace_back(std::in_place, i);
+    child->children.emplace_back(std::in_place, 10 * i);
+  }
+
+  PmrNode::Child copy(std::allocator_arg, copy_alloc, tree);
+  ASSERT_EQ(copy->children.size(), 3u);
+  for (int i = 1; i <= 3; ++i) {
+    const auto& child = copy->children[i - 1];
+    EXPECT_EQ(child->value, i);
+    EXPECT_EQ(child.get_allocator().resource(), &copy_resource);
+    EXPECT_EQ(child->children.get_allocator().resource(), &copy_resource);
+    ASSERT_EQ(child->children.size(), 1u);
+    EXPECT_EQ(child->children[0]->value, 10 * i);
+    EXPECT_EQ(child->children[0].get_allocator().resource(), &copy_resource);
+  }
+}
+#endif  // XYZ_HAS_STD_MEMORY_RESOURCE
+
+}  // namespace
@@ -0,0 +1,245 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+#include "experimental/thread_caching_allocator.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "indirect.h"
+#include "polymorphic.h"
+
+namespace {
+
+TEST(ThreadCachingAllocatorTest, AllocatorsCompareEqual) {
+  xyz::thread_caching_allocator<int> a;
+  xyz::thread_caching_allocator<double> b;
+  EXPECT_EQ(a, b);
+  EXPECT_TRUE(std::allocator_traits<
+              xyz::thread_caching_allocator<int>>::is_always_equal::value);
+}
+
+TEST(ThreadCachingAllocatorTest, AllocatorsCompareEqualAcrossThreads) {
+  xyz::thread_caching_allocator<int> a;
+  bool equal = false;
+  std::thread t([&] { equal = xyz::thread_caching_allocator<int>() == a; });
+  t.join();
+  EXPECT_TRUE(equal);
+}
+
+TEST(ThreadCachingAllocatorTest, ReusesDeallocatedBlocks) {
+  xyz::thread_caching_allocator<int> a;
+  int* p = a.allocate(1);
+  a.deallocate(p, 1);
+  int* pp = a.allocate(1);
+  EXPECT_EQ(p, pp);
+  a.deallocate(pp, 1);
+}
+
+TEST(ThreadCachingAllocatorTest, BlocksAreAligned) {
+  xyz::thread_caching_allocator<std::max_align_t> a;
+  std::vector<std::max_align_t*> blocks;
+  for (int i = 0; i < 1000; ++i) {
+    blocks.push_back(a.allocate(1));
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(blocks.back()) %
+                  alignof(std::max_align_t),
+              0);
+  }
+  for (auto* p : blocks) a.deallocate(p, 1);
+}
+
+TEST(ThreadCachingAllocatorTest, AllocatesArraysAndLargeObjects) {
+  xyz::thread_caching_allocator<int> a;
+  int* p = a.allocate(1000);
+  a.deallocate(p, 1000);
+  xyz::thread_caching_allocator<std::array<char, 1000>> b;
+  auto* pp = b.allocate(1);
+  b.deallocate(pp, 1);
+}
+
+TEST(ThreadCachingAllocatorTest, AllocatesOverAlignedTypes) {
+  struct alignas(2 * alignof(std::max_align_t)) OverAligned {
+    char c;
+  };
+  xyz::thread_caching_allocator<OverAligned> a;
+  OverAligned* p = a.allocate(1);
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(p) % alignof(OverAligned), 0);
+  a.deallocate(p, 1);
+}
+
+TEST(ThreadCachingAllocatorTest, RemoteFreesReturnToOwningThread) {
+  xyz::thread_caching_allocator<std::array<char, 200>> a;
+  auto* p = a.allocate(1);
+  std::thread t([&] { a.deallocate(p, 1); });
+  t.join();
+  // The local free list is empty so the remote-free list is drained.
+  auto* pp = a.allocate(1);
+  EXPECT_EQ(p, pp);
+  a.deallocate(pp, 1);
+}
+
+TEST(ThreadCachingAllocatorTest, CachesOfExitedThreadsAreReused) {
+  xyz::thread_caching_allocator<std::array<char, 300>> a;
+  std::array<char, 300>* p = nullptr;
+  std::thread t([&] { a.deallocate(a.allocate(1), 1); p = a.allocate(1); });
+  t.join();
+  a.deallocate(p, 1);
+  std::array<char, 300>* pp = nullptr;
+  std::thread tt([&] { pp = a.allocate(1); });
+  tt.join();
+  EXPECT_EQ(p, pp);
+  a.deallocate(pp, 1);
+}
+
+using Block = std::array<char, 400>;
+
+std::atomic<int> exit_stage{0};
+Block* block_allocated_during_exit = nullptr;
+
+void wait_for_exit_stage(int stage) {
+  for (int s = exit_stage.load(); s != stage; s = exit_stage.load()) {
+    exit_stage.wait(s);
+  }
+}
+
+void set_exit_stage(int stage) {
+  exit_stage.store(stage);
+  exit_stage.notify_all();
+}
+
+// Allocates from a thread_local destructor which runs after the thread has
+// handed its cache back, while another thread is using that cache.
+struct AllocatesDuringThreadExit {
+  ~AllocatesDuringThreadExit() {
+    set_exit_stage(1);
+    wait_for_exit_stage(2);
+    xyz::thread_caching_allocator<Block> a;
+    block_allocated_during_exit = a.allocate(1);
+    a.deallocate(a.allocate(1), 1);
+    set_exit_stage(3);
+  }
+};
+
+TEST(ThreadCachingAllocatorTest, ExitingThreadsDoNotUseHandedBackCaches) {
+  xyz::thread_caching_allocator<Block> a;
+  exit_stage = 0;
+  std::thread t([&] {
+    // Constructed before the cache owner so that it is destroyed after it.
+    static thread_local AllocatesDuringThreadExit allocates_during_exit;
+    a.deallocate(a.allocate(1), 1);
+  });
+  Block* p = nullptr;
+  Block* pp = nullptr;
+  std::thread tt([&] {
+    wait_for_exit_stage(1);
+    // Adopts the cache handed back by t and leaves p on its free list.
+    p = a.allocate(1);
+    a.deallocate(p, 1);
+    set_exit_stage(2);
+    wait_for_exit_stage(3);
+    pp = a.allocate(1);
+  });
+  t.join();
+  tt.join();
+  EXPECT_EQ(p, pp);
+  EXPECT_NE(block_allocated_during_exit, p);
+  a.deallocate(pp, 1);
+  a.deallocate(block_allocated_during_exit, 1);
+}
+
+class Base {
+ public:
+  virtual ~Base() = default;
+  virtual int value() const = 0;
+};
+
+class Derived : public Base {
+  int value_;
+
+ public:
+  Derived(int v) : value_(v) {}
+  int value() const override { return value_; }
+};
+
+TEST(ThreadCachingAllocatorTest, Indirect) {
+  using I = xyz::indirect<int, xyz::thread_caching_allocator<int>>;
+  I i(std::in_place, 42);
+  I ii = i;
+  EXPECT_EQ(*ii, 42);
+  I iii(std::in_place, 101);
+  const int* address = &*iii;
+  ii = std::move(iii);
+  EXPECT_EQ(&*ii, address);
+}
+
+TEST(ThreadCachingAllocatorTest, Polymorphic) {
+  using P = xyz::polymorphic<Base, xyz::thread_caching_allocator<Base>>;
+  P p(std::in_place_type<Derived>, 42);
+  P pp = p;
+  EXPECT_EQ(pp->value(), 42);
+  const Base* address = &*pp;
+  P ppp(std::in_place_type<Derived>, 101);
+  swap(pp, ppp);
+  EXPECT_EQ(&*ppp, address);
+}
+
+TEST(ThreadCachingAllocatorTest, ObjectsCreatedAndDestroyedOnManyThreads) {
+  using P = xyz::polymorphic<Base, xyz::thread_caching_allocator<Base>>;
+  constexpr int thread_count = 4;
+  constexpr int object_count = 10000;
+  std::array<std::vector<P>, thread_count> objects;
+  {
+    std::vector<std::thread> producers;
+    for (int t = 0; t < thread_count; ++t) {
+      producers.emplace_back([&objects, t] {
+        for (int i = 0; i < object_count; ++i) {
+          objects[t].emplace_back(std::in_place_type<Derived>, i);
+        }
+      });
+    }
+    for (auto& t : producers) t.join();
+  }
+  {
+    // Each thread destroys objects created by another and creates more.
+    std::vector<std::thread> consumers;
+    for (int t = 0; t < thread_count; ++t) {
+      consumers.emplace_back([&objects, t] {
+        std::vector<P> v = std::move(objects[(t + 1) % thread_count]);
+        int sum = 0;
+        for (const auto& p : v) sum += p->value();
+        EXPECT_EQ(sum, object_count * (object_count - 1) / 2);
+        v.clear();
+        for (int i = 0; i < object_count; ++i) {
+          v.emplace_back(std::in_place_type<Derived>, i);
+        }
+      });
+    }
+    for (auto& t : consumers) t.join();
+  }
+}
+
+}  // namespace
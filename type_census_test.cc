@@ -0,0 +1,193 @@
+/* Copyright (c) 2016 The Value Types Authors. All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+==============================================================================*/
+
+#include "experimental/type_census.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "indirect.h"
+#include "polymorphic.h"
+
+namespace {
+
+class Shape {
+ public:
+  virtual ~Shape() = default;
+  virtual int sides() const = 0;
+};
+
+class Triangle : public Shape {
+ public:
+  int sides() const override { return 3; }
+};
+
+class Square : public Shape {
+  double side_ = 1.0;
+
+ public:
+  int sides() const override { return 4; }
+};
+
+class Hexagon : public Shape {
+ public:
+  int sides() const override { return 6; }
+};
+
+class Octagon : public Shape {
+ public:
+  int sides() const override { return 8; }
+};
+
+using CensusShape = xyz::polymorphic<Shape, xyz::census_allocator<Shape>>;
+
+static_assert(
+    xyz::allocator_has_lifecycle_hooks_v<xyz::census_allocator<Shape>>);
+
+TEST(TypeCensusTest, TypeNames) {
+  EXPECT_EQ(xyz::detail::census_type_name<int>(), "int");
+  std::string_view name = xyz::detail::census_type_name<Square>();
+  EXPECT_NE(name.find("Square"), std::string_view::npos);
+  EXPECT_EQ(name.find("int"), std::string_view::npos);
+}
+
+TEST(TypeCensusTest, CountsLiveObjectsPerType) {
+  auto triangles = xyz::type_census::entry_for<Triangle>();
+  auto squares = xyz::type_census::entry_for<Square>();
+  {
+    CensusShape t(std::in_place_type<Triangle>);
+    CensusShape s(std::in_place_type<Square>);
+    CensusShape ss(s);
+
+    auto t_now = xyz::type_census::entry_for<Triangle>();
+    auto s_now = xyz::type_census::entry_for<Square>();
+    EXPECT_EQ(t_now.live - triangles.live, 1);
+    EXPECT_EQ(s_now.live - squares.live, 2);
+    EXPECT_EQ(s_now.constructed - squares.constructed, 2u);
+    EXPECT_EQ(s_now.size, sizeof(Square));
+    EXPECT_GE(s_now.live_bytes - squares.live_bytes,
+              static_cast<std::int64_t>(2 * sizeof(Square)));
+  }
+  auto t_after = xyz::type_census::entry_for<Triangle>();
+  auto s_after = xyz::type_census::entry_for<Square>();
+  EXPECT_EQ(t_after.live, triangles.live);
+  EXPECT_EQ(s_after.live, squares.live);
+  EXPECT_EQ(s_after.live_bytes, squares.live_bytes);
+}
+
+TEST(TypeCensusTest, MovesThatTransferOwnershipAreNotCounted) {
+  auto before = xyz::type_census::entry_for<Triangle>();
+  std::vector<CensusShape> v;
+  for (int i = 0; i < 100; ++i) {
+    v.emplace_back(std::in_place_type<Triangle>);
+  }
+  auto during = xyz::type_census::entry_for<Triangle>();
+  EXPECT_EQ(during.live - before.live, 100);
+  // Growing the vector moves each polymorphic, but not the object it owns.
+  EXPECT_EQ(during.constructed - before.constructed, 100u);
+  v.clear();
+  EXPECT_EQ(xyz::type_census::entry_for<Triangle>().live, before.live);
+}
+
+TEST(TypeCensusTest, PeakLive) {
+  {
+    std::vector<CensusShape> v;
+    v.reserve(10);
+    for (int i = 0; i < 10; ++i) {
+      v.emplace_back(std::in_place_type<Hexagon>);
+    }
+  }
+  CensusShape h(std::in_place_type<Hexagon>);
+  auto e = xyz::type_census::entry_for<Hexagon>();
+  EXPECT_EQ(e.live, 1);
+  EXPECT_EQ(e.peak_live, 10);
+  EXPECT_EQ(e.constructed, 11u);
+}
+
+TEST(TypeCensusTest, Indirect) {
+  auto before = xyz::type_census::entry_for<std::string>();
+  xyz::indirect<std::string, xyz::census_allocator<std::string>> i(
+      std::in_place, "census");
+  auto ii = i;
+  auto after = xyz::type_census::entry_for<std::string>();
+  EXPECT_EQ(after.live - before.live, 2);
+  EXPECT_EQ(after.live_bytes - before.live_bytes,
+            static_cast<std::int64_t>(2 * sizeof(std::string)));
+}
+
+TEST(TypeCensusTest, SnapshotAndDump) {
+  CensusShape o(std::in_place_type<Octagon>);
+  std::vector<CensusShape> squares;
+  for (int i = 0; i < 1000; ++i) {
+    squares.emplace_back(std::in_place_type<Square>);
+  }
+
+  auto entries = xyz::type_census::snapshot();
+  ASSERT_FALSE(entries.empty());
+  for (std::size_t i = 1; i < entries.size(); ++i) {
+    EXPECT_GE(entries[i - 1].live_bytes, entries[i].live_bytes);
+  }
+  EXPECT_NE(entries.front().name.find("Square"), std::string_view::npos);
+
+  std::ostringstream os;
+  xyz::type_census::dump(os);
+  std::string report = os.str();
+  auto square = report.find("Square");
+  auto octagon = report.find("Octagon");
+  ASSERT_NE(square, std::string::npos);
+  ASSERT_NE(octagon, std::string::npos);
+  EXPECT_LT(square, octagon);
+  EXPECT_NE(report.find("live 1000"), std::string::npos);
+}
+
+TEST(TypeCensusTest, CountsAcrossThreads) {
+  constexpr int threads = 4;
+  constexpr int objects = 1000;
+  auto before = xyz::type_census::entry_for<Triangle>();
+  {
+    std::vector<std::vector<CensusShape>> kept(threads);
+    {
+      std::vector<std::jthread> workers;
+      for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&kept, t] {
+          for (int i = 0; i < objects; ++i) {
+            kept[t].emplace_back(std::in_place_type<Triangle>);
+            CensusShape discarded(std::in_place_type<Triangle>);
+          }
+        });
+      }
+    }
+    auto during = xyz::type_census::entry_for<Triangle>();
+    EXPECT_EQ(during.live - before.live, threads * objects);
+    EXPECT_EQ(during.constructed - before.constructed,
+              2u * threads * objects);
+  }
+  EXPECT_EQ(xyz::type_census::entry_for<Triangle>().live, before.live);
+}
+
+}  // namespace